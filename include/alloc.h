@@ -0,0 +1,291 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "./api.h"
+#include "./env.h"
+#include "./numa.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+/**
+ * @brief Page sizes and placement of a buffer allocated with bench_alloc().
+ *
+ * BENCH_ALLOC_DEFAULT:   Pages chosen by the kernel's THP policy
+ * BENCH_ALLOC_SMALL:     Base pages only, transparent hugepages disabled
+ * BENCH_ALLOC_THP:       Transparent hugepages, aligned to their size
+ * BENCH_ALLOC_HUGE_2M:   Explicit 2 MB pages from hugetlbfs
+ * BENCH_ALLOC_HUGE_1G:   Explicit 1 GB pages from hugetlbfs
+ * BENCH_ALLOC_ON_NODE:   Place the pages on the node of the options
+ *
+ * Explicit huge pages fall back to transparent hugepages if the pool is
+ * empty, see /proc/sys/vm/nr_hugepages.
+ */
+enum {
+  BENCH_ALLOC_DEFAULT = 0,
+  BENCH_ALLOC_SMALL = 1 << 0,
+  BENCH_ALLOC_THP = 1 << 1,
+  BENCH_ALLOC_HUGE_2M = 1 << 2,
+  BENCH_ALLOC_HUGE_1G = 1 << 3,
+  BENCH_ALLOC_ON_NODE = 1 << 4,
+};
+
+/**
+ * @brief Options of bench_alloc_ex().
+ *
+ * flags:               BENCH_ALLOC_* flags
+ * alignment:           Alignment of the buffer, 0 for the page size
+ * offset:              Bytes added to the aligned start, e.g. a multiple of
+ *                      the cache line size to color the buffer
+ * node:                NUMA node of the pages with BENCH_ALLOC_ON_NODE
+ */
+typedef struct {
+  int flags;
+  size_t alignment;
+  size_t offset;
+  int node;
+} bench_alloc_options_t;
+
+/**
+ * @brief Mapping backing one buffer returned by bench_alloc().
+ *
+ * ptr:                 Address returned to the caller
+ * base:                Start of the mapping
+ * length:              Length of the mapping
+ */
+typedef struct {
+  void *ptr;
+  void *base;
+  size_t length;
+} bench_allocation_t;
+
+/**
+ * @brief Buffers allocated with bench_alloc() and not yet freed.
+ *
+ * entries:             Mapping of every buffer
+ * count:               Number of buffers
+ * capacity:            Allocated size of entries
+ */
+typedef struct {
+  bench_allocation_t *entries;
+  size_t count;
+  size_t capacity;
+} bench_allocations_t;
+
+PIBENCH_STATE bench_allocations_t bench_allocations PIBENCH_INIT(PIBENCH_ZERO);
+
+/**
+ * @brief Returns the size of a transparent hugepage.
+ */
+static inline size_t bench_thp_size(void) {
+  char line[32];
+  if (bench_read_line("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size",
+                      line, sizeof(line)))
+    return (size_t)strtoull(line, NULL, 10);
+  return 2 << 20;
+}
+
+/**
+ * @brief Returns the size of the pages backing an address.
+ *
+ * Reads the mapping of the address from /proc/self/smaps, so transparent
+ * hugepages are only reported if the kernel actually used them.
+ *
+ * @param ptr Any address of the process
+ * @return Page size in bytes, the base page size if it cannot be determined
+ */
+static inline size_t bench_page_size(const void *ptr) {
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  FILE *f = fopen("/proc/self/smaps", "r");
+  if (f == NULL)
+    return page_size;
+
+  char line[256];
+  bool found = false;
+  uintptr_t addr = (uintptr_t)ptr;
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long start, end, kb;
+    if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+      if (found)
+        break;
+      found = addr >= start && addr < end;
+    } else if (!found) {
+      continue;
+    } else if (sscanf(line, "KernelPageSize: %lu kB", &kb) == 1) {
+      page_size = (size_t)kb << 10;
+    } else if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 && kb > 0) {
+      page_size = bench_thp_size();
+    }
+  }
+
+  fclose(f);
+  return page_size;
+}
+
+/**
+ * @brief Records a buffer so bench_free() can unmap it.
+ *
+ * @return true on success
+ */
+static inline bool bench_alloc_track(void *ptr, void *base, size_t length) {
+  bench_allocations_t *allocations = &bench_allocations;
+  if (allocations->count == allocations->capacity) {
+    size_t capacity =
+        allocations->capacity == 0 ? 16 : 2 * allocations->capacity;
+    bench_allocation_t *entries = (bench_allocation_t *)realloc(
+        allocations->entries, capacity * sizeof(bench_allocation_t));
+    if (entries == NULL)
+      return false;
+    allocations->entries = entries;
+    allocations->capacity = capacity;
+  }
+  allocations->entries[allocations->count++] =
+      (bench_allocation_t){ptr, base, length};
+  return true;
+}
+
+/**
+ * @brief Maps anonymous memory, with explicit huge pages if requested.
+ *
+ * @param length Length of the mapping, rounded up to the page size
+ * @param huge_page Size of the explicit huge pages, 0 for base pages
+ * @return The mapping, or MAP_FAILED
+ */
+static inline void *bench_alloc_map(size_t *length, size_t huge_page) {
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  size_t page = huge_page > 0 ? huge_page : (size_t)sysconf(_SC_PAGESIZE);
+  if (huge_page > 0)
+    flags |= MAP_HUGETLB | (__builtin_ctzl(huge_page) << MAP_HUGE_SHIFT);
+
+  *length = (*length + page - 1) / page * page;
+  return mmap(NULL, *length, PROT_READ | PROT_WRITE, flags, -1, 0);
+}
+
+/**
+ * @brief Allocates a zeroed, prefaulted buffer for benchmark inputs or
+ * outputs.
+ *
+ * The pages are touched once before the buffer is returned, so no page fault
+ * or zeroing by the kernel lands in a timed iteration. Check the page size the
+ * kernel used with bench_page_size().
+ *
+ *   double *a = bench_alloc_ex(n * sizeof(double),
+ *                              (bench_alloc_options_t){
+ *                                  .flags = BENCH_ALLOC_HUGE_2M,
+ *                                  .offset = 3 * 64,
+ *                              });
+ *
+ * @param size Size of the buffer in bytes
+ * @param options Page size, alignment, offset and NUMA node
+ * @return The buffer, free it with bench_free(), or NULL on error
+ *
+ * @note Explicit huge pages require a reserved pool, see
+ * /sys/kernel/mm/hugepages
+ */
+static inline void *bench_alloc_ex(size_t size,
+                                   bench_alloc_options_t options) {
+  size_t huge_page = 0;
+  if (options.flags & BENCH_ALLOC_HUGE_1G)
+    huge_page = 1UL << 30;
+  else if (options.flags & BENCH_ALLOC_HUGE_2M)
+    huge_page = 2UL << 20;
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t alignment = options.alignment;
+  if (alignment == 0)
+    alignment = huge_page > 0 ? huge_page
+                : (options.flags & BENCH_ALLOC_THP) ? bench_thp_size()
+                                                     : page;
+
+  /* over-allocate to align the start, huge page mappings are aligned */
+  size_t slack = huge_page > 0 && alignment <= huge_page ? 0 : alignment;
+  size_t length = size + options.offset + slack;
+  void *base = bench_alloc_map(&length, huge_page);
+  if (base == MAP_FAILED && huge_page > 0) {
+    printf("\033[33mCould not allocate %zu MB of %zu MB huge pages, using "
+           "transparent hugepages!\033[0m\n",
+           size >> 20, huge_page >> 20);
+    options.flags |= BENCH_ALLOC_THP;
+    huge_page = 0;
+    if (alignment < bench_thp_size())
+      alignment = bench_thp_size();
+    length = size + options.offset + alignment;
+    base = bench_alloc_map(&length, 0);
+  }
+  if (base == MAP_FAILED)
+    return NULL;
+
+  uintptr_t start = ((uintptr_t)base + alignment - 1) / alignment * alignment;
+  uint8_t *ptr = (uint8_t *)start + options.offset;
+
+  bench_nodemask_t node = {{0}};
+  bench_nodemask_set(&node, options.node);
+  if ((options.flags & BENCH_ALLOC_ON_NODE) &&
+      !bench_mbind(base, length, MPOL_BIND, &node))
+    printf("\033[33mCould not place the buffer on node %d!\033[0m\n",
+           options.node);
+  if (huge_page == 0 && (options.flags & BENCH_ALLOC_THP))
+    madvise(base, length, MADV_HUGEPAGE);
+  else if (huge_page == 0 && (options.flags & BENCH_ALLOC_SMALL))
+    madvise(base, length, MADV_NOHUGEPAGE);
+
+  /* prefault */
+  for (size_t i = 0; i < length; i += page)
+    ((volatile uint8_t *)base)[i] = 0;
+
+  if (!bench_alloc_track(ptr, base, length)) {
+    munmap(base, length);
+    return NULL;
+  }
+  return ptr;
+}
+
+/**
+ * @brief Allocates a zeroed, prefaulted buffer with the given BENCH_ALLOC_*
+ * flags.
+ *
+ * @see bench_alloc_ex
+ */
+static inline void *bench_alloc(size_t size, int flags) {
+  bench_alloc_options_t options = PIBENCH_ZERO;
+  options.flags = flags;
+  return bench_alloc_ex(size, options);
+}
+
+/**
+ * @brief Frees a buffer allocated with bench_alloc().
+ *
+ * Buffers that were not allocated with bench_alloc() are passed to free(), so
+ * buffers of either origin can be released the same way.
+ */
+static inline void bench_free(void *ptr) {
+  bench_allocations_t *allocations = &bench_allocations;
+  for (size_t i = 0; i < allocations->count; i++) {
+    bench_allocation_t *entry = &allocations->entries[i];
+    if (entry->ptr != ptr)
+      continue;
+
+    munmap(entry->base, entry->length);
+    *entry = allocations->entries[--allocations->count];
+    if (allocations->count == 0) {
+      free(allocations->entries);
+      memset(allocations, 0, sizeof(*allocations));
+    }
+    return;
+  }
+  free(ptr);
+}
+
+#endif // ALLOC_H
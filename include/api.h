@@ -0,0 +1,58 @@
+#ifndef API_H
+#define API_H
+
+/**
+ * @brief Linkage of the pi-bench engine and global state.
+ *
+ * By default pi-bench is header-only: the engine (statistics, reporting,
+ * export and the NDJSON stream) and the global state (options, registry,
+ * schedule, NUMA sweep, repetitions, families, buffers of bench_alloc(), the
+ * IRQ shield, the energy meter and the run metadata of the exports) are
+ * static to every translation unit including the headers. The timing macros are always expanded inline.
+ *
+ * PIBENCH_LINK:        The engine and the global state are provided by
+ *                      libpibench, the headers only declare them, so several
+ *                      translation units share one registry. Set by
+ *                      `pkg-config --cflags pibench`.
+ * PIBENCH_BUILD:       Set by the translation unit that builds libpibench
+ */
+#if defined(PIBENCH_BUILD)
+#define PIBENCH_ENGINE
+#define PIBENCH_STATE
+#define PIBENCH_DEFINITIONS 1
+#elif defined(PIBENCH_LINK)
+#define PIBENCH_ENGINE extern
+#define PIBENCH_STATE extern
+#define PIBENCH_DEFINITIONS 0
+#else
+#define PIBENCH_ENGINE static inline
+#define PIBENCH_STATE static
+#define PIBENCH_DEFINITIONS 1
+#endif
+
+/**
+ * @brief Initial value of a global, dropped when the global is only declared.
+ *
+ *   PIBENCH_STATE bench_registry_t bench_registry PIBENCH_INIT(PIBENCH_ZERO);
+ */
+#if PIBENCH_DEFINITIONS
+#define PIBENCH_INIT(...) = __VA_ARGS__
+#else
+#define PIBENCH_INIT(...)
+#endif
+
+/**
+ * @brief Zero initializer of a struct.
+ *
+ * `{0}` only initializes the first member explicitly, which C++ warns about
+ * with -Wextra, so C++ uses the empty initializer.
+ *
+ *   bench_validation_t report = PIBENCH_ZERO;
+ */
+#ifdef __cplusplus
+#define PIBENCH_ZERO {}
+#else
+#define PIBENCH_ZERO {0}
+#endif
+
+#endif // API_H
@@ -0,0 +1,140 @@
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Type of a copy of a value: without qualifiers, arrays decayed to
+ * pointers.
+ */
+#ifdef __cplusplus
+#include <type_traits>
+#define BENCH_VALUE_TYPE(value) std::decay_t<decltype(value)>
+#else
+#define BENCH_VALUE_TYPE(value) __typeof__(((void)0, (value)))
+#endif
+
+/**
+ * @brief Register class of floating point and vector values.
+ *
+ * Lets BENCH_DO_NOT_OPTIMIZE keep doubles and SIMD vectors in their register
+ * instead of moving them to a general purpose register or the stack.
+ */
+#if defined(__aarch64__)
+#define BENCH_FP_REGISTER "w"
+#elif defined(__x86_64__) || defined(__i386__)
+#define BENCH_FP_REGISTER "x"
+#else
+#define BENCH_FP_REGISTER ""
+#endif
+
+/**
+ * @brief Forces the compiler to compute a value and to assume it is used.
+ *
+ * The value is copied into a local that an empty asm statement reads and may
+ * modify, so neither the computation of the value nor the benchmark body that
+ * produced it can be removed, hoisted out of the measure loop or merged
+ * across iterations. Scalars, pointers and SIMD vectors stay in a register;
+ * larger values are stored once.
+ *
+ *   BENCH_DO_NOT_OPTIMIZE(checksum(buffer, size));
+ *
+ * Arrays decay to a pointer, use BENCH_CLOBBER_MEMORY() to keep the stores
+ * to a buffer.
+ *
+ * @param value Expression whose result must be computed
+ *
+ * @note GCC picks the cheapest of the register, memory and floating point
+ * register classes. They are given as a single alternative, GCC rejects
+ * separate alternatives ("+r,m") as impossible for constants. Clang always
+ * picks memory for "rm" and rejects values that do not fit a register in "r",
+ * so values of up to 8 bytes are moved to an integer register and larger ones
+ * are kept in memory.
+ */
+#if defined(__clang__)
+#define BENCH_DO_NOT_OPTIMIZE(value)                                           \
+  do {                                                                         \
+    BENCH_VALUE_TYPE(value) _bench_value = (value);                            \
+    if (sizeof(_bench_value) <= sizeof(uint64_t)) {                            \
+      uint64_t _bench_bits = 0;                                                \
+      memcpy(&_bench_bits, &_bench_value, sizeof(_bench_value));               \
+      __asm__ volatile("" : "+r"(_bench_bits) : : "memory");                   \
+    } else {                                                                   \
+      __asm__ volatile("" : "+m"(_bench_value) : : "memory");                  \
+    }                                                                          \
+  } while (0)
+#else
+#define BENCH_DO_NOT_OPTIMIZE(value)                                           \
+  do {                                                                         \
+    BENCH_VALUE_TYPE(value) _bench_value = (value);                            \
+    __asm__ volatile(""                                                        \
+                     : "+rm" BENCH_FP_REGISTER(_bench_value)                   \
+                     :                                                         \
+                     : "memory");                                              \
+  } while (0)
+#endif
+
+/**
+ * @brief Forces the compiler to perform all pending stores to memory.
+ *
+ * Acts as a read and write of all memory: stores before it cannot be removed
+ * as dead, and loads after it cannot reuse values loaded before it. Does not
+ * emit any instruction, the CPU may still reorder memory accesses.
+ */
+#define BENCH_CLOBBER_MEMORY() __asm__ volatile("" : : : "memory")
+
+/**
+ * @brief Marks the memory a pointer points to as read by unknown code.
+ *
+ * Weaker than BENCH_CLOBBER_MEMORY(): only stores reachable through the
+ * pointer are kept.
+ *
+ * @param pointer Pointer to the memory to keep
+ */
+#define BENCH_ESCAPE(pointer)                                                  \
+  __asm__ volatile("" : : "r"((const void *)(pointer)) : "memory")
+
+/**
+ * @brief Number of timer ticks at or below which a sample counts as empty.
+ *
+ * Samples of a body that was optimized away only contain the noise of the
+ * timer itself.
+ */
+#define BENCH_ELIDED_TICKS 0
+
+/**
+ * @brief Share of empty samples, in percent, from which a benchmark is
+ * reported as possibly optimized away.
+ */
+#define BENCH_ELIDED_PERCENT 90
+
+/**
+ * @brief Checks if the samples of a benchmark look like an empty body.
+ *
+ * Samples at or below BENCH_ELIDED_TICKS, and samples that wrapped around
+ * because the cycle counter overhead compensation exceeded the measured time,
+ * count as empty.
+ *
+ * @param samples Samples of the benchmark
+ * @param count Number of samples
+ * @return true if at least BENCH_ELIDED_PERCENT percent of the samples are
+ * empty
+ */
+static inline bool bench_samples_elided(const uint64_t *samples,
+                                        size_t count) {
+  if (samples == NULL || count == 0)
+    return false;
+
+  size_t empty = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (samples[i] <= BENCH_ELIDED_TICKS || samples[i] > UINT64_MAX / 2)
+      empty++;
+  }
+
+  return empty * 100 >= count * BENCH_ELIDED_PERCENT;
+}
+
+#endif // BARRIER_H
@@ -1,8 +1,17 @@
 #ifndef BENCH_H
 #define BENCH_H
 
+#ifndef _GNU_SOURCE
 #define _GNU_SOURCE
+#endif
+#include "./barrier.h"
+#include "./cli.h"
+#include "./cores.h"
+#include "./energy.h"
+#include "./hash.h"
+#include "./irq.h"
 #include "./system.h"
+#include "./validate.h"
 #include <assert.h>
 #include <fcntl.h>
 #include <linux/perf_event.h>
@@ -27,6 +36,32 @@ typedef struct {
   int miss_fd;
 } cache_counter_t;
 
+/**
+ * @brief Hook run outside of the timed region of a benchmark.
+ *
+ * @param ctx User context of the fixture
+ */
+typedef void (*bench_hook_fn)(void *ctx);
+
+/**
+ * @brief Structure holding the setup and teardown hooks of a benchmark.
+ *
+ * All hooks are optional and run outside of the timed region.
+ *
+ * setup:               Runs once before the first call of the benchmark
+ * teardown:            Runs once after the last timed iteration
+ * iteration_setup:     Runs before every call, e.g. to reset the input
+ * iteration_teardown:  Runs after every call
+ * ctx:                 User context passed to every hook
+ */
+typedef struct {
+  bench_hook_fn setup;
+  bench_hook_fn teardown;
+  bench_hook_fn iteration_setup;
+  bench_hook_fn iteration_teardown;
+  void *ctx;
+} bench_fixture_t;
+
 /**
  * @brief Structure containing benchmark measurement results and statistics.
  *
@@ -41,6 +76,29 @@ typedef struct {
  * stddev:              Standard deviation of timing values
  * min:                 Minimum timing value in CPU cycles
  * max:                 Maximum timing value in CPU cycles
+ * p90/p99/p999:        90th, 99th and 99.9th percentile of the timing values
+ * fixture_setup_ns:    Duration of the fixture setup in nanoseconds
+ * fixture_teardown_ns: Duration of the fixture teardown in nanoseconds
+ * hook_total_ns:       Total duration of all per-iteration hooks
+ * hook_max_ns:         Longest setup + teardown of a single iteration
+ * hook_pending_ns:     Setup cost of the iteration that is running
+ * hook_calls:          Number of iterations the hooks ran for
+ * sample_hook_ns:      Time the timed iterations spent in bench_sample_begin()
+ *                      and bench_sample_end(), excluded from the energy
+ * irq_counts:          Interrupts on the benchmark core during every timed
+ *                      iteration, NULL unless --irq-shield was given
+ * irq_total:           Interrupts during all timed iterations
+ * irq_max:             Most interrupts during a single iteration
+ * irq_samples:         Number of iterations hit by at least one interrupt
+ * irq_counter:         Counter of the interrupts, open while pinned
+ * page_size:           Size of the pages backing the output buffer, 0 without
+ *                      output buffer
+ * energy_j:            Energy used during the timed iterations in joules
+ * energy_ns:           Duration the energy was measured over
+ * energy_calls:        Calls of the benchmark the energy was measured over, 0
+ *                      unless --energy was given
+ * owns_output_buffer:  Flag indicating if setup_benchmark() allocated the
+ *                      output buffer, cleanup_benchmark() frees it then
  */
 typedef struct {
   void *output_buffer;
@@ -51,11 +109,65 @@ typedef struct {
   uint64_t min_time, max_time;
   double *cache_miss_rates;
   double mean_time, stddev_time;
+  double p90_time, p99_time, p999_time;
   double median_cmr, min_cmr, max_cmr;
   double mean_cmr, stddev_cmr;
   bool is_cycles;
+  uint64_t fixture_setup_ns, fixture_teardown_ns;
+  uint64_t hook_total_ns, hook_max_ns;
+  uint64_t hook_pending_ns;
+  size_t hook_calls;
+  uint64_t sample_hook_ns;
+  uint64_t *irq_counts;
+  uint64_t irq_total, irq_max;
+  size_t irq_samples;
+  bench_irq_counter_t irq_counter;
+  size_t page_size;
+  double energy_j;
+  uint64_t energy_ns;
+  uint64_t energy_calls;
+  bool owns_output_buffer;
 } benchmark_result_t;
 
+/**
+ * @brief Maximum number of parameters of a parameterized benchmark.
+ */
+#define BENCH_MAX_PARAMS 4
+
+/**
+ * @brief Structure holding the parameters of one parameterized benchmark
+ * instance.
+ *
+ * values:              Value of every parameter
+ * names:               Name of every parameter
+ * count:               Number of parameters
+ */
+typedef struct {
+  int64_t values[BENCH_MAX_PARAMS];
+  const char *names[BENCH_MAX_PARAMS];
+  size_t count;
+} bench_args_t;
+
+/**
+ * @brief Work done by one call of a benchmark, used to place it on a
+ * roofline.
+ *
+ * The per_arg terms scale with the first parameter of a benchmark family
+ * instance, e.g. 2 flops and 24 bytes per element of a daxpy over n elements.
+ *
+ * flops:               Floating point operations per call
+ * bytes:               Bytes moved between the core and memory per call
+ * flops_per_arg:       Floating point operations per unit of the first
+ *                      parameter
+ * bytes_per_arg:       Bytes moved per unit of the first parameter
+ */
+typedef struct {
+  double flops;
+  double bytes;
+  double flops_per_arg;
+  double bytes_per_arg;
+} bench_work_t;
+
 /**
  * @brief Structure defining a benchmark configuration and its results.
  *
@@ -69,6 +181,22 @@ typedef struct {
  * is_baseline:         Flag indicating if this is a baseline benchmark
  * validate:            Flag indicating if the result should be validated
  * is_validate:         Flag indicating if the benchmark result is valid
+ * family:              Name of the benchmark family, NULL if not parameterized
+ * group:               Name of the comparison group, NULL for the default group
+ * args:                Parameters of this instance of the benchmark family
+ * fixture:             Hooks run outside of the timed region
+ * validator:           Describes how the output is compared to the ground truth
+ * validation:          Outcome of the last validation
+ * block_size:          Number of samples measured per run when interleaved,
+ *                      0 to measure all samples in one run
+ * sample_count:        Number of samples measured so far
+ * numa:                Placement of the buffers relative to the benchmark core
+ * numa_base:           Name without the placement suffix of a --numa=sweep
+ *                      run and the repetition suffix
+ * repetition:          Index of the run of a --repetitions run, from 0
+ * repetition_base:     Name without the repetition suffix, equal to name
+ *                      unless --repetitions is above 1
+ * work:                Work done by one call, all zero if not declared
  */
 typedef struct {
   const char *name;
@@ -78,8 +206,38 @@ typedef struct {
   bool is_baseline;
   bool validate;
   bool is_valid;
+  const char *family;
+  const char *group;
+  bench_args_t args;
+  bench_fixture_t fixture;
+  bench_validator_t validator;
+  bench_validation_t validation;
+  size_t block_size;
+  size_t sample_count;
+  bench_numa_mode_t numa;
+  const char *numa_base;
+  size_t repetition;
+  const char *repetition_base;
+  bench_work_t work;
 } benchmark_t;
 
+/**
+ * @brief Scheduling state of the process saved while a benchmark is pinned.
+ *
+ * core:                Core the benchmark is pinned to
+ * old_set:             CPU affinity before pinning
+ * old_policy:          Scheduling policy before pinning
+ * old_sp:              Scheduling parameters before pinning
+ * parked:              SMT siblings taken offline for the run
+ */
+typedef struct {
+  int core;
+  cpu_set_t old_set;
+  int old_policy;
+  struct sched_param old_sp;
+  cpu_set_t parked;
+} bench_pinning_t;
+
 /**
  * @brief Macro for running a benchmark with CPU core pinning and real-time
  * scheduling.
@@ -104,142 +262,7 @@ typedef struct {
  * @note Includes thermal monitoring and system status reporting
  */
 #define BENCHMARK_FUNC_PINNED(func_call, benchmark, core)                      \
-  do {                                                                         \
-                                                                               \
-    size_t warmup_iterations = benchmark->warmup_iterations;                   \
-    size_t timed_iterations = benchmark->timed_iterations;                     \
-                                                                               \
-    uint64_t *samples = malloc((timed_iterations) * sizeof(uint64_t));         \
-    double *cache_miss_rates = malloc((timed_iterations) * sizeof(double));    \
-                                                                               \
-    printf("\033[34mRunning benchmark: %s\033[0m\n", benchmark->name);         \
-                                                                               \
-    if (benchmark->is_baseline) {                                              \
-      printf("\033[32mThis is a baseline run!\033[0m\n");                      \
-    }                                                                          \
-                                                                               \
-    printf("\033[34mRunning %lu warmup iterations, followed by %lu timed "     \
-           "iterations...\033[0m\n",                                           \
-           warmup_iterations, timed_iterations);                               \
-                                                                               \
-    disable_cpu_scaling(core);                                                 \
-    printf("\033[33mDisabled CPU scaling for core %d!\033[0m\n", core);        \
-                                                                               \
-    system_wait();                                                             \
-                                                                               \
-    /* save old cpu set */                                                     \
-    cpu_set_t old_set;                                                         \
-    CPU_ZERO(&old_set);                                                        \
-    sched_getaffinity(0, sizeof(cpu_set_t), &old_set);                         \
-                                                                               \
-    /* pin process to a core */                                                \
-    cpu_set_t cpuset;                                                          \
-    CPU_ZERO(&cpuset);                                                         \
-    CPU_SET(core, &cpuset);                                                    \
-    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0) {               \
-      perror("Failed to set affinity!");                                       \
-    }                                                                          \
-                                                                               \
-    printf("\033[33mPinned process to core %d!\033[0m\n", core);               \
-                                                                               \
-    /* save old schduling policy */                                            \
-    int old_policy = sched_getscheduler(0);                                    \
-    struct sched_param old_sp;                                                 \
-    sched_getparam(0, &old_sp);                                                \
-                                                                               \
-    /* set priority to highest */                                              \
-    struct sched_param sp = {.sched_priority = 99};                            \
-    sched_setscheduler(0, SCHED_FIFO, &sp);                                    \
-                                                                               \
-    printf("\033[33mSet scheduling settings!\033[0m\n");                       \
-                                                                               \
-    if (benchmark->is_baseline) {                                              \
-      if (benchmark->results->output_buffer != NULL) {                         \
-        func_call;                                                             \
-                                                                               \
-        memcpy(benchmark->results->gt, benchmark->results->output_buffer,      \
-               benchmark->results->size);                                      \
-        printf("\033[32mSucessfully set ground truth!\033[0m\n");              \
-      } else {                                                                 \
-        printf("\033[33mCould not set ground truth!\033[0m\n");                \
-      }                                                                        \
-    } else {                                                                   \
-      if (benchmark->validate) {                                               \
-        if (benchmark->results->output_buffer != NULL &&                       \
-            benchmark->results->gt != NULL) {                                  \
-          func_call;                                                           \
-                                                                               \
-          if (memcmp(benchmark->results->gt,                                   \
-                     benchmark->results->output_buffer,                        \
-                     benchmark->results->size) == 0) {                         \
-            benchmark->is_valid = true;                                        \
-                                                                               \
-            printf("\033[32mResult of '%s' is valid!\033[0m\n",                \
-                   benchmark->name);                                           \
-          } else {                                                             \
-            benchmark->is_valid = false;                                       \
-                                                                               \
-            printf("\033[33mResult of '%s' is not valid!\033[0m\n",            \
-                   benchmark->name);                                           \
-          }                                                                    \
-        } else {                                                               \
-          printf("\033[33mCannot validate benchmark %s! Result or output "     \
-                 "buffer is missing\033[0m\n",                                 \
-                 benchmark->name);                                             \
-        }                                                                      \
-      }                                                                        \
-    }                                                                          \
-                                                                               \
-    block_all_signals_in_this_thread();                                        \
-    printf("\033[33mBlocking signals in current thread!\033[0m\n");            \
-                                                                               \
-    struct timespec start, end;                                                \
-                                                                               \
-    throttle_warning(MAX_TEMP);                                                \
-    get_system_status();                                                       \
-                                                                               \
-    /* Warmup */                                                               \
-    for (size_t i = 0; i < warmup_iterations; i++) {                           \
-      func_call;                                                               \
-    }                                                                          \
-                                                                               \
-    /* Measure */                                                              \
-    for (size_t i = 0; i < (timed_iterations); i++) {                          \
-      COMPILER_BARRIER();                                                      \
-      cache_counter_t counter = start_l1_cache_miss_counter();                 \
-      clock_gettime(CLOCK_MONOTONIC, &start);                                  \
-      func_call;                                                               \
-      clock_gettime(CLOCK_MONOTONIC, &end);                                    \
-      double miss_rate = stop_l1_cache_miss_counter(&counter);                 \
-      COMPILER_BARRIER();                                                      \
-      samples[i] = (end.tv_sec - start.tv_sec) * 1000000 +                     \
-                   (end.tv_nsec - start.tv_nsec) / 1000;                       \
-      cache_miss_rates[i] = miss_rate;                                         \
-    }                                                                          \
-                                                                               \
-    printf("\033[32mCollected %lu samples!\033[0m\n", timed_iterations);       \
-                                                                               \
-    get_system_status();                                                       \
-                                                                               \
-    throttle_warning(MAX_TEMP);                                                \
-                                                                               \
-    benchmark->results->samples = samples;                                     \
-    benchmark->results->cache_miss_rates = cache_miss_rates;                   \
-    benchmark->results->is_cycles = false;                                     \
-                                                                               \
-    enable_cpu_scaling(core);                                                  \
-    printf("\033[33mRe-enabled CPU scaling for core %d!\033[0m\n", core);      \
-                                                                               \
-    sched_setaffinity(0, sizeof(cpu_set_t), &old_set);                         \
-    printf("\033[33mRestored CPU affinity!\033[0m\n");                         \
-                                                                               \
-    sched_setscheduler(0, old_policy, &old_sp);                                \
-                                                                               \
-    printf("\033[33mRestored scheduling settings!\033[0m\n");                  \
-                                                                               \
-    unblock_all_signals_in_this_thread();                                      \
-    printf("\033[33mUnblocking signals in current thread!\033[0m\n");          \
-  } while (0)
+  BENCH_MEASURE(func_call, benchmark, TIME, L1_CACHE, PINNED, core, 1)
 
 /**
  * @brief Macro for running a benchmark without CPU core pinning.
@@ -259,118 +282,7 @@ typedef struct {
  * @note Includes thermal monitoring and system status reporting
  */
 #define BENCHMARK_FUNC(func_call, benchmark)                                   \
-  do {                                                                         \
-                                                                               \
-    size_t warmup_iterations = benchmark->warmup_iterations;                   \
-    size_t timed_iterations = benchmark->timed_iterations;                     \
-                                                                               \
-    uint64_t *samples = malloc((timed_iterations) * sizeof(uint64_t));         \
-    double *cache_miss_rates = malloc((timed_iterations) * sizeof(double));    \
-                                                                               \
-    printf("\033[34mRunning benchmark: %s\033[0m\n", benchmark->name);         \
-                                                                               \
-    if (benchmark->is_baseline) {                                              \
-      printf("\033[32mThis is a baseline run!\033[0m\n");                      \
-    }                                                                          \
-                                                                               \
-    printf("\033[34mRunning %lu warmup iterations, followed by %lu timed "     \
-           "iterations...\033[0m\n",                                           \
-           warmup_iterations, timed_iterations);                               \
-                                                                               \
-    if (benchmark->is_baseline) {                                              \
-      if (benchmark->results->output_buffer != NULL) {                         \
-        func_call;                                                             \
-                                                                               \
-        memcpy(benchmark->results->gt, benchmark->results->output_buffer,      \
-               benchmark->results->size);                                      \
-        printf("\033[32mSucessfully set ground truth!\033[0m\n");              \
-      } else {                                                                 \
-        printf("\033[33mCould not set ground truth!\033[0m\n");                \
-      }                                                                        \
-    } else {                                                                   \
-      if (benchmark->validate) {                                               \
-        if (benchmark->results->output_buffer != NULL &&                       \
-            benchmark->results->gt != NULL) {                                  \
-          func_call;                                                           \
-                                                                               \
-          if (memcmp(benchmark->results->gt,                                   \
-                     benchmark->results->output_buffer,                        \
-                     benchmark->results->size) == 0) {                         \
-            benchmark->is_valid = true;                                        \
-                                                                               \
-            printf("\033[32mResult of '%s' is valid!\033[0m\n",                \
-                   benchmark->name);                                           \
-          } else {                                                             \
-            benchmark->is_valid = false;                                       \
-                                                                               \
-            printf("\033[33mResult of '%s' is not valid!\033[0m\n",            \
-                   benchmark->name);                                           \
-          }                                                                    \
-        } else {                                                               \
-          printf("\033[33mCannot validate benchmark %s! Result or output "     \
-                 "buffer is missing\033[0m\n",                                 \
-                 benchmark->name);                                             \
-        }                                                                      \
-      }                                                                        \
-    }                                                                          \
-                                                                               \
-    block_all_signals_in_this_thread();                                        \
-    printf("\033[33mBlocking signals in current thread!\033[0m\n");            \
-                                                                               \
-    struct timespec start, end;                                                \
-                                                                               \
-    throttle_warning(MAX_TEMP);                                                \
-    get_system_status();                                                       \
-                                                                               \
-    /* Warmup */                                                               \
-    for (size_t i = 0; i < warmup_iterations; i++) {                           \
-      func_call;                                                               \
-    }                                                                          \
-                                                                               \
-    /* Measure */                                                              \
-    for (size_t i = 0; i < (timed_iterations); i++) {                          \
-      COMPILER_BARRIER();                                                      \
-      cache_counter_t counter = start_l1_cache_miss_counter();                 \
-      clock_gettime(CLOCK_MONOTONIC, &start);                                  \
-      func_call;                                                               \
-      clock_gettime(CLOCK_MONOTONIC, &end);                                    \
-      double miss_rate = stop_l1_cache_miss_counter(&counter);                 \
-      COMPILER_BARRIER();                                                      \
-      samples[i] = (end.tv_sec - start.tv_sec) * 1000000 +                     \
-                   (end.tv_nsec - start.tv_nsec) / 1000;                       \
-      cache_miss_rates[i] = miss_rate;                                         \
-    }                                                                          \
-                                                                               \
-    printf("\033[32mCollected %lu samples!\033[0m\n", timed_iterations);       \
-                                                                               \
-    get_system_status();                                                       \
-                                                                               \
-    throttle_warning(MAX_TEMP);                                                \
-                                                                               \
-    benchmark->results->samples = samples;                                     \
-    benchmark->results->cache_miss_rates = cache_miss_rates;                   \
-    benchmark->results->is_cycles = false;                                     \
-                                                                               \
-    unblock_all_signals_in_this_thread();                                      \
-    printf("\033[33mUnblocking signals in current thread!\033[0m\n");          \
-                                                                               \
-  } while (0)
-
-/**
- * @brief Compiler memory barrier.
- *
- * Prevents the compiler from reordering memory operations across this point,
- * ensuring accurate timing measurements by preventing optimization artifacts.
- */
-#define COMPILER_BARRIER() __asm__("" ::: "memory")
-
-/**
- * @brief Temperature limit at which thermal throttling starts
- *
- * Used for thermal throttling warnings during benchmark execution.
- * Benchmarks results may be skewed if temperature exceeds this threshold.
- */
-#define MAX_TEMP 70
+  BENCH_MEASURE(func_call, benchmark, TIME, L1_CACHE, UNPINNED, 0, 1)
 
 /**
  * @brief Macro for running a benchmark with CPU core pinning and real-time
@@ -396,141 +308,7 @@ typedef struct {
  * @note Includes thermal monitoring and system status reporting
  */
 #define BENCHMARK_FUNC_CYCLES_PINNED(func_call, benchmark, core)               \
-  do {                                                                         \
-                                                                               \
-    size_t warmup_iterations = benchmark->warmup_iterations;                   \
-    size_t timed_iterations = benchmark->timed_iterations;                     \
-                                                                               \
-    uint64_t *samples = malloc((timed_iterations) * sizeof(uint64_t));         \
-    double *cache_miss_rates = malloc((timed_iterations) * sizeof(double));    \
-                                                                               \
-    printf("\033[34mRunning benchmark: %s\033[0m\n", benchmark->name);         \
-                                                                               \
-    if (benchmark->is_baseline) {                                              \
-      printf("\033[32mThis is a baseline run!\033[0m\n");                      \
-    }                                                                          \
-                                                                               \
-    printf("\033[34mRunning %lu warmup iterations, followed by %lu timed "     \
-           "iterations...\033[0m\n",                                           \
-           warmup_iterations, timed_iterations);                               \
-                                                                               \
-    disable_cpu_scaling(core);                                                 \
-    printf("\033[33mDisabled CPU scaling for core %d!\033[0m\n", core);        \
-                                                                               \
-    system_wait();                                                             \
-                                                                               \
-    /* save old cpu set */                                                     \
-    cpu_set_t old_set;                                                         \
-    CPU_ZERO(&old_set);                                                        \
-    sched_getaffinity(0, sizeof(cpu_set_t), &old_set);                         \
-                                                                               \
-    /* pin process to a core */                                                \
-    cpu_set_t cpuset;                                                          \
-    CPU_ZERO(&cpuset);                                                         \
-    CPU_SET(core, &cpuset);                                                    \
-    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0) {               \
-      perror("Failed to set affinity!");                                       \
-    }                                                                          \
-                                                                               \
-    printf("\033[33mPinned process to core %d!\033[0m\n", core);               \
-                                                                               \
-    /* save old schduling policy */                                            \
-    int old_policy = sched_getscheduler(0);                                    \
-    struct sched_param old_sp;                                                 \
-    sched_getparam(0, &old_sp);                                                \
-                                                                               \
-    /* set priority to highest */                                              \
-    struct sched_param sp = {.sched_priority = 99};                            \
-    sched_setscheduler(0, SCHED_FIFO, &sp);                                    \
-                                                                               \
-    printf("\033[33mSet scheduling settings!\033[0m\n");                       \
-                                                                               \
-    if (benchmark->is_baseline) {                                              \
-      if (benchmark->results->output_buffer != NULL) {                         \
-        func_call;                                                             \
-                                                                               \
-        memcpy(benchmark->results->gt, benchmark->results->output_buffer,      \
-               benchmark->results->size);                                      \
-        printf("\033[32mSucessfully set ground truth!\033[0m\n");              \
-      } else {                                                                 \
-        printf("\033[33mCould not set ground truth!\033[0m\n");                \
-      }                                                                        \
-    } else {                                                                   \
-      if (benchmark->validate) {                                               \
-        if (benchmark->results->output_buffer != NULL &&                       \
-            benchmark->results->gt != NULL) {                                  \
-          func_call;                                                           \
-                                                                               \
-          if (memcmp(benchmark->results->gt,                                   \
-                     benchmark->results->output_buffer,                        \
-                     benchmark->results->size) == 0) {                         \
-            benchmark->is_valid = true;                                        \
-                                                                               \
-            printf("\033[32mResult of '%s' is valid!\033[0m\n",                \
-                   benchmark->name);                                           \
-          } else {                                                             \
-            benchmark->is_valid = false;                                       \
-                                                                               \
-            printf("\033[33mResult of '%s' is not valid!\033[0m\n",            \
-                   benchmark->name);                                           \
-          }                                                                    \
-        } else {                                                               \
-          printf("\033[33mCannot validate benchmark %s! Result or output "     \
-                 "buffer is missing\033[0m\n",                                 \
-                 benchmark->name);                                             \
-        }                                                                      \
-      }                                                                        \
-    }                                                                          \
-                                                                               \
-    block_all_signals_in_this_thread();                                        \
-    printf("\033[33mBlocking signals in current thread!\033[0m\n");            \
-                                                                               \
-    uint64_t cycle_count_overhead = get_cycle_count_overhead();                \
-                                                                               \
-    throttle_warning(MAX_TEMP);                                                \
-    get_system_status();                                                       \
-                                                                               \
-    /* Warmup */                                                               \
-    for (size_t i = 0; i < warmup_iterations; i++) {                           \
-      func_call;                                                               \
-    }                                                                          \
-                                                                               \
-    /* Measure */                                                              \
-    for (size_t i = 0; i < (timed_iterations); i++) {                          \
-      COMPILER_BARRIER();                                                      \
-      cache_counter_t counter = start_l1_cache_miss_counter();                 \
-      uint64_t start = get_cycles();                                           \
-      func_call;                                                               \
-      uint64_t end = get_cycles();                                             \
-      double miss_rate = stop_l1_cache_miss_counter(&counter);                 \
-      COMPILER_BARRIER();                                                      \
-      samples[i] = (end - start) - cycle_count_overhead;                       \
-      cache_miss_rates[i] = miss_rate;                                         \
-    }                                                                          \
-                                                                               \
-    printf("\033[32mCollected %lu samples!\033[0m\n", timed_iterations);       \
-                                                                               \
-    get_system_status();                                                       \
-                                                                               \
-    throttle_warning(MAX_TEMP);                                                \
-                                                                               \
-    benchmark->results->samples = samples;                                     \
-    benchmark->results->cache_miss_rates = cache_miss_rates;                   \
-    benchmark->results->is_cycles = true;                                      \
-                                                                               \
-    enable_cpu_scaling(core);                                                  \
-    printf("\033[33mRe-enabled CPU scaling for core %d!\033[0m\n", core);      \
-                                                                               \
-    sched_setaffinity(0, sizeof(cpu_set_t), &old_set);                         \
-    printf("\033[33mRestored CPU affinity!\033[0m\n");                         \
-                                                                               \
-    sched_setscheduler(0, old_policy, &old_sp);                                \
-                                                                               \
-    printf("\033[33mRestored scheduling settings!\033[0m\n");                  \
-                                                                               \
-    unblock_all_signals_in_this_thread();                                      \
-    printf("\033[33mUnblocking signals in current thread!\033[0m\n");          \
-  } while (0)
+  BENCH_MEASURE(func_call, benchmark, CYCLES, L1_CACHE, PINNED, core, 1)
 
 /**
  * @brief Macro for running a benchmark without CPU core pinning.
@@ -550,53 +328,177 @@ typedef struct {
  * @note Includes thermal monitoring and system status reporting
  */
 #define BENCHMARK_FUNC_CYCLES(func_call, benchmark)                            \
+  BENCH_MEASURE(func_call, benchmark, CYCLES, L1_CACHE, UNPINNED, 0, 1)
+
+/**
+ * @brief Compiler memory barrier.
+ *
+ * Prevents the compiler from reordering memory operations across this point,
+ * ensuring accurate timing measurements by preventing optimization artifacts.
+ */
+#define COMPILER_BARRIER() BENCH_CLOBBER_MEMORY()
+
+/**
+ * @brief Temperature limit at which thermal throttling starts
+ *
+ * Used for thermal throttling warnings during benchmark execution.
+ * Benchmarks results may be skewed if temperature exceeds this threshold.
+ */
+#define MAX_TEMP 70
+
+/**
+ * @brief Clock policies of BENCH_MEASURE.
+ *
+ * CYCLES:              Cycle counter, minus the overhead of reading it
+ * TIME:                CLOCK_MONOTONIC, samples in nanoseconds
+ */
+#define BENCH_CLOCK_CYCLES_IS_CYCLES true
+#define BENCH_CLOCK_CYCLES_OVERHEAD() get_cycle_count_overhead()
+#define BENCH_CLOCK_CYCLES_NOW() get_cycles()
+#define BENCH_CLOCK_CYCLES_SAMPLE(start, end, overhead)                        \
+  (((end) - (start)) - (overhead))
+
+#define BENCH_CLOCK_TIME_IS_CYCLES false
+#define BENCH_CLOCK_TIME_OVERHEAD() 0
+#define BENCH_CLOCK_TIME_NOW() get_time_ns()
+#define BENCH_CLOCK_TIME_SAMPLE(start, end, overhead)                          \
+  ((void)(overhead), (end) - (start))
+
+/**
+ * @brief Counter policies of BENCH_MEASURE.
+ *
+ * L1_CACHE:            L1 data cache miss rate of every sample
+ * NO_COUNTERS:         No hardware counters, the miss rates are 0
+ */
+#define BENCH_COUNTERS_L1_CACHE_START() start_l1_cache_miss_counter()
+#define BENCH_COUNTERS_L1_CACHE_STOP(counter)                                  \
+  stop_l1_cache_miss_counter(&(counter))
+
+#define BENCH_COUNTERS_NO_COUNTERS_START() ((cache_counter_t){-1, -1})
+#define BENCH_COUNTERS_NO_COUNTERS_STOP(counter) ((void)(counter), 0.0)
+
+/**
+ * @brief Pinning policies of BENCH_MEASURE.
+ *
+ * PINNED:              Pinned to a core with real-time priority and the
+ *                      performance governor, restored afterwards
+ * UNPINNED:            Scheduled by the OS
+ */
+#define BENCH_PINNING_PINNED_ENTER(benchmark, core, state)                     \
+  bench_pin(benchmark, core, &(state))
+#define BENCH_PINNING_PINNED_LEAVE(benchmark, core, state)                     \
+  bench_unpin(benchmark, &(state))
+
+#define BENCH_PINNING_UNPINNED_ENTER(benchmark, core, state) ((void)0)
+#define BENCH_PINNING_UNPINNED_LEAVE(benchmark, core, state) ((void)(state))
+
+/**
+ * @brief Per-iteration hook variants of BENCH_MEASURE_LOOP.
+ *
+ * HOOKS:               Runs the iteration setup and teardown hooks and
+ *                      counts the interrupts of every sample
+ * NO_HOOKS:            Leaves no trace of the hooks in the measure loop
+ */
+#define BENCH_HOOKS_HOOKS_SETUP(benchmark) bench_sample_begin(benchmark)
+#define BENCH_HOOKS_HOOKS_TEARDOWN(benchmark, i) bench_sample_end(benchmark, i)
+
+#define BENCH_HOOKS_NO_HOOKS_SETUP(benchmark) ((void)0)
+#define BENCH_HOOKS_NO_HOOKS_TEARDOWN(benchmark, i) ((void)0)
+
+/**
+ * @brief Timed loop of BENCH_MEASURE for one combination of policies.
+ *
+ * Only the instructions of the selected policies are expanded between the
+ * two clock reads. A batch of 1 leaves no loop around func_call.
+ */
+#define BENCH_MEASURE_LOOP(func_call, benchmark, clock, counters, batch,       \
+                           hooks, samples, cache_miss_rates, overhead,         \
+                           block_end)                                          \
+  for (size_t i = benchmark->sample_count; i < block_end; i++) {               \
+    BENCH_HOOKS_##hooks##_SETUP(benchmark);                                    \
+    COMPILER_BARRIER();                                                        \
+    cache_counter_t counter = BENCH_COUNTERS_##counters##_START();             \
+    uint64_t start = BENCH_CLOCK_##clock##_NOW();                              \
+    for (size_t _bench_call = 0; _bench_call < (batch); _bench_call++) {       \
+      func_call;                                                               \
+    }                                                                          \
+    uint64_t end = BENCH_CLOCK_##clock##_NOW();                                \
+    double miss_rate = BENCH_COUNTERS_##counters##_STOP(counter);              \
+    COMPILER_BARRIER();                                                        \
+    BENCH_HOOKS_##hooks##_TEARDOWN(benchmark, i);                              \
+    samples[i] = BENCH_CLOCK_##clock##_SAMPLE(start, end, overhead) / (batch); \
+    cache_miss_rates[i] = miss_rate;                                           \
+  }
+
+/**
+ * @brief Runs a benchmark with a compile-time choice of clock, counters,
+ * pinning and batch size.
+ *
+ * Shared by all BENCHMARK_FUNC variants. The policies are pasted into the
+ * expansion, so a configuration pays for nothing it does not use. The measure
+ * loop is expanded with and without the per-iteration hooks, a benchmark
+ * without hooks runs the loop that does not contain them.
+ *
+ *   BENCH_MEASURE(hash(key), benchmark, CYCLES, NO_COUNTERS, UNPINNED, 0, 16);
+ *
+ * @param func_call The function call to benchmark (e.g., my_function())
+ * @param benchmark Pointer to benchmark_t structure with configuration
+ * @param clock CYCLES or TIME
+ * @param counters L1_CACHE or NO_COUNTERS
+ * @param pinning PINNED or UNPINNED
+ * @param core CPU core number to pin the benchmark to, ignored if UNPINNED
+ * @param batch Constant number of calls per sample, samples are per call
+ *
+ * @note A batch amortizes the clock reads over several calls of very short
+ * bodies, the miss rate is the one of the whole batch
+ */
+#define BENCH_MEASURE(func_call, benchmark, clock, counters, pinning, core,    \
+                      batch)                                                   \
   do {                                                                         \
                                                                                \
-    size_t warmup_iterations = benchmark->warmup_iterations;                   \
+    size_t warmup_iterations = bench_block_warmup(benchmark);                  \
     size_t timed_iterations = benchmark->timed_iterations;                     \
                                                                                \
-    uint64_t *samples = malloc((timed_iterations) * sizeof(uint64_t));         \
-    double *cache_miss_rates = malloc((timed_iterations) * sizeof(double));    \
-                                                                               \
-    printf("\033[34mRunning benchmark: %s\033[0m\n", benchmark->name);         \
+    BENCH_STATUS(benchmark, "\033[34mRunning benchmark: %s\033[0m\n",          \
+                 benchmark->name);                                             \
                                                                                \
     if (benchmark->is_baseline) {                                              \
-      printf("\033[32mThis is a baseline run!\033[0m\n");                      \
+      BENCH_STATUS(benchmark, "\033[32mThis is a baseline run!\033[0m\n");     \
     }                                                                          \
                                                                                \
-    printf("\033[34mRunning %lu warmup iterations, followed by %lu timed "     \
-           "iterations...\033[0m\n",                                           \
-           warmup_iterations, timed_iterations);                               \
+    BENCH_STATUS(benchmark,                                                    \
+                 "\033[34mRunning %lu warmup iterations, followed by %lu "     \
+                 "timed iterations...\033[0m\n",                               \
+                 warmup_iterations, timed_iterations);                         \
                                                                                \
-    if (benchmark->is_baseline) {                                              \
+    bench_pinning_t pinning_state;                                             \
+    BENCH_PINNING_##pinning##_ENTER(benchmark, core, pinning_state);           \
+    bench_numa_enter(benchmark);                                               \
+                                                                               \
+    if (bench_first_block(benchmark))                                          \
+      bench_fixture_setup(benchmark);                                          \
+                                                                               \
+    if (bench_first_block(benchmark) && benchmark->is_baseline) {              \
       if (benchmark->results->output_buffer != NULL) {                         \
+        bench_iteration_setup(benchmark);                                      \
         func_call;                                                             \
                                                                                \
-        memcpy(benchmark->results->gt, benchmark->results->output_buffer,      \
-               benchmark->results->size);                                      \
+        store_ground_truth(benchmark);                                         \
+        bench_iteration_teardown(benchmark);                                   \
         printf("\033[32mSucessfully set ground truth!\033[0m\n");              \
       } else {                                                                 \
         printf("\033[33mCould not set ground truth!\033[0m\n");                \
       }                                                                        \
     } else {                                                                   \
-      if (benchmark->validate) {                                               \
+      if (bench_first_block(benchmark) && benchmark->validate) {               \
         if (benchmark->results->output_buffer != NULL &&                       \
             benchmark->results->gt != NULL) {                                  \
+          bench_iteration_setup(benchmark);                                    \
           func_call;                                                           \
                                                                                \
-          if (memcmp(benchmark->results->gt,                                   \
-                     benchmark->results->output_buffer,                        \
-                     benchmark->results->size) == 0) {                         \
-            benchmark->is_valid = true;                                        \
-                                                                               \
-            printf("\033[32mResult of '%s' is valid!\033[0m\n",                \
-                   benchmark->name);                                           \
-          } else {                                                             \
-            benchmark->is_valid = false;                                       \
-                                                                               \
-            printf("\033[33mResult of '%s' is not valid!\033[0m\n",            \
-                   benchmark->name);                                           \
-          }                                                                    \
+          validate_result(benchmark, benchmark->results->output_buffer,        \
+                          benchmark->results->gt, benchmark->results->size);   \
+          bench_iteration_teardown(benchmark);                                 \
         } else {                                                               \
           printf("\033[33mCannot validate benchmark %s! Result or output "     \
                  "buffer is missing\033[0m\n",                                 \
@@ -606,46 +508,432 @@ typedef struct {
     }                                                                          \
                                                                                \
     block_all_signals_in_this_thread();                                        \
-    printf("\033[33mBlocking signals in current thread!\033[0m\n");            \
-                                                                               \
-    uint64_t cycle_count_overhead = get_cycle_count_overhead();                \
-                                                                               \
-    throttle_warning(MAX_TEMP);                                                \
-    get_system_status();                                                       \
-                                                                               \
-    /* Warmup */                                                               \
-    for (size_t i = 0; i < warmup_iterations; i++) {                           \
+    BENCH_STATUS(benchmark,                                                    \
+                 "\033[33mBlocking signals in current thread!\033[0m\n");      \
+                                                                               \
+    uint64_t clock_overhead = BENCH_CLOCK_##clock##_OVERHEAD();                \
+                                                                               \
+    if (bench_verbose(benchmark))                                              \
+      throttle_warning(MAX_TEMP);                                              \
+    if (bench_verbose(benchmark))                                              \
+      get_system_status();                                                     \
+                                                                               \
+    /* Warmup (also used to calibrate --min-time) */                           \
+    size_t calibration_calls = bench_calibration_calls(warmup_iterations);     \
+    uint64_t warmup_start = get_time_ns();                                     \
+    uint64_t warmup_hook_ns = benchmark->results->hook_total_ns;               \
+    for (size_t i = 0; i < calibration_calls; i++) {                           \
+      bench_iteration_setup(benchmark);                                        \
       func_call;                                                               \
+      bench_iteration_teardown(benchmark);                                     \
+    }                                                                          \
+    warmup_hook_ns = benchmark->results->hook_total_ns - warmup_hook_ns;       \
+    if (bench_first_block(benchmark))                                          \
+      timed_iterations = bench_min_time_iterations(                            \
+          timed_iterations, calibration_calls,                                 \
+          (get_time_ns() - warmup_start - warmup_hook_ns) * (batch));          \
+    if (!bench_reserve_samples(benchmark, timed_iterations)) {                 \
+      /* the buffers still hold the configured number of samples */            \
+      fprintf(stderr,                                                          \
+              "Error: Could not allocate %lu samples of %s, measuring "        \
+              "%lu\n",                                                         \
+              timed_iterations, benchmark->name,                               \
+              benchmark->timed_iterations);                                    \
+      timed_iterations = benchmark->timed_iterations;                          \
     }                                                                          \
+    benchmark->timed_iterations = timed_iterations;                            \
+    bench_irq_reserve(benchmark, timed_iterations);                            \
+    uint64_t *samples = benchmark->results->samples;                           \
+    double *cache_miss_rates = benchmark->results->cache_miss_rates;           \
                                                                                \
     /* Measure */                                                              \
-    for (size_t i = 0; i < (timed_iterations); i++) {                          \
-      COMPILER_BARRIER();                                                      \
-      cache_counter_t counter = start_l1_cache_miss_counter();                 \
-      uint64_t start = get_cycles();                                           \
-      func_call;                                                               \
-      uint64_t end = get_cycles();                                             \
-      double miss_rate = stop_l1_cache_miss_counter(&counter);                 \
-      COMPILER_BARRIER();                                                      \
-      samples[i] = (end - start) - cycle_count_overhead;                       \
-      cache_miss_rates[i] = miss_rate;                                         \
+    size_t block_end = bench_block_end(benchmark);                             \
+    uint64_t energy_hook_ns = benchmark->results->sample_hook_ns;              \
+    bench_energy_enter(benchmark);                                             \
+    if (bench_has_sample_hooks(benchmark)) {                                   \
+      BENCH_MEASURE_LOOP(func_call, benchmark, clock, counters, batch, HOOKS,  \
+                         samples, cache_miss_rates, clock_overhead,            \
+                         block_end);                                           \
+    } else {                                                                   \
+      BENCH_MEASURE_LOOP(func_call, benchmark, clock, counters, batch,         \
+                         NO_HOOKS, samples, cache_miss_rates, clock_overhead,  \
+                         block_end);                                           \
     }                                                                          \
+    bench_energy_leave(benchmark,                                              \
+                       (block_end - benchmark->sample_count) * (batch),        \
+                       benchmark->results->sample_hook_ns - energy_hook_ns);   \
                                                                                \
-    printf("\033[32mCollected %lu samples!\033[0m\n", timed_iterations);       \
+    benchmark->sample_count = block_end;                                       \
                                                                                \
-    get_system_status();                                                       \
+    if (block_end == timed_iterations)                                         \
+      bench_fixture_teardown(benchmark);                                       \
                                                                                \
-    throttle_warning(MAX_TEMP);                                                \
+    BENCH_STATUS(benchmark, "\033[32mCollected %lu samples!\033[0m\n",         \
+                 timed_iterations);                                            \
                                                                                \
-    benchmark->results->samples = samples;                                     \
-    benchmark->results->cache_miss_rates = cache_miss_rates;                   \
-    benchmark->results->is_cycles = true;                                      \
+    if (bench_verbose(benchmark))                                              \
+      get_system_status();                                                     \
                                                                                \
-    unblock_all_signals_in_this_thread();                                      \
-    printf("\033[33mUnblocking signals in current thread!\033[0m\n");          \
+    if (bench_verbose(benchmark))                                              \
+      throttle_warning(MAX_TEMP);                                              \
+                                                                               \
+    benchmark->results->is_cycles = BENCH_CLOCK_##clock##_IS_CYCLES;           \
+                                                                               \
+    bench_numa_leave(benchmark);                                               \
+    BENCH_PINNING_##pinning##_LEAVE(benchmark, core, pinning_state);           \
                                                                                \
+    unblock_all_signals_in_this_thread();                                      \
+    BENCH_STATUS(benchmark,                                                    \
+                 "\033[33mUnblocking signals in current thread!\033[0m\n");    \
+  } while (0)
+
+/**
+ * @brief Upper bound for the number of timed iterations chosen by --min-time.
+ */
+#define MAX_TIMED_ITERATIONS 100000000
+
+/**
+ * @brief Checks if the next run of a benchmark measures its first samples.
+ *
+ * Interleaved benchmarks are run once per block of samples. The ground truth
+ * is set and the output validated by the first run only.
+ */
+static inline bool bench_first_block(const benchmark_t *benchmark) {
+  return benchmark->sample_count == 0;
+}
+
+/**
+ * @brief Checks if a benchmark reports the status of its runs.
+ *
+ * Interleaved benchmarks run many short blocks, so their status messages are
+ * suppressed.
+ */
+static inline bool bench_verbose(const benchmark_t *benchmark) {
+  return benchmark->block_size == 0;
+}
+
+/**
+ * @brief Prints a status message of a benchmark run, unless it is
+ * interleaved.
+ */
+#define BENCH_STATUS(benchmark, ...)                                           \
+  do {                                                                         \
+    if (bench_verbose(benchmark))                                              \
+      printf(__VA_ARGS__);                                                     \
   } while (0)
 
+/**
+ * @brief Returns the number of warmup iterations of the next run.
+ *
+ * Later blocks of an interleaved benchmark warm up with at most as many calls
+ * as they measure, to restore the caches after the other benchmarks ran.
+ */
+static inline size_t bench_block_warmup(const benchmark_t *benchmark) {
+  if (bench_first_block(benchmark) ||
+      benchmark->block_size >= benchmark->warmup_iterations)
+    return benchmark->warmup_iterations;
+  return benchmark->block_size;
+}
+
+/**
+ * @brief Returns the index after the last sample measured by the next run.
+ */
+static inline size_t bench_block_end(const benchmark_t *benchmark) {
+  size_t end = benchmark->timed_iterations;
+  if (benchmark->block_size > 0 &&
+      benchmark->sample_count + benchmark->block_size < end)
+    end = benchmark->sample_count + benchmark->block_size;
+  return end;
+}
+
+/**
+ * @brief Returns the number of untimed calls made before the measurement.
+ *
+ * This is the number of warmup iterations, but at least one call if a minimum
+ * run time was requested, so the duration of a single call can be estimated.
+ *
+ * @param warmup_iterations Number of configured warmup iterations
+ * @return Number of untimed calls to make
+ */
+[[nodiscard]] static inline size_t
+bench_calibration_calls(size_t warmup_iterations) {
+  if (warmup_iterations == 0 && bench_options.min_time > 0.0)
+    return 1;
+  return warmup_iterations;
+}
+
+/**
+ * @brief Scales the number of timed iterations to satisfy --min-time.
+ *
+ * Estimates the duration of a single call from the untimed calls and raises
+ * the number of timed iterations so they take at least the requested minimum
+ * time. The number of iterations is never reduced.
+ *
+ * @param timed_iterations Number of configured timed iterations
+ * @param calls Number of untimed calls that were made
+ * @param elapsed_ns Duration of the untimed calls in nanoseconds
+ * @return Number of timed iterations to run
+ *
+ * @note Capped at MAX_TIMED_ITERATIONS
+ */
+[[nodiscard]] static inline size_t
+bench_min_time_iterations(size_t timed_iterations, size_t calls,
+                          uint64_t elapsed_ns) {
+  if (bench_options.min_time <= 0.0 || calls == 0)
+    return timed_iterations;
+
+  double per_call_ns = (double)elapsed_ns / (double)calls;
+  if (per_call_ns < 1.0)
+    per_call_ns = 1.0;
+
+  double wanted = bench_options.min_time * 1e9 / per_call_ns;
+  if (wanted > MAX_TIMED_ITERATIONS)
+    wanted = MAX_TIMED_ITERATIONS;
+
+  if ((size_t)wanted > timed_iterations) {
+    printf("\033[34mIncreased timed iterations to %zu to reach a minimum "
+           "time of %.2fs\033[0m\n",
+           (size_t)wanted, bench_options.min_time);
+    return (size_t)wanted;
+  }
+
+  return timed_iterations;
+}
+
+/**
+ * @brief Grows the sample buffers of a benchmark to a number of timed
+ * iterations.
+ *
+ * A buffer is only replaced once it was grown, so on failure the benchmark
+ * keeps valid buffers of the previous size.
+ *
+ * @param benchmark The benchmark about to be measured
+ * @param timed_iterations Number of timed iterations of the benchmark
+ * @return false if a buffer could not be grown
+ */
+[[nodiscard]] static inline bool
+bench_reserve_samples(benchmark_t *benchmark, size_t timed_iterations) {
+  benchmark_result_t *results = benchmark->results;
+
+  uint64_t *samples = (uint64_t *)realloc(results->samples,
+                                          timed_iterations * sizeof(uint64_t));
+  if (samples == NULL)
+    return false;
+  results->samples = samples;
+
+  double *cache_miss_rates = (double *)realloc(
+      results->cache_miss_rates, timed_iterations * sizeof(double));
+  if (cache_miss_rates == NULL)
+    return false;
+  results->cache_miss_rates = cache_miss_rates;
+  return true;
+}
+
+/**
+ * @brief Runs the setup hook of a benchmark fixture and records its cost.
+ *
+ * @param benchmark The benchmark whose fixture to set up
+ */
+static inline void bench_fixture_setup(benchmark_t *benchmark) {
+  if (benchmark->fixture.setup == NULL)
+    return;
+
+  uint64_t start = get_time_ns();
+  benchmark->fixture.setup(benchmark->fixture.ctx);
+  benchmark->results->fixture_setup_ns = get_time_ns() - start;
+}
+
+/**
+ * @brief Runs the teardown hook of a benchmark fixture and records its cost.
+ *
+ * @param benchmark The benchmark whose fixture to tear down
+ */
+static inline void bench_fixture_teardown(benchmark_t *benchmark) {
+  if (benchmark->fixture.teardown == NULL)
+    return;
+
+  uint64_t start = get_time_ns();
+  benchmark->fixture.teardown(benchmark->fixture.ctx);
+  benchmark->results->fixture_teardown_ns = get_time_ns() - start;
+}
+
+/**
+ * @brief Checks if a benchmark has per-iteration hooks.
+ *
+ * Selects the measure loop of BENCH_MEASURE once, before the first sample.
+ */
+static inline bool bench_has_iteration_hooks(const benchmark_t *benchmark) {
+  return benchmark->fixture.iteration_setup != NULL ||
+         benchmark->fixture.iteration_teardown != NULL;
+}
+
+/**
+ * @brief Runs the per-iteration setup hook before the timer is started.
+ *
+ * The cost of the hook is recorded separately and never part of a sample.
+ *
+ * @param benchmark The benchmark about to run an iteration
+ */
+static inline void bench_iteration_setup(benchmark_t *benchmark) {
+  if (benchmark->fixture.iteration_setup == NULL)
+    return;
+
+  uint64_t start = get_time_ns();
+  benchmark->fixture.iteration_setup(benchmark->fixture.ctx);
+  benchmark->results->hook_pending_ns = get_time_ns() - start;
+}
+
+/**
+ * @brief Runs the per-iteration teardown hook after the timer was stopped.
+ *
+ * Accumulates the cost of the setup and teardown hooks of the iteration.
+ *
+ * @param benchmark The benchmark that finished an iteration
+ */
+static inline void bench_iteration_teardown(benchmark_t *benchmark) {
+  benchmark_result_t *results = benchmark->results;
+  if (!bench_has_iteration_hooks(benchmark))
+    return;
+
+  uint64_t cost = results->hook_pending_ns;
+  results->hook_pending_ns = 0;
+
+  if (benchmark->fixture.iteration_teardown != NULL) {
+    uint64_t start = get_time_ns();
+    benchmark->fixture.iteration_teardown(benchmark->fixture.ctx);
+    cost += get_time_ns() - start;
+  }
+
+  results->hook_total_ns += cost;
+  if (cost > results->hook_max_ns)
+    results->hook_max_ns = cost;
+  results->hook_calls++;
+}
+
+/**
+ * @brief Checks if the timed iterations of a benchmark need the hooks of
+ * BENCH_MEASURE_LOOP, for its per-iteration hooks or to count interrupts.
+ */
+static inline bool bench_has_sample_hooks(const benchmark_t *benchmark) {
+  return bench_has_iteration_hooks(benchmark) ||
+         benchmark->results->irq_counter.active;
+}
+
+/**
+ * @brief Grows the per-iteration interrupt counts along with the samples.
+ *
+ * Does nothing unless the interrupts of the benchmark core are counted.
+ *
+ * @param benchmark The benchmark about to be measured
+ * @param timed_iterations Number of timed iterations of the benchmark
+ */
+static inline void bench_irq_reserve(benchmark_t *benchmark,
+                                     size_t timed_iterations) {
+  benchmark_result_t *results = benchmark->results;
+  if (!results->irq_counter.active)
+    return;
+
+  uint64_t *irq_counts = (uint64_t *)realloc(
+      results->irq_counts, timed_iterations * sizeof(uint64_t));
+  if (irq_counts == NULL) {
+    bench_irq_counter_close(&results->irq_counter);
+    return;
+  }
+  results->irq_counts = irq_counts;
+}
+
+/**
+ * @brief Starts measuring the energy of the timed iterations of a benchmark.
+ *
+ * Does nothing unless --energy was given. The meter is discovered on first
+ * use, see bench_energy_open().
+ *
+ * @param benchmark The benchmark about to be measured
+ */
+static inline void bench_energy_enter(const benchmark_t *benchmark) {
+  if (!bench_options.energy)
+    return;
+
+  if (!bench_energy_meter.probed) {
+    if (bench_energy_open(bench_options.energy_domain))
+      printf("\033[33mMeasuring energy with %s!\033[0m\n",
+             bench_energy_meter.label);
+    else
+      printf("\033[33mNo readable RAPL counter or hwmon power sensor, energy "
+             "is not measured!\033[0m\n");
+  }
+  if (!bench_energy_begin() && bench_energy_meter.source != BENCH_ENERGY_NONE)
+    printf("\033[33mCannot measure the energy of '%s'!\033[0m\n",
+           benchmark->name);
+}
+
+/**
+ * @brief Adds the energy since bench_energy_enter() to a benchmark.
+ *
+ * The blocks of an interleaved run accumulate. The time spent in the sample
+ * hooks is taken out of the measurement along with its share of the energy,
+ * assuming the power stayed the same.
+ *
+ * @param benchmark The benchmark that was measured
+ * @param calls Calls of the benchmark since bench_energy_enter()
+ * @param hook_ns Time spent in the sample hooks since bench_energy_enter()
+ */
+static inline void bench_energy_leave(benchmark_t *benchmark, size_t calls,
+                                      uint64_t hook_ns) {
+  if (!bench_options.energy)
+    return;
+
+  uint64_t elapsed_ns;
+  double joules = bench_energy_end(&elapsed_ns);
+  if (joules < 0.0 || hook_ns >= elapsed_ns)
+    return;
+  joules *= (double)(elapsed_ns - hook_ns) / (double)elapsed_ns;
+  elapsed_ns -= hook_ns;
+
+  benchmark_result_t *results = benchmark->results;
+  results->energy_j += joules;
+  results->energy_ns += elapsed_ns;
+  results->energy_calls += calls;
+}
+
+/**
+ * @brief Runs before every timed iteration of BENCH_MEASURE_LOOP.
+ *
+ * Runs the per-iteration setup hook and reads the interrupt counter last, so
+ * only the interrupts of the timed region are attributed to the sample.
+ *
+ * @param benchmark The benchmark about to run an iteration
+ */
+static inline void bench_sample_begin(benchmark_t *benchmark) {
+  uint64_t start = get_time_ns();
+  bench_iteration_setup(benchmark);
+
+  bench_irq_counter_t *counter = &benchmark->results->irq_counter;
+  if (counter->active)
+    counter->start = bench_irq_counter_read(counter);
+  benchmark->results->sample_hook_ns += get_time_ns() - start;
+}
+
+/**
+ * @brief Runs after every timed iteration of BENCH_MEASURE_LOOP.
+ *
+ * Records the interrupts of the iteration and runs the per-iteration
+ * teardown hook.
+ *
+ * @param benchmark The benchmark that finished an iteration
+ * @param i Index of the sample
+ */
+static inline void bench_sample_end(benchmark_t *benchmark, size_t i) {
+  uint64_t start = get_time_ns();
+  benchmark_result_t *results = benchmark->results;
+  bench_irq_counter_t *counter = &results->irq_counter;
+  if (counter->active)
+    results->irq_counts[i] = bench_irq_counter_read(counter) - counter->start;
+
+  bench_iteration_teardown(benchmark);
+  results->sample_hook_ns += get_time_ns() - start;
+}
+
 /**
  * @brief Disables CPU frequency scaling by setting the governor to performance
  * mode for a specific core.
@@ -695,6 +983,158 @@ static inline void enable_cpu_scaling(int core) {
   system(command);
 }
 
+/**
+ * @brief Pins the process to a core with real-time priority and disables
+ * frequency scaling of the core.
+ *
+ * The core is resolved with bench_resolve_core(), so --core overrides it and
+ * BENCH_CORE_AUTO selects the quietest core. With --smt=park the SMT siblings
+ * of the core are taken offline, see bench_park(). With --irq-shield the
+ * interrupts are steered away from the core until bench_irq_unshield() and
+ * counted for every sample.
+ *
+ * @param benchmark The benchmark about to run
+ * @param core CPU core number to pin the benchmark to, or BENCH_CORE_AUTO
+ * @param state Receives the scheduling state to restore with bench_unpin()
+ *
+ * @note Requires appropriate privileges for CPU affinity and real-time
+ * scheduling
+ */
+static inline void bench_pin(const benchmark_t *benchmark, int core,
+                             bench_pinning_t *state) {
+  core = bench_resolve_core(core);
+  state->core = core;
+
+  CPU_ZERO(&state->parked);
+  if (bench_options.smt == BENCH_SMT_PARK &&
+      bench_park(core, &state->parked) > 0)
+    BENCH_STATUS(benchmark,
+                 "\033[33mParked %d SMT siblings of core %d!\033[0m\n",
+                 CPU_COUNT(&state->parked), core);
+
+  if (bench_options.irq_shield) {
+    int moved = bench_irq_shield(core);
+    if (moved >= 0)
+      BENCH_STATUS(benchmark,
+                   "\033[33mSteered %d interrupts away from core %d!\033[0m\n",
+                   moved, core);
+    if (!bench_irq_counter_open(&benchmark->results->irq_counter, core))
+      printf("\033[33mCannot count the interrupts of core %d!\033[0m\n",
+             core);
+  }
+
+  disable_cpu_scaling(core);
+  BENCH_STATUS(benchmark, "\033[33mDisabled CPU scaling for core %d!\033[0m\n",
+               core);
+
+  system_wait();
+
+  /* save old cpu set */
+  CPU_ZERO(&state->old_set);
+  sched_getaffinity(0, sizeof(cpu_set_t), &state->old_set);
+
+  /* pin process to a core */
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(core, &cpuset);
+  if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0) {
+    perror("Failed to set affinity!");
+  }
+
+  BENCH_STATUS(benchmark, "\033[33mPinned process to core %d!\033[0m\n", core);
+
+  /* save old schduling policy */
+  state->old_policy = sched_getscheduler(0);
+  sched_getparam(0, &state->old_sp);
+
+  /* set priority to highest */
+  struct sched_param sp = {.sched_priority = 99};
+  sched_setscheduler(0, SCHED_FIFO, &sp);
+
+  BENCH_STATUS(benchmark, "\033[33mSet scheduling settings!\033[0m\n");
+}
+
+/**
+ * @brief Restores the frequency scaling, CPU affinity and scheduling saved by
+ * bench_pin().
+ *
+ * @param benchmark The benchmark that finished running
+ * @param state Scheduling state saved by bench_pin()
+ */
+static inline void bench_unpin(const benchmark_t *benchmark,
+                               const bench_pinning_t *state) {
+  enable_cpu_scaling(state->core);
+  BENCH_STATUS(benchmark,
+               "\033[33mRe-enabled CPU scaling for core %d!\033[0m\n",
+               state->core);
+
+  sched_setaffinity(0, sizeof(cpu_set_t), &state->old_set);
+  BENCH_STATUS(benchmark, "\033[33mRestored CPU affinity!\033[0m\n");
+
+  sched_setscheduler(0, state->old_policy, &state->old_sp);
+  BENCH_STATUS(benchmark, "\033[33mRestored scheduling settings!\033[0m\n");
+
+  bench_unpark(&state->parked);
+  bench_irq_counter_close(&benchmark->results->irq_counter);
+}
+
+/**
+ * @brief Places the buffers of a benchmark relative to the core it runs on.
+ *
+ * Called once the benchmark is pinned, so BENCH_NUMA_LOCAL resolves to the
+ * node of the benchmark core. The output buffer and every buffer of
+ * bench_alloc() are moved to the target nodes, and the memory policy of the
+ * thread places the pages first touched during the run, e.g. by the fixture.
+ *
+ * @param benchmark The benchmark about to run
+ */
+static inline void bench_numa_enter(const benchmark_t *benchmark) {
+  if (benchmark->numa == BENCH_NUMA_DEFAULT)
+    return;
+
+  int cpu = sched_getcpu();
+  bench_nodemask_t mask;
+  int node;
+  int policy = bench_numa_policy(benchmark->numa, cpu, &mask, &node);
+
+  bool placed = true;
+  benchmark_result_t *results = benchmark->results;
+  if (results->output_buffer != NULL)
+    placed &= bench_mbind(results->output_buffer, results->size, policy, &mask);
+  for (size_t i = 0; i < bench_allocations.count; i++) {
+    const bench_allocation_t *entry = &bench_allocations.entries[i];
+    placed &= bench_mbind(entry->base, entry->length, policy, &mask);
+  }
+  placed &= bench_set_mempolicy(policy, &mask);
+
+  if (!placed)
+    printf("\033[33mCould not place the buffers of %s (%s)!\033[0m\n",
+           benchmark->name, bench_numa_mode_name(benchmark->numa));
+  else if (benchmark->numa == BENCH_NUMA_REMOTE &&
+           node == bench_numa_cpu_node(cpu))
+    BENCH_STATUS(benchmark,
+                 "\033[33mNo remote node, placed the buffers on the local "
+                 "node %d!\033[0m\n",
+                 node);
+  else if (node >= 0)
+    BENCH_STATUS(benchmark,
+                 "\033[33mPlaced the buffers on node %d (core %d)!\033[0m\n",
+                 node, cpu);
+  else
+    BENCH_STATUS(benchmark,
+                 "\033[33mInterleaved the buffers over all nodes!\033[0m\n");
+}
+
+/**
+ * @brief Restores the default memory policy changed by bench_numa_enter().
+ *
+ * The buffers keep their placement until the next benchmark moves them.
+ */
+static inline void bench_numa_leave(const benchmark_t *benchmark) {
+  if (benchmark->numa != BENCH_NUMA_DEFAULT)
+    bench_set_mempolicy(MPOL_DEFAULT, NULL);
+}
+
 /**
  * @brief Enables user-space access to performance monitoring units (PMU).
  *
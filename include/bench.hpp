@@ -0,0 +1,341 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include "./utils.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * @brief C++ interface of pi-bench.
+ *
+ * A Runner measures any callable, so calls containing commas need no macro
+ * and the body is inlined into a single timed loop. The clock, the counters
+ * and the pinning are policy parameters, paths a policy does not need are
+ * removed at compile time. Results are recorded in the registry like those of
+ * the C macros, so PRINT_RESULTS_GROUP(), EXPORT_RESULTS() and CLEANUP() work
+ * unchanged.
+ *
+ *   pibench::Runner<pibench::CycleClock, pibench::NoCounters> runner;
+ *   runner.run([&] { sum(data, size); }, {.name = "sum", .samples = 1000});
+ *
+ * Requires C++17, designated initializers require C++20.
+ */
+namespace pibench {
+
+/**
+ * @brief Clock policy reading the cycle counter with get_cycles().
+ *
+ * Samples are counter ticks minus the overhead of reading the counter, like
+ * those of BENCHMARK_FUNC_CYCLES.
+ */
+struct CycleClock {
+  static constexpr bool is_cycles = true;
+
+  static uint64_t now() { return get_cycles(); }
+  static uint64_t sample(uint64_t start, uint64_t end, uint64_t overhead) {
+    return (end - start) - overhead;
+  }
+};
+
+/**
+ * @brief Clock policy reading CLOCK_MONOTONIC.
+ *
+ * Samples are nanoseconds, like those of BENCHMARK_FUNC.
+ */
+struct MonotonicClock {
+  static constexpr bool is_cycles = false;
+
+  static uint64_t now() { return get_time_ns(); }
+  static uint64_t sample(uint64_t start, uint64_t end, uint64_t) {
+    return end - start;
+  }
+};
+
+/**
+ * @brief Counter policy measuring no hardware events.
+ */
+struct NoCounters {
+  static constexpr bool enabled = false;
+  struct State {};
+
+  static State start() { return {}; }
+  static double stop(State &) { return 0.0; }
+};
+
+/**
+ * @brief Counter policy measuring the L1 data cache miss rate of every
+ * sample.
+ */
+struct L1CacheCounters {
+  static constexpr bool enabled = true;
+  using State = cache_counter_t;
+
+  static State start() { return start_l1_cache_miss_counter(); }
+  static double stop(State &state) {
+    return stop_l1_cache_miss_counter(&state);
+  }
+};
+
+/**
+ * @brief Pinning policy running the benchmark wherever the scheduler puts it.
+ */
+struct Unpinned {
+  struct State {};
+
+  static State enter(const benchmark_t *, int) { return {}; }
+  static void leave(const benchmark_t *, State &) {}
+};
+
+/**
+ * @brief Pinning policy running the benchmark on one core with real-time
+ * priority and the performance governor, like BENCHMARK_FUNC_PINNED.
+ *
+ * @note Requires appropriate privileges for CPU affinity and real-time
+ * scheduling
+ */
+struct Pinned {
+  using State = bench_pinning_t;
+
+  static State enter(const benchmark_t *benchmark, int core) {
+    State state;
+    bench_pin(benchmark, core, &state);
+    return state;
+  }
+  static void leave(const benchmark_t *benchmark, State &state) {
+    bench_unpin(benchmark, &state);
+  }
+};
+
+/**
+ * @brief Configuration of one benchmark run.
+ *
+ * name:                Human-readable name of the benchmark
+ * warmup:              Number of warmup iterations
+ * samples:             Number of timed iterations
+ * is_baseline:         Flag indicating if this is a baseline benchmark
+ * validate:            Flag indicating if the result should be validated
+ * output_buffer:       Buffer the benchmark writes its result to
+ * size:                Size of the output buffer in bytes
+ * core:                Core to run on, or BENCH_CORE_AUTO, only used by the
+ *                      Pinned policy
+ */
+struct Config {
+  const char *name = "benchmark";
+  size_t warmup = 10;
+  size_t samples = 100;
+  bool is_baseline = false;
+  bool validate = false;
+  void *output_buffer = nullptr;
+  size_t size = 0;
+  int core = 0;
+};
+
+/**
+ * @brief Runs benchmarks with a compile-time choice of clock, counters and
+ * pinning.
+ *
+ * @tparam Clock CycleClock or MonotonicClock
+ * @tparam Counters L1CacheCounters or NoCounters
+ * @tparam Pinning Unpinned or Pinned
+ */
+template <class Clock = CycleClock, class Counters = L1CacheCounters,
+          class Pinning = Unpinned>
+class Runner {
+public:
+  /**
+   * @brief Measures a callable and records the result in the registry.
+   *
+   * Honors --filter, --list, --samples, --repetitions and --min-time, and
+   * the fixture and validator set with bench_set_fixture() and
+   * bench_set_validator(). With --repetitions the callable is measured that
+   * many times in a row, every run is recorded as "<name>#<n>".
+   *
+   * @param func Callable to measure, called without arguments
+   * @param config Configuration of the run
+   * @return The last finished run, owned by the registry, or nullptr if the
+   * benchmark was not selected or its samples could not be allocated
+   */
+  template <class F> benchmark_t *run(F &&func, const Config &config) const {
+    if (!bench_filter_match(config.name))
+      return nullptr;
+    if (bench_options.list) {
+      printf("%s\n", config.name);
+      return nullptr;
+    }
+
+    size_t index = bench_repetitions.index;
+    benchmark_t *benchmark = nullptr;
+    for (size_t r = 0; r < bench_repetition_count(); r++) {
+      bench_repetitions.index = r;
+      benchmark = run_once(func, config);
+      if (benchmark == nullptr)
+        break;
+    }
+    bench_repetitions.index = index;
+    return benchmark;
+  }
+
+private:
+  /**
+   * @brief Measures one run of a callable and records it in the registry.
+   *
+   * @return The finished benchmark, or nullptr if its samples could not be
+   * allocated
+   */
+  template <class F>
+  static benchmark_t *run_once(F &func, const Config &config) {
+    printf("\n=== %s Benchmark ===\n", config.name);
+
+    benchmark_t *benchmark = setup_benchmark(
+        config.name, config.warmup, config.samples, config.is_baseline,
+        config.validate, config.output_buffer, config.size);
+    bench_bind_ground_truth(benchmark);
+
+    printf("\033[34mRunning benchmark: %s\033[0m\n", benchmark->name);
+    typename Pinning::State pinning = Pinning::enter(benchmark, config.core);
+    bench_numa_enter(benchmark);
+
+    bench_fixture_setup(benchmark);
+    check(func, benchmark);
+
+    block_all_signals_in_this_thread();
+    throttle_warning(MAX_TEMP);
+
+    /* Warmup (also used to calibrate --min-time) */
+    size_t calls = bench_calibration_calls(benchmark->warmup_iterations);
+    uint64_t warmup_start = get_time_ns();
+    uint64_t warmup_hook_ns = benchmark->results->hook_total_ns;
+    for (size_t i = 0; i < calls; i++) {
+      bench_iteration_setup(benchmark);
+      func();
+      bench_iteration_teardown(benchmark);
+    }
+    warmup_hook_ns = benchmark->results->hook_total_ns - warmup_hook_ns;
+    size_t timed_iterations = bench_min_time_iterations(
+        benchmark->timed_iterations, calls,
+        get_time_ns() - warmup_start - warmup_hook_ns);
+    benchmark->timed_iterations = timed_iterations;
+
+    if (!bench_reserve_samples(benchmark, timed_iterations)) {
+      fprintf(stderr, "Error: Could not allocate %zu samples of %s\n",
+              timed_iterations, benchmark->name);
+      bench_fixture_teardown(benchmark);
+      bench_numa_leave(benchmark);
+      Pinning::leave(benchmark, pinning);
+      unblock_all_signals_in_this_thread();
+      cleanup_benchmark(benchmark, false);
+      return nullptr;
+    }
+    bench_irq_reserve(benchmark, timed_iterations);
+    uint64_t *samples = benchmark->results->samples;
+    double *cache_miss_rates = benchmark->results->cache_miss_rates;
+
+    uint64_t overhead = 0;
+    if constexpr (Clock::is_cycles)
+      overhead = get_cycle_count_overhead();
+
+    /* Measure */
+    uint64_t energy_hook_ns = benchmark->results->sample_hook_ns;
+    bench_energy_enter(benchmark);
+    if (bench_has_sample_hooks(benchmark))
+      measure<true>(func, benchmark, timed_iterations, samples,
+                    cache_miss_rates, overhead);
+    else
+      measure<false>(func, benchmark, timed_iterations, samples,
+                     cache_miss_rates, overhead);
+    bench_energy_leave(benchmark, timed_iterations,
+                       benchmark->results->sample_hook_ns - energy_hook_ns);
+
+    benchmark->sample_count = timed_iterations;
+    bench_fixture_teardown(benchmark);
+
+    benchmark->results->is_cycles = Clock::is_cycles;
+
+    bench_numa_leave(benchmark);
+    Pinning::leave(benchmark, pinning);
+    unblock_all_signals_in_this_thread();
+
+    printf("\033[32mCollected %zu samples!\033[0m\n", timed_iterations);
+
+    if (config.output_buffer != nullptr)
+      memset(config.output_buffer, 0, config.size);
+
+    bench_registry_add_result(benchmark);
+    return benchmark;
+  }
+
+  /**
+   * @brief Runs the timed iterations of a benchmark.
+   *
+   * Instantiated with and without the per-iteration hooks, like
+   * BENCH_MEASURE_LOOP, so a benchmark without hooks and counters runs a loop
+   * containing nothing but the clock reads and the call.
+   *
+   * @tparam Hooks Run bench_sample_begin() and bench_sample_end() around
+   * every call
+   * @param n Number of timed iterations
+   */
+  template <bool Hooks, class F>
+  static void measure(F &func, benchmark_t *benchmark, size_t n,
+                      uint64_t *samples, double *cache_miss_rates,
+                      uint64_t overhead) {
+    for (size_t i = 0; i < n; i++) {
+      if constexpr (Hooks)
+        bench_sample_begin(benchmark);
+      BENCH_CLOBBER_MEMORY();
+      [[maybe_unused]] typename Counters::State counter;
+      if constexpr (Counters::enabled)
+        counter = Counters::start();
+      uint64_t start = Clock::now();
+      func();
+      uint64_t end = Clock::now();
+      double miss_rate = 0.0;
+      if constexpr (Counters::enabled)
+        miss_rate = Counters::stop(counter);
+      BENCH_CLOBBER_MEMORY();
+      if constexpr (Hooks)
+        bench_sample_end(benchmark, i);
+      samples[i] = Clock::sample(start, end, overhead);
+      cache_miss_rates[i] = miss_rate;
+    }
+  }
+
+  /**
+   * @brief Sets the ground truth of a baseline or validates the output of
+   * any other benchmark, outside of the timed region.
+   */
+  template <class F> static void check(F &func, benchmark_t *benchmark) {
+    benchmark_result_t *results = benchmark->results;
+
+    if (benchmark->is_baseline) {
+      if (results->output_buffer == nullptr) {
+        printf("\033[33mCould not set ground truth!\033[0m\n");
+        return;
+      }
+      bench_iteration_setup(benchmark);
+      func();
+      store_ground_truth(benchmark);
+      bench_iteration_teardown(benchmark);
+      printf("\033[32mSucessfully set ground truth!\033[0m\n");
+    } else if (benchmark->validate) {
+      if (results->output_buffer == nullptr || results->gt == nullptr) {
+        printf("\033[33mCannot validate benchmark %s! Result or output "
+               "buffer is missing\033[0m\n",
+               benchmark->name);
+        return;
+      }
+      bench_iteration_setup(benchmark);
+      func();
+      validate_result(benchmark, results->output_buffer, results->gt,
+                      results->size);
+      bench_iteration_teardown(benchmark);
+    }
+  }
+};
+
+} // namespace pibench
+
+#endif // BENCH_HPP
@@ -0,0 +1,809 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "./bench.h"
+#include "./env.h"
+#include "./machine.h"
+#include "./writer.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef PIBENCH_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * @brief Magic bytes at the start of a binary result file.
+ */
+#define BENCH_BIN_MAGIC "PIBR"
+
+/**
+ * @brief Current version of the binary result format.
+ *
+ * Readers accept files of the same or an older version. Header and
+ * descriptors store their own size, fields are only ever appended, so older
+ * readers skip fields they do not know about.
+ */
+#define BENCH_BIN_VERSION 1
+
+/**
+ * @brief Maximum length of a benchmark name stored in a descriptor.
+ */
+#define BENCH_BIN_NAME_SIZE 128
+
+/**
+ * @brief Flags of a benchmark descriptor.
+ *
+ * Samples of files written by older versions carry neither BENCH_BIN_CYCLES
+ * nor BENCH_BIN_NANOSECONDS and are microseconds.
+ */
+enum {
+  BENCH_BIN_BASELINE = 1 << 0,
+  BENCH_BIN_VALIDATED = 1 << 1,
+  BENCH_BIN_VALID = 1 << 2,
+  BENCH_BIN_CYCLES = 1 << 3,
+  BENCH_BIN_NANOSECONDS = 1 << 4,
+  BENCH_BIN_IRQ_COUNTS = 1 << 5,
+};
+
+/**
+ * @brief Environment of the run, stored in the header, see bench_env_t.
+ *
+ * Strings are NUL terminated.
+ */
+typedef struct {
+  char hostname[64];
+  char kernel[144];
+  char kernel_version[72];
+  char arch[72];
+  char cpu_model[128];
+  char board[128];
+  char governor[32];
+  char clocksource[32];
+  char cycle_counter[32];
+  char compiler[128];
+  char cflags[256];
+  char git_sha[64];
+  int32_t cpu_count;
+  float temperature;
+  uint64_t cur_freq_mhz[BENCH_ENV_MAX_CPUS];
+  uint64_t min_freq_mhz, max_freq_mhz;
+  uint64_t cycle_counter_hz;
+  uint64_t timestamp;
+} bench_bin_env_t;
+
+/**
+ * @brief File header, stored at offset 0.
+ *
+ * Files written before the run metadata was added end the header after
+ * hostname, see BENCH_BIN_HEADER_MIN_SIZE.
+ *
+ * magic:               BENCH_BIN_MAGIC
+ * version:             Format version of the file
+ * header_size:         Size of this header in bytes
+ * benchmark_count:     Number of descriptors following the header
+ * descriptor_size:     Size of a descriptor in bytes
+ * timestamp:           Time of the export in seconds since the epoch
+ * hostname:            Name of the machine the benchmarks ran on
+ * env:                 Environment the benchmarks ran in
+ * has_machine:         Flag indicating if machine holds a characterization
+ * machine:             Machine characterization of the run, see machine.h
+ */
+typedef struct {
+  char magic[4];
+  uint16_t version;
+  uint16_t header_size;
+  uint32_t benchmark_count;
+  uint32_t descriptor_size;
+  uint64_t timestamp;
+  char hostname[64];
+  bench_bin_env_t env;
+  uint32_t has_machine;
+  uint32_t reserved;
+  bench_machine_t machine;
+} bench_bin_header_t;
+
+/**
+ * @brief Smallest valid header, that of files without run metadata.
+ */
+#define BENCH_BIN_HEADER_MIN_SIZE offsetof(bench_bin_header_t, env)
+
+/**
+ * @brief Location of a column in the file.
+ *
+ * offset:              Offset from the start of the file, 8 byte aligned
+ * size:                Size of the (encoded) column in bytes
+ * encoding:            One of bench_bin_encoding_t
+ */
+typedef struct {
+  uint64_t offset;
+  uint64_t size;
+  uint32_t encoding;
+  uint32_t reserved;
+} bench_bin_column_t;
+
+/**
+ * @brief Description of one benchmark, the descriptors follow the header.
+ *
+ * name:                Name of the benchmark, NUL terminated
+ * warmup_iterations:   Number of warmup iterations
+ * timed_iterations:    Number of timed iterations, i.e. values per column
+ * flags:               Combination of the BENCH_BIN_* flags
+ * samples:             Column of the timing samples (uint64_t)
+ * cache_miss_rates:    Column of the L1 cache miss rates (double)
+ * irq_counts:          Column of the interrupts during every sample
+ *                      (uint64_t), only valid with BENCH_BIN_IRQ_COUNTS
+ */
+typedef struct {
+  char name[BENCH_BIN_NAME_SIZE];
+  uint64_t warmup_iterations;
+  uint64_t timed_iterations;
+  uint32_t flags;
+  uint32_t reserved;
+  bench_bin_column_t samples;
+  bench_bin_column_t cache_miss_rates;
+  bench_bin_column_t irq_counts;
+} bench_bin_descriptor_t;
+
+/**
+ * @brief Smallest valid descriptor, that of files without interrupt counts.
+ */
+#define BENCH_BIN_DESCRIPTOR_MIN_SIZE                                          \
+  offsetof(bench_bin_descriptor_t, irq_counts)
+
+/**
+ * @brief Number of columns written per benchmark.
+ */
+#define BENCH_BIN_COLUMNS 3
+
+/**
+ * @brief Returns the number of bytes of a value encoded as LEB128 varint.
+ */
+static inline size_t bench_varint_size(uint64_t value) {
+  size_t n = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    n++;
+  }
+  return n;
+}
+
+/**
+ * @brief Returns the zigzag encoded difference of two consecutive values.
+ *
+ * Small positive and negative deltas map to small unsigned values, so they
+ * fit into short varints.
+ *
+ * @param current Value to encode
+ * @param previous Value preceding it in the column, 0 for the first one
+ * @return The delta mapped to 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+ */
+static inline uint64_t bench_zigzag(uint64_t current, uint64_t previous) {
+  int64_t delta = (int64_t)(current - previous);
+  return ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+}
+
+/**
+ * @brief Returns the size of a column of integers in delta encoding.
+ */
+static inline size_t bench_delta_size(const uint64_t *values, size_t count) {
+  size_t size = 0;
+  uint64_t previous = 0;
+  for (size_t i = 0; i < count; i++) {
+    size += bench_varint_size(bench_zigzag(values[i], previous));
+    previous = values[i];
+  }
+  return size;
+}
+
+/**
+ * @brief Encodes a column of integers as zigzag deltas and LEB128 varints.
+ *
+ * @param values Values to encode
+ * @param count Number of values
+ * @param out Destination of bench_delta_size() bytes
+ */
+static inline void bench_delta_encode(const uint64_t *values, size_t count,
+                                      uint8_t *out) {
+  uint64_t previous = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t value = bench_zigzag(values[i], previous);
+    previous = values[i];
+    while (value >= 0x80) {
+      *out++ = (uint8_t)(value | 0x80);
+      value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+  }
+}
+
+/**
+ * @brief Decodes a column of delta encoded integers.
+ *
+ * @param in Encoded column
+ * @param size Size of the encoded column in bytes
+ * @param out Destination of count values
+ * @param count Number of values
+ * @return false if the column is truncated or malformed
+ */
+static inline bool bench_delta_decode(const uint8_t *in, size_t size,
+                                      uint64_t *out, size_t count) {
+  const uint8_t *end = in + size;
+  uint64_t previous = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    uint64_t value = 0;
+    unsigned shift = 0;
+    for (;;) {
+      if (in == end || shift > 63)
+        return false;
+      uint8_t byte = *in++;
+      value |= (uint64_t)(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+        break;
+      shift += 7;
+    }
+    uint64_t delta = (value >> 1) ^ (0 - (value & 1));
+    previous += delta;
+    out[i] = previous;
+  }
+
+  return in == end;
+}
+
+/**
+ * @brief Encoded form of a column, prepared before the file is written.
+ */
+typedef struct {
+  const void *data;
+  void *owned;
+  bench_bin_column_t column;
+} bench_bin_encoded_t;
+
+/**
+ * @brief Encodes a column for writing.
+ *
+ * Columns without an applicable encoding, e.g. delta encoding of doubles or
+ * zstd in builds without it, are stored raw and point to values.
+ *
+ * @param encoded Destination of the encoded column, its owned buffer has to
+ * be freed after writing
+ * @param values Column of count uint64_t or double values
+ * @param count Number of values
+ * @param is_integer Flag indicating if the values are uint64_t
+ * @param encoding Requested encoding of the column
+ * @return false if out of memory or the compression failed
+ */
+static inline bool bench_bin_encode(bench_bin_encoded_t *encoded,
+                                    const void *values, size_t count,
+                                    bool is_integer,
+                                    bench_bin_encoding_t encoding) {
+  size_t raw_size = count * sizeof(uint64_t);
+
+  encoded->data = values;
+  encoded->owned = NULL;
+  encoded->column.size = raw_size;
+  encoded->column.encoding = BENCH_BIN_RAW;
+  encoded->column.reserved = 0;
+
+  if (encoding == BENCH_BIN_DELTA && is_integer) {
+    size_t size = bench_delta_size((const uint64_t *)values, count);
+    encoded->owned = malloc(size > 0 ? size : 1);
+    if (encoded->owned == NULL)
+      return false;
+    bench_delta_encode((const uint64_t *)values, count,
+                       (uint8_t *)encoded->owned);
+    encoded->data = encoded->owned;
+    encoded->column.size = size;
+    encoded->column.encoding = BENCH_BIN_DELTA;
+  }
+
+#ifdef PIBENCH_HAVE_ZSTD
+  if (encoding == BENCH_BIN_ZSTD) {
+    size_t bound = ZSTD_compressBound(raw_size);
+    encoded->owned = malloc(bound);
+    if (encoded->owned == NULL)
+      return false;
+    size_t size = ZSTD_compress(encoded->owned, bound, values, raw_size, 3);
+    if (ZSTD_isError(size)) {
+      free(encoded->owned);
+      encoded->owned = NULL;
+      return false;
+    }
+    encoded->data = encoded->owned;
+    encoded->column.size = size;
+    encoded->column.encoding = BENCH_BIN_ZSTD;
+  }
+#endif
+
+  return true;
+}
+
+/**
+ * @brief Copies a string into or out of a stored field.
+ *
+ * Stored fields of a damaged file may lack their terminator, so at most
+ * in_size bytes are read. Longer strings are truncated.
+ *
+ * @param out Destination of size bytes, always NUL terminated
+ * @param size Size of out
+ * @param in String to copy
+ * @param in_size Number of bytes of in that may be read
+ */
+static inline void bench_bin_copy_string(char *out, size_t size,
+                                         const char *in, size_t in_size) {
+  size_t len = strnlen(in, in_size);
+  if (len >= size)
+    len = size - 1;
+  memcpy(out, in, len);
+  out[len] = '\0';
+}
+
+/**
+ * @brief Copies the environment of the run into its stored form.
+ */
+static inline void bench_bin_store_env(bench_bin_env_t *out,
+                                       const bench_env_t *env) {
+  memset(out, 0, sizeof(*out));
+#define BENCH_BIN_STORE(field)                                                 \
+  bench_bin_copy_string(out->field, sizeof(out->field), env->field,            \
+                        sizeof(out->field))
+  BENCH_BIN_STORE(hostname);
+  BENCH_BIN_STORE(kernel);
+  BENCH_BIN_STORE(kernel_version);
+  BENCH_BIN_STORE(arch);
+  BENCH_BIN_STORE(cpu_model);
+  BENCH_BIN_STORE(board);
+  BENCH_BIN_STORE(governor);
+  BENCH_BIN_STORE(clocksource);
+  BENCH_BIN_STORE(cycle_counter);
+  BENCH_BIN_STORE(compiler);
+  BENCH_BIN_STORE(cflags);
+  BENCH_BIN_STORE(git_sha);
+#undef BENCH_BIN_STORE
+
+  out->cpu_count = env->cpu_count;
+  out->temperature = env->temperature;
+  memcpy(out->cur_freq_mhz, env->cur_freq_mhz, sizeof(out->cur_freq_mhz));
+  out->min_freq_mhz = env->min_freq_mhz;
+  out->max_freq_mhz = env->max_freq_mhz;
+  out->cycle_counter_hz = env->cycle_counter_hz;
+  out->timestamp = env->timestamp;
+}
+
+/**
+ * @brief Writes benchmark results to a binary result file.
+ *
+ * The file consists of a bench_bin_header_t with the environment of the run,
+ * one bench_bin_descriptor_t per benchmark and the columns of all benchmarks,
+ * each aligned to 8 bytes. All values are stored in the native (little
+ * endian) byte order.
+ *
+ * @param benchmarks Array of benchmarks to export
+ * @param num Number of benchmarks
+ * @param path Path of the result file
+ * @param encoding Encoding of the columns, BENCH_BIN_DELTA only applies to
+ * the integer samples, BENCH_BIN_ZSTD requires PIBENCH_HAVE_ZSTD
+ * @return true on success, false on error
+ */
+static inline bool to_binary(benchmark_t **benchmarks, size_t num,
+                             const char *path, bench_bin_encoding_t encoding) {
+#ifndef PIBENCH_HAVE_ZSTD
+  if (encoding == BENCH_BIN_ZSTD) {
+    fprintf(stderr, "Warning: Built without zstd, writing raw columns\n");
+    encoding = BENCH_BIN_RAW;
+  }
+#endif
+
+  size_t column_count = num * BENCH_BIN_COLUMNS;
+  bench_bin_encoded_t *columns = (bench_bin_encoded_t *)calloc(
+      column_count > 0 ? column_count : 1, sizeof(bench_bin_encoded_t));
+  if (columns == NULL) {
+    fprintf(stderr, "Error: Could not allocate memory for the columns\n");
+    return false;
+  }
+
+  bool success = true;
+  uint64_t offset =
+      sizeof(bench_bin_header_t) + num * sizeof(bench_bin_descriptor_t);
+
+  for (size_t i = 0; i < num && success; i++) {
+    benchmark_result_t *results = benchmarks[i]->results;
+    size_t count = benchmarks[i]->timed_iterations;
+    bench_bin_encoded_t *column = &columns[BENCH_BIN_COLUMNS * i];
+
+    success = bench_bin_encode(&column[0], results->samples, count, true,
+                               encoding) &&
+              bench_bin_encode(&column[1], results->cache_miss_rates, count,
+                               false, encoding);
+    if (success && results->irq_counts != NULL)
+      success = bench_bin_encode(&column[2], results->irq_counts, count, true,
+                                 encoding);
+
+    for (size_t c = 0; c < BENCH_BIN_COLUMNS && success; c++) {
+      if (column[c].data == NULL)
+        continue;
+      offset = (offset + 7) & ~(uint64_t)7;
+      column[c].column.offset = offset;
+      offset += column[c].column.size;
+    }
+  }
+
+  bench_writer_t writer;
+  if (success && !bench_writer_init(&writer)) {
+    fprintf(stderr, "Error: Could not allocate memory for the writer\n");
+    success = false;
+  } else if (success) {
+    int flags = BENCH_WRITER_PREALLOCATE;
+    if (bench_options.direct_io)
+      flags |= BENCH_WRITER_DIRECT;
+
+    if (!bench_writer_open(&writer, path, flags, offset)) {
+      fprintf(stderr, "Error: Could not open file %s for writing\n", path);
+      bench_writer_free(&writer);
+      success = false;
+    }
+  }
+
+  if (success) {
+    bench_bin_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BENCH_BIN_MAGIC, sizeof(header.magic));
+    header.version = BENCH_BIN_VERSION;
+    header.header_size = sizeof(bench_bin_header_t);
+    header.benchmark_count = (uint32_t)num;
+    header.descriptor_size = sizeof(bench_bin_descriptor_t);
+    header.timestamp = (uint64_t)time(NULL);
+    gethostname(header.hostname, sizeof(header.hostname) - 1);
+    bench_env_t env;
+    bench_env_collect(&env);
+    bench_bin_store_env(&header.env, &env);
+    header.has_machine = bench_machine_load(&header.machine);
+    bench_writer_put(&writer, (const char *)&header, sizeof(header));
+
+    for (size_t i = 0; i < num; i++) {
+      benchmark_t *benchmark = benchmarks[i];
+      bench_bin_descriptor_t descriptor;
+      memset(&descriptor, 0, sizeof(descriptor));
+
+      strncpy(descriptor.name, benchmark->name, BENCH_BIN_NAME_SIZE - 1);
+      descriptor.warmup_iterations = benchmark->warmup_iterations;
+      descriptor.timed_iterations = benchmark->timed_iterations;
+      descriptor.flags =
+          (benchmark->is_baseline ? BENCH_BIN_BASELINE : 0) |
+          (benchmark->validate ? BENCH_BIN_VALIDATED : 0) |
+          (benchmark->is_valid ? BENCH_BIN_VALID : 0) |
+          (benchmark->results->is_cycles ? BENCH_BIN_CYCLES
+                                         : BENCH_BIN_NANOSECONDS) |
+          (benchmark->results->irq_counts != NULL ? BENCH_BIN_IRQ_COUNTS : 0);
+      descriptor.samples = columns[BENCH_BIN_COLUMNS * i].column;
+      descriptor.cache_miss_rates = columns[BENCH_BIN_COLUMNS * i + 1].column;
+      descriptor.irq_counts = columns[BENCH_BIN_COLUMNS * i + 2].column;
+      bench_writer_put(&writer, (const char *)&descriptor, sizeof(descriptor));
+    }
+
+    static const char padding[8] = {0};
+    uint64_t position =
+        sizeof(bench_bin_header_t) + num * sizeof(bench_bin_descriptor_t);
+    for (size_t c = 0; c < column_count; c++) {
+      if (columns[c].data == NULL)
+        continue;
+      bench_writer_put(&writer, padding,
+                       (size_t)(columns[c].column.offset - position));
+      bench_writer_put(&writer, (const char *)columns[c].data,
+                       (size_t)columns[c].column.size);
+      position = columns[c].column.offset + columns[c].column.size;
+    }
+
+    if (!bench_writer_close(&writer)) {
+      fprintf(stderr, "Error: Could not write file %s\n", path);
+      success = false;
+    }
+    bench_writer_free(&writer);
+  }
+
+  for (size_t c = 0; c < column_count; c++)
+    free(columns[c].owned);
+  free(columns);
+
+  return success;
+}
+
+/**
+ * @brief Structure of a memory-mapped binary result file.
+ *
+ * map:                 Start of the mapping
+ * length:              Length of the mapping in bytes
+ * header:              Header of the file
+ */
+typedef struct {
+  const uint8_t *map;
+  size_t length;
+  const bench_bin_header_t *header;
+} bench_bin_reader_t;
+
+/**
+ * @brief Returns the column of the interrupt counts of a benchmark.
+ *
+ * @param reader Reader of the file
+ * @param descriptor Descriptor of the benchmark
+ * @return The column, NULL if the interrupts were not counted or the file
+ * predates the column
+ */
+static inline const bench_bin_column_t *
+bench_bin_irq_column(const bench_bin_reader_t *reader,
+                     const bench_bin_descriptor_t *descriptor) {
+  if (reader->header->descriptor_size < sizeof(bench_bin_descriptor_t) ||
+      (descriptor->flags & BENCH_BIN_IRQ_COUNTS) == 0)
+    return NULL;
+  return &descriptor->irq_counts;
+}
+
+/**
+ * @brief Maps a binary result file and checks its header and descriptors.
+ *
+ * @param reader Reader to initialize
+ * @param path Path of the result file
+ * @return true on success, false if the file is missing or malformed
+ */
+static inline bool bench_bin_open(bench_bin_reader_t *reader,
+                                  const char *path) {
+  reader->map = NULL;
+  reader->length = 0;
+  reader->header = NULL;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Could not open file %s\n", path);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < BENCH_BIN_HEADER_MIN_SIZE) {
+    fprintf(stderr, "Error: %s is not a result file\n", path);
+    close(fd);
+    return false;
+  }
+
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Error: Could not map file %s\n", path);
+    return false;
+  }
+
+  reader->map = (const uint8_t *)map;
+  reader->length = (size_t)st.st_size;
+  reader->header = (const bench_bin_header_t *)map;
+
+  const bench_bin_header_t *header = reader->header;
+  bool valid = memcmp(header->magic, BENCH_BIN_MAGIC, 4) == 0 &&
+               header->version >= 1 && header->version <= BENCH_BIN_VERSION &&
+               header->header_size >= BENCH_BIN_HEADER_MIN_SIZE &&
+               header->descriptor_size >= BENCH_BIN_DESCRIPTOR_MIN_SIZE &&
+               header->header_size % 8 == 0 &&
+               header->descriptor_size % 8 == 0;
+
+  uint64_t table_end =
+      header->header_size +
+      (uint64_t)header->benchmark_count * header->descriptor_size;
+  valid = valid && table_end <= reader->length;
+
+  for (uint32_t i = 0; valid && i < header->benchmark_count; i++) {
+    const bench_bin_descriptor_t *d =
+        (const bench_bin_descriptor_t *)(reader->map + header->header_size +
+                                         (uint64_t)i *
+                                             header->descriptor_size);
+    const bench_bin_column_t *columns[] = {&d->samples, &d->cache_miss_rates,
+                                           bench_bin_irq_column(reader, d)};
+    for (size_t c = 0; c < BENCH_BIN_COLUMNS; c++) {
+      if (columns[c] == NULL)
+        continue;
+      valid = valid && columns[c]->offset % 8 == 0 &&
+              columns[c]->offset <= reader->length &&
+              columns[c]->size <= reader->length - columns[c]->offset;
+      if (columns[c]->encoding == BENCH_BIN_RAW)
+        valid = valid &&
+                columns[c]->size == d->timed_iterations * sizeof(uint64_t);
+    }
+    valid = valid && memchr(d->name, '\0', BENCH_BIN_NAME_SIZE) != NULL;
+  }
+
+  if (!valid) {
+    fprintf(stderr, "Error: %s is not a valid result file\n", path);
+    munmap(map, reader->length);
+    reader->map = NULL;
+    reader->header = NULL;
+    return false;
+  }
+
+  madvise(map, reader->length, MADV_WILLNEED);
+  return true;
+}
+
+/**
+ * @brief Returns the number of benchmarks in a result file.
+ */
+static inline size_t bench_bin_count(const bench_bin_reader_t *reader) {
+  return reader->header->benchmark_count;
+}
+
+/**
+ * @brief Reads the environment the benchmarks of a result file ran in.
+ *
+ * @param reader Open reader
+ * @param env Receives the environment, cycle_counter, compiler, cflags and
+ * git_sha point into storage, which has to outlive env
+ * @param storage Strings of env that bench_env_t does not hold itself
+ * @return false if the file was written without run metadata
+ */
+static inline bool bench_bin_env(const bench_bin_reader_t *reader,
+                                 bench_env_t *env, bench_bin_env_t *storage) {
+  const bench_bin_header_t *header = reader->header;
+  if (header->header_size < sizeof(bench_bin_header_t))
+    return false;
+
+  const bench_bin_env_t *stored = &header->env;
+  memset(env, 0, sizeof(*env));
+  memset(storage, 0, sizeof(*storage));
+#define BENCH_BIN_LOAD(out, field)                                             \
+  bench_bin_copy_string((out)->field, sizeof((out)->field), stored->field,     \
+                        sizeof(stored->field))
+  BENCH_BIN_LOAD(env, hostname);
+  BENCH_BIN_LOAD(env, kernel);
+  BENCH_BIN_LOAD(env, kernel_version);
+  BENCH_BIN_LOAD(env, arch);
+  BENCH_BIN_LOAD(env, cpu_model);
+  BENCH_BIN_LOAD(env, board);
+  BENCH_BIN_LOAD(env, governor);
+  BENCH_BIN_LOAD(env, clocksource);
+  BENCH_BIN_LOAD(storage, cycle_counter);
+  BENCH_BIN_LOAD(storage, compiler);
+  BENCH_BIN_LOAD(storage, cflags);
+  BENCH_BIN_LOAD(storage, git_sha);
+#undef BENCH_BIN_LOAD
+
+  env->cycle_counter = storage->cycle_counter;
+  env->compiler = storage->compiler;
+  env->cflags = storage->cflags;
+  env->git_sha = storage->git_sha;
+  env->cpu_count = stored->cpu_count;
+  env->temperature = stored->temperature;
+  memcpy(env->cur_freq_mhz, stored->cur_freq_mhz, sizeof(env->cur_freq_mhz));
+  env->min_freq_mhz = stored->min_freq_mhz;
+  env->max_freq_mhz = stored->max_freq_mhz;
+  env->cycle_counter_hz = stored->cycle_counter_hz;
+  env->timestamp = stored->timestamp;
+  return true;
+}
+
+/**
+ * @brief Reads the machine characterization of the run of a result file.
+ *
+ * @param reader Open reader
+ * @param machine Receives the characterization
+ * @return false if the run had none or the file has no run metadata
+ */
+static inline bool bench_bin_machine(const bench_bin_reader_t *reader,
+                                     bench_machine_t *machine) {
+  const bench_bin_header_t *header = reader->header;
+  if (header->header_size < sizeof(bench_bin_header_t) ||
+      !header->has_machine ||
+      header->machine.latency_count > BENCH_MACHINE_MAX_LEVELS ||
+      header->machine.scaling_count > BENCH_MACHINE_MAX_THREADS)
+    return false;
+
+  *machine = header->machine;
+  return true;
+}
+
+/**
+ * @brief Returns the descriptor of a benchmark.
+ *
+ * @param reader Open reader
+ * @param index Index of the benchmark, smaller than bench_bin_count()
+ * @return Pointer into the mapping
+ */
+static inline const bench_bin_descriptor_t *
+bench_bin_descriptor(const bench_bin_reader_t *reader, size_t index) {
+  return (const bench_bin_descriptor_t *)(reader->map +
+                                          reader->header->header_size +
+                                          index *
+                                              reader->header->descriptor_size);
+}
+
+/**
+ * @brief Returns a raw column without copying.
+ *
+ * @return Pointer into the mapping, NULL if the column is encoded
+ */
+static inline const void *bench_bin_view(const bench_bin_reader_t *reader,
+                                         const bench_bin_column_t *column) {
+  if (column->encoding != BENCH_BIN_RAW)
+    return NULL;
+  return reader->map + column->offset;
+}
+
+/**
+ * @brief Returns the timing samples of a benchmark without copying.
+ *
+ * @return Pointer to timed_iterations values, NULL if the column is encoded
+ */
+static inline const uint64_t *
+bench_bin_samples_view(const bench_bin_reader_t *reader, size_t index) {
+  return (const uint64_t *)bench_bin_view(
+      reader, &bench_bin_descriptor(reader, index)->samples);
+}
+
+/**
+ * @brief Returns the cache miss rates of a benchmark without copying.
+ *
+ * @return Pointer to timed_iterations values, NULL if the column is encoded
+ */
+static inline const double *
+bench_bin_cmr_view(const bench_bin_reader_t *reader, size_t index) {
+  return (const double *)bench_bin_view(
+      reader, &bench_bin_descriptor(reader, index)->cache_miss_rates);
+}
+
+/**
+ * @brief Decodes a column of any encoding into a buffer.
+ *
+ * @param reader Open reader
+ * @param column Column to decode
+ * @param count Number of values in the column
+ * @param out Destination of count 8 byte values
+ * @return false if the column is malformed or its encoding is not supported
+ */
+static inline bool bench_bin_read(const bench_bin_reader_t *reader,
+                                  const bench_bin_column_t *column,
+                                  size_t count, void *out) {
+  const uint8_t *data = reader->map + column->offset;
+
+  switch (column->encoding) {
+  case BENCH_BIN_RAW:
+    memcpy(out, data, count * sizeof(uint64_t));
+    return true;
+  case BENCH_BIN_DELTA:
+    return bench_delta_decode(data, (size_t)column->size, (uint64_t *)out,
+                              count);
+#ifdef PIBENCH_HAVE_ZSTD
+  case BENCH_BIN_ZSTD: {
+    size_t size = ZSTD_decompress(out, count * sizeof(uint64_t), data,
+                                  (size_t)column->size);
+    return !ZSTD_isError(size) && size == count * sizeof(uint64_t);
+  }
+#endif
+  default:
+    fprintf(stderr, "Error: Unsupported column encoding %u\n",
+            column->encoding);
+    return false;
+  }
+}
+
+/**
+ * @brief Releases the mapping of a reader.
+ */
+static inline void bench_bin_close(bench_bin_reader_t *reader) {
+  if (reader->map != NULL)
+    munmap((void *)reader->map, reader->length);
+
+  reader->map = NULL;
+  reader->length = 0;
+  reader->header = NULL;
+}
+
+#endif // BINARY_H
@@ -0,0 +1,581 @@
+#ifndef CLI_H
+#define CLI_H
+
+#include "./alloc.h"
+#include "./api.h"
+#include "./numa.h"
+#include <regex.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Output formats supported by the result exporter.
+ */
+typedef enum {
+  BENCH_FORMAT_CSV,
+  BENCH_FORMAT_JSON,
+  BENCH_FORMAT_BINARY,
+  BENCH_FORMAT_NDJSON,
+} bench_format_t;
+
+/**
+ * @brief Encodings of a column.
+ *
+ * BENCH_BIN_RAW:       Little endian array, readable without copying
+ * BENCH_BIN_DELTA:     Zigzag deltas of consecutive values as LEB128 varints
+ *                      (integer columns only)
+ * BENCH_BIN_ZSTD:      Raw array compressed with zstd
+ */
+typedef enum {
+  BENCH_BIN_RAW = 0,
+  BENCH_BIN_DELTA = 1,
+  BENCH_BIN_ZSTD = 2,
+} bench_bin_encoding_t;
+
+/**
+ * @brief How the output of a baseline is kept to validate other benchmarks.
+ *
+ * BENCH_GT_COPY keeps a full copy of the output, BENCH_GT_HASH only keeps
+ * CRC32C hashes of it, which limits validation to bit-exact comparison.
+ */
+typedef enum {
+  BENCH_GT_COPY,
+  BENCH_GT_HASH,
+} bench_gt_mode_t;
+
+/**
+ * @brief Metrics the summary of print_results() can be sorted by.
+ *
+ * BENCH_SORT_MEDIAN:     Median time
+ * BENCH_SORT_P99:        99th percentile of the time
+ * BENCH_SORT_THROUGHPUT: Bytes of output (or calls) per time unit
+ * BENCH_SORT_CMR:        Median L1 cache miss rate
+ * BENCH_SORT_ENERGY:     Joules per call, needs --energy
+ */
+typedef enum {
+  BENCH_SORT_MEDIAN,
+  BENCH_SORT_P99,
+  BENCH_SORT_THROUGHPUT,
+  BENCH_SORT_CMR,
+  BENCH_SORT_ENERGY,
+} bench_sort_key_t;
+
+/**
+ * @brief Cluster a core is selected from on heterogeneous (big.LITTLE) SoCs.
+ */
+typedef enum {
+  BENCH_CLUSTER_ANY,
+  BENCH_CLUSTER_BIG,
+  BENCH_CLUSTER_LITTLE,
+} bench_cluster_t;
+
+/**
+ * @brief Treatment of the SMT siblings of a pinned benchmark's core.
+ *
+ * BENCH_SMT_IGNORE:      Siblings keep running
+ * BENCH_SMT_VERIFY:      Automatic selection skips cores with busy siblings
+ * BENCH_SMT_PARK:        Siblings are also taken offline during pinned runs
+ */
+typedef enum {
+  BENCH_SMT_IGNORE,
+  BENCH_SMT_VERIFY,
+  BENCH_SMT_PARK,
+} bench_smt_t;
+
+/**
+ * @brief Core argument of a pinned benchmark selecting the quietest core.
+ */
+#define BENCH_CORE_AUTO (-1)
+
+/**
+ * @brief Value of the core option when --core was not given.
+ */
+#define BENCH_CORE_UNSET (-2)
+
+/**
+ * @brief Default number of samples per block of an interleaved run.
+ */
+#define BENCH_INTERLEAVE_BLOCK 10
+
+/**
+ * @brief Structure holding the runtime options of a benchmark binary.
+ *
+ * filter:              Extended regular expression selecting benchmarks by name
+ * list:                Only list the selected benchmarks, do not run them
+ * help:                Usage was requested, the program should exit
+ * samples:             Overrides the number of timed iterations (0 = default)
+ * repetitions:         Independent runs of every benchmark, reported with
+ *                      their spread (0 or 1 = a single run)
+ * min_time:            Minimum time in seconds the timed iterations should take
+ * format:              Format used when exporting the results
+ * out:                 Output directory (CSV) or file (other formats)
+ * ground_truth:        How the output of a baseline is kept
+ * gt_chunk_size:       Bytes covered by each hash of a hashed ground truth
+ * direct_io:           Write CSV files with O_DIRECT, bypassing the page cache
+ * encoding:            Encoding of the columns of binary result files
+ * history:             Directory of the result history, NULL = disabled
+ * compare_runs:        Compare against the last n runs of the history
+ * compare_tag:         Compare against the last run with this tag
+ * threshold:           Slowdown in percent that counts as a regression
+ * tag:                 Tag stored with the results of this run
+ * interleave:          Samples per block of an interleaved run, 0 = disabled
+ * seed:                Seed of the interleaving order, 0 = random
+ * sort_key:            Metric the summary is sorted by
+ * sort_ascending:      Sort the summary ascending instead of descending
+ * show_invalid:        Include benchmarks that failed validation in the summary
+ * core:                Core of all pinned benchmarks, BENCH_CORE_AUTO or
+ *                      BENCH_CORE_UNSET to use the core of each benchmark
+ * cluster:             Cluster the automatic core selection chooses from
+ * smt:                 Treatment of the SMT siblings of the benchmark core
+ * irq_shield:          Steer interrupts away from the core of pinned benchmarks
+ *                      and count the interrupts of every sample
+ * pages:               BENCH_ALLOC_* flags of the output buffers allocated by
+ *                      setup_benchmark()
+ * numa:                Placement of the buffers relative to the benchmark core
+ * machine:             Machine characterization embedded in the reports, NULL
+ *                      for the default path, see bench_machine_path()
+ * energy:              Measure the energy of the timed iterations
+ * energy_domain:       RAPL domain or hwmon device to measure, NULL for the
+ *                      packages or all power sensors
+ */
+typedef struct {
+  const char *filter;
+  bool list;
+  bool help;
+  size_t samples;
+  size_t repetitions;
+  double min_time;
+  bench_format_t format;
+  const char *out;
+  bench_gt_mode_t ground_truth;
+  size_t gt_chunk_size;
+  bool direct_io;
+  bench_bin_encoding_t encoding;
+  const char *history;
+  size_t compare_runs;
+  const char *compare_tag;
+  double threshold;
+  const char *tag;
+  size_t interleave;
+  unsigned long long seed;
+  bench_sort_key_t sort_key;
+  bool sort_ascending;
+  bool show_invalid;
+  int core;
+  bench_cluster_t cluster;
+  bench_smt_t smt;
+  bool irq_shield;
+  int pages;
+  bench_numa_mode_t numa;
+  const char *machine;
+  bool energy;
+  const char *energy_domain;
+
+  regex_t filter_regex;
+  bool has_filter;
+} bench_options_t;
+
+/**
+ * @brief Global benchmark options.
+ *
+ * Defaults to running every benchmark with the compiled-in iteration counts.
+ * Filled in by bench_parse_args().
+ */
+PIBENCH_STATE bench_options_t bench_options PIBENCH_INIT({
+    .filter = NULL,
+    .list = false,
+    .help = false,
+    .samples = 0,
+    .repetitions = 0,
+    .min_time = 0.0,
+    .format = BENCH_FORMAT_CSV,
+    .out = NULL,
+    .ground_truth = BENCH_GT_COPY,
+    .gt_chunk_size = 64 * 1024,
+    .direct_io = false,
+    .encoding = BENCH_BIN_RAW,
+    .history = NULL,
+    .compare_runs = 0,
+    .compare_tag = NULL,
+    .threshold = 5.0,
+    .tag = NULL,
+    .interleave = 0,
+    .seed = 0,
+    .sort_key = BENCH_SORT_MEDIAN,
+    .sort_ascending = false,
+    .show_invalid = false,
+    .core = BENCH_CORE_UNSET,
+    .cluster = BENCH_CLUSTER_ANY,
+    .smt = BENCH_SMT_VERIFY,
+    .irq_shield = false,
+    .pages = BENCH_ALLOC_DEFAULT,
+    .numa = BENCH_NUMA_DEFAULT,
+    .machine = NULL,
+    .energy = false,
+    .energy_domain = NULL,
+    .filter_regex = PIBENCH_ZERO,
+    .has_filter = false,
+});
+
+/**
+ * @brief Prints the command line usage of a benchmark binary.
+ *
+ * @param prog Name of the program (usually argv[0])
+ */
+static inline void bench_print_usage(const char *prog) {
+  printf("Usage: %s [options]\n"
+         "\n"
+         "Options:\n"
+         "  --filter=<regex>     Only run benchmarks whose name matches regex\n"
+         "  --list               List the selected benchmarks and exit\n"
+         "  --samples=<n>        Number of timed iterations per benchmark\n"
+         "  --repetitions=<n>    Run every benchmark n times and report the\n"
+         "                       spread of the runs\n"
+         "  --min-time=<s>       Run timed iterations for at least s seconds\n"
+         "  --format=csv|json|ndjson|binary\n"
+         "                       Format of the exported results\n"
+         "  --out=<path>         Output directory (csv) or file\n"
+         "  --encoding=raw|delta|zstd\n"
+         "                       Encoding of the columns of binary results\n"
+         "  --ground-truth=copy|hash\n"
+         "                       Keep a copy or hashes of the baseline output\n"
+         "  --gt-chunk=<bytes>   Bytes per ground truth hash (0 = one hash)\n"
+         "  --direct-io          Write csv files with O_DIRECT\n"
+         "  --history=<dir>      Record results in a history store\n"
+         "  --compare=<n>        Compare against the last n recorded runs\n"
+         "  --compare-tag=<tag>  Compare against the last run tagged tag\n"
+         "  --threshold=<pct>    Slowdown counted as regression (default 5)\n"
+         "  --tag=<tag>          Tag the recorded results\n"
+         "  --interleave[=<n>]   Alternate blocks of n samples (default 10)\n"
+         "                       between the benchmarks in random order\n"
+         "  --seed=<n>           Seed of the interleaving order\n"
+         "  --sort=median|p99|throughput|cmr|energy\n"
+         "                       Metric the summary is sorted by\n"
+         "  --order=asc|desc     Sort order of the summary (default desc)\n"
+         "  --show-invalid       Include invalid results in the summary\n"
+         "  --core=<n>|auto      Core of all pinned benchmarks, auto picks\n"
+         "                       the quietest core\n"
+         "  --cluster=big|little|any\n"
+         "                       Cluster the automatic core is picked from\n"
+         "  --smt=ignore|verify|park\n"
+         "                       Skip cores with busy SMT siblings (verify,\n"
+         "                       default) or take the siblings offline (park)\n"
+         "  --irq-shield         Steer interrupts away from the core of\n"
+         "                       pinned benchmarks, count them per sample\n"
+         "  --pages=default|small|thp|2m|1g\n"
+         "                       Pages of the output buffers allocated by\n"
+         "                       the harness\n"
+         "  --numa=default|local|remote|interleave|sweep\n"
+         "                       Place the buffers relative to the core,\n"
+         "                       sweep runs every placement\n"
+         "  --machine=<file>     Machine characterization of the reports,\n"
+         "                       written by machine-bench\n"
+         "  --energy[=<domain>]  Measure joules per call with RAPL or hwmon,\n"
+         "                       domain e.g. dram or ina219\n"
+         "  --help               Show this help message\n",
+         prog);
+}
+
+/**
+ * @brief Returns the value of a "--key=value" argument.
+ *
+ * @param arg The command line argument
+ * @param key The option name including the leading dashes
+ * @return Pointer to the value, or NULL if arg is not the given option
+ */
+static inline const char *bench_arg_value(const char *arg, const char *key) {
+  size_t len = strlen(key);
+  if (strncmp(arg, key, len) != 0 || arg[len] != '=')
+    return NULL;
+  return arg + len + 1;
+}
+
+/**
+ * @brief Parses the command line arguments into an options structure.
+ *
+ * Unknown arguments are reported as errors, so typos in option names do not
+ * silently run the whole suite.
+ *
+ * @param argc Argument count as passed to main()
+ * @param argv Argument vector as passed to main()
+ * @param options Options structure to fill in
+ * @return true on success, false if an argument is invalid
+ *
+ * @note The filter is compiled as a POSIX extended regular expression
+ */
+static inline bool bench_parse_args(int argc, char **argv,
+                                    bench_options_t *options) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value;
+
+    if (strcmp(arg, "--list") == 0) {
+      options->list = true;
+    } else if (strcmp(arg, "--direct-io") == 0) {
+      options->direct_io = true;
+    } else if (strcmp(arg, "--interleave") == 0) {
+      options->interleave = BENCH_INTERLEAVE_BLOCK;
+    } else if (strcmp(arg, "--show-invalid") == 0) {
+      options->show_invalid = true;
+    } else if (strcmp(arg, "--irq-shield") == 0) {
+      options->irq_shield = true;
+    } else if (strcmp(arg, "--energy") == 0) {
+      options->energy = true;
+    } else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+      options->help = true;
+    } else if ((value = bench_arg_value(arg, "--filter")) != NULL) {
+      if (options->has_filter) {
+        regfree(&options->filter_regex);
+        options->has_filter = false;
+      }
+      int err =
+          regcomp(&options->filter_regex, value, REG_EXTENDED | REG_NOSUB);
+      if (err != 0) {
+        char msg[256];
+        regerror(err, &options->filter_regex, msg, sizeof(msg));
+        fprintf(stderr, "Error: Invalid filter '%s': %s\n", value, msg);
+        return false;
+      }
+      options->filter = value;
+      options->has_filter = true;
+    } else if ((value = bench_arg_value(arg, "--samples")) != NULL) {
+      char *end;
+      unsigned long long samples = strtoull(value, &end, 10);
+      if (*value == '\0' || *end != '\0' || samples == 0) {
+        fprintf(stderr, "Error: Invalid samples '%s'\n", value);
+        return false;
+      }
+      options->samples = (size_t)samples;
+    } else if ((value = bench_arg_value(arg, "--repetitions")) != NULL) {
+      char *end;
+      unsigned long long repetitions = strtoull(value, &end, 10);
+      if (*value == '\0' || *end != '\0' || repetitions == 0) {
+        fprintf(stderr, "Error: Invalid repetitions '%s'\n", value);
+        return false;
+      }
+      options->repetitions = (size_t)repetitions;
+    } else if ((value = bench_arg_value(arg, "--min-time")) != NULL) {
+      char *end;
+      double min_time = strtod(value, &end);
+      if (*value == '\0' || (*end != '\0' && strcmp(end, "s") != 0) ||
+          min_time < 0.0) {
+        fprintf(stderr, "Error: Invalid min-time '%s'\n", value);
+        return false;
+      }
+      options->min_time = min_time;
+    } else if ((value = bench_arg_value(arg, "--format")) != NULL) {
+      if (strcmp(value, "csv") == 0) {
+        options->format = BENCH_FORMAT_CSV;
+      } else if (strcmp(value, "json") == 0) {
+        options->format = BENCH_FORMAT_JSON;
+      } else if (strcmp(value, "ndjson") == 0) {
+        options->format = BENCH_FORMAT_NDJSON;
+      } else if (strcmp(value, "binary") == 0) {
+        options->format = BENCH_FORMAT_BINARY;
+      } else {
+        fprintf(stderr, "Error: Unknown format '%s'\n", value);
+        return false;
+      }
+    } else if ((value = bench_arg_value(arg, "--out")) != NULL) {
+      options->out = value;
+    } else if ((value = bench_arg_value(arg, "--encoding")) != NULL) {
+      if (strcmp(value, "raw") == 0) {
+        options->encoding = BENCH_BIN_RAW;
+      } else if (strcmp(value, "delta") == 0) {
+        options->encoding = BENCH_BIN_DELTA;
+      } else if (strcmp(value, "zstd") == 0) {
+        options->encoding = BENCH_BIN_ZSTD;
+      } else {
+        fprintf(stderr, "Error: Unknown encoding '%s'\n", value);
+        return false;
+      }
+    } else if ((value = bench_arg_value(arg, "--history")) != NULL) {
+      options->history = value;
+    } else if ((value = bench_arg_value(arg, "--compare")) != NULL) {
+      char *end;
+      unsigned long long runs = strtoull(value, &end, 10);
+      if (*value == '\0' || *end != '\0' || runs == 0) {
+        fprintf(stderr, "Error: Invalid number of runs '%s'\n", value);
+        return false;
+      }
+      options->compare_runs = (size_t)runs;
+    } else if ((value = bench_arg_value(arg, "--compare-tag")) != NULL) {
+      options->compare_tag = value;
+    } else if ((value = bench_arg_value(arg, "--threshold")) != NULL) {
+      char *end;
+      double threshold = strtod(value, &end);
+      if (*value == '\0' || (*end != '\0' && strcmp(end, "%") != 0) ||
+          threshold < 0.0) {
+        fprintf(stderr, "Error: Invalid threshold '%s'\n", value);
+        return false;
+      }
+      options->threshold = threshold;
+    } else if ((value = bench_arg_value(arg, "--tag")) != NULL) {
+      options->tag = value;
+    } else if ((value = bench_arg_value(arg, "--interleave")) != NULL) {
+      char *end;
+      unsigned long long block = strtoull(value, &end, 10);
+      if (*value == '\0' || *end != '\0' || block == 0) {
+        fprintf(stderr, "Error: Invalid interleave block size '%s'\n", value);
+        return false;
+      }
+      options->interleave = (size_t)block;
+    } else if ((value = bench_arg_value(arg, "--sort")) != NULL) {
+      if (strcmp(value, "median") == 0) {
+        options->sort_key = BENCH_SORT_MEDIAN;
+      } else if (strcmp(value, "p99") == 0) {
+        options->sort_key = BENCH_SORT_P99;
+      } else if (strcmp(value, "throughput") == 0) {
+        options->sort_key = BENCH_SORT_THROUGHPUT;
+      } else if (strcmp(value, "cmr") == 0) {
+        options->sort_key = BENCH_SORT_CMR;
+      } else if (strcmp(value, "energy") == 0) {
+        options->sort_key = BENCH_SORT_ENERGY;
+      } else {
+        fprintf(stderr, "Error: Unknown sort metric '%s'\n", value);
+        return false;
+      }
+    } else if ((value = bench_arg_value(arg, "--order")) != NULL) {
+      if (strcmp(value, "asc") == 0) {
+        options->sort_ascending = true;
+      } else if (strcmp(value, "desc") == 0) {
+        options->sort_ascending = false;
+      } else {
+        fprintf(stderr, "Error: Unknown sort order '%s'\n", value);
+        return false;
+      }
+    } else if ((value = bench_arg_value(arg, "--seed")) != NULL) {
+      char *end;
+      unsigned long long seed = strtoull(value, &end, 0);
+      if (*value == '\0' || *end != '\0') {
+        fprintf(stderr, "Error: Invalid seed '%s'\n", value);
+        return false;
+      }
+      options->seed = seed;
+    } else if ((value = bench_arg_value(arg, "--ground-truth")) != NULL) {
+      if (strcmp(value, "copy") == 0) {
+        options->ground_truth = BENCH_GT_COPY;
+      } else if (strcmp(value, "hash") == 0) {
+        options->ground_truth = BENCH_GT_HASH;
+      } else {
+        fprintf(stderr, "Error: Unknown ground truth mode '%s'\n", value);
+        return false;
+      }
+    } else if ((value = bench_arg_value(arg, "--gt-chunk")) != NULL) {
+      char *end;
+      unsigned long long chunk_size = strtoull(value, &end, 10);
+      if (*value == '\0' || *end != '\0') {
+        fprintf(stderr, "Error: Invalid ground truth chunk size '%s'\n", value);
+        return false;
+      }
+      options->gt_chunk_size = (size_t)chunk_size;
+    } else if ((value = bench_arg_value(arg, "--core")) != NULL) {
+      char *end;
+      long core = strtol(value, &end, 10);
+      if (strcmp(value, "auto") == 0) {
+        options->core = BENCH_CORE_AUTO;
+      } else if (*value == '\0' || *end != '\0' || core < 0) {
+        fprintf(stderr, "Error: Invalid core '%s'\n", value);
+        return false;
+      } else {
+        options->core = (int)core;
+      }
+    } else if ((value = bench_arg_value(arg, "--cluster")) != NULL) {
+      if (strcmp(value, "any") == 0) {
+        options->cluster = BENCH_CLUSTER_ANY;
+      } else if (strcmp(value, "big") == 0) {
+        options->cluster = BENCH_CLUSTER_BIG;
+      } else if (strcmp(value, "little") == 0) {
+        options->cluster = BENCH_CLUSTER_LITTLE;
+      } else {
+        fprintf(stderr, "Error: Unknown cluster '%s'\n", value);
+        return false;
+      }
+    } else if ((value = bench_arg_value(arg, "--smt")) != NULL) {
+      if (strcmp(value, "ignore") == 0) {
+        options->smt = BENCH_SMT_IGNORE;
+      } else if (strcmp(value, "verify") == 0) {
+        options->smt = BENCH_SMT_VERIFY;
+      } else if (strcmp(value, "park") == 0) {
+        options->smt = BENCH_SMT_PARK;
+      } else {
+        fprintf(stderr, "Error: Unknown SMT mode '%s'\n", value);
+        return false;
+      }
+    } else if ((value = bench_arg_value(arg, "--pages")) != NULL) {
+      if (strcmp(value, "default") == 0) {
+        options->pages = BENCH_ALLOC_DEFAULT;
+      } else if (strcmp(value, "small") == 0) {
+        options->pages = BENCH_ALLOC_SMALL;
+      } else if (strcmp(value, "thp") == 0) {
+        options->pages = BENCH_ALLOC_THP;
+      } else if (strcmp(value, "2m") == 0) {
+        options->pages = BENCH_ALLOC_HUGE_2M;
+      } else if (strcmp(value, "1g") == 0) {
+        options->pages = BENCH_ALLOC_HUGE_1G;
+      } else {
+        fprintf(stderr, "Error: Unknown page size '%s'\n", value);
+        return false;
+      }
+    } else if ((value = bench_arg_value(arg, "--machine")) != NULL) {
+      options->machine = value;
+    } else if ((value = bench_arg_value(arg, "--energy")) != NULL) {
+      options->energy = true;
+      options->energy_domain = value;
+    } else if ((value = bench_arg_value(arg, "--numa")) != NULL) {
+      if (strcmp(value, "default") == 0) {
+        options->numa = BENCH_NUMA_DEFAULT;
+      } else if (strcmp(value, "local") == 0) {
+        options->numa = BENCH_NUMA_LOCAL;
+      } else if (strcmp(value, "remote") == 0) {
+        options->numa = BENCH_NUMA_REMOTE;
+      } else if (strcmp(value, "interleave") == 0) {
+        options->numa = BENCH_NUMA_INTERLEAVE;
+      } else if (strcmp(value, "sweep") == 0) {
+        options->numa = BENCH_NUMA_SWEEP;
+      } else {
+        fprintf(stderr, "Error: Unknown NUMA placement '%s'\n", value);
+        return false;
+      }
+    } else {
+      fprintf(stderr, "Error: Unknown argument '%s'\n", arg);
+      bench_print_usage(argv[0]);
+      return false;
+    }
+  }
+
+  if ((options->compare_runs > 0 || options->compare_tag != NULL) &&
+      options->history == NULL) {
+    fprintf(stderr, "Error: --compare requires --history\n");
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Checks whether a benchmark is selected by the current filter.
+ *
+ * @param name Name of the benchmark
+ * @return true if no filter is set or the name matches the filter
+ */
+static inline bool bench_filter_match(const char *name) {
+  if (!bench_options.has_filter)
+    return true;
+  return regexec(&bench_options.filter_regex, name, 0, NULL, 0) == 0;
+}
+
+/**
+ * @brief Releases resources held by the global options.
+ */
+static inline void bench_free_options(void) {
+  if (bench_options.has_filter) {
+    regfree(&bench_options.filter_regex);
+    bench_options.has_filter = false;
+  }
+}
+
+#endif // CLI_H
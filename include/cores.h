@@ -0,0 +1,418 @@
+#ifndef CORES_H
+#define CORES_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "./cli.h"
+#include "./topology.h"
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief Duration in milliseconds over which interrupts and CPU load are
+ * sampled to find a quiet core.
+ */
+#define BENCH_CORE_SAMPLE_MS 200
+
+/**
+ * @brief Load of an SMT sibling, in percent, above which --smt=verify rejects
+ * a core.
+ */
+#define BENCH_SMT_BUSY_PERCENT 10
+
+/**
+ * @brief Activity of every CPU at one point in time.
+ *
+ * irqs:                Interrupts handled per CPU (/proc/interrupts)
+ * busy:                Non-idle jiffies per CPU (/proc/stat)
+ * total:               All jiffies per CPU (/proc/stat)
+ * count:               Number of CPUs of every array
+ */
+typedef struct {
+  uint64_t *irqs;
+  uint64_t *busy;
+  uint64_t *total;
+  int count;
+} bench_cpu_activity_t;
+
+/**
+ * @brief Reads the interrupt count of every CPU from /proc/interrupts.
+ *
+ * The header names the columns, offline CPUs have none.
+ *
+ * @param irqs Receives the counts, indexed by CPU number
+ * @param count Number of entries of irqs
+ * @return true if the file was read
+ */
+static inline bool bench_read_irq_counts(uint64_t *irqs, int count) {
+  FILE *f = fopen("/proc/interrupts", "r");
+  if (f == NULL)
+    return false;
+
+  memset(irqs, 0, (size_t)count * sizeof(uint64_t));
+
+  size_t line_size = 4096;
+  char *line = (char *)malloc(line_size);
+  int columns[CPU_SETSIZE];
+  int column_count = 0;
+  bool ok = line != NULL && getline(&line, &line_size, f) > 0;
+
+  /* header: "           CPU0       CPU1 ..." */
+  for (char *p = ok ? strstr(line, "CPU") : NULL;
+       p != NULL && column_count < CPU_SETSIZE; p = strstr(p + 3, "CPU"))
+    columns[column_count++] = atoi(p + 3);
+
+  while (ok && getline(&line, &line_size, f) > 0) {
+    char *p = strchr(line, ':');
+    if (p == NULL)
+      continue;
+    p++;
+    for (int column = 0; column < column_count; column++) {
+      char *end;
+      uint64_t value = strtoull(p, &end, 10);
+      if (end == p)
+        break;
+      p = end;
+      if (columns[column] < count)
+        irqs[columns[column]] += value;
+    }
+  }
+
+  free(line);
+  fclose(f);
+  return ok;
+}
+
+/**
+ * @brief Reads the busy and total jiffies of every CPU from /proc/stat.
+ *
+ * @return true if the file was read
+ */
+static inline bool bench_read_cpu_times(uint64_t *busy, uint64_t *total,
+                                        int count) {
+  FILE *f = fopen("/proc/stat", "r");
+  if (f == NULL)
+    return false;
+
+  memset(busy, 0, (size_t)count * sizeof(uint64_t));
+  memset(total, 0, (size_t)count * sizeof(uint64_t));
+
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    int cpu;
+    unsigned long long v[8] = {0};
+    /* skip the "cpu " line summing up all CPUs */
+    if (strncmp(line, "cpu", 3) != 0 || line[3] < '0' || line[3] > '9')
+      continue;
+    if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu", &cpu,
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) < 5 ||
+        cpu < 0 || cpu >= count)
+      continue;
+
+    /* user nice system idle iowait irq softirq steal */
+    uint64_t idle = v[3] + v[4];
+    total[cpu] = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+    busy[cpu] = total[cpu] - idle;
+  }
+
+  fclose(f);
+  return true;
+}
+
+/**
+ * @brief Takes a snapshot of the activity of every CPU.
+ *
+ * @param activity Structure to fill in, release with
+ * bench_cpu_activity_free()
+ * @param count Number of CPUs
+ * @return true if the interrupt counts could be read
+ */
+static inline bool bench_cpu_activity_read(bench_cpu_activity_t *activity,
+                                           int count) {
+  activity->count = count;
+  activity->irqs = (uint64_t *)calloc((size_t)count, sizeof(uint64_t));
+  activity->busy = (uint64_t *)calloc((size_t)count, sizeof(uint64_t));
+  activity->total = (uint64_t *)calloc((size_t)count, sizeof(uint64_t));
+  if (activity->irqs == NULL || activity->busy == NULL ||
+      activity->total == NULL)
+    return false;
+
+  bench_read_cpu_times(activity->busy, activity->total, count);
+  return bench_read_irq_counts(activity->irqs, count);
+}
+
+/**
+ * @brief Frees a snapshot taken with bench_cpu_activity_read().
+ */
+static inline void bench_cpu_activity_free(bench_cpu_activity_t *activity) {
+  free(activity->irqs);
+  free(activity->busy);
+  free(activity->total);
+  memset(activity, 0, sizeof(*activity));
+}
+
+/**
+ * @brief Extracts the CPU list of a parameter from a kernel command line.
+ *
+ * Flags of isolcpus= (e.g. "isolcpus=managed_irq,domain,2-3") are skipped.
+ *
+ * @param cmdline The kernel command line, modified while parsing
+ * @param param Parameter name, e.g. "isolcpus"
+ * @param set Receives the CPUs
+ * @return Number of CPUs in the set
+ */
+static inline int bench_cmdline_cpulist(char *cmdline, const char *param,
+                                        cpu_set_t *set) {
+  CPU_ZERO(set);
+
+  size_t len = strlen(param);
+  char *save = NULL;
+  for (char *token = strtok_r(cmdline, " ", &save); token != NULL;
+       token = strtok_r(NULL, " ", &save)) {
+    if (strncmp(token, param, len) != 0 || token[len] != '=')
+      continue;
+
+    char *list = token + len + 1;
+    while (*list != '\0' && (*list < '0' || *list > '9')) {
+      char *comma = strchr(list, ',');
+      list = comma == NULL ? list + strlen(list) : comma + 1;
+    }
+    bench_cpulist_parse(list, set);
+  }
+  return CPU_COUNT(set);
+}
+
+/**
+ * @brief Reads the CPUs isolated from the scheduler or running tickless.
+ *
+ * Prefers the lists the kernel exports in /sys/devices/system/cpu and falls
+ * back to /proc/cmdline.
+ *
+ * @param param "isolcpus" or "nohz_full"
+ * @param set Receives the CPUs
+ * @return Number of CPUs in the set
+ */
+static inline int bench_kernel_cpulist(const char *param, cpu_set_t *set) {
+  char path[128], line[4096];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/%s",
+           strcmp(param, "isolcpus") == 0 ? "isolated" : param);
+  if (bench_sysfs_cpulist(path, set) && CPU_COUNT(set) > 0)
+    return CPU_COUNT(set);
+
+  CPU_ZERO(set);
+  if (!bench_read_line("/proc/cmdline", line, sizeof(line)))
+    return 0;
+  return bench_cmdline_cpulist(line, param, set);
+}
+
+/**
+ * @brief Returns the load of the SMT siblings of a CPU over a sample window.
+ *
+ * @return Highest load of a sibling in percent, 0 without siblings
+ */
+static inline int bench_sibling_load(const bench_topology_t *topology, int cpu,
+                                     const bench_cpu_activity_t *before,
+                                     const bench_cpu_activity_t *after) {
+  int load = 0;
+  for (int sibling = 0; sibling < topology->cpu_count; sibling++) {
+    if (sibling == cpu || !CPU_ISSET(sibling, &topology->cpus[cpu].siblings))
+      continue;
+    uint64_t total = after->total[sibling] - before->total[sibling];
+    uint64_t busy = after->busy[sibling] - before->busy[sibling];
+    if (total > 0 && (int)(busy * 100 / total) > load)
+      load = (int)(busy * 100 / total);
+  }
+  return load;
+}
+
+/**
+ * @brief Compares the ranking keys of two candidate cores.
+ *
+ * @return true if a ranks before b
+ */
+static inline bool bench_core_key_less(const uint64_t a[5],
+                                       const uint64_t b[5]) {
+  for (int i = 0; i < 5; i++) {
+    if (a[i] != b[i])
+      return a[i] < b[i];
+  }
+  return false;
+}
+
+/**
+ * @brief Picks the quietest core to pin a benchmark to.
+ *
+ * Candidates are the online CPUs the process may run on, restricted to the
+ * big or LITTLE cluster if requested. They are ranked by:
+ * 1. isolated from the scheduler (isolcpus=)
+ * 2. running tickless (nohz_full=)
+ * 3. fewest interrupts over BENCH_CORE_SAMPLE_MS
+ * 4. lowest load over the same window
+ * 5. any core other than core 0, which handles most interrupts on boot
+ *
+ * With BENCH_SMT_VERIFY or BENCH_SMT_PARK, cores whose SMT sibling is busier
+ * than BENCH_SMT_BUSY_PERCENT are skipped unless no other core is left.
+ *
+ * @param cluster Cluster to choose from
+ * @param smt How SMT siblings are treated
+ * @return The chosen core, or 0 if the CPUs cannot be inspected
+ */
+static inline int bench_select_core(bench_cluster_t cluster, bench_smt_t smt) {
+  const bench_topology_t *topology = bench_topology();
+  if (topology->cpus == NULL)
+    return 0;
+
+  cpu_set_t candidates, allowed, isolated, nohz_full;
+  if (cluster == BENCH_CLUSTER_ANY)
+    candidates = topology->online;
+  else
+    bench_topology_cluster_cpus(topology, cluster == BENCH_CLUSTER_BIG,
+                                &candidates);
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0)
+    CPU_AND(&candidates, &candidates, &allowed);
+  bench_kernel_cpulist("isolcpus", &isolated);
+  bench_kernel_cpulist("nohz_full", &nohz_full);
+
+  bench_cpu_activity_t before = PIBENCH_ZERO, after = PIBENCH_ZERO;
+  bool sampled = bench_cpu_activity_read(&before, topology->cpu_count);
+  if (sampled) {
+    usleep(BENCH_CORE_SAMPLE_MS * 1000);
+    sampled = bench_cpu_activity_read(&after, topology->cpu_count);
+  }
+
+  int best = -1, best_unverified = -1;
+  uint64_t best_key[5] = {0}, best_unverified_key[5] = {0};
+  for (int cpu = 0; cpu < topology->cpu_count; cpu++) {
+    if (!CPU_ISSET(cpu, &candidates))
+      continue;
+
+    uint64_t key[5] = {
+        !CPU_ISSET(cpu, &isolated),
+        !CPU_ISSET(cpu, &nohz_full),
+        sampled ? after.irqs[cpu] - before.irqs[cpu] : 0,
+        sampled ? after.busy[cpu] - before.busy[cpu] : 0,
+        cpu == 0,
+    };
+
+    if (best_unverified < 0 || bench_core_key_less(key, best_unverified_key)) {
+      best_unverified = cpu;
+      memcpy(best_unverified_key, key, sizeof(key));
+    }
+
+    if (smt != BENCH_SMT_IGNORE && sampled &&
+        bench_sibling_load(topology, cpu, &before, &after) >
+            BENCH_SMT_BUSY_PERCENT)
+      continue;
+    if (best < 0 || bench_core_key_less(key, best_key)) {
+      best = cpu;
+      memcpy(best_key, key, sizeof(key));
+    }
+  }
+
+  if (best < 0 && best_unverified >= 0) {
+    printf("\033[33mEvery candidate core has a busy SMT sibling!\033[0m\n");
+    best = best_unverified;
+    memcpy(best_key, best_unverified_key, sizeof(best_key));
+  }
+
+  bench_cpu_activity_free(&before);
+  bench_cpu_activity_free(&after);
+
+  if (best < 0)
+    return 0;
+
+  printf("\033[34mSelected core %d (%s%s%lu interrupts in %d ms)\033[0m\n",
+         best, best_key[0] == 0 ? "isolated, " : "",
+         best_key[1] == 0 ? "nohz_full, " : "", (unsigned long)best_key[2],
+         BENCH_CORE_SAMPLE_MS);
+  return best;
+}
+
+/**
+ * @brief Resolves the core a pinned benchmark runs on.
+ *
+ * --core overrides the core given to the benchmark. BENCH_CORE_AUTO selects
+ * the quietest core once per process, with --cluster and --smt.
+ *
+ * @param core Core given to the benchmark, or BENCH_CORE_AUTO
+ * @return The core to pin to
+ */
+static inline int bench_resolve_core(int core) {
+  static int selected = BENCH_CORE_AUTO;
+
+  if (bench_options.core != BENCH_CORE_UNSET)
+    core = bench_options.core;
+  if (core != BENCH_CORE_AUTO)
+    return core;
+
+  if (selected == BENCH_CORE_AUTO)
+    selected = bench_select_core(bench_options.cluster, bench_options.smt);
+  return selected;
+}
+
+/**
+ * @brief Takes a CPU offline or brings it back online.
+ *
+ * @return true on success
+ *
+ * @note Requires root privileges
+ */
+static inline bool bench_set_cpu_online(int cpu, bool online) {
+  char path[128];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/online", cpu);
+
+  FILE *f = fopen(path, "w");
+  if (f == NULL)
+    return false;
+  bool ok = fputs(online ? "1" : "0", f) >= 0;
+  return fclose(f) == 0 && ok;
+}
+
+/**
+ * @brief Takes the SMT siblings of a core offline for the duration of a run.
+ *
+ * @param core The benchmark core
+ * @param parked Receives the siblings that were taken offline
+ * @return Number of siblings taken offline
+ *
+ * @note Requires root privileges, siblings that cannot be taken offline are
+ * reported and left running. bench_park() also has them brought back should
+ * the benchmark die.
+ */
+static inline int bench_smt_park(int core, cpu_set_t *parked) {
+  const bench_topology_t *topology = bench_topology();
+  CPU_ZERO(parked);
+  if (topology->cpus == NULL || core < 0 || core >= topology->cpu_count)
+    return 0;
+
+  for (int sibling = 0; sibling < topology->cpu_count; sibling++) {
+    if (sibling == core || !CPU_ISSET(sibling, &topology->cpus[core].siblings))
+      continue;
+
+    if (bench_set_cpu_online(sibling, false))
+      CPU_SET(sibling, parked);
+    else
+      printf("\033[33mCould not park SMT sibling %d of core %d!\033[0m\n",
+             sibling, core);
+  }
+  return CPU_COUNT(parked);
+}
+
+/**
+ * @brief Brings SMT siblings parked with bench_smt_park() back online.
+ */
+static inline void bench_smt_unpark(const cpu_set_t *parked) {
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, parked) && !bench_set_cpu_online(cpu, true))
+      printf("\033[31mCould not bring CPU %d back online!\033[0m\n", cpu);
+  }
+}
+
+#endif // CORES_H
@@ -2,7 +2,12 @@
 #define DATA_PROCESSING_H
 
 #include "./bench.h"
+#include "./binary.h"
+#include "./cli.h"
+#include "./env.h"
+#include "./machine.h"
 #include "./stats.h"
+#include "./writer.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -10,35 +15,160 @@
 #include <stdlib.h>
 #include <string.h>
 
-void *get_validation_buffer(const void *const gt, size_t size) {
+/**
+ * @brief Engine of pi-bench: validation, statistics, reporting and export.
+ *
+ * Compiled into libpibench when PIBENCH_LINK is set, see api.h.
+ */
+PIBENCH_ENGINE void *get_validation_buffer(const void *const gt, size_t size);
+PIBENCH_ENGINE void validate_result(benchmark_t *benchmark,
+                                    const void *const result,
+                                    const void *const gt, size_t size);
+PIBENCH_ENGINE void calculate_stats(benchmark_result_t *results, size_t size);
+PIBENCH_ENGINE void print_result(benchmark_t *results);
+PIBENCH_ENGINE void print_results(benchmark_t **results, size_t count,
+                                  bool print_invalid);
+PIBENCH_ENGINE void print_comparison_matrix(benchmark_t **results,
+                                            size_t count, const char *group);
+PIBENCH_ENGINE void print_comparison_matrices(benchmark_t **results,
+                                              size_t count);
+PIBENCH_ENGINE void print_family_results(benchmark_t **results, size_t count);
+PIBENCH_ENGINE void print_numa_results(benchmark_t **results, size_t count);
+PIBENCH_ENGINE void print_repetition_results(benchmark_t **results,
+                                             size_t count);
+PIBENCH_ENGINE void print_roofline(benchmark_t **results, size_t count);
+PIBENCH_ENGINE bool to_csv(benchmark_t **benchmarks, size_t num,
+                           const char *dir);
+PIBENCH_ENGINE bool to_roofline_csv(benchmark_t **benchmarks, size_t num,
+                                    const char *path);
+PIBENCH_ENGINE bool to_json(benchmark_t **benchmarks, size_t num,
+                            const char *path);
+PIBENCH_ENGINE void bench_ndjson_record(benchmark_t *benchmark);
+PIBENCH_ENGINE bool export_results(benchmark_t **benchmarks, size_t num,
+                                   const bench_options_t *options);
+
+/**
+ * @brief Metadata of the run reported by the JSON and NDJSON exports.
+ *
+ * Exports describe the environment they are written in, unless the metadata
+ * of the run was recorded, e.g. by pibench-convert from a binary result file.
+ *
+ * recorded:            Flag indicating if env and machine describe the run
+ * env:                 Environment the benchmarks ran in
+ * machine:             Machine characterization of the run
+ * has_machine:         Flag indicating if the run had a characterization
+ */
+typedef struct {
+  bool recorded;
+  bench_env_t env;
+  bench_machine_t machine;
+  bool has_machine;
+} bench_run_metadata_t;
+
+PIBENCH_STATE bench_run_metadata_t bench_run_metadata
+    PIBENCH_INIT(PIBENCH_ZERO);
+
+/**
+ * @brief Stores the output of a baseline as ground truth.
+ *
+ * Depending on --ground-truth the output is either copied or hashed.
+ *
+ * @param benchmark The baseline benchmark
+ */
+static inline void store_ground_truth(benchmark_t *benchmark) {
+  benchmark_result_t *results = benchmark->results;
+
+  if (results->gt == NULL)
+    return;
+
+  if (bench_options.ground_truth == BENCH_GT_HASH) {
+    bench_digest_compute((bench_digest_t *)results->gt, results->output_buffer);
+  } else {
+    memcpy(results->gt, results->output_buffer, results->size);
+  }
+}
+
+#if PIBENCH_DEFINITIONS
+
+PIBENCH_ENGINE void *get_validation_buffer(const void *const gt, size_t size) {
   void *buffer = malloc(size);
   memcpy(buffer, gt, size);
 
   return buffer;
 }
 
-void validate_result(benchmark_t *benchmark, const void *const result,
-                     const void *const gt, size_t size) {
+PIBENCH_ENGINE void validate_result(benchmark_t *benchmark,
+                                    const void *const result,
+                                    const void *const gt, size_t size) {
 
-  if (memcmp(gt, result, size) == 0) {
+  bench_validation_t report;
+  bool hashed = bench_options.ground_truth == BENCH_GT_HASH;
+
+  if (hashed) {
+    /* the digest belongs to the benchmark, validating fills its scratch */
+    bench_digest_t *digest = (bench_digest_t *)gt;
+    if (benchmark->validator.kind != BENCH_VALIDATE_BYTES &&
+        benchmark->validator.kind != BENCH_VALIDATE_INT) {
+      printf("\033[33mHashed ground truth only supports exact comparison, "
+             "ignoring the validator of '%s'\033[0m\n",
+             benchmark->name);
+    }
+    if (digest->size != size) {
+      printf("\033[33mGround truth has %zu bytes, but '%s' has %zu\033[0m\n",
+             digest->size, benchmark->name, size);
+      memset(&report, 0, sizeof(report));
+    } else {
+      report = bench_digest_validate(digest, result);
+    }
+  } else {
+    report = bench_validate(&benchmark->validator, gt, result, size);
+  }
+  benchmark->validation = report;
+
+  if (report.valid) {
     benchmark->is_valid = true;
-    printf("\033[32mResult of '%s' is valid!\033[0m\n", benchmark->name);
+    printf("\033[32mResult of '%s' is valid!\033[0m", benchmark->name);
+    if (report.max_error > 0.0)
+      printf(" (max error %g)", report.max_error);
+    printf("\n");
   } else {
 
     benchmark->is_valid = false;
     printf("\033[33mResult of '%s' is not valid!\033[0m\n", benchmark->name);
+    if (hashed) {
+      if (report.mismatches > 0)
+        printf("\033[33m  %zu of %zu chunks differ, first at byte %zu\033[0m\n",
+               report.mismatches, report.elements, report.first_mismatch);
+    } else if (benchmark->validator.kind != BENCH_VALIDATE_CUSTOM ||
+               report.mismatches > 0) {
+      printf("\033[33m  %zu of %zu elements differ, first at index %zu, "
+             "max error %g",
+             report.mismatches, report.elements, report.first_mismatch,
+             report.max_error);
+      if (report.max_ulp > 0)
+        printf(", max %lu ulp", report.max_ulp);
+      printf("\033[0m\n");
+    }
   }
 }
 
-void calculate_stats(benchmark_result_t *results, size_t size) {
+PIBENCH_ENGINE void calculate_stats(benchmark_result_t *results, size_t size) {
   uint64_t *samples = results->samples;
   double *cmrs = results->cache_miss_rates;
 
-  results->median_time = median(samples, size, selection_sort);
+  /* keep the interrupts of every iteration next to its sample */
+  if (results->irq_counts != NULL)
+    sort_pairs(samples, results->irq_counts, size);
+  results->median_time = median(samples, size, quick_sort);
   results->mean_time = mean(samples, size);
   results->stddev_time = stddev(samples, size);
 
-  results->median_cmr = median(cmrs, size, selection_sort);
+  /* median() sorted the samples */
+  results->p90_time = percentile(samples, size, 90.0);
+  results->p99_time = percentile(samples, size, 99.0);
+  results->p999_time = percentile(samples, size, 99.9);
+
+  results->median_cmr = median(cmrs, size, quick_sort);
   results->mean_cmr = mean(cmrs, size);
   results->stddev_cmr = stddev(cmrs, size);
 
@@ -64,9 +194,47 @@ void calculate_stats(benchmark_result_t *results, size_t size) {
 
   results->min_cmr = min_cmr;
   results->max_cmr = max_cmr;
+
+  if (results->irq_counts != NULL) {
+    results->irq_total = 0;
+    results->irq_max = 0;
+    results->irq_samples = 0;
+    for (size_t i = 0; i < size; i++) {
+      uint64_t irqs = results->irq_counts[i];
+      results->irq_total += irqs;
+      if (irqs > results->irq_max)
+        results->irq_max = irqs;
+      if (irqs > 0)
+        results->irq_samples++;
+    }
+  }
+}
+
+/**
+ * @brief Returns the energy of one call of a benchmark in joules.
+ *
+ * @return Joules per call, 0 if the energy was not measured
+ */
+static inline double bench_energy_per_call(const benchmark_t *benchmark) {
+  const benchmark_result_t *data = benchmark->results;
+  if (data->energy_calls == 0)
+    return 0.0;
+  return data->energy_j / (double)data->energy_calls;
+}
+
+/**
+ * @brief Returns the average power of a benchmark while it was measured.
+ *
+ * @return Watts, 0 if the energy was not measured
+ */
+static inline double bench_energy_watts(const benchmark_t *benchmark) {
+  const benchmark_result_t *data = benchmark->results;
+  if (data->energy_calls == 0 || data->energy_ns == 0)
+    return 0.0;
+  return data->energy_j / ((double)data->energy_ns * 1e-9);
 }
 
-void print_result(benchmark_t *results) {
+PIBENCH_ENGINE void print_result(benchmark_t *results) {
   if (results == NULL || results->results == NULL) {
     printf("Error: Invalid benchmark results\n");
     return;
@@ -81,138 +249,915 @@ void print_result(benchmark_t *results) {
   printf("Iterations: %zu warmup, %zu timed\n", results->warmup_iterations,
          results->timed_iterations);
   printf("Baseline: %s\n", results->is_baseline ? "Yes" : "No");
+  if (data->page_size > 0)
+    printf("Page size: %zu KB\n", data->page_size >> 10);
+  if (results->numa != BENCH_NUMA_DEFAULT)
+    printf("NUMA placement: %s\n", bench_numa_mode_name(results->numa));
   printf("\n");
   printf("Statistical Results:\n");
   printf("Time:\n");
   printf("  Median: %lu %s\n", data->median_time,
-         results->results->is_cycles ? "cycles" : "us");
+         results->results->is_cycles ? "cycles" : "ns");
   printf("  Mean:   %.2f %s\n", data->mean_time,
-         results->results->is_cycles ? "cycles" : "us");
+         results->results->is_cycles ? "cycles" : "ns");
   printf("  StdDev: %.2f %s\n", data->stddev_time,
-         results->results->is_cycles ? "cycles" : "us");
+         results->results->is_cycles ? "cycles" : "ns");
   printf("  Min:    %lu %s\n", data->min_time,
-         results->results->is_cycles ? "cycles" : "us");
+         results->results->is_cycles ? "cycles" : "ns");
   printf("  Max:    %lu %s\n", data->max_time,
-         results->results->is_cycles ? "cycles" : "us");
+         results->results->is_cycles ? "cycles" : "ns");
+  printf("  P90:    %.2f %s\n", data->p90_time,
+         results->results->is_cycles ? "cycles" : "ns");
+  printf("  P99:    %.2f %s\n", data->p99_time,
+         results->results->is_cycles ? "cycles" : "ns");
   printf("\nCache-Miss Rate:\n");
   printf("  Median: %.2f%% \n", data->median_cmr);
   printf("  Mean:   %.2f%% \n", data->mean_cmr);
   printf("  StdDev: %.2f%% \n", data->stddev_cmr);
   printf("  Min:    %.2f%% \n", data->min_cmr);
   printf("  Max:    %.2f%% \n", data->max_cmr);
+  if (data->hook_calls > 0 || data->fixture_setup_ns > 0 ||
+      data->fixture_teardown_ns > 0) {
+    printf("\nFixture (outside of timed region):\n");
+    printf("  Setup:    %lu ns\n", data->fixture_setup_ns);
+    printf("  Teardown: %lu ns\n", data->fixture_teardown_ns);
+    printf("  Per-iteration hooks: mean %.2f ns, max %lu ns (%zu iterations)\n",
+           data->hook_calls > 0
+               ? (double)data->hook_total_ns / (double)data->hook_calls
+               : 0.0,
+           data->hook_max_ns, data->hook_calls);
+  }
+  if (data->irq_counts != NULL) {
+    printf("\nInterrupts on the benchmark core:\n");
+    printf("  Total:   %lu\n", data->irq_total);
+    printf("  Max:     %lu per iteration\n", data->irq_max);
+    printf("  Samples: %zu of %zu hit\n", data->irq_samples,
+           results->timed_iterations);
+  }
+  if (data->energy_calls > 0) {
+    printf("\nEnergy (%s):\n", bench_energy_meter.label);
+    printf("  Per call: %.3f uJ\n", bench_energy_per_call(results) * 1e6);
+    printf("  Power:    %.2f W average\n", bench_energy_watts(results));
+    printf("  Total:    %.3f J over %.3f s, %lu calls\n", data->energy_j,
+           (double)data->energy_ns * 1e-9, data->energy_calls);
+  }
   printf("========================================\n");
   printf("\n");
 }
 
-void print_results(benchmark_t **results, size_t count) {
-  if (results == NULL || count == 0) {
-    printf("Error: No benchmark results to display\n");
-    return;
+/**
+ * @brief Checks if two benchmarks belong to the same comparison group.
+ */
+static inline bool bench_same_group(const char *a, const char *b) {
+  if (a == NULL || b == NULL)
+    return a == b;
+  return strcmp(a, b) == 0;
+}
+
+/**
+ * @brief Checks if the group of results[index] already occurred before index.
+ */
+static inline bool bench_group_seen(benchmark_t **results, size_t index) {
+  for (size_t i = 0; i < index; i++) {
+    if (results[i] != NULL &&
+        bench_same_group(results[i]->group, results[index]->group))
+      return true;
   }
+  return false;
+}
+
+/**
+ * @brief Checks if a benchmark failed its validation.
+ *
+ * Baselines and benchmarks that are not validated are never invalid.
+ */
+static inline bool bench_is_invalid(const benchmark_t *benchmark) {
+  return benchmark->validate && !benchmark->is_baseline && !benchmark->is_valid;
+}
+
+/**
+ * @brief Returns the throughput of a benchmark.
+ *
+ * @return Bytes of output per time unit, or calls per time unit if the
+ * benchmark has no output buffer
+ */
+static inline double bench_throughput(const benchmark_t *benchmark) {
+  const benchmark_result_t *data = benchmark->results;
+  if (data->median_time == 0)
+    return 0.0;
+
+  double work = data->size > 0 ? (double)data->size : 1.0;
+  return work / (double)data->median_time;
+}
+
+/**
+ * @brief Position of a benchmark on the roofline of the machine.
+ *
+ * flops:               Floating point operations per call
+ * bytes:               Bytes moved per call
+ * seconds:             Median duration of a call in seconds
+ * gflops:              Achieved GFLOP/s
+ * gbs:                 Achieved bandwidth in GB/s
+ * intensity:           Arithmetic intensity in flops per byte, 0 if no bytes
+ *                      were declared
+ * has_roofs:           Flag indicating if the fields below are known, needs a
+ *                      machine characterization with the peak compute rate
+ * attainable_gflops:   Roof at the intensity, min(peak, intensity * bandwidth)
+ * compute_pct:         Achieved GFLOP/s in percent of the peak
+ * bandwidth_pct:       Achieved GB/s in percent of the triad bandwidth
+ * memory_bound:        Flag indicating if the intensity is below the ridge
+ *                      point peak / bandwidth
+ */
+typedef struct {
+  double flops, bytes;
+  double seconds;
+  double gflops, gbs;
+  double intensity;
+  bool has_roofs;
+  double attainable_gflops;
+  double compute_pct, bandwidth_pct;
+  bool memory_bound;
+} bench_roofline_t;
 
-  // Find the baseline benchmark
+/**
+ * @brief Places a benchmark on the roofline of a machine.
+ *
+ * The roofs are the peak compute rate and the triad bandwidth of a single
+ * core. Expects the statistics of the benchmark to be calculated.
+ *
+ * @param benchmark The benchmark, see bench_set_work()
+ * @param machine The characterization, NULL if none was measured
+ * @param point Receives the position
+ * @return false if the benchmark declared no work or its duration is unknown,
+ * e.g. cycles without a known cycle counter frequency
+ */
+static inline bool bench_roofline(const benchmark_t *benchmark,
+                                  const bench_machine_t *machine,
+                                  bench_roofline_t *point) {
+  const benchmark_result_t *data = benchmark->results;
+  const bench_work_t *work = &benchmark->work;
+  memset(point, 0, sizeof(*point));
+
+  double arg = benchmark->args.count > 0 ? (double)benchmark->args.values[0]
+                                         : 0.0;
+  point->flops = work->flops + work->flops_per_arg * arg;
+  point->bytes = work->bytes + work->bytes_per_arg * arg;
+  if ((point->flops <= 0.0 && point->bytes <= 0.0) || data->median_time == 0)
+    return false;
+
+  if (!data->is_cycles) {
+    point->seconds = (double)data->median_time * 1e-9;
+  } else {
+    uint64_t hz = bench_cycle_counter_hz();
+    if (hz == 0)
+      return false;
+    point->seconds = (double)data->median_time / (double)hz;
+  }
+
+  point->gflops = point->flops / point->seconds * 1e-9;
+  point->gbs = point->bytes / point->seconds * 1e-9;
+  point->intensity = point->bytes > 0.0 ? point->flops / point->bytes : 0.0;
+
+  if (machine == NULL || machine->peak_gflops <= 0.0 ||
+      machine->triad_gbs <= 0.0)
+    return true;
+
+  double ridge = machine->peak_gflops / machine->triad_gbs;
+  point->has_roofs = true;
+  point->memory_bound = point->bytes > 0.0 && point->intensity < ridge;
+  point->attainable_gflops =
+      point->memory_bound ? point->intensity * machine->triad_gbs
+                          : machine->peak_gflops;
+  point->compute_pct = 100.0 * point->gflops / machine->peak_gflops;
+  point->bandwidth_pct = 100.0 * point->gbs / machine->triad_gbs;
+  return true;
+}
+
+/**
+ * @brief Returns the value of a benchmark for a sort metric.
+ */
+static inline double bench_sort_value(const benchmark_t *benchmark,
+                                      bench_sort_key_t key) {
+  const benchmark_result_t *data = benchmark->results;
+  switch (key) {
+  case BENCH_SORT_P99:
+    return data->p99_time;
+  case BENCH_SORT_THROUGHPUT:
+    return bench_throughput(benchmark);
+  case BENCH_SORT_CMR:
+    return data->median_cmr;
+  case BENCH_SORT_ENERGY:
+    return bench_energy_per_call(benchmark);
+  case BENCH_SORT_MEDIAN:
+  default:
+    return (double)data->median_time;
+  }
+}
+
+/**
+ * @brief Returns the name of a sort metric.
+ */
+static inline const char *bench_sort_name(bench_sort_key_t key) {
+  switch (key) {
+  case BENCH_SORT_P99:
+    return "p99";
+  case BENCH_SORT_THROUGHPUT:
+    return "throughput";
+  case BENCH_SORT_CMR:
+    return "cache miss rate";
+  case BENCH_SORT_ENERGY:
+    return "energy";
+  case BENCH_SORT_MEDIAN:
+  default:
+    return "median";
+  }
+}
+
+/**
+ * @brief Entry of a sorted summary.
+ *
+ * value:               Value of the sort metric
+ * benchmark:           The benchmark
+ */
+typedef struct {
+  double value;
+  benchmark_t *benchmark;
+} bench_sort_entry_t;
+
+/**
+ * @brief Sorts summary entries with a stable bottom-up merge sort.
+ *
+ * Entries with equal values keep their order, i.e. the order the benchmarks
+ * ran in.
+ *
+ * @param entries Entries to sort
+ * @param count Number of entries
+ * @param ascending Sort in ascending instead of descending order
+ * @return false if out of memory, the entries are left unsorted
+ */
+static inline bool bench_sort_entries(bench_sort_entry_t *entries,
+                                      size_t count, bool ascending) {
+  if (count < 2)
+    return true;
+
+  bench_sort_entry_t *buffer =
+      (bench_sort_entry_t *)malloc(count * sizeof(bench_sort_entry_t));
+  if (buffer == NULL)
+    return false;
+
+  bench_sort_entry_t *from = entries, *to = buffer;
+  for (size_t width = 1; width < count; width *= 2) {
+    for (size_t lo = 0; lo < count; lo += 2 * width) {
+      size_t mid = lo + width < count ? lo + width : count;
+      size_t hi = lo + 2 * width < count ? lo + 2 * width : count;
+      size_t i = lo, j = mid, k = lo;
+
+      while (i < mid && j < hi) {
+        /* take from the right run only if strictly before, to stay stable */
+        bool right = ascending ? from[j].value < from[i].value
+                               : from[j].value > from[i].value;
+        to[k++] = right ? from[j++] : from[i++];
+      }
+      while (i < mid)
+        to[k++] = from[i++];
+      while (j < hi)
+        to[k++] = from[j++];
+    }
+
+    bench_sort_entry_t *tmp = from;
+    from = to;
+    to = tmp;
+  }
+
+  if (from != entries)
+    memcpy(entries, from, count * sizeof(bench_sort_entry_t));
+  free(buffer);
+  return true;
+}
+
+/**
+ * @brief Returns the baseline of a group that ran in a repetition.
+ *
+ * @param results Array of benchmarks
+ * @param count Number of benchmarks
+ * @param group Name of the group, NULL for the default group
+ * @param repetition Index of the repetition, see --repetitions
+ * @return The baseline, NULL if the repetition has none
+ */
+static inline benchmark_t *bench_group_baseline(benchmark_t **results,
+                                                size_t count, const char *group,
+                                                size_t repetition) {
+  for (size_t i = 0; i < count; i++) {
+    if (results[i] != NULL && results[i]->results != NULL &&
+        results[i]->is_baseline && results[i]->repetition == repetition &&
+        bench_same_group(results[i]->group, group))
+      return results[i];
+  }
+  return NULL;
+}
+
+/**
+ * @brief Prints the summary of one comparison group relative to its baseline.
+ *
+ * Benchmarks are sorted by --sort in the order given by --order. With
+ * --repetitions every run is compared to the baseline of its repetition.
+ *
+ * @param results Array of benchmarks
+ * @param count Number of benchmarks
+ * @param group Name of the group, NULL for the default group
+ * @param print_invalid Include benchmarks that failed validation
+ */
+static inline void print_group_results(benchmark_t **results, size_t count,
+                                       const char *group, bool print_invalid) {
+  // Find the baseline benchmark of the group
   benchmark_t *baseline = NULL;
+  bool repeated = false;
   for (size_t i = 0; i < count; i++) {
-    if (results[i] != NULL && results[i]->is_baseline) {
-      baseline = results[i];
-      break;
+    if (results[i] != NULL && results[i]->results != NULL &&
+        results[i]->is_baseline && bench_same_group(results[i]->group, group)) {
+      if (baseline == NULL)
+        baseline = results[i];
+      else if (results[i]->repetition != baseline->repetition)
+        repeated = true;
     }
   }
 
-  if (baseline == NULL || baseline->results == NULL) {
-    printf("Error: No baseline benchmark found\n");
+  if (baseline == NULL) {
+    if (group != NULL)
+      printf("Error: No baseline benchmark found in group '%s'\n", group);
+    else
+      printf("Error: No baseline benchmark found\n");
     return;
   }
 
-  // Create array of indices for sorting
-  size_t *indices = (size_t *)malloc(count * sizeof(size_t));
-  for (size_t i = 0; i < count; i++) {
-    indices[i] = i;
+  bench_sort_key_t key = bench_options.sort_key;
+  bench_sort_entry_t *entries =
+      (bench_sort_entry_t *)malloc(count * sizeof(bench_sort_entry_t));
+  if (entries == NULL) {
+    printf("Error: Could not allocate memory for the summary\n");
+    return;
   }
 
-  // Sort by performance: worst to best (higher cycles = worse performance)
-  for (size_t i = 0; i < count - 1; i++) {
-    for (size_t j = i + 1; j < count; j++) {
-      benchmark_t *bench_i = results[indices[i]];
-      benchmark_t *bench_j = results[indices[j]];
-
-      // Skip if either benchmark is invalid
-      if (bench_i == NULL || bench_j == NULL || bench_i->results == NULL ||
-          bench_j->results == NULL) {
-        continue;
-      }
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++) {
+    benchmark_t *bench = results[i];
+    if (bench == NULL || bench->results == NULL ||
+        !bench_same_group(bench->group, group) ||
+        (bench_is_invalid(bench) && !print_invalid))
+      continue;
 
-      // Sort by performance (higher cycles = worse performance)
-      if (bench_j->results->median_time > bench_i->results->median_time) {
-        size_t temp = indices[i];
-        indices[i] = indices[j];
-        indices[j] = temp;
-      }
-    }
+    calculate_stats(bench->results, bench->timed_iterations);
+    entries[n].value = bench_sort_value(bench, key);
+    entries[n].benchmark = bench;
+    n++;
   }
 
+  bench_sort_entries(entries, n, bench_options.sort_ascending);
+
   // Print header
   printf("\n");
   printf("========================================\n");
   printf("BENCHMARK RESULTS SUMMARY\n");
+  if (group != NULL)
+    printf("Group: %s\n", group);
   printf("========================================\n");
-  printf("Baseline: %s (%.2f %s)\n", baseline->name,
-         baseline->results->mean_time,
-         baseline->results->is_cycles ? "cycles" : "us");
+  if (repeated)
+    printf("Baseline: %s of every repetition\n", baseline->repetition_base);
+  else
+    printf("Baseline: %s (%.2f %s)\n", baseline->name,
+           baseline->results->mean_time,
+           baseline->results->is_cycles ? "cycles" : "ns");
+  printf("Sorted by %s (%s)\n", bench_sort_name(key),
+         bench_options.sort_ascending ? "ascending" : "descending");
   printf("\n");
 
   // Print results in sorted order
+  for (size_t i = 0; i < n; i++) {
+    benchmark_t *bench = entries[i].benchmark;
+    benchmark_result_t *data = bench->results;
+    const char *unit = data->is_cycles ? "cycles" : "ns";
+    double relative_performance = 1.0;
+    benchmark_t *reference =
+        bench_group_baseline(results, count, group, bench->repetition);
+
+    printf("%-20s: %8lu %s", bench->name, data->median_time, unit);
+
+    if (reference != NULL && bench != reference &&
+        reference->results->median_time > 0)
+      relative_performance = (double)data->median_time /
+                             (double)reference->results->median_time;
+    if (reference != NULL)
+      printf(" (%.2fx)", relative_performance);
+    else
+      printf(" (n/a)");
+
+    if (bench == reference)
+      printf(" - baseline");
+    else if (relative_performance < 1.0 && relative_performance > 0.0)
+      printf(" - %.1fx faster", 1.0 / relative_performance);
+
+    switch (key) {
+    case BENCH_SORT_P99:
+      printf(" [p99 %.2f %s]", data->p99_time, unit);
+      break;
+    case BENCH_SORT_THROUGHPUT:
+      printf(" [%.2f %s/%s]", bench_throughput(bench),
+             data->size > 0 ? "bytes" : "calls",
+             data->is_cycles ? "cycle" : "ns");
+      break;
+    case BENCH_SORT_CMR:
+      printf(" [cmr %.2f%%]", data->median_cmr);
+      break;
+    case BENCH_SORT_ENERGY:
+    case BENCH_SORT_MEDIAN:
+    default:
+      break;
+    }
+    if (data->energy_calls > 0)
+      printf(" [%.3f uJ/call, %.2f W]", bench_energy_per_call(bench) * 1e6,
+             bench_energy_watts(bench));
+
+    printf("%s\n", bench_is_invalid(bench) ? " - INVALID" : "");
+  }
+
+  printf("========================================\n");
+  printf("\n");
+
+  free(entries);
+}
+
+/**
+ * @brief Prints a summary of every comparison group relative to its baseline.
+ *
+ * @param results Array of benchmarks
+ * @param count Number of benchmarks
+ * @param print_invalid Include benchmarks that failed validation, also
+ * enabled by --show-invalid
+ */
+PIBENCH_ENGINE void print_results(benchmark_t **results, size_t count,
+                                  bool print_invalid) {
+  if (results == NULL || count == 0) {
+    printf("Error: No benchmark results to display\n");
+    return;
+  }
+
+  print_invalid = print_invalid || bench_options.show_invalid;
+  for (size_t i = 0; i < count; i++) {
+    if (results[i] != NULL && !bench_group_seen(results, i))
+      print_group_results(results, count, results[i]->group, print_invalid);
+  }
+}
+
+/**
+ * @brief Largest group printed by print_comparison_matrix().
+ */
+#define BENCH_MATRIX_MAX_SIZE 8
+
+/**
+ * @brief Quantile of the normal distribution used for the median intervals
+ * of the comparison matrix.
+ *
+ * Each median uses a 97.5% interval, so the interval of a ratio of two
+ * medians covers the true ratio with at least 95% probability.
+ */
+#define BENCH_MATRIX_Z 2.241
+
+/**
+ * @brief Prints the pairwise speedups of the benchmarks of a group.
+ *
+ * The cell in row r and column c is median(c) / median(r), i.e. how many
+ * times faster r is than c, followed by its 95% confidence interval. The
+ * interval combines distribution-free intervals of both medians and is
+ * conservative. Benchmarks that failed validation are left out.
+ *
+ * @param results Array of benchmarks
+ * @param count Number of benchmarks
+ * @param group Name of the group, NULL for the default group
+ */
+PIBENCH_ENGINE void print_comparison_matrix(benchmark_t **results,
+                                            size_t count, const char *group) {
+  benchmark_t *members[BENCH_MATRIX_MAX_SIZE];
+  double lo[BENCH_MATRIX_MAX_SIZE], hi[BENCH_MATRIX_MAX_SIZE];
+  size_t n = 0;
+
   for (size_t i = 0; i < count; i++) {
-    benchmark_t *bench = results[indices[i]];
-    if (bench == NULL || bench->results == NULL || !bench->is_valid) {
+    benchmark_t *bench = results[i];
+    if (bench == NULL || bench->results == NULL ||
+        !bench_same_group(bench->group, group) || bench_is_invalid(bench))
       continue;
+
+    if (n == BENCH_MATRIX_MAX_SIZE) {
+      printf("Group '%s' has more than %d benchmarks, skipping the "
+             "comparison matrix\n",
+             group != NULL ? group : "default", BENCH_MATRIX_MAX_SIZE);
+      return;
     }
 
+    /* calculate_stats() sorts the samples the interval is read from */
     benchmark_result_t *data = bench->results;
-    double relative_performance = 1.0;
+    calculate_stats(data, bench->timed_iterations);
+
+    size_t lo_idx, hi_idx;
+    median_ci_ranks(bench->timed_iterations, BENCH_MATRIX_Z, &lo_idx, &hi_idx);
+    lo[n] = bench->timed_iterations > 0 ? (double)data->samples[lo_idx] : 0.0;
+    hi[n] = bench->timed_iterations > 0 ? (double)data->samples[hi_idx] : 0.0;
+    members[n++] = bench;
+  }
+
+  if (n == 0)
+    return;
+
+  printf("\n");
+  printf("========================================\n");
+  printf("SPEEDUP MATRIX (row vs. column, 95%% CI)\n");
+  if (group != NULL)
+    printf("Group: %s\n", group);
+  printf("========================================\n");
+
+  printf("%-20s", "");
+  for (size_t c = 0; c < n; c++) {
+    printf(" %-20.20s", members[c]->name);
+  }
+  printf("\n");
+
+  for (size_t r = 0; r < n; r++) {
+    benchmark_result_t *row = members[r]->results;
+    printf("%-20.20s", members[r]->name);
+
+    for (size_t c = 0; c < n; c++) {
+      benchmark_result_t *col = members[c]->results;
+      char cell[32];
+
+      if (r == c) {
+        snprintf(cell, sizeof(cell), "-");
+      } else if (row->is_cycles != col->is_cycles || row->median_time == 0 ||
+                 lo[r] <= 0.0) {
+        snprintf(cell, sizeof(cell), "n/a");
+      } else {
+        snprintf(cell, sizeof(cell), "%.2fx [%.2f, %.2f]",
+                 (double)col->median_time / (double)row->median_time,
+                 lo[c] / hi[r], hi[c] / lo[r]);
+      }
+      printf(" %-20s", cell);
+    }
+    printf("\n");
+  }
+
+  printf("(cell = median(column) / median(row), > 1 means row is faster)\n");
+  printf("========================================\n");
+  printf("\n");
+}
+
+/**
+ * @brief Prints the comparison matrix of every comparison group.
+ *
+ * @param results Array of benchmarks
+ * @param count Number of benchmarks
+ */
+PIBENCH_ENGINE void print_comparison_matrices(benchmark_t **results,
+                                              size_t count) {
+  if (results == NULL || count == 0) {
+    printf("Error: No benchmark results to display\n");
+    return;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (results[i] != NULL && !bench_group_seen(results, i))
+      print_comparison_matrix(results, count, results[i]->group);
+  }
+}
+
+PIBENCH_ENGINE void print_family_results(benchmark_t **results, size_t count) {
+  if (results == NULL || count == 0) {
+    printf("Error: No benchmark results to display\n");
+    return;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    benchmark_t *first = results[i];
+    if (first == NULL || first->family == NULL)
+      continue;
+
+    /* skip families that were already printed */
+    bool printed = false;
+    for (size_t j = 0; j < i; j++) {
+      if (results[j] != NULL && results[j]->family == first->family &&
+          results[j]->numa == first->numa) {
+        printed = true;
+        break;
+      }
+    }
+    if (printed)
+      continue;
+
+    const char *unit = first->results->is_cycles ? "cycles" : "ns";
+
+    printf("\n");
+    printf("========================================\n");
+    if (bench_options.numa == BENCH_NUMA_SWEEP)
+      printf("Family: %s (%s)\n", first->family,
+             bench_numa_mode_name(first->numa));
+    else
+      printf("Family: %s\n", first->family);
+    printf("========================================\n");
+
+    for (size_t a = 0; a < first->args.count; a++) {
+      printf("%14s ", first->args.names[a]);
+    }
+    printf("%12s %12s %12s %12s %10s %14s\n", "median", "mean", "stddev",
+           "min", "cmr %", first->args.count > 0 ? "median/param" : "");
 
-    if (!bench->is_baseline) {
-      relative_performance =
-          (double)data->median_time / (double)baseline->results->median_time;
-      if (relative_performance < 1.0) {
-        double speed_increase = 1.0 / relative_performance;
-        printf("%-20s: %8lu %s (%.2fx) - %.1fx faster\n", bench->name,
-               data->median_time, data->is_cycles ? "cycles" : "us",
-               relative_performance, speed_increase);
+    for (size_t j = i; j < count; j++) {
+      benchmark_t *bench = results[j];
+      if (bench == NULL || bench->family != first->family ||
+          bench->numa != first->numa)
         continue;
+
+      benchmark_result_t *data = bench->results;
+      calculate_stats(data, bench->timed_iterations);
+
+      for (size_t a = 0; a < bench->args.count; a++) {
+        printf("%14ld ", (long)bench->args.values[a]);
       }
-    } else {
-      relative_performance = 1.0;
+      printf("%12lu %12.2f %12.2f %12lu %10.2f", data->median_time,
+             data->mean_time, data->stddev_time, data->min_time,
+             data->median_cmr);
+      if (bench->args.count > 0 && bench->args.values[0] != 0) {
+        printf(" %14.6f", (double)data->median_time /
+                              (double)bench->args.values[0]);
+      }
+      printf("\n");
+    }
+
+    printf("(times in %s, median/param is relative to '%s')\n", unit,
+           first->args.count > 0 ? first->args.names[0] : "-");
+    printf("========================================\n");
+  }
+
+  printf("\n");
+}
+
+/**
+ * @brief Finds the result of a benchmark with the given placement in the
+ * given repetition.
+ *
+ * @return The benchmark, or NULL if it did not run with the placement
+ */
+static inline benchmark_t *bench_numa_find(benchmark_t **results, size_t count,
+                                           const char *base,
+                                           bench_numa_mode_t mode,
+                                           size_t repetition) {
+  for (size_t i = 0; i < count; i++) {
+    if (results[i] != NULL && results[i]->numa == mode &&
+        results[i]->repetition == repetition &&
+        strcmp(results[i]->numa_base, base) == 0)
+      return results[i];
+  }
+  return NULL;
+}
+
+/**
+ * @brief Prints the slowdown of remote and interleaved memory relative to
+ * local memory for every benchmark of a --numa=sweep run.
+ *
+ * @param results Array of benchmarks
+ * @param count Number of benchmarks
+ */
+PIBENCH_ENGINE void print_numa_results(benchmark_t **results, size_t count) {
+  if (results == NULL || count == 0) {
+    printf("Error: No benchmark results to display\n");
+    return;
+  }
+
+  bool printed = false;
+  for (size_t i = 0; i < count; i++) {
+    benchmark_t *local = results[i];
+    if (local == NULL || local->numa != BENCH_NUMA_LOCAL ||
+        local->repetition_base == local->numa_base)
+      continue;
+
+    if (!printed) {
+      printf("\n");
+      printf("========================================\n");
+      printf("NUMA PLACEMENT\n");
+      printf("========================================\n");
+      printf("%-24s %12s %12s %8s %12s %8s\n", "Benchmark", "local",
+             "remote", "ratio", "interleave", "ratio");
+      printed = true;
     }
 
-    printf("%-20s: %8lu %s (%.2fx)%s\n", bench->name, data->median_time,
-           bench->results->is_cycles ? "cycles" : "us", relative_performance,
-           bench->is_baseline ? " - baseline" : "");
+    calculate_stats(local->results, local->timed_iterations);
+    char label[64];
+    if (local->name == local->repetition_base)
+      snprintf(label, sizeof(label), "%s", local->numa_base);
+    else
+      snprintf(label, sizeof(label), "%s#%zu", local->numa_base,
+               local->repetition + 1);
+    printf("%-24.24s %12lu", label, local->results->median_time);
+
+    const bench_numa_mode_t modes[] = {BENCH_NUMA_REMOTE,
+                                       BENCH_NUMA_INTERLEAVE};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+      benchmark_t *other =
+          bench_numa_find(results, count, local->numa_base, modes[m],
+                          local->repetition);
+      if (other == NULL) {
+        printf(" %12s %8s", "-", "-");
+        continue;
+      }
+
+      calculate_stats(other->results, other->timed_iterations);
+      printf(" %12lu", other->results->median_time);
+      if (local->results->median_time > 0)
+        printf(" %7.2fx", (double)other->results->median_time /
+                              (double)local->results->median_time);
+      else
+        printf(" %8s", "n/a");
+    }
+    printf("\n");
   }
 
+  if (!printed)
+    return;
+  printf("(medians, ratio = median / local median, > 1 means slower)\n");
+  if (bench_topology()->node_count < 2)
+    printf("\033[33mSingle NUMA node: remote and interleaved memory are "
+           "local!\033[0m\n");
   printf("========================================\n");
   printf("\n");
+}
+
+/**
+ * @brief Prints the spread of the medians of every benchmark over the runs of
+ * a --repetitions run.
+ *
+ * The median of every run is one observation, their mean, median, standard
+ * deviation and coefficient of variation show how reproducible the
+ * benchmark is from run to run.
+ *
+ * @param results Array of benchmarks
+ * @param count Number of benchmarks
+ */
+PIBENCH_ENGINE void print_repetition_results(benchmark_t **results,
+                                             size_t count) {
+  if (results == NULL || count == 0) {
+    printf("Error: No benchmark results to display\n");
+    return;
+  }
+
+  uint64_t *medians = (uint64_t *)malloc(count * sizeof(uint64_t));
+  if (medians == NULL) {
+    fprintf(stderr, "Error: Could not allocate memory for the repetitions\n");
+    return;
+  }
+
+  bool printed = false;
+  for (size_t i = 0; i < count; i++) {
+    benchmark_t *first = results[i];
+    if (first == NULL || first->repetition != 0 ||
+        first->name == first->repetition_base)
+      continue;
 
-  free(indices);
+    size_t runs = 0;
+    for (size_t j = i; j < count; j++) {
+      benchmark_t *run = results[j];
+      if (run == NULL ||
+          strcmp(run->repetition_base, first->repetition_base) != 0)
+        continue;
+      calculate_stats(run->results, run->timed_iterations);
+      medians[runs++] = run->results->median_time;
+    }
+
+    if (!printed) {
+      printf("\n");
+      printf("========================================\n");
+      printf("REPETITIONS\n");
+      printf("========================================\n");
+      printf("%-24s %4s %12s %12s %10s %7s %10s %10s\n", "Benchmark", "runs",
+             "mean", "median", "stddev", "cv", "min", "max");
+      printed = true;
+    }
+
+    double avg = mean(medians, runs);
+    double sd = stddev(medians, runs);
+    uint64_t mid = median(medians, runs, quick_sort);
+    printf("%-24.24s %4zu %12.1f %12lu %10.1f", first->repetition_base, runs,
+           avg, mid, sd);
+    if (avg > 0.0)
+      printf(" %6.2f%%", 100.0 * sd / avg);
+    else
+      printf(" %7s", "n/a");
+    printf(" %10lu %10lu %s\n", medians[0], medians[runs - 1],
+           first->results->is_cycles ? "cycles" : "ns");
+  }
+  free(medians);
+
+  if (!printed)
+    return;
+  printf("(medians of the runs, cv = stddev / mean)\n");
+  printf("========================================\n");
+  printf("\n");
 }
 
-bool to_csv(benchmark_t **benchmarks, size_t num, const char *dir) {
+/**
+ * @brief Prints the position of every benchmark with declared work on the
+ * roofline of the machine.
+ *
+ * The roofs come from the machine characterization of machine-bench, without
+ * one only the achieved rates are printed.
+ *
+ * @param results Array of benchmarks
+ * @param count Number of benchmarks
+ */
+PIBENCH_ENGINE void print_roofline(benchmark_t **results, size_t count) {
+  if (results == NULL || count == 0) {
+    printf("Error: No benchmark results to display\n");
+    return;
+  }
 
-  for (size_t i = 0; i < num; i++) {
+  bench_machine_t machine;
+  bool has_machine = bench_machine_load(&machine);
+
+  bool printed = false;
+  for (size_t i = 0; i < count; i++) {
+    benchmark_t *bench = results[i];
+    if (bench == NULL)
+      continue;
+
+    calculate_stats(bench->results, bench->timed_iterations);
+    bench_roofline_t point;
+    if (!bench_roofline(bench, has_machine ? &machine : NULL, &point))
+      continue;
+
+    if (!printed) {
+      printf("\n");
+      printf("========================================\n");
+      printf("ROOFLINE\n");
+      printf("========================================\n");
+      if (has_machine && machine.peak_gflops > 0.0 && machine.triad_gbs > 0.0)
+        printf("peak %.2f GFLOP/s (%s), bandwidth %.2f GB/s (triad), "
+               "ridge %.2f flop/byte\n",
+               machine.peak_gflops, machine.peak_kernels, machine.triad_gbs,
+               machine.peak_gflops / machine.triad_gbs);
+      else
+        printf("\033[33mNo machine characterization with a peak compute "
+               "rate, run machine-bench for the roofs!\033[0m\n");
+      printf("%-24s %10s %10s %10s %10s %8s %8s %8s\n", "Benchmark",
+             "GFLOP/s", "GB/s", "flop/B", "roof", "% peak", "% bw", "bound");
+      printed = true;
+    }
+
+    printf("%-24.24s %10.3f %10.3f", bench->name, point.gflops, point.gbs);
+    if (point.bytes > 0.0)
+      printf(" %10.3f", point.intensity);
+    else
+      printf(" %10s", "-");
+    if (point.has_roofs)
+      printf(" %10.3f %7.1f%% %7.1f%% %8s\n", point.attainable_gflops,
+             point.compute_pct, point.bandwidth_pct,
+             point.memory_bound ? "memory" : "compute");
+    else
+      printf(" %10s %8s %8s %8s\n", "-", "-", "-", "-");
+  }
+
+  if (!printed) {
+    printf("No benchmark declared its work, see bench_set_work()\n");
+    return;
+  }
+  printf("(medians, roof = attainable GFLOP/s at the intensity)\n");
+  printf("========================================\n");
+  printf("\n");
+}
+
+PIBENCH_ENGINE bool to_csv(benchmark_t **benchmarks, size_t num,
+                           const char *dir) {
+  bench_writer_t writer;
+  if (!bench_writer_init(&writer)) {
+    fprintf(stderr, "Error: Could not allocate memory for the csv writer\n");
+    return false;
+  }
+
+  int flags = BENCH_WRITER_PREALLOCATE;
+  if (bench_options.direct_io)
+    flags |= BENCH_WRITER_DIRECT;
+
+  bool success = true;
+  for (size_t i = 0; i < num && success; i++) {
     benchmark_t *benchmark = benchmarks[i];
     benchmark_result_t *results = benchmark->results;
     uint64_t *samples = results->samples;
     double *cmr = results->cache_miss_rates;
     const char *name = benchmark->name;
-    size_t len = strlen(name) + 1;
 
-    char *filename = (char *)malloc(len);
-    if (filename == NULL) {
-      fprintf(stderr, "Error: Could not allocate memory for header\n");
-      return false;
+    char filename[192];
+    size_t len = strlen(name);
+    if (len >= sizeof(filename)) {
+      fprintf(stderr, "Error: Name too long\n");
+      success = false;
+      break;
     }
 
-    for (size_t cidx = 0; cidx < len; cidx++) {
+    for (size_t cidx = 0; cidx <= len; cidx++) {
       char c = name[cidx];
       if (c == ' ')
         filename[cidx] = '_';
@@ -224,36 +1169,529 @@ bool to_csv(benchmark_t **benchmarks, size_t num, const char *dir) {
 
     int written =
         snprintf(path, sizeof(path), "%s/benchmark_%s.csv", dir, filename);
-    if (written >= sizeof(path)) {
+    if (written < 0 || (size_t)written >= sizeof(path)) {
       fprintf(stderr, "Error: Path too long\n");
-      free(filename);
-      return false;
+      success = false;
+      break;
     }
 
-    FILE *csv = fopen(path, "w");
-    if (csv == NULL) {
+    /* one sample takes at most 20 digits, a comma and ~8 characters of cmr,
+     * the interrupts another 20 digits and a comma */
+    uint64_t *irqs = results->irq_counts;
+    uint64_t size_hint = 256 + (uint64_t)benchmark->timed_iterations *
+                                   (irqs != NULL ? 53 : 32);
+    if (!bench_writer_open(&writer, path, flags, size_hint)) {
       fprintf(stderr, "Error: Could not open file %s for writing\n", path);
-      return false;
+      success = false;
+      break;
     }
 
-    fprintf(csv,
-            "# name: %s\n# timing format: %s\n# is valid: %s\n# warmup runs: "
-            "%lu\n# timed runs: %lu\n\ntiming,cache_miss_rate\n",
-            name, benchmark->results->is_cycles ? "cycles" : "microseconds",
-            benchmark->is_baseline
-                ? "Baseline"
-                : (benchmark->validate ? (benchmark->is_valid ? "Yes" : "No")
-                                       : "Not Validated"),
-            benchmark->warmup_iterations, benchmark->timed_iterations);
+    char header[512];
+    int header_len = snprintf(
+        header, sizeof(header),
+        "# name: %s\n# timing format: %s\n# is valid: %s\n# warmup runs: "
+        "%lu\n# timed runs: %lu\n\ntiming,cache_miss_rate%s\n",
+        name, benchmark->results->is_cycles ? "cycles" : "nanoseconds",
+        benchmark->is_baseline
+            ? "Baseline"
+            : (benchmark->validate ? (benchmark->is_valid ? "Yes" : "No")
+                                   : "Not Validated"),
+        benchmark->warmup_iterations, benchmark->timed_iterations,
+        irqs != NULL ? ",irqs" : "");
+    if (header_len > 0 && (size_t)header_len >= sizeof(header))
+      header_len = sizeof(header) - 1;
+    if (header_len > 0)
+      bench_writer_put(&writer, header, (size_t)header_len);
 
     for (size_t i = 0; i < benchmark->timed_iterations; i++) {
-      fprintf(csv, "%lu,%0.2f\n", samples[i], cmr[i]);
+      bench_writer_u64(&writer, samples[i]);
+      bench_writer_char(&writer, ',');
+      bench_writer_fixed(&writer, cmr[i], 2);
+      if (irqs != NULL) {
+        bench_writer_char(&writer, ',');
+        bench_writer_u64(&writer, irqs[i]);
+      }
+      bench_writer_char(&writer, '\n');
+    }
+
+    if (!bench_writer_close(&writer)) {
+      fprintf(stderr, "Error: Could not write file %s\n", path);
+      success = false;
+    }
+  }
+
+  bench_writer_free(&writer);
+  return success;
+}
+
+/**
+ * @brief Writes the roofline of the benchmarks with declared work as CSV for
+ * plotting.
+ *
+ * The roofs are written as comments, the columns of a benchmark without
+ * roofs are left empty.
+ *
+ * @param benchmarks Array of benchmarks to export
+ * @param num Number of benchmarks
+ * @param path File to write to, "-" or NULL for stdout
+ * @return true on success, false if the file could not be written
+ */
+PIBENCH_ENGINE bool to_roofline_csv(benchmark_t **benchmarks, size_t num,
+                                    const char *path) {
+  bool use_stdout = path == NULL || strcmp(path, "-") == 0;
+  FILE *csv = use_stdout ? stdout : fopen(path, "w");
+  if (csv == NULL) {
+    fprintf(stderr, "Error: Could not open file %s for writing\n", path);
+    return false;
+  }
+
+  bench_machine_t machine;
+  bool has_machine = bench_machine_load(&machine);
+  if (has_machine)
+    fprintf(csv, "# peak_gflops: %.3f\n# bandwidth_gbs: %.3f\n",
+            machine.peak_gflops, machine.triad_gbs);
+  fprintf(csv, "name,flops,bytes,seconds,intensity,gflops,gbs,"
+               "attainable_gflops,compute_pct,bandwidth_pct,bound\n");
+
+  for (size_t i = 0; i < num; i++) {
+    benchmark_t *benchmark = benchmarks[i];
+    calculate_stats(benchmark->results, benchmark->timed_iterations);
+
+    bench_roofline_t point;
+    if (!bench_roofline(benchmark, has_machine ? &machine : NULL, &point))
+      continue;
+
+    fprintf(csv, "%s,%.0f,%.0f,%.9g,%.6f,%.6f,%.6f,", benchmark->name,
+            point.flops, point.bytes, point.seconds, point.intensity,
+            point.gflops, point.gbs);
+    if (point.has_roofs)
+      fprintf(csv, "%.6f,%.3f,%.3f,%s\n", point.attainable_gflops,
+              point.compute_pct, point.bandwidth_pct,
+              point.memory_bound ? "memory" : "compute");
+    else
+      fprintf(csv, ",,,\n");
+  }
+
+  bool success = !ferror(csv);
+  if (!use_stdout)
+    success = fclose(csv) == 0 && success;
+  if (!success)
+    fprintf(stderr, "Error: Could not write file %s\n", path);
+  return success;
+}
+
+/**
+ * @brief Writes a string as a quoted and escaped JSON string.
+ *
+ * @param out Stream to write to
+ * @param str String to write
+ */
+static inline void json_write_string(FILE *out, const char *str) {
+  fputc('"', out);
+  for (const char *c = str; *c != '\0'; c++) {
+    switch (*c) {
+    case '"':
+      fputs("\\\"", out);
+      break;
+    case '\\':
+      fputs("\\\\", out);
+      break;
+    case '\n':
+      fputs("\\n", out);
+      break;
+    case '\t':
+      fputs("\\t", out);
+      break;
+    default:
+      if ((unsigned char)*c < 0x20)
+        fprintf(out, "\\u%04x", (unsigned char)*c);
+      else
+        fputc(*c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+/**
+ * @brief Returns the metadata of the run being exported.
+ *
+ * @param env Receives the environment, collected now unless recorded
+ * @param machine Receives the machine characterization
+ * @return true if a characterization was found
+ */
+static inline bool bench_run_metadata_get(bench_env_t *env,
+                                          bench_machine_t *machine) {
+  if (bench_run_metadata.recorded) {
+    *env = bench_run_metadata.env;
+    *machine = bench_run_metadata.machine;
+    return bench_run_metadata.has_machine;
+  }
+
+  bench_env_collect(env);
+  return bench_machine_load(machine);
+}
+
+/**
+ * @brief Writes the environment metadata as a JSON object.
+ *
+ * @param out Stream to write to
+ * @param env Collected environment
+ * @param nl Separator between the fields, e.g. "\n    " or ""
+ */
+static inline void json_write_env(FILE *out, const bench_env_t *env,
+                                  const char *nl) {
+  const char *strings[][2] = {
+      {"hostname", env->hostname},
+      {"kernel", env->kernel},
+      {"kernel_version", env->kernel_version},
+      {"arch", env->arch},
+      {"cpu_model", env->cpu_model},
+      {"board", env->board},
+      {"governor", env->governor},
+      {"clocksource", env->clocksource},
+      {"cycle_counter", env->cycle_counter},
+      {"compiler", env->compiler},
+      {"cflags", env->cflags},
+      {"git_sha", env->git_sha},
+  };
+
+  fputc('{', out);
+  for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+    fprintf(out, "%s\"%s\": ", nl, strings[i][0]);
+    json_write_string(out, strings[i][1]);
+    fputc(',', out);
+  }
+
+  fprintf(out, "%s\"cpu_count\": %d,%s\"cur_freq_mhz\": [", nl,
+          env->cpu_count, nl);
+  for (int i = 0; i < env->cpu_count && i < BENCH_ENV_MAX_CPUS; i++)
+    fprintf(out, "%s%lu", i == 0 ? "" : ", ", env->cur_freq_mhz[i]);
+  fprintf(out,
+          "],%s\"min_freq_mhz\": %lu,%s\"max_freq_mhz\": %lu,"
+          "%s\"temperature\": %.1f,%s\"cycle_counter_hz\": %lu,"
+          "%s\"timer\": \"CLOCK_MONOTONIC\",%s\"timestamp\": %lu",
+          nl, env->min_freq_mhz, nl, env->max_freq_mhz, nl,
+          env->temperature, nl, env->cycle_counter_hz, nl, nl,
+          env->timestamp);
+  fprintf(out, "%s}", nl[0] == '\0' ? "" : "\n  ");
+}
+
+/**
+ * @brief Writes a machine characterization as a JSON object.
+ *
+ * @param out Stream to write to
+ * @param machine The characterization
+ * @param nl Separator between the fields, e.g. "\n    " or ""
+ */
+static inline void json_write_machine(FILE *out, const bench_machine_t *machine,
+                                      const char *nl) {
+  fprintf(out, "{%s\"fingerprint\": ", nl);
+  json_write_string(out, machine->fingerprint);
+  fprintf(out, ",%s\"kernels\": ", nl);
+  json_write_string(out, machine->kernels);
+  fprintf(out, ",%s\"peak_kernels\": ", nl);
+  json_write_string(out, machine->peak_kernels);
+  fprintf(out,
+          ",%s\"peak_gflops\": %.3f,%s\"timestamp\": %lu,%s\"core\": %d,"
+          "%s\"stream_bytes\": %lu,"
+          "%s\"stream_gbs\": {\"copy\": %.3f, \"scale\": %.3f, "
+          "\"add\": %.3f, \"triad\": %.3f},%s\"latency_ns\": [",
+          nl, machine->peak_gflops, nl, machine->timestamp, nl, machine->core,
+          nl, machine->stream_bytes, nl, machine->copy_gbs, machine->scale_gbs,
+          machine->add_gbs, machine->triad_gbs, nl);
+  for (uint32_t i = 0; i < machine->latency_count; i++)
+    fprintf(out, "%s{\"bytes\": %lu, \"ns\": %.3f}", i == 0 ? "" : ", ",
+            machine->latency[i].bytes, machine->latency[i].ns);
+  fprintf(out, "],%s\"triad_scaling_gbs\": [", nl);
+  for (uint32_t i = 0; i < machine->scaling_count; i++)
+    fprintf(out, "%s{\"threads\": %u, \"gbs\": %.3f}", i == 0 ? "" : ", ",
+            machine->scaling[i].threads, machine->scaling[i].gbs);
+  fprintf(out, "]%s}", nl[0] == '\0' ? "" : "\n  ");
+}
+
+/**
+ * @brief Writes the statistics of a benchmark as a JSON object.
+ *
+ * Calculates the statistics of the benchmark first.
+ *
+ * @param out Stream to write to
+ * @param benchmark The benchmark
+ * @param machine Roofs of the roofline, NULL if not characterized
+ * @param nl Separator between the fields, e.g. "\n      " or ""
+ */
+static inline void json_write_benchmark(FILE *out, benchmark_t *benchmark,
+                                        const bench_machine_t *machine,
+                                        const char *nl) {
+  benchmark_result_t *results = benchmark->results;
+
+  calculate_stats(results, benchmark->timed_iterations);
+
+  fprintf(out, "{%s\"name\": ", nl);
+  json_write_string(out, benchmark->name);
+  if (benchmark->family != NULL) {
+    fprintf(out, ",%s\"family\": ", nl);
+    json_write_string(out, benchmark->family);
+    fprintf(out, ",%s\"args\": {", nl);
+    for (size_t a = 0; a < benchmark->args.count; a++) {
+      fprintf(out, "%s", a == 0 ? "" : ", ");
+      json_write_string(out, benchmark->args.names[a]);
+      fprintf(out, ": %ld", (long)benchmark->args.values[a]);
     }
+    fprintf(out, "}");
+  }
+  if (benchmark->group != NULL) {
+    fprintf(out, ",%s\"group\": ", nl);
+    json_write_string(out, benchmark->group);
+  }
+  if (benchmark->numa != BENCH_NUMA_DEFAULT)
+    fprintf(out, ",%s\"numa\": \"%s\"", nl,
+            bench_numa_mode_name(benchmark->numa));
+  fprintf(out,
+          ",%s\"timing_format\": \"%s\","
+          "%s\"is_baseline\": %s,"
+          "%s\"validated\": %s,"
+          "%s\"is_valid\": %s,"
+          "%s\"warmup_runs\": %zu,"
+          "%s\"timed_runs\": %zu,"
+          "%s\"page_size\": %zu,",
+          nl, results->is_cycles ? "cycles" : "nanoseconds", nl,
+          benchmark->is_baseline ? "true" : "false", nl,
+          benchmark->validate ? "true" : "false", nl,
+          benchmark->is_valid ? "true" : "false", nl,
+          benchmark->warmup_iterations, nl, benchmark->timed_iterations, nl,
+          results->page_size);
+  fprintf(out,
+          "%s\"time\": {\"median\": %lu, \"mean\": %.4f, "
+          "\"stddev\": %.4f, \"min\": %lu, \"max\": %lu, "
+          "\"p90\": %.4f, \"p99\": %.4f, \"p999\": %.4f},",
+          nl, results->median_time, results->mean_time, results->stddev_time,
+          results->min_time, results->max_time, results->p90_time,
+          results->p99_time, results->p999_time);
+  fprintf(out,
+          "%s\"cache_miss_rate\": {\"median\": %.6f, \"mean\": %.6f, "
+          "\"stddev\": %.6f, \"min\": %.6f, \"max\": %.6f},",
+          nl, results->median_cmr, results->mean_cmr, results->stddev_cmr,
+          results->min_cmr, results->max_cmr);
+  fprintf(out,
+          "%s\"validation\": {\"mismatches\": %zu, "
+          "\"first_mismatch\": %zu, \"max_error\": %g, \"max_ulp\": %lu},",
+          nl, benchmark->validation.mismatches,
+          benchmark->validation.first_mismatch,
+          benchmark->validation.max_error, benchmark->validation.max_ulp);
+  if (results->irq_counts != NULL)
+    fprintf(out,
+            "%s\"interrupts\": {\"total\": %lu, \"max\": %lu, "
+            "\"samples_hit\": %zu},",
+            nl, results->irq_total, results->irq_max, results->irq_samples);
+  if (results->energy_calls > 0) {
+    fprintf(out, "%s\"energy\": {\"source\": ", nl);
+    json_write_string(out, bench_energy_meter.label);
+    fprintf(out,
+            ", \"joules\": %.6f, \"seconds\": %.6f, \"calls\": %lu, "
+            "\"joules_per_call\": %.9g, \"watts\": %.4f},",
+            results->energy_j, (double)results->energy_ns * 1e-9,
+            results->energy_calls, bench_energy_per_call(benchmark),
+            bench_energy_watts(benchmark));
+  }
+  bench_roofline_t point;
+  if (bench_roofline(benchmark, machine, &point)) {
+    fprintf(out,
+            "%s\"roofline\": {\"flops\": %.0f, \"bytes\": %.0f, "
+            "\"gflops\": %.6f, \"gbs\": %.6f, \"intensity\": %.6f",
+            nl, point.flops, point.bytes, point.gflops, point.gbs,
+            point.intensity);
+    if (point.has_roofs)
+      fprintf(out,
+              ", \"attainable_gflops\": %.6f, \"compute_pct\": %.3f, "
+              "\"bandwidth_pct\": %.3f, \"bound\": \"%s\"",
+              point.attainable_gflops, point.compute_pct,
+              point.bandwidth_pct, point.memory_bound ? "memory" : "compute");
+    fprintf(out, "},");
+  }
+  fprintf(out,
+          "%s\"fixture\": {\"setup_ns\": %lu, \"teardown_ns\": %lu, "
+          "\"hook_mean_ns\": %.2f, \"hook_max_ns\": %lu, "
+          "\"hook_calls\": %zu}",
+          nl, results->fixture_setup_ns, results->fixture_teardown_ns,
+          results->hook_calls > 0 ? (double)results->hook_total_ns /
+                                        (double)results->hook_calls
+                                  : 0.0,
+          results->hook_max_ns, results->hook_calls);
+  fprintf(out, "%s}", nl[0] == '\0' ? "" : "\n    ");
+}
 
-    fclose(csv);
-    free(filename);
+/**
+ * @brief Writes the statistics of all benchmarks as a JSON document.
+ *
+ * Statistics are (re)calculated before they are written.
+ *
+ * @param benchmarks Array of benchmarks to export
+ * @param num Number of benchmarks
+ * @param path File to write to, "-" or NULL for stdout
+ * @return true on success, false if the file could not be written
+ */
+PIBENCH_ENGINE bool to_json(benchmark_t **benchmarks, size_t num,
+                            const char *path) {
+  bool use_stdout = path == NULL || strcmp(path, "-") == 0;
+  FILE *json = use_stdout ? stdout : fopen(path, "w");
+  if (json == NULL) {
+    fprintf(stderr, "Error: Could not open file %s for writing\n", path);
+    return false;
   }
 
+  bench_env_t env;
+  bench_machine_t machine;
+  bool has_machine = bench_run_metadata_get(&env, &machine);
+
+  fprintf(json, "{\n  \"environment\": ");
+  json_write_env(json, &env, "\n    ");
+  if (has_machine) {
+    fprintf(json, ",\n  \"machine\": ");
+    json_write_machine(json, &machine, "\n    ");
+  }
+  fprintf(json, ",\n  \"benchmarks\": [");
+
+  for (size_t i = 0; i < num; i++) {
+    fprintf(json, "%s\n    ", i == 0 ? "" : ",");
+    json_write_benchmark(json, benchmarks[i], has_machine ? &machine : NULL,
+                         "\n      ");
+  }
+
+  fprintf(json, "\n  ]\n}\n");
+
+  bool success = !ferror(json);
+  if (!use_stdout)
+    success = fclose(json) == 0 && success;
+  if (!success)
+    fprintf(stderr, "Error: Could not write file %s\n", path);
+  return success;
+}
+
+/**
+ * @brief State of the NDJSON stream written while the benchmarks run.
+ *
+ * out:                 Stream the records are written to, NULL if not open
+ * is_stdout:           Flag indicating if out is stdout
+ * machine:             Machine characterization of the environment record
+ * has_machine:         Flag indicating if a characterization was loaded
+ */
+typedef struct {
+  FILE *out;
+  bool is_stdout;
+  bench_machine_t machine;
+  bool has_machine;
+} bench_ndjson_t;
+
+static bench_ndjson_t bench_ndjson = PIBENCH_ZERO;
+
+/**
+ * @brief Opens the NDJSON stream and writes the environment record.
+ *
+ * @param path Output file, NULL or "-" for stdout
+ * @return true on success, false if the file could not be opened
+ */
+static inline bool bench_ndjson_open(const char *path) {
+  if (bench_ndjson.out != NULL)
+    return true;
+
+  bench_ndjson.is_stdout = path == NULL || strcmp(path, "-") == 0;
+  bench_ndjson.out = bench_ndjson.is_stdout ? stdout : fopen(path, "w");
+  if (bench_ndjson.out == NULL) {
+    fprintf(stderr, "Error: Could not open file %s for writing\n", path);
+    return false;
+  }
+
+  bench_env_t env;
+  bench_ndjson.has_machine =
+      bench_run_metadata_get(&env, &bench_ndjson.machine);
+
+  fprintf(bench_ndjson.out, "{\"type\": \"environment\", \"environment\": ");
+  json_write_env(bench_ndjson.out, &env, "");
+  if (bench_ndjson.has_machine) {
+    fprintf(bench_ndjson.out, ", \"machine\": ");
+    json_write_machine(bench_ndjson.out, &bench_ndjson.machine, "");
+  }
+  fprintf(bench_ndjson.out, "}\n");
+  fflush(bench_ndjson.out);
   return true;
 }
+
+/**
+ * @brief Writes one benchmark as an NDJSON record and flushes it.
+ *
+ * Called as soon as a benchmark finished, so consumers can follow the run.
+ *
+ * @param benchmark The finished benchmark
+ */
+PIBENCH_ENGINE void bench_ndjson_record(benchmark_t *benchmark) {
+  if (!bench_ndjson_open(bench_options.out))
+    return;
+
+  fprintf(bench_ndjson.out, "{\"type\": \"benchmark\", \"benchmark\": ");
+  json_write_benchmark(bench_ndjson.out, benchmark,
+                       bench_ndjson.has_machine ? &bench_ndjson.machine : NULL,
+                       "");
+  fprintf(bench_ndjson.out, "}\n");
+  fflush(bench_ndjson.out);
+}
+
+/**
+ * @brief Closes the NDJSON stream.
+ *
+ * @return true if every record was written, false on a write error
+ */
+static inline bool bench_ndjson_close(void) {
+  if (bench_ndjson.out == NULL)
+    return true;
+
+  bool success = !ferror(bench_ndjson.out);
+  if (!bench_ndjson.is_stdout)
+    success = fclose(bench_ndjson.out) == 0 && success;
+  bench_ndjson.out = NULL;
+  if (!success)
+    fprintf(stderr, "Error: Could not write the NDJSON records\n");
+  return success;
+}
+
+/**
+ * @brief Writes benchmarks as NDJSON records.
+ *
+ * Benchmarks that were streamed while running are not written again.
+ *
+ * @param benchmarks Array of benchmarks to export
+ * @param num Number of benchmarks
+ * @return true on success, false on error
+ */
+static inline bool to_ndjson(benchmark_t **benchmarks, size_t num) {
+  if (bench_ndjson.out != NULL)
+    return bench_ndjson_close();
+
+  for (size_t i = 0; i < num; i++) {
+    bench_ndjson_record(benchmarks[i]);
+    if (bench_ndjson.out == NULL)
+      return false;
+  }
+
+  return bench_ndjson_close();
+}
+
+PIBENCH_ENGINE bool export_results(benchmark_t **benchmarks, size_t num,
+                                   const bench_options_t *options) {
+  switch (options->format) {
+  case BENCH_FORMAT_JSON:
+    return to_json(benchmarks, num, options->out);
+  case BENCH_FORMAT_NDJSON:
+    return to_ndjson(benchmarks, num);
+  case BENCH_FORMAT_BINARY:
+    return to_binary(benchmarks, num,
+                     options->out != NULL ? options->out : "results.pibr",
+                     options->encoding);
+  case BENCH_FORMAT_CSV:
+  default:
+    return to_csv(benchmarks, num, options->out != NULL ? options->out : ".");
+  }
+}
+
+#endif // PIBENCH_DEFINITIONS
+
 #endif // DATA_PROCESSING_H
@@ -0,0 +1,587 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "./api.h"
+#include "./env.h"
+#include "./system.h"
+#include "./topology.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Directories the energy meter is discovered in, can be overridden to
+ * point at a copy of sysfs.
+ */
+#ifndef BENCH_POWERCAP_ROOT
+#define BENCH_POWERCAP_ROOT "/sys/class/powercap"
+#endif
+#ifndef BENCH_HWMON_ROOT
+#define BENCH_HWMON_ROOT "/sys/class/hwmon"
+#endif
+
+/**
+ * @brief Highest number of counters and sensors the energy meter sums up.
+ */
+#define BENCH_ENERGY_MAX_DOMAINS 16
+
+/**
+ * @brief Highest channel index probed on every hwmon device.
+ */
+#define BENCH_ENERGY_MAX_CHANNELS 8
+
+/**
+ * @brief Interval at which the power sensors are read in microseconds.
+ */
+#define BENCH_ENERGY_INTERVAL_US 2000
+
+/**
+ * @brief Backend of the energy meter.
+ *
+ * BENCH_ENERGY_NONE:   No readable counter or sensor
+ * BENCH_ENERGY_RAPL:   energy_uj counters of /sys/class/powercap/intel-rapl*,
+ *                      also used by AMD CPUs
+ * BENCH_ENERGY_HWMON:  Energy counters or power/current sensors of
+ *                      /sys/class/hwmon, e.g. an INA219 on the power rail
+ */
+typedef enum {
+  BENCH_ENERGY_NONE,
+  BENCH_ENERGY_RAPL,
+  BENCH_ENERGY_HWMON,
+} bench_energy_source_t;
+
+/**
+ * @brief One energy counter or power sensor of the meter.
+ *
+ * name:                Name of the domain, e.g. "package-0" or "ina219"
+ * energy_fd:           Counter in microjoules, -1 for power sensors
+ * range_uj:            Value at which the counter wraps around, 0 if unknown
+ * power_fd:            Power in microwatts, -1 if read as current * voltage
+ * current_fd:          Current in milliamperes, -1 if not used
+ * voltage_fd:          Voltage in millivolts, -1 if not used
+ * start_uj:            Counter value when the measurement began
+ * last_uw:             Power at the last read of the sampler
+ */
+typedef struct {
+  char name[32];
+  int energy_fd;
+  uint64_t range_uj;
+  int power_fd;
+  int current_fd;
+  int voltage_fd;
+  uint64_t start_uj;
+  double last_uw;
+} bench_energy_domain_t;
+
+/**
+ * @brief Energy meter of the process, opened on first use with --energy.
+ *
+ * Counters are read when a measurement begins and ends. Power sensors are
+ * integrated by a sampler thread that runs on another CPU than the benchmark
+ * while a measurement is in progress. The sampler is started by the first
+ * measurement and waits for the next one in between, so the blocks of an
+ * interleaved run share it.
+ *
+ * probed:              Flag indicating if the meter was discovered
+ * source:              Backend of the meter
+ * domains:             Counters and sensors summed up
+ * count:               Number of domains
+ * label:               Source and domain names for the reports
+ * sampler:             Thread integrating the power sensors
+ * lock:                Protects sampling, sensor_joules, last_ns and the
+ *                      last_uw of the domains once the sampler runs
+ * wake:                Signaled when sampling or running is changed
+ * running:             Flag telling the sampler to keep running
+ * sampling:            Flag telling the sampler to integrate the sensors
+ * has_sampler:         Flag indicating if the sampler was started
+ * sensor_joules:       Energy integrated since the measurement began
+ * last_ns:             Time the sensors were last read
+ * active:              Flag indicating if a measurement is in progress
+ * start_ns:            Time the measurement began
+ */
+typedef struct {
+  bool probed;
+  bench_energy_source_t source;
+  bench_energy_domain_t domains[BENCH_ENERGY_MAX_DOMAINS];
+  size_t count;
+  char label[160];
+  pthread_t sampler;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  bool running;
+  bool sampling;
+  bool has_sampler;
+  double sensor_joules;
+  uint64_t last_ns;
+  bool active;
+  uint64_t start_ns;
+} bench_energy_meter_t;
+
+PIBENCH_STATE bench_energy_meter_t
+    bench_energy_meter PIBENCH_INIT(PIBENCH_ZERO);
+
+/**
+ * @brief Reads an integer from a sysfs file that is kept open.
+ *
+ * @return The value, or -1 if the file cannot be read
+ */
+static inline long long bench_energy_read(int fd) {
+  char buffer[32];
+  ssize_t len = pread(fd, buffer, sizeof(buffer) - 1, 0);
+  if (len <= 0)
+    return -1;
+  buffer[len] = '\0';
+
+  char *end;
+  long long value = strtoll(buffer, &end, 10);
+  return end == buffer ? -1 : value;
+}
+
+/**
+ * @brief Opens a sysfs file of a domain and checks that it can be read.
+ *
+ * @return File descriptor, -1 if the file is missing or not readable
+ */
+static inline int bench_energy_open_file(const char *dir, const char *file) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, file);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd >= 0 && bench_energy_read(fd) < 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief Adds a domain to the meter.
+ *
+ * @return The domain with all files closed, NULL if the meter is full
+ */
+static inline bench_energy_domain_t *
+bench_energy_add(bench_energy_meter_t *meter, const char *name) {
+  if (meter->count == BENCH_ENERGY_MAX_DOMAINS)
+    return NULL;
+
+  bench_energy_domain_t *domain = &meter->domains[meter->count++];
+  memset(domain, 0, sizeof(*domain));
+  snprintf(domain->name, sizeof(domain->name), "%s", name);
+  domain->energy_fd = -1;
+  domain->power_fd = -1;
+  domain->current_fd = -1;
+  domain->voltage_fd = -1;
+  return domain;
+}
+
+/**
+ * @brief Adds the RAPL counters to the meter.
+ *
+ * Without a filter the package domains are summed up, their subzones (core,
+ * uncore, dram) and psys would count the same energy twice.
+ *
+ * @param meter The meter
+ * @param filter Name of the domains to use, e.g. "dram", NULL for packages
+ * @return true if at least one counter can be read
+ *
+ * @note Since Linux 5.10 energy_uj is only readable by root
+ */
+static inline bool bench_energy_probe_rapl(bench_energy_meter_t *meter,
+                                           const char *filter) {
+  DIR *dir = opendir(BENCH_POWERCAP_ROOT);
+  if (dir == NULL)
+    return false;
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, "intel-rapl:", 11) != 0)
+      continue;
+
+    char zone[384], path[448], name[32];
+    snprintf(zone, sizeof(zone), "%s/%s", BENCH_POWERCAP_ROOT, entry->d_name);
+    snprintf(path, sizeof(path), "%s/name", zone);
+    if (!bench_read_line(path, name, sizeof(name)))
+      continue;
+    if (filter != NULL ? strcmp(name, filter) != 0
+                       : strncmp(name, "package-", 8) != 0)
+      continue;
+
+    int fd = bench_energy_open_file(zone, "energy_uj");
+    if (fd < 0)
+      continue;
+    bench_energy_domain_t *domain = bench_energy_add(meter, name);
+    if (domain == NULL) {
+      close(fd);
+      break;
+    }
+    domain->energy_fd = fd;
+    snprintf(path, sizeof(path), "%s/max_energy_range_uj", zone);
+    long range = bench_sysfs_long(path, 0);
+    domain->range_uj = range > 0 ? (uint64_t)range : 0;
+  }
+
+  closedir(dir);
+  return meter->count > 0;
+}
+
+/**
+ * @brief Adds the first energy counter, power sensor or current and voltage
+ * pair of every hwmon device to the meter.
+ *
+ * @param meter The meter
+ * @param filter Name of the devices to use, e.g. "ina219", NULL for all
+ * @return true if at least one device can be read
+ */
+static inline bool bench_energy_probe_hwmon(bench_energy_meter_t *meter,
+                                            const char *filter) {
+  DIR *dir = opendir(BENCH_HWMON_ROOT);
+  if (dir == NULL)
+    return false;
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, "hwmon", 5) != 0)
+      continue;
+
+    char device[384], path[448], name[32];
+    snprintf(device, sizeof(device), "%s/%s", BENCH_HWMON_ROOT,
+             entry->d_name);
+    snprintf(path, sizeof(path), "%s/name", device);
+    if (!bench_read_line(path, name, sizeof(name)) ||
+        (filter != NULL && strcmp(name, filter) != 0))
+      continue;
+
+    int energy = -1, power = -1, current = -1, voltage = -1;
+    for (int c = 0; c <= BENCH_ENERGY_MAX_CHANNELS && energy < 0; c++) {
+      char file[32];
+      snprintf(file, sizeof(file), "energy%d_input", c);
+      energy = bench_energy_open_file(device, file);
+    }
+    for (int c = 0; c <= BENCH_ENERGY_MAX_CHANNELS && energy < 0 && power < 0;
+         c++) {
+      char file[32];
+      snprintf(file, sizeof(file), "power%d_input", c);
+      power = bench_energy_open_file(device, file);
+      if (power < 0) {
+        snprintf(file, sizeof(file), "power%d_average", c);
+        power = bench_energy_open_file(device, file);
+      }
+    }
+    /* the bus voltage has the index of the current on e.g. the INA2xx */
+    for (int c = 0; c <= BENCH_ENERGY_MAX_CHANNELS && energy < 0 &&
+                    power < 0 && voltage < 0;
+         c++) {
+      char file[32];
+      snprintf(file, sizeof(file), "curr%d_input", c);
+      current = bench_energy_open_file(device, file);
+      if (current < 0)
+        continue;
+      snprintf(file, sizeof(file), "in%d_input", c);
+      voltage = bench_energy_open_file(device, file);
+      if (voltage < 0) {
+        close(current);
+        current = -1;
+      }
+    }
+    if (energy < 0 && power < 0 && current < 0)
+      continue;
+
+    bench_energy_domain_t *domain = bench_energy_add(meter, name);
+    if (domain == NULL) {
+      int fds[] = {energy, power, current, voltage};
+      for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+        if (fds[i] >= 0)
+          close(fds[i]);
+      break;
+    }
+    domain->energy_fd = energy;
+    domain->power_fd = power;
+    domain->current_fd = current;
+    domain->voltage_fd = voltage;
+  }
+
+  closedir(dir);
+  return meter->count > 0;
+}
+
+/**
+ * @brief Discovers the energy meter, RAPL first and hwmon otherwise.
+ *
+ * Only the first call probes sysfs, later calls return the result of the
+ * first.
+ *
+ * @param filter Name of the RAPL domains or hwmon devices to use, NULL for
+ * the defaults
+ * @return true if the meter can be read
+ */
+static inline bool bench_energy_open(const char *filter) {
+  bench_energy_meter_t *meter = &bench_energy_meter;
+  if (meter->probed)
+    return meter->source != BENCH_ENERGY_NONE;
+  meter->probed = true;
+
+  if (bench_energy_probe_rapl(meter, filter))
+    meter->source = BENCH_ENERGY_RAPL;
+  else if (bench_energy_probe_hwmon(meter, filter))
+    meter->source = BENCH_ENERGY_HWMON;
+  else
+    meter->source = BENCH_ENERGY_NONE;
+
+  int len = snprintf(meter->label, sizeof(meter->label), "%s",
+                     meter->source == BENCH_ENERGY_RAPL ? "rapl" : "hwmon");
+  for (size_t i = 0; i < meter->count && len > 0 &&
+                     (size_t)len < sizeof(meter->label);
+       i++)
+    len += snprintf(meter->label + len, sizeof(meter->label) - len, "%s%s",
+                    i == 0 ? ": " : " + ", meter->domains[i].name);
+  return meter->source != BENCH_ENERGY_NONE;
+}
+
+/**
+ * @brief Reads the power of a sensor domain in microwatts.
+ *
+ * @return The power, or a negative value if the sensor cannot be read
+ */
+static inline double
+bench_energy_power_uw(const bench_energy_domain_t *domain) {
+  if (domain->power_fd >= 0)
+    return (double)bench_energy_read(domain->power_fd);
+
+  long long current = bench_energy_read(domain->current_fd);
+  long long voltage = bench_energy_read(domain->voltage_fd);
+  if (current < 0 || voltage < 0)
+    return -1.0;
+  return (double)current * (double)voltage;
+}
+
+/**
+ * @brief Integrates the power sensors from their last read up to a time.
+ *
+ * Uses the trapezoidal rule between two reads, so the energy of a sensor is
+ * exact if its power changes linearly between them.
+ *
+ * @note Called with the lock of the meter held
+ */
+static inline void bench_energy_integrate(bench_energy_meter_t *meter,
+                                          uint64_t now_ns) {
+  double seconds =
+      now_ns > meter->last_ns ? (double)(now_ns - meter->last_ns) * 1e-9 : 0.0;
+  meter->last_ns = now_ns;
+
+  for (size_t i = 0; i < meter->count; i++) {
+    bench_energy_domain_t *domain = &meter->domains[i];
+    if (domain->energy_fd >= 0)
+      continue;
+    double uw = bench_energy_power_uw(domain);
+    if (uw < 0.0)
+      uw = domain->last_uw;
+    meter->sensor_joules += (domain->last_uw + uw) * 0.5e-6 * seconds;
+    domain->last_uw = uw;
+  }
+}
+
+/**
+ * @brief Integrates the power sensors while a measurement is in progress and
+ * waits for the next one otherwise, until bench_energy_close().
+ */
+static inline void *bench_energy_sampler(void *arg) {
+  bench_energy_meter_t *meter = (bench_energy_meter_t *)arg;
+
+  pthread_mutex_lock(&meter->lock);
+  while (meter->running) {
+    if (!meter->sampling) {
+      pthread_cond_wait(&meter->wake, &meter->lock);
+      continue;
+    }
+
+    pthread_mutex_unlock(&meter->lock);
+    struct timespec interval = {0, BENCH_ENERGY_INTERVAL_US * 1000L};
+    nanosleep(&interval, NULL);
+    pthread_mutex_lock(&meter->lock);
+
+    /* the measurement may have ended or a new one begun meanwhile */
+    if (meter->sampling)
+      bench_energy_integrate(meter, get_time_ns());
+  }
+  pthread_mutex_unlock(&meter->lock);
+  return NULL;
+}
+
+/**
+ * @brief Moves the sampler to the online CPUs other than the calling one.
+ *
+ * Pinned benchmarks may run on a different core each, so this is done for
+ * every measurement.
+ */
+static inline void bench_energy_place_sampler(bench_energy_meter_t *meter) {
+  cpu_set_t cpus = bench_topology()->online;
+  int cpu = sched_getcpu();
+  if (cpu >= 0 && CPU_COUNT(&cpus) > 1)
+    CPU_CLR(cpu, &cpus);
+  if (CPU_COUNT(&cpus) > 0)
+    pthread_setaffinity_np(meter->sampler, sizeof(cpus), &cpus);
+}
+
+/**
+ * @brief Starts the sampler with normal priority, waiting for the first
+ * measurement.
+ *
+ * @return true if the sampler is running
+ */
+static inline bool bench_energy_start_sampler(bench_energy_meter_t *meter) {
+  pthread_attr_t attr;
+  if (pthread_attr_init(&attr) != 0)
+    return false;
+
+  /* the pinned benchmark thread runs with SCHED_FIFO */
+  struct sched_param param = {.sched_priority = 0};
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+  pthread_attr_setschedparam(&attr, &param);
+
+  pthread_mutex_init(&meter->lock, NULL);
+  pthread_cond_init(&meter->wake, NULL);
+  meter->running = true;
+  meter->sampling = false;
+  meter->has_sampler =
+      pthread_create(&meter->sampler, &attr, bench_energy_sampler, meter) == 0;
+  pthread_attr_destroy(&attr);
+
+  if (!meter->has_sampler) {
+    pthread_cond_destroy(&meter->wake);
+    pthread_mutex_destroy(&meter->lock);
+  }
+  return meter->has_sampler;
+}
+
+/**
+ * @brief Reads the counters and starts integrating the power sensors.
+ *
+ * @return true if the meter is measuring, false if there is no meter
+ */
+static inline bool bench_energy_begin(void) {
+  bench_energy_meter_t *meter = &bench_energy_meter;
+  if (meter->source == BENCH_ENERGY_NONE)
+    return false;
+
+  bool has_sensors = false;
+  for (size_t i = 0; i < meter->count; i++) {
+    bench_energy_domain_t *domain = &meter->domains[i];
+    if (domain->energy_fd >= 0) {
+      long long uj = bench_energy_read(domain->energy_fd);
+      domain->start_uj = uj > 0 ? (uint64_t)uj : 0;
+    } else {
+      has_sensors = true;
+    }
+  }
+
+  if (has_sensors) {
+    if (!meter->has_sampler && !bench_energy_start_sampler(meter))
+      return false;
+    bench_energy_place_sampler(meter);
+
+    pthread_mutex_lock(&meter->lock);
+    for (size_t i = 0; i < meter->count; i++) {
+      bench_energy_domain_t *domain = &meter->domains[i];
+      if (domain->energy_fd >= 0)
+        continue;
+      double uw = bench_energy_power_uw(domain);
+      domain->last_uw = uw > 0.0 ? uw : 0.0;
+    }
+    meter->sensor_joules = 0.0;
+    meter->start_ns = meter->last_ns = get_time_ns();
+    meter->sampling = true;
+    pthread_cond_signal(&meter->wake);
+    pthread_mutex_unlock(&meter->lock);
+  } else {
+    meter->start_ns = get_time_ns();
+  }
+
+  meter->active = true;
+  return true;
+}
+
+/**
+ * @brief Ends a measurement started by bench_energy_begin().
+ *
+ * The sensors are integrated up to the end of the measurement, the sampler
+ * keeps waiting for the next one.
+ *
+ * @param elapsed_ns Receives the duration of the measurement
+ * @return Energy used since bench_energy_begin() in joules, -1 if it could
+ * not be measured or no measurement is in progress
+ */
+static inline double bench_energy_end(uint64_t *elapsed_ns) {
+  bench_energy_meter_t *meter = &bench_energy_meter;
+  uint64_t stop_ns = get_time_ns();
+  *elapsed_ns = stop_ns - meter->start_ns;
+  if (!meter->active)
+    return -1.0;
+  meter->active = false;
+
+  double joules = 0.0;
+  if (meter->has_sampler) {
+    pthread_mutex_lock(&meter->lock);
+    bench_energy_integrate(meter, stop_ns);
+    meter->sampling = false;
+    joules += meter->sensor_joules;
+    pthread_mutex_unlock(&meter->lock);
+  }
+
+  for (size_t i = 0; i < meter->count; i++) {
+    bench_energy_domain_t *domain = &meter->domains[i];
+    if (domain->energy_fd < 0)
+      continue;
+
+    long long uj = bench_energy_read(domain->energy_fd);
+    if (uj < 0)
+      return -1.0;
+    uint64_t end_uj = (uint64_t)uj;
+    uint64_t delta = end_uj >= domain->start_uj
+                         ? end_uj - domain->start_uj
+                         : end_uj + domain->range_uj - domain->start_uj;
+    joules += (double)delta * 1e-6;
+  }
+  return joules;
+}
+
+/**
+ * @brief Stops the sampler and closes the files of the energy meter.
+ *
+ * The next bench_energy_open() probes sysfs again.
+ */
+static inline void bench_energy_close(void) {
+  bench_energy_meter_t *meter = &bench_energy_meter;
+  if (meter->has_sampler) {
+    pthread_mutex_lock(&meter->lock);
+    meter->running = false;
+    pthread_cond_signal(&meter->wake);
+    pthread_mutex_unlock(&meter->lock);
+    pthread_join(meter->sampler, NULL);
+    pthread_cond_destroy(&meter->wake);
+    pthread_mutex_destroy(&meter->lock);
+  }
+
+  for (size_t i = 0; i < meter->count; i++) {
+    bench_energy_domain_t *domain = &meter->domains[i];
+    int fds[] = {domain->energy_fd, domain->power_fd, domain->current_fd,
+                 domain->voltage_fd};
+    for (size_t f = 0; f < sizeof(fds) / sizeof(fds[0]); f++)
+      if (fds[f] >= 0)
+        close(fds[f]);
+  }
+  memset(meter, 0, sizeof(*meter));
+}
+
+#endif // ENERGY_H
@@ -0,0 +1,217 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include "./system.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Git revision the benchmarks were built from.
+ *
+ * Passed in by the build, e.g. -DPIBENCH_GIT_SHA="\"$(git rev-parse HEAD)\"".
+ */
+#ifndef PIBENCH_GIT_SHA
+#define PIBENCH_GIT_SHA "unknown"
+#endif
+
+/**
+ * @brief Compiler flags the benchmarks were built with.
+ *
+ * Passed in by the build, e.g. -DPIBENCH_CFLAGS="\"$(CFLAGS)\"".
+ */
+#ifndef PIBENCH_CFLAGS
+#define PIBENCH_CFLAGS "unknown"
+#endif
+
+/**
+ * @brief Maximum number of CPUs whose frequency is recorded.
+ */
+#define BENCH_ENV_MAX_CPUS 64
+
+/**
+ * @brief Structure describing the machine and build the benchmarks ran on.
+ *
+ * hostname:            Name of the machine
+ * kernel:              Kernel name and release (uname -sr)
+ * kernel_version:      Kernel build version (uname -v)
+ * arch:                Machine architecture (uname -m)
+ * cpu_model:           CPU model from /proc/cpuinfo
+ * board:               Board model from the device tree (e.g. Raspberry Pi)
+ * governor:            cpufreq governor of CPU 0
+ * clocksource:         Current kernel clocksource
+ * cpu_count:           Number of CPUs
+ * cur_freq_mhz:        Current frequency of every CPU in MHz
+ * min_freq_mhz:        Minimum frequency of CPU 0 in MHz
+ * max_freq_mhz:        Maximum frequency of CPU 0 in MHz
+ * temperature:         CPU temperature in degrees Celsius, -1 if unknown
+ * cycle_counter:       Counter read by get_cycles()
+ * cycle_counter_hz:    Frequency of the cycle counter, 0 if unknown
+ * compiler:            Compiler name and version
+ * cflags:              Compiler flags (PIBENCH_CFLAGS)
+ * git_sha:             Git revision (PIBENCH_GIT_SHA)
+ * timestamp:           Time of collection in seconds since the epoch
+ */
+typedef struct {
+  char hostname[64];
+  char kernel[144];
+  char kernel_version[72];
+  char arch[72];
+  char cpu_model[128];
+  char board[128];
+  char governor[32];
+  char clocksource[32];
+  int cpu_count;
+  uint64_t cur_freq_mhz[BENCH_ENV_MAX_CPUS];
+  uint64_t min_freq_mhz, max_freq_mhz;
+  float temperature;
+  const char *cycle_counter;
+  uint64_t cycle_counter_hz;
+  const char *compiler;
+  const char *cflags;
+  const char *git_sha;
+  uint64_t timestamp;
+} bench_env_t;
+
+/**
+ * @brief Reads the first line of a file, without the trailing newline.
+ *
+ * @return true if a line was read
+ */
+static inline bool bench_read_line(const char *path, char *out, size_t size) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+    return false;
+
+  bool ok = fgets(out, (int)size, f) != NULL;
+  fclose(f);
+  if (ok)
+    out[strcspn(out, "\n")] = '\0';
+  return ok;
+}
+
+/**
+ * @brief Reads a frequency in kHz from a cpufreq file and returns MHz.
+ */
+static inline uint64_t bench_read_freq_mhz(int cpu, const char *file) {
+  char path[128], line[32];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/%s", cpu,
+           file);
+  if (!bench_read_line(path, line, sizeof(line)))
+    return 0;
+  return strtoull(line, NULL, 10) / 1000;
+}
+
+/**
+ * @brief Looks up a "key : value" entry of /proc/cpuinfo.
+ *
+ * @return true if the key was found
+ */
+static inline bool bench_cpuinfo(const char *key, char *out, size_t size) {
+  FILE *f = fopen("/proc/cpuinfo", "r");
+  if (f == NULL)
+    return false;
+
+  char line[256];
+  size_t len = strlen(key);
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), f)) {
+    if (strncmp(line, key, len) != 0 || (line[len] != ' ' && line[len] != '\t'))
+      continue;
+    char *value = strchr(line, ':');
+    if (value == NULL)
+      continue;
+    value += strspn(value + 1, " \t") + 1;
+    value[strcspn(value, "\n")] = '\0';
+    snprintf(out, size, "%s", value);
+    found = true;
+  }
+
+  fclose(f);
+  return found;
+}
+
+/**
+ * @brief Returns the frequency of the cycle counter in Hz.
+ *
+ * @return cntfrq_el0 on aarch64, 0 where the frequency is unknown
+ */
+static inline uint64_t bench_cycle_counter_hz(void) {
+#if defined(__aarch64__)
+  uint64_t frequency;
+  __asm__("mrs %0, cntfrq_el0" : "=r"(frequency));
+  return frequency;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Collects the environment metadata of the current machine and build.
+ *
+ * @param env Structure to fill in, unknown strings are left empty
+ */
+static inline void bench_env_collect(bench_env_t *env) {
+  memset(env, 0, sizeof(*env));
+
+  gethostname(env->hostname, sizeof(env->hostname) - 1);
+
+  struct utsname uts;
+  if (uname(&uts) == 0) {
+    snprintf(env->kernel, sizeof(env->kernel), "%s %s", uts.sysname,
+             uts.release);
+    snprintf(env->kernel_version, sizeof(env->kernel_version), "%s",
+             uts.version);
+    snprintf(env->arch, sizeof(env->arch), "%s", uts.machine);
+  }
+
+  if (!bench_cpuinfo("model name", env->cpu_model, sizeof(env->cpu_model))) {
+    char implementer[32] = "", part[32] = "";
+    if (bench_cpuinfo("CPU implementer", implementer, sizeof(implementer)) &&
+        bench_cpuinfo("CPU part", part, sizeof(part)))
+      snprintf(env->cpu_model, sizeof(env->cpu_model),
+               "implementer %s part %s", implementer, part);
+  }
+  if (!bench_read_line("/sys/firmware/devicetree/base/model", env->board,
+                       sizeof(env->board)))
+    bench_cpuinfo("Model", env->board, sizeof(env->board));
+
+  bench_read_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor",
+                  env->governor, sizeof(env->governor));
+  bench_read_line(
+      "/sys/devices/system/clocksource/clocksource0/current_clocksource",
+      env->clocksource, sizeof(env->clocksource));
+
+  env->cpu_count = get_cpu_cores();
+  for (int i = 0; i < env->cpu_count && i < BENCH_ENV_MAX_CPUS; i++)
+    env->cur_freq_mhz[i] = get_cpu_frequency(i);
+  env->min_freq_mhz = bench_read_freq_mhz(0, "cpuinfo_min_freq");
+  env->max_freq_mhz = bench_read_freq_mhz(0, "cpuinfo_max_freq");
+  env->temperature = get_cpu_temperature();
+
+#if defined(__aarch64__)
+  env->cycle_counter = "cntvct_el0";
+#else
+  env->cycle_counter = "unknown";
+#endif
+  env->cycle_counter_hz = bench_cycle_counter_hz();
+
+#if defined(__clang__)
+  env->compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+  env->compiler = "gcc " __VERSION__;
+#else
+  env->compiler = "unknown";
+#endif
+  env->cflags = PIBENCH_CFLAGS;
+  env->git_sha = PIBENCH_GIT_SHA;
+  env->timestamp = (uint64_t)time(NULL);
+}
+
+#endif // ENV_H
@@ -0,0 +1,362 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "./validate.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#define BENCH_CRC32C_HW 1
+#if defined(__clang__)
+#define BENCH_CRC32C_TARGET __attribute__((target("crc")))
+#else
+#define BENCH_CRC32C_TARGET __attribute__((target("+crc")))
+#endif
+#elif defined(__x86_64__)
+#include <nmmintrin.h>
+#define BENCH_CRC32C_HW 1
+#define BENCH_CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+
+/**
+ * @brief Default number of bytes covered by one hash of a digest.
+ *
+ * 64 KiB keeps the digest of a 512 MB buffer at 32 KB, while still pointing
+ * to the region of a mismatch.
+ */
+#define BENCH_DIGEST_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief Number of chunks hashed in lockstep.
+ *
+ * The CRC instructions have a latency of 3 cycles but a throughput of 1 per
+ * cycle, so three independent chunks keep the unit busy.
+ */
+#define BENCH_CRC32C_LANES 3
+
+/**
+ * @brief Structure holding the CRC32C hashes of a buffer.
+ *
+ * size:                Size of the hashed buffer in bytes
+ * chunk_size:          Number of bytes covered by each hash
+ * chunk_count:         Number of hashes
+ * chunks:              CRC32C of every chunk
+ * scratch:             CRC32C of every chunk of the validated buffer, reused
+ *                      by every validation
+ */
+typedef struct {
+  size_t size;
+  size_t chunk_size;
+  size_t chunk_count;
+  uint32_t *chunks;
+  uint32_t *scratch;
+} bench_digest_t;
+
+/**
+ * @brief Slicing-by-8 tables of the software CRC32C fallback.
+ */
+static uint32_t bench_crc32c_table[8][256];
+static bool bench_crc32c_table_ready = false;
+
+static inline void bench_crc32c_init(void) {
+  if (bench_crc32c_table_ready)
+    return;
+
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u)));
+    bench_crc32c_table[0][i] = crc;
+  }
+
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = bench_crc32c_table[0][i];
+    for (int slice = 1; slice < 8; slice++) {
+      crc = (crc >> 8) ^ bench_crc32c_table[0][crc & 0xff];
+      bench_crc32c_table[slice][i] = crc;
+    }
+  }
+
+  bench_crc32c_table_ready = true;
+}
+
+/**
+ * @brief Feeds one byte into a CRC32C, using the tables.
+ */
+static inline uint32_t bench_crc32c_u8_table(uint32_t crc, uint8_t value) {
+  return (crc >> 8) ^ bench_crc32c_table[0][(crc ^ value) & 0xff];
+}
+
+/**
+ * @brief Feeds eight bytes (little endian) into a CRC32C, using the tables.
+ */
+static inline uint32_t bench_crc32c_u64_table(uint32_t crc, uint64_t value) {
+  uint32_t lo = crc ^ (uint32_t)value;
+  uint32_t hi = (uint32_t)(value >> 32);
+  return bench_crc32c_table[7][lo & 0xff] ^
+         bench_crc32c_table[6][(lo >> 8) & 0xff] ^
+         bench_crc32c_table[5][(lo >> 16) & 0xff] ^
+         bench_crc32c_table[4][lo >> 24] ^ bench_crc32c_table[3][hi & 0xff] ^
+         bench_crc32c_table[2][(hi >> 8) & 0xff] ^
+         bench_crc32c_table[1][(hi >> 16) & 0xff] ^
+         bench_crc32c_table[0][hi >> 24];
+}
+
+#if defined(BENCH_CRC32C_HW)
+/**
+ * @brief Feeds one byte into a CRC32C, using the CRC instructions.
+ */
+BENCH_CRC32C_TARGET static inline uint32_t bench_crc32c_u8_hw(uint32_t crc,
+                                                              uint8_t value) {
+#if defined(__aarch64__)
+  return __crc32cb(crc, value);
+#else
+  return _mm_crc32_u8(crc, value);
+#endif
+}
+
+/**
+ * @brief Feeds eight bytes (little endian) into a CRC32C, using the CRC
+ * instructions.
+ */
+BENCH_CRC32C_TARGET static inline uint32_t bench_crc32c_u64_hw(uint32_t crc,
+                                                               uint64_t value) {
+#if defined(__aarch64__)
+  return __crc32cd(crc, value);
+#else
+  return (uint32_t)_mm_crc32_u64(crc, value);
+#endif
+}
+#endif
+
+static inline uint64_t bench_load_u64(const uint8_t *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+/**
+ * @brief Defines the CRC32C kernels of one implementation.
+ *
+ * bench_crc32c_update_<isa>() feeds a buffer into a CRC.
+ * bench_crc32c_chunks_<isa>() hashes full chunks BENCH_CRC32C_LANES at a time,
+ * interleaving the independent CRCs to hide the latency of the CRC
+ * instruction.
+ *
+ * @param isa Suffix of the bench_crc32c_u8 and bench_crc32c_u64 primitives
+ * @param attributes Function attributes of the kernels, e.g. the target
+ */
+#define BENCH_CRC32C_KERNELS(isa, attributes)                                  \
+  attributes static inline uint32_t bench_crc32c_update_##isa(                 \
+      uint32_t crc, const uint8_t *p, size_t size) {                           \
+    for (; size >= 8; size -= 8, p += 8)                                       \
+      crc = bench_crc32c_u64_##isa(crc, bench_load_u64(p));                    \
+    for (; size > 0; size--, p++)                                              \
+      crc = bench_crc32c_u8_##isa(crc, *p);                                    \
+    return crc;                                                                \
+  }                                                                            \
+                                                                               \
+  attributes static inline void bench_crc32c_chunks_##isa(                     \
+      const uint8_t *base, size_t size, size_t chunk_size, uint32_t *out) {    \
+    size_t full = size / chunk_size;                                           \
+    size_t chunk = 0;                                                          \
+                                                                               \
+    for (; chunk + BENCH_CRC32C_LANES <= full; chunk += BENCH_CRC32C_LANES) {  \
+      const uint8_t *p0 = base + chunk * chunk_size;                           \
+      const uint8_t *p1 = p0 + chunk_size;                                     \
+      const uint8_t *p2 = p1 + chunk_size;                                     \
+      uint32_t c0 = 0xFFFFFFFFu, c1 = 0xFFFFFFFFu, c2 = 0xFFFFFFFFu;           \
+                                                                               \
+      size_t i = 0;                                                            \
+      for (; i + 8 <= chunk_size; i += 8) {                                    \
+        c0 = bench_crc32c_u64_##isa(c0, bench_load_u64(p0 + i));               \
+        c1 = bench_crc32c_u64_##isa(c1, bench_load_u64(p1 + i));               \
+        c2 = bench_crc32c_u64_##isa(c2, bench_load_u64(p2 + i));               \
+      }                                                                        \
+      for (; i < chunk_size; i++) {                                            \
+        c0 = bench_crc32c_u8_##isa(c0, p0[i]);                                 \
+        c1 = bench_crc32c_u8_##isa(c1, p1[i]);                                 \
+        c2 = bench_crc32c_u8_##isa(c2, p2[i]);                                 \
+      }                                                                        \
+                                                                               \
+      out[chunk] = ~c0;                                                        \
+      out[chunk + 1] = ~c1;                                                    \
+      out[chunk + 2] = ~c2;                                                    \
+    }                                                                          \
+                                                                               \
+    for (; chunk * chunk_size < size; chunk++) {                               \
+      size_t offset = chunk * chunk_size;                                      \
+      size_t len = size - offset < chunk_size ? size - offset : chunk_size;    \
+      uint32_t crc = 0xFFFFFFFFu;                                              \
+      out[chunk] = ~bench_crc32c_update_##isa(crc, base + offset, len);        \
+    }                                                                          \
+  }
+
+BENCH_CRC32C_KERNELS(table, )
+#if defined(BENCH_CRC32C_HW)
+BENCH_CRC32C_KERNELS(hw, BENCH_CRC32C_TARGET)
+#endif
+
+/**
+ * @brief Checks if the CPU has the CRC32C instructions.
+ *
+ * Reads the hardware capabilities on aarch64 and cpuid (SSE4.2) on x86-64.
+ * No check is needed if the compiler already targets them.
+ */
+static inline bool bench_crc32c_hw(void) {
+#if defined(__ARM_FEATURE_CRC32) || defined(__SSE4_2__)
+  return true;
+#elif defined(__aarch64__)
+  return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#elif defined(__x86_64__)
+  return __builtin_cpu_supports("sse4.2");
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Computes the CRC32C (Castagnoli) of a buffer.
+ *
+ * Uses the ARMv8 CRC32 or SSE4.2 instructions if the CPU has them, a
+ * slicing-by-8 table otherwise.
+ *
+ * @param data Buffer to hash
+ * @param size Size of the buffer in bytes
+ * @return CRC32C of the buffer
+ */
+static inline uint32_t bench_crc32c(const void *data, size_t size) {
+  const uint8_t *p = (const uint8_t *)data;
+
+#if defined(BENCH_CRC32C_HW)
+  if (bench_crc32c_hw())
+    return ~bench_crc32c_update_hw(0xFFFFFFFFu, p, size);
+#endif
+  bench_crc32c_init();
+  return ~bench_crc32c_update_table(0xFFFFFFFFu, p, size);
+}
+
+/**
+ * @brief Computes the CRC32C of consecutive chunks of a buffer.
+ *
+ * Full chunks are hashed BENCH_CRC32C_LANES at a time, interleaving the
+ * independent CRCs to hide the latency of the CRC instruction.
+ *
+ * @param data Buffer to hash
+ * @param size Size of the buffer in bytes
+ * @param chunk_size Number of bytes per chunk, the last one may be shorter
+ * @param out Array receiving one CRC per chunk
+ */
+static inline void bench_crc32c_chunks(const void *data, size_t size,
+                                       size_t chunk_size, uint32_t *out) {
+  const uint8_t *base = (const uint8_t *)data;
+
+#if defined(BENCH_CRC32C_HW)
+  if (bench_crc32c_hw()) {
+    bench_crc32c_chunks_hw(base, size, chunk_size, out);
+    return;
+  }
+#endif
+  bench_crc32c_init();
+  bench_crc32c_chunks_table(base, size, chunk_size, out);
+}
+
+/**
+ * @brief Allocates an empty digest for a buffer.
+ *
+ * @param size Size of the buffer in bytes
+ * @param chunk_size Number of bytes per hash, 0 for a single hash
+ * @return Pointer to the digest, or NULL if out of memory
+ */
+static inline bench_digest_t *bench_digest_create(size_t size,
+                                                  size_t chunk_size) {
+  if (chunk_size == 0 || chunk_size > size)
+    chunk_size = size > 0 ? size : 1;
+
+  bench_digest_t *digest = (bench_digest_t *)malloc(sizeof(bench_digest_t));
+  if (digest == NULL)
+    return NULL;
+
+  digest->size = size;
+  digest->chunk_size = chunk_size;
+  digest->chunk_count = (size + chunk_size - 1) / chunk_size;
+  size_t count = digest->chunk_count > 0 ? digest->chunk_count : 1;
+  digest->chunks = (uint32_t *)calloc(count, sizeof(uint32_t));
+  digest->scratch = (uint32_t *)calloc(count, sizeof(uint32_t));
+  if (digest->chunks == NULL || digest->scratch == NULL) {
+    free(digest->chunks);
+    free(digest->scratch);
+    free(digest);
+    return NULL;
+  }
+
+  return digest;
+}
+
+/**
+ * @brief Hashes a buffer into a digest.
+ *
+ * @param digest Digest created for a buffer of the same size
+ * @param data Buffer to hash
+ */
+static inline void bench_digest_compute(bench_digest_t *digest,
+                                        const void *data) {
+  bench_crc32c_chunks(data, digest->size, digest->chunk_size, digest->chunks);
+}
+
+/**
+ * @brief Validates a buffer against a digest.
+ *
+ * The report counts chunks instead of elements, first_mismatch is the byte
+ * offset of the first mismatching chunk. The CRCs of the buffer are computed
+ * into the scratch array of the digest, so a digest validates one buffer at a
+ * time.
+ *
+ * @param digest Digest of the ground truth, its scratch array is overwritten
+ * @param data Buffer to validate
+ * @return The validation report
+ *
+ * @note Hashing is only able to check for bit-exact results
+ */
+static inline bench_validation_t bench_digest_validate(bench_digest_t *digest,
+                                                       const void *data) {
+  bench_validation_t report = {.valid = true,
+                               .elements = digest->chunk_count,
+                               .mismatches = 0,
+                               .first_mismatch = 0,
+                               .max_error = 0.0,
+                               .max_ulp = 0};
+
+  uint32_t *chunks = digest->scratch;
+  bench_crc32c_chunks(data, digest->size, digest->chunk_size, chunks);
+
+  for (size_t i = 0; i < digest->chunk_count; i++) {
+    if (chunks[i] != digest->chunks[i]) {
+      if (report.mismatches == 0)
+        report.first_mismatch = i * digest->chunk_size;
+      report.mismatches++;
+    }
+  }
+
+  report.valid = report.mismatches == 0;
+  return report;
+}
+
+/**
+ * @brief Frees a digest.
+ */
+static inline void bench_digest_free(bench_digest_t *digest) {
+  if (digest == NULL)
+    return;
+
+  free(digest->chunks);
+  free(digest->scratch);
+  free(digest);
+}
+
+#endif // HASH_H
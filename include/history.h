@@ -0,0 +1,394 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "./bench.h"
+#include "./cli.h"
+#include "./data_processing.h"
+#include "./env.h"
+#include "./hash.h"
+#include "./machine.h"
+#include "./stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Magic bytes at the start of a history log.
+ */
+#define BENCH_HISTORY_MAGIC "PIBH"
+
+/**
+ * @brief Current version of the history log format.
+ */
+#define BENCH_HISTORY_VERSION 1
+
+/**
+ * @brief Significance level of the regression test.
+ */
+#define BENCH_HISTORY_ALPHA 0.05
+
+/**
+ * @brief Header of a history log, stored at offset 0.
+ *
+ * magic:               BENCH_HISTORY_MAGIC
+ * version:             Format version of the log
+ * record_size:         Size of a record in bytes
+ * name:                Name of the benchmark, NUL terminated
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t reserved;
+  char name[128];
+} bench_history_header_t;
+
+/**
+ * @brief Summary of one run of a benchmark, appended to its history log.
+ *
+ * Records have a fixed size, so record i is found at
+ * sizeof(bench_history_header_t) + i * record_size.
+ *
+ * timestamp:           Time of the run in seconds since the epoch
+ * samples:             Number of timed iterations
+ * median:              Median timing value
+ * mean:                Mean timing value
+ * stddev:              Population standard deviation of the timing values
+ * p99:                 99th percentile of the timing values
+ * min, max:            Minimum and maximum timing value
+ * is_cycles:           Flag indicating if the timing values are cycles
+ * is_ns:               Flag indicating if the timing values are nanoseconds,
+ *                      records of neither are microseconds
+ * git_sha:             Git revision the run was built from
+ * tag:                 Tag given with --tag, empty if none
+ */
+typedef struct {
+  uint64_t timestamp;
+  uint64_t samples;
+  double median;
+  double mean;
+  double stddev;
+  double p99;
+  uint64_t min, max;
+  uint32_t is_cycles;
+  uint32_t is_ns;
+  char git_sha[40];
+  char tag[32];
+} bench_history_record_t;
+
+/**
+ * @brief Reference a benchmark is compared against.
+ *
+ * runs:                Number of history records the reference is made of
+ * samples:             Total number of timed iterations of these runs
+ * median:              Median of the run medians
+ * mean:                Pooled mean of all timing values
+ * variance:            Pooled unbiased variance of all timing values
+ */
+typedef struct {
+  size_t runs;
+  double samples;
+  double median;
+  double mean;
+  double variance;
+} bench_history_reference_t;
+
+/**
+ * @brief Builds the path of the history log of a benchmark.
+ *
+ * Creates the directories of the store if needed.
+ *
+ * @param dir Directory of the history store
+ * @param name Name of the benchmark
+ * @param path Destination of the path
+ * @param size Size of the destination
+ * @return true on success, false if the path is too long or the directories
+ * could not be created
+ */
+static inline bool bench_history_path(const char *dir, const char *name,
+                                      char *path, size_t size) {
+  char fingerprint[9];
+  bench_machine_fingerprint(fingerprint);
+
+  char filename[129];
+  size_t len = strlen(name);
+  if (len >= sizeof(filename))
+    len = sizeof(filename) - 1;
+  for (size_t i = 0; i < len; i++) {
+    char c = name[i];
+    bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                (c >= '0' && c <= '9') || c == '-' || c == '.';
+    filename[i] = safe ? c : '_';
+  }
+  filename[len] = '\0';
+
+  int written = snprintf(path, size, "%s/%s", dir, fingerprint);
+  if (written < 0 || (size_t)written >= size)
+    return false;
+  if ((mkdir(dir, 0755) != 0 && errno != EEXIST) ||
+      (mkdir(path, 0755) != 0 && errno != EEXIST)) {
+    fprintf(stderr, "Error: Could not create history directory %s\n", path);
+    return false;
+  }
+
+  written = snprintf(path, size, "%s/%s/%s.pibh", dir, fingerprint, filename);
+  return written >= 0 && (size_t)written < size;
+}
+
+/**
+ * @brief Opens the history log of a benchmark, creating it if needed.
+ *
+ * @param dir Directory of the history store
+ * @param name Name of the benchmark
+ * @return File descriptor, or -1 on error
+ */
+static inline int bench_history_open(const char *dir, const char *name) {
+  char path[512];
+  if (!bench_history_path(dir, name, path, sizeof(path)))
+    return -1;
+
+  int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Could not open history %s\n", path);
+    return -1;
+  }
+
+  bench_history_header_t header;
+  ssize_t got = pread(fd, &header, sizeof(header), 0);
+
+  if (got == 0) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BENCH_HISTORY_MAGIC, sizeof(header.magic));
+    header.version = BENCH_HISTORY_VERSION;
+    header.record_size = sizeof(bench_history_record_t);
+    strncpy(header.name, name, sizeof(header.name) - 1);
+    if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+      close(fd);
+      return -1;
+    }
+  } else if (got != (ssize_t)sizeof(header) ||
+             memcmp(header.magic, BENCH_HISTORY_MAGIC, 4) != 0 ||
+             header.version > BENCH_HISTORY_VERSION ||
+             header.record_size != sizeof(bench_history_record_t) ||
+             strncmp(header.name, name, sizeof(header.name) - 1) != 0) {
+    fprintf(stderr, "Error: %s is not the history of '%s'\n", path, name);
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/**
+ * @brief Returns the number of records in a history log.
+ */
+static inline size_t bench_history_count(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(bench_history_header_t))
+    return 0;
+  return ((size_t)st.st_size - sizeof(bench_history_header_t)) /
+         sizeof(bench_history_record_t);
+}
+
+/**
+ * @brief Reads record i of a history log.
+ */
+static inline bool bench_history_read(int fd, size_t i,
+                                      bench_history_record_t *record) {
+  off_t offset = (off_t)(sizeof(bench_history_header_t) +
+                         i * sizeof(bench_history_record_t));
+  return pread(fd, record, sizeof(*record), offset) ==
+         (ssize_t)sizeof(*record);
+}
+
+/**
+ * @brief Appends the summary of a finished benchmark to its history log.
+ *
+ * @param fd History log of the benchmark
+ * @param benchmark The benchmark, its statistics have to be calculated
+ * @param tag Tag of the run, NULL for none
+ * @return true on success
+ */
+static inline bool bench_history_append(int fd, const benchmark_t *benchmark,
+                                        const char *tag) {
+  const benchmark_result_t *results = benchmark->results;
+  bench_history_record_t record;
+  memset(&record, 0, sizeof(record));
+
+  record.timestamp = (uint64_t)time(NULL);
+  record.samples = benchmark->timed_iterations;
+  record.median = (double)results->median_time;
+  record.mean = results->mean_time;
+  record.stddev = results->stddev_time;
+  record.p99 = results->p99_time;
+  record.min = results->min_time;
+  record.max = results->max_time;
+  record.is_cycles = results->is_cycles;
+  record.is_ns = !results->is_cycles;
+  strncpy(record.git_sha, PIBENCH_GIT_SHA, sizeof(record.git_sha) - 1);
+  if (tag != NULL)
+    strncpy(record.tag, tag, sizeof(record.tag) - 1);
+
+  return write(fd, &record, sizeof(record)) == (ssize_t)sizeof(record);
+}
+
+/**
+ * @brief Builds the reference of a benchmark from its history.
+ *
+ * With a tag the latest record carrying it is used, otherwise the last runs
+ * records are pooled. Microsecond records of older versions are scaled to
+ * nanoseconds.
+ *
+ * @param fd History log of the benchmark
+ * @param runs Number of runs to pool
+ * @param tag Tag of the reference run, NULL to use the last runs
+ * @param is_cycles Only records with this timing format are used
+ * @param ref Destination of the reference
+ * @return true if at least one matching record was found
+ */
+static inline bool bench_history_reference(int fd, size_t runs,
+                                           const char *tag, bool is_cycles,
+                                           bench_history_reference_t *ref) {
+  size_t count = bench_history_count(fd);
+  double medians[64];
+  double sum_n = 0.0, sum_mean = 0.0, sum_sq = 0.0;
+
+  if (tag != NULL || runs == 0)
+    runs = 1;
+  if (runs > sizeof(medians) / sizeof(medians[0]))
+    runs = sizeof(medians) / sizeof(medians[0]);
+
+  memset(ref, 0, sizeof(*ref));
+  for (size_t i = count; i > 0 && ref->runs < runs; i--) {
+    bench_history_record_t record;
+    if (!bench_history_read(fd, i - 1, &record) ||
+        (record.is_cycles != 0) != is_cycles)
+      continue;
+    if (tag != NULL && strncmp(record.tag, tag, sizeof(record.tag)) != 0)
+      continue;
+
+    double n = (double)record.samples;
+    double scale = !record.is_cycles && !record.is_ns ? 1e3 : 1.0;
+    double mean = record.mean * scale, stddev = record.stddev * scale;
+    medians[ref->runs++] = record.median * scale;
+    sum_n += n;
+    sum_mean += n * mean;
+    /* population variance + mean^2 = mean of the squares */
+    sum_sq += n * (stddev * stddev + mean * mean);
+  }
+
+  if (ref->runs == 0 || sum_n <= 0.0)
+    return false;
+
+  quick_sort(medians, ref->runs);
+  ref->median = ref->runs % 2 == 1 ? medians[ref->runs / 2]
+                                   : (medians[ref->runs / 2 - 1] +
+                                      medians[ref->runs / 2]) /
+                                         2.0;
+  ref->samples = sum_n;
+  ref->mean = sum_mean / sum_n;
+  ref->variance = sum_n > 1.0
+                      ? (sum_sq - sum_n * ref->mean * ref->mean) / (sum_n - 1.0)
+                      : 0.0;
+  if (ref->variance < 0.0)
+    ref->variance = 0.0;
+  return true;
+}
+
+/**
+ * @brief Compares the benchmarks against their history and records them.
+ *
+ * A benchmark regressed if its median is more than --threshold percent above
+ * the median of the reference and Welch's t-test rejects equal means at
+ * BENCH_HISTORY_ALPHA. Afterwards every benchmark is appended to its history
+ * log, tagged with --tag.
+ *
+ * @param benchmarks Array of benchmarks
+ * @param num Number of benchmarks
+ * @param options Options with the history directory and comparison settings
+ * @return 1 if a regression was found, 0 otherwise
+ */
+static inline int bench_history_process(benchmark_t **benchmarks, size_t num,
+                                        const bench_options_t *options) {
+  if (options->history == NULL)
+    return 0;
+
+  bool compare = options->compare_runs > 0 || options->compare_tag != NULL;
+  size_t regressions = 0;
+
+  if (compare) {
+    if (options->compare_tag != NULL)
+      printf("\nComparison against tag %s (threshold %.1f%%):\n",
+             options->compare_tag, options->threshold);
+    else
+      printf("\nComparison against the last %zu runs (threshold %.1f%%):\n",
+             options->compare_runs, options->threshold);
+    printf("%-40s %14s %14s %9s %9s  %s\n", "Benchmark", "Reference",
+           "Current", "Change", "p-value", "Verdict");
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    benchmark_t *benchmark = benchmarks[i];
+    benchmark_result_t *results = benchmark->results;
+
+    int fd = bench_history_open(options->history, benchmark->name);
+    if (fd < 0)
+      continue;
+
+    calculate_stats(results, benchmark->timed_iterations);
+
+    bench_history_reference_t ref;
+    if (compare && !bench_history_reference(fd, options->compare_runs,
+                                            options->compare_tag,
+                                            results->is_cycles, &ref)) {
+      printf("%-40.40s %14s %14lu %9s %9s  no reference\n", benchmark->name,
+             "-", results->median_time, "-", "-");
+    } else if (compare) {
+      double n = (double)benchmark->timed_iterations;
+      double variance =
+          n > 1.0 ? results->stddev_time * results->stddev_time * n / (n - 1.0)
+                  : 0.0;
+      double p = welch_t_test(results->mean_time, variance, n, ref.mean,
+                              ref.variance, ref.samples);
+      double change =
+          ref.median > 0.0
+              ? ((double)results->median_time / ref.median - 1.0) * 100.0
+              : 0.0;
+
+      const char *verdict = "unchanged";
+      if (p < BENCH_HISTORY_ALPHA && change > options->threshold) {
+        verdict = "\033[31mREGRESSION\033[0m";
+        regressions++;
+      } else if (p < BENCH_HISTORY_ALPHA && change < -options->threshold) {
+        verdict = "\033[32mimproved\033[0m";
+      }
+
+      printf("%-40.40s %14.1f %14lu %8.2f%% %9.4f  %s\n", benchmark->name,
+             ref.median, results->median_time, change, p, verdict);
+    }
+
+    if (!bench_history_append(fd, benchmark, options->tag))
+      fprintf(stderr, "Error: Could not record history of '%s'\n",
+              benchmark->name);
+    close(fd);
+  }
+
+  if (regressions > 0)
+    printf("\033[31m%zu benchmark(s) regressed!\033[0m\n", regressions);
+
+  return regressions > 0 ? 1 : 0;
+}
+
+#endif // HISTORY_H
@@ -0,0 +1,529 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "./api.h"
+#include "./cores.h"
+#include "./env.h"
+#include "./topology.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @brief Affinity of one interrupt before it was shielded.
+ *
+ * irq:                 Interrupt number
+ * affinity:            CPUs the interrupt was allowed to run on
+ */
+typedef struct {
+  int irq;
+  cpu_set_t affinity;
+} bench_irq_affinity_t;
+
+/**
+ * @brief State of the interrupt shield of the process.
+ *
+ * saved:               Original affinity of every interrupt
+ * count:               Number of entries of saved
+ * cores:               Cores the interrupts are steered away from
+ */
+typedef struct {
+  bench_irq_affinity_t *saved;
+  size_t count;
+  cpu_set_t cores;
+} bench_irq_shield_t;
+
+/**
+ * @brief Process undoing the system changes of the benchmark once it exits.
+ *
+ * pid:                 Process id of the guardian, 0 if there is none
+ * fd:                  Socket the guardian reads its records from
+ */
+typedef struct {
+  pid_t pid;
+  int fd;
+} bench_guardian_t;
+
+/**
+ * @brief Change the guardian has to undo, sent over its socket.
+ *
+ * kind:                One of BENCH_GUARD_*
+ * id:                  Interrupt number or CPU the record refers to
+ * affinity:            Original affinity of a BENCH_GUARD_IRQ record
+ */
+typedef struct {
+  int32_t kind;
+  int32_t id;
+  cpu_set_t affinity;
+} bench_guard_record_t;
+
+#define BENCH_GUARD_IRQ 0    /**< Interrupt affinity to restore */
+#define BENCH_GUARD_PARK 1   /**< CPU taken offline */
+#define BENCH_GUARD_UNPARK 2 /**< CPU brought back online */
+
+/**
+ * @brief Counter of the interrupts handled by one core.
+ *
+ * active:              Flag indicating if the counter is open
+ * core:                Core whose interrupts are counted
+ * fd:                  perf tracepoint counter, -1 to parse /proc/interrupts
+ * counts:              Per-CPU buffer used to parse /proc/interrupts
+ * start:               Count read at the start of the current iteration
+ */
+typedef struct {
+  bool active;
+  int core;
+  int fd;
+  uint64_t *counts;
+  uint64_t start;
+} bench_irq_counter_t;
+
+PIBENCH_STATE bench_irq_shield_t bench_irq_shield_state PIBENCH_INIT({
+    .saved = NULL,
+    .count = 0,
+    .cores = {{0}},
+});
+
+PIBENCH_STATE bench_guardian_t bench_guardian_state PIBENCH_INIT({
+    .pid = 0,
+    .fd = -1,
+});
+
+/**
+ * @brief Sets the CPUs an interrupt may run on through
+ * /proc/irq/N/smp_affinity_list.
+ *
+ * @return true on success, false if the interrupt cannot be moved
+ */
+static inline bool bench_irq_set_affinity(int irq, const cpu_set_t *cpus) {
+  char path[64], list[1024];
+  snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", irq);
+  bench_cpulist_format(cpus, list, sizeof(list));
+
+  int fd = open(path, O_WRONLY);
+  if (fd < 0)
+    return false;
+  size_t len = strlen(list);
+  bool ok = write(fd, list, len) == (ssize_t)len;
+  return close(fd) == 0 && ok;
+}
+
+/**
+ * @brief Saves the affinity of every interrupt in /proc/irq.
+ *
+ * @return true if at least one affinity could be read
+ */
+static inline bool bench_irq_save(bench_irq_shield_t *shield) {
+  DIR *dir = opendir("/proc/irq");
+  if (dir == NULL)
+    return false;
+
+  size_t capacity = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    char *end;
+    long irq = strtol(entry->d_name, &end, 10);
+    if (end == entry->d_name || *end != '\0')
+      continue;
+
+    char path[64];
+    cpu_set_t affinity;
+    snprintf(path, sizeof(path), "/proc/irq/%ld/smp_affinity_list", irq);
+    if (!bench_sysfs_cpulist(path, &affinity))
+      continue;
+
+    if (shield->count == capacity) {
+      capacity = capacity == 0 ? 64 : 2 * capacity;
+      bench_irq_affinity_t *saved = (bench_irq_affinity_t *)realloc(
+          shield->saved, capacity * sizeof(bench_irq_affinity_t));
+      if (saved == NULL)
+        break;
+      shield->saved = saved;
+    }
+    shield->saved[shield->count].irq = (int)irq;
+    shield->saved[shield->count].affinity = affinity;
+    shield->count++;
+  }
+
+  closedir(dir);
+  return shield->count > 0;
+}
+
+/**
+ * @brief Writes back the affinities saved by bench_irq_save().
+ */
+static inline void bench_irq_restore(const bench_irq_shield_t *shield) {
+  for (size_t i = 0; i < shield->count; i++)
+    bench_irq_set_affinity(shield->saved[i].irq, &shield->saved[i].affinity);
+}
+
+/**
+ * @brief Reads one record from the socket of the guardian.
+ *
+ * @return false once the benchmark closed its end
+ */
+static inline bool bench_guardian_receive(int fd,
+                                          bench_guard_record_t *record) {
+  size_t done = 0;
+  while (done < sizeof(*record)) {
+    ssize_t n = read(fd, (char *)record + done, sizeof(*record) - done);
+    if (n <= 0)
+      return false;
+    done += (size_t)n;
+  }
+  return true;
+}
+
+/**
+ * @brief Body of the guardian process.
+ *
+ * Collects the records until the benchmark closes its end, then brings the
+ * parked CPUs back online and restores the interrupt affinities. The CPUs
+ * come first, as an affinity naming only offline CPUs is rejected.
+ */
+static inline void bench_guardian_run(int fd) {
+  bench_irq_affinity_t *saved = NULL;
+  size_t count = 0, capacity = 0;
+  cpu_set_t parked;
+  CPU_ZERO(&parked);
+
+  bench_guard_record_t record;
+  while (bench_guardian_receive(fd, &record)) {
+    if (record.id < 0)
+      continue;
+    if (record.kind == BENCH_GUARD_PARK && record.id < CPU_SETSIZE) {
+      CPU_SET(record.id, &parked);
+    } else if (record.kind == BENCH_GUARD_UNPARK && record.id < CPU_SETSIZE) {
+      CPU_CLR(record.id, &parked);
+    } else if (record.kind == BENCH_GUARD_IRQ) {
+      if (count == capacity) {
+        capacity = capacity == 0 ? 64 : 2 * capacity;
+        bench_irq_affinity_t *grown = (bench_irq_affinity_t *)realloc(
+            saved, capacity * sizeof(bench_irq_affinity_t));
+        if (grown == NULL)
+          continue;
+        saved = grown;
+      }
+      saved[count].irq = record.id;
+      saved[count].affinity = record.affinity;
+      count++;
+    }
+  }
+
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &parked))
+      bench_set_cpu_online(cpu, true);
+  }
+  for (size_t i = 0; i < count; i++)
+    bench_irq_set_affinity(saved[i].irq, &saved[i].affinity);
+}
+
+/**
+ * @brief Starts the guardian of the process unless it is already running.
+ *
+ * The guardian blocks on a socket pair whose other end only the benchmark
+ * holds and records the changes sent by bench_guardian_send(). Whether the
+ * benchmark calls bench_guardian_stop(), returns from main(), crashes or is
+ * killed, its end is closed and the guardian undoes the changes. It runs in
+ * its own session, so Ctrl-C in the terminal does not reach it.
+ *
+ * @return true if the guardian is running
+ */
+static inline bool bench_guardian_start(void) {
+  bench_guardian_t *guardian = &bench_guardian_state;
+  if (guardian->pid > 0)
+    return true;
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+    return false;
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    close(fds[1]);
+    setsid();
+    bench_guardian_run(fds[0]);
+    _exit(EXIT_SUCCESS);
+  }
+
+  close(fds[0]);
+  guardian->pid = pid;
+  guardian->fd = fds[1];
+  return true;
+}
+
+/**
+ * @brief Sends a change to the guardian.
+ *
+ * MSG_NOSIGNAL keeps a guardian that died from raising SIGPIPE in the
+ * benchmark.
+ *
+ * @return true if the record was sent
+ */
+static inline bool bench_guardian_send(int32_t kind, int32_t id,
+                                       const cpu_set_t *affinity) {
+  bench_guardian_t *guardian = &bench_guardian_state;
+  if (guardian->pid <= 0)
+    return false;
+
+  bench_guard_record_t record;
+  memset(&record, 0, sizeof(record));
+  record.kind = kind;
+  record.id = id;
+  if (affinity != NULL)
+    record.affinity = *affinity;
+  return send(guardian->fd, &record, sizeof(record), MSG_NOSIGNAL) ==
+         (ssize_t)sizeof(record);
+}
+
+/**
+ * @brief Closes the socket of the guardian and waits until it has undone the
+ * changes. Does nothing if there is no guardian.
+ */
+static inline void bench_guardian_stop(void) {
+  bench_guardian_t *guardian = &bench_guardian_state;
+  if (guardian->pid <= 0)
+    return;
+
+  close(guardian->fd);
+  waitpid(guardian->pid, NULL, 0);
+  guardian->pid = 0;
+  guardian->fd = -1;
+}
+
+/**
+ * @brief Takes the SMT siblings of a core offline and has the guardian bring
+ * them back online should the benchmark die before bench_unpark().
+ *
+ * @param core The benchmark core
+ * @param parked Receives the siblings that were taken offline
+ * @return Number of siblings taken offline
+ *
+ * @note Requires root privileges
+ */
+static inline int bench_park(int core, cpu_set_t *parked) {
+  if (!bench_guardian_start())
+    printf("\033[33mCould not start the guardian, parked CPUs are only "
+           "brought back online by bench_unpark()!\033[0m\n");
+
+  int count = bench_smt_park(core, parked);
+  for (int cpu = 0; cpu < CPU_SETSIZE && count > 0; cpu++) {
+    if (CPU_ISSET(cpu, parked))
+      bench_guardian_send(BENCH_GUARD_PARK, cpu, NULL);
+  }
+  return count;
+}
+
+/**
+ * @brief Brings CPUs parked with bench_park() back online and tells the
+ * guardian.
+ */
+static inline void bench_unpark(const cpu_set_t *parked) {
+  bench_smt_unpark(parked);
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, parked))
+      bench_guardian_send(BENCH_GUARD_UNPARK, cpu, NULL);
+  }
+}
+
+/**
+ * @brief Checks if irqbalance is running, which would undo the shield.
+ */
+static inline bool bench_irqbalance_running(void) {
+  DIR *dir = opendir("/proc");
+  if (dir == NULL)
+    return false;
+
+  bool running = false;
+  struct dirent *entry;
+  while (!running && (entry = readdir(dir)) != NULL) {
+    char path[288], comm[32];
+    if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+      continue;
+    snprintf(path, sizeof(path), "/proc/%s/comm", entry->d_name);
+    running = bench_read_line(path, comm, sizeof(comm)) &&
+              strcmp(comm, "irqbalance") == 0;
+  }
+
+  closedir(dir);
+  return running;
+}
+
+/**
+ * @brief Steers all interrupts away from a benchmark core.
+ *
+ * The first call saves the affinity of every interrupt and hands it to the
+ * guardian, see bench_guardian_start(). Every core added later is removed
+ * from the original affinities as well, so the shield only grows. Interrupts
+ * whose affinity would become empty are moved to the CPUs currently online,
+ * which excludes parked SMT siblings. Per-CPU interrupts such as the local
+ * timer cannot be moved.
+ *
+ * @param core Core to shield
+ * @return Number of interrupts steered away, -1 if /proc/irq cannot be read
+ *
+ * @note Requires root privileges
+ */
+static inline int bench_irq_shield(int core) {
+  bench_irq_shield_t *shield = &bench_irq_shield_state;
+
+  if (shield->saved == NULL) {
+    if (!bench_irq_save(shield))
+      return -1;
+    bool guarded = bench_guardian_start();
+    for (size_t i = 0; i < shield->count && guarded; i++)
+      guarded = bench_guardian_send(BENCH_GUARD_IRQ, shield->saved[i].irq,
+                                    &shield->saved[i].affinity);
+    if (!guarded)
+      printf("\033[33mCould not start the IRQ guardian, affinities are only "
+             "restored by bench_irq_unshield()!\033[0m\n");
+    if (bench_irqbalance_running())
+      printf("\033[33mirqbalance is running and may undo the IRQ "
+             "shield!\033[0m\n");
+  }
+  CPU_SET(core, &shield->cores);
+
+  /* the cached topology does not know about parked CPUs */
+  cpu_set_t online, others;
+  if (!bench_sysfs_cpulist("/sys/devices/system/cpu/online", &online))
+    online = bench_topology()->online;
+  CPU_XOR(&others, &online, &shield->cores);
+  CPU_AND(&others, &others, &online);
+
+  int moved = 0;
+  for (size_t i = 0; i < shield->count; i++) {
+    cpu_set_t affinity;
+    CPU_AND(&affinity, &shield->saved[i].affinity, &shield->cores);
+    if (CPU_COUNT(&affinity) == 0)
+      continue;
+
+    CPU_XOR(&affinity, &shield->saved[i].affinity, &affinity);
+    if (CPU_COUNT(&affinity) == 0)
+      affinity = others;
+    if (CPU_COUNT(&affinity) > 0 &&
+        bench_irq_set_affinity(shield->saved[i].irq, &affinity))
+      moved++;
+  }
+  return moved;
+}
+
+/**
+ * @brief Restores the interrupt affinities changed by bench_irq_shield().
+ *
+ * Stops the guardian, which restores the affinities and brings any CPU still
+ * parked back online. The affinities are then written once more, in case
+ * there was no guardian or it missed records.
+ */
+static inline void bench_irq_unshield(void) {
+  bench_irq_shield_t *shield = &bench_irq_shield_state;
+  bench_guardian_stop();
+  if (shield->saved == NULL)
+    return;
+
+  bench_irq_restore(shield);
+  free(shield->saved);
+  memset(shield, 0, sizeof(*shield));
+}
+
+/**
+ * @brief Opens a perf counter of the irq:irq_handler_entry tracepoint on a
+ * core.
+ *
+ * @return File descriptor of the counter, -1 if tracefs is not mounted or
+ * the counter is not permitted
+ *
+ * @note Counts the interrupts with a handler. On arm these include the timer
+ * and the IPIs, on x86 the local APIC vectors are not counted.
+ */
+static inline int bench_irq_tracepoint_open(int core) {
+  static const char *paths[] = {
+      "/sys/kernel/tracing/events/irq/irq_handler_entry/id",
+      "/sys/kernel/debug/tracing/events/irq/irq_handler_entry/id",
+  };
+
+  long id = -1;
+  for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]) && id < 0; i++)
+    id = bench_sysfs_long(paths[i], -1);
+  if (id < 0)
+    return -1;
+
+  struct perf_event_attr pe;
+  memset(&pe, 0, sizeof(struct perf_event_attr));
+  pe.type = PERF_TYPE_TRACEPOINT;
+  pe.size = sizeof(struct perf_event_attr);
+  pe.config = (uint64_t)id;
+  return (int)syscall(__NR_perf_event_open, &pe, -1, core, -1, 0);
+}
+
+/**
+ * @brief Opens a counter of the interrupts handled by a core.
+ *
+ * Uses the irq:irq_handler_entry tracepoint if available and otherwise
+ * parses /proc/interrupts, which takes tens of microseconds per read.
+ *
+ * @return true if the interrupts of the core can be counted
+ */
+static inline bool bench_irq_counter_open(bench_irq_counter_t *counter,
+                                          int core) {
+  memset(counter, 0, sizeof(*counter));
+  counter->core = core;
+  counter->fd = bench_irq_tracepoint_open(core);
+  if (counter->fd < 0) {
+    counter->counts = (uint64_t *)calloc((size_t)core + 1, sizeof(uint64_t));
+    if (counter->counts == NULL ||
+        !bench_read_irq_counts(counter->counts, core + 1)) {
+      free(counter->counts);
+      counter->counts = NULL;
+      return false;
+    }
+  }
+  counter->active = true;
+  return true;
+}
+
+/**
+ * @brief Reads the number of interrupts the core has handled so far.
+ */
+static inline uint64_t bench_irq_counter_read(bench_irq_counter_t *counter) {
+  if (counter->fd >= 0) {
+    uint64_t count = 0;
+    if (read(counter->fd, &count, sizeof(count)) != sizeof(count))
+      return 0;
+    return count;
+  }
+  bench_read_irq_counts(counter->counts, counter->core + 1);
+  return counter->counts[counter->core];
+}
+
+/**
+ * @brief Closes a counter opened with bench_irq_counter_open().
+ */
+static inline void bench_irq_counter_close(bench_irq_counter_t *counter) {
+  if (counter->fd >= 0)
+    close(counter->fd);
+  free(counter->counts);
+  memset(counter, 0, sizeof(*counter));
+}
+
+#endif // IRQ_H
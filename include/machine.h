@@ -0,0 +1,527 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "./cli.h"
+#include "./env.h"
+#include "./hash.h"
+#include "./topology.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Magic bytes at the start of a machine characterization file.
+ */
+#define BENCH_MACHINE_MAGIC "PIBM"
+
+/**
+ * @brief Current version of the machine characterization format.
+ */
+#define BENCH_MACHINE_VERSION 2
+
+/**
+ * @brief Largest number of working set sizes of the latency ladder.
+ */
+#define BENCH_MACHINE_MAX_LEVELS 32
+
+/**
+ * @brief Largest number of thread counts of the bandwidth scaling test.
+ */
+#define BENCH_MACHINE_MAX_THREADS 64
+
+/**
+ * @brief Load latency at one working set size.
+ *
+ * bytes:               Size of the working set
+ * ns:                  Median latency of a dependent load in nanoseconds
+ */
+typedef struct {
+  uint64_t bytes;
+  double ns;
+} bench_latency_point_t;
+
+/**
+ * @brief Triad bandwidth of a number of threads.
+ *
+ * threads:             Number of threads, each pinned to its own CPU
+ * gbs:                 Combined bandwidth in GB/s
+ */
+typedef struct {
+  uint32_t threads;
+  uint32_t reserved;
+  double gbs;
+} bench_scaling_point_t;
+
+/**
+ * @brief Memory bandwidth and latency of a machine, measured by
+ * tools/machine-bench.c and stored at bench_machine_path().
+ *
+ * magic:               BENCH_MACHINE_MAGIC
+ * version:             Format version of the file
+ * fingerprint:         Machine the characterization was measured on, see
+ *                      bench_machine_fingerprint()
+ * kernels:             Instruction set of the STREAM kernels
+ * peak_kernels:        Instruction set of the peak compute kernel
+ * timestamp:           Time of the measurement in seconds since the epoch
+ * core:                Core of the single-threaded measurements
+ * stream_bytes:        Size of each STREAM array
+ * copy_gbs:            Best bandwidth of c = a in GB/s
+ * scale_gbs:           Best bandwidth of b = q * c in GB/s
+ * add_gbs:             Best bandwidth of c = a + b in GB/s
+ * triad_gbs:           Best bandwidth of a = b + q * c in GB/s
+ * peak_gflops:         Best double precision GFLOP/s of one core
+ * latency:             Latency ladder, growing working set sizes
+ * latency_count:       Number of entries of latency
+ * scaling:             Triad bandwidth of 1 to scaling_count threads
+ * scaling_count:       Number of entries of scaling
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  char fingerprint[16];
+  char kernels[16];
+  char peak_kernels[16];
+  uint64_t timestamp;
+  int32_t core;
+  uint32_t reserved;
+  uint64_t stream_bytes;
+  double copy_gbs, scale_gbs, add_gbs, triad_gbs;
+  double peak_gflops;
+  bench_latency_point_t latency[BENCH_MACHINE_MAX_LEVELS];
+  uint32_t latency_count;
+  uint32_t scaling_count;
+  bench_scaling_point_t scaling[BENCH_MACHINE_MAX_THREADS];
+} bench_machine_t;
+
+/**
+ * @brief Computes a fingerprint of the machine the benchmarks run on.
+ *
+ * Results are only comparable on the same hardware, so every machine gets its
+ * own directory in the history store and its own characterization.
+ *
+ * @param out Destination of 9 characters
+ */
+static inline void bench_machine_fingerprint(char out[9]) {
+  bench_env_t env;
+  bench_env_collect(&env);
+
+  char identity[512];
+  int len = snprintf(identity, sizeof(identity), "%s|%s|%s|%s|%d|%lu",
+                     env.hostname, env.arch, env.cpu_model, env.board,
+                     env.cpu_count, env.max_freq_mhz);
+  if (len < 0)
+    len = 0;
+  if ((size_t)len >= sizeof(identity))
+    len = sizeof(identity) - 1;
+
+  snprintf(out, 9, "%08x", bench_crc32c(identity, (size_t)len));
+}
+
+/**
+ * @brief Returns the instruction set the STREAM kernels use on this machine.
+ */
+static inline const char *bench_stream_isa(void) {
+#if defined(__ARM_NEON) && defined(__aarch64__)
+  return "neon";
+#elif defined(__x86_64__)
+  return __builtin_cpu_supports("avx") ? "avx" : "scalar";
+#else
+  return "scalar";
+#endif
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx"))) static inline void
+bench_stream_triad_avx(double *a, const double *b, const double *c, double q,
+                       size_t n) {
+  __m256d vq = _mm256_set1_pd(q);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(a + i, _mm256_add_pd(_mm256_loadu_pd(b + i),
+                                          _mm256_mul_pd(vq, _mm256_loadu_pd(
+                                                                c + i))));
+  for (; i < n; i++)
+    a[i] = b[i] + q * c[i];
+}
+
+__attribute__((target("avx"))) static inline void
+bench_stream_add_avx(double *c, const double *a, const double *b, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(c + i, _mm256_add_pd(_mm256_loadu_pd(a + i),
+                                          _mm256_loadu_pd(b + i)));
+  for (; i < n; i++)
+    c[i] = a[i] + b[i];
+}
+#endif
+
+/**
+ * @brief STREAM triad a = b + q * c, the other kernels are special cases.
+ *
+ * Uses NEON on aarch64 and AVX on x86-64 CPUs supporting it.
+ *
+ * @param a Destination of n doubles
+ * @param b, c Sources of n doubles
+ * @param q Scalar factor
+ * @param n Number of elements
+ */
+static inline void bench_stream_triad(double *a, const double *b,
+                                      const double *c, double q, size_t n) {
+  size_t i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+  float64x2_t vq = vdupq_n_f64(q);
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f64(a + i, vfmaq_f64(vld1q_f64(b + i), vq, vld1q_f64(c + i)));
+    vst1q_f64(a + i + 2,
+              vfmaq_f64(vld1q_f64(b + i + 2), vq, vld1q_f64(c + i + 2)));
+  }
+#elif defined(__x86_64__)
+  if (__builtin_cpu_supports("avx")) {
+    bench_stream_triad_avx(a, b, c, q, n);
+    return;
+  }
+#endif
+  for (; i < n; i++)
+    a[i] = b[i] + q * c[i];
+}
+
+/**
+ * @brief STREAM add c = a + b.
+ */
+static inline void bench_stream_add(double *c, const double *a,
+                                    const double *b, size_t n) {
+  size_t i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f64(c + i, vaddq_f64(vld1q_f64(a + i), vld1q_f64(b + i)));
+    vst1q_f64(c + i + 2, vaddq_f64(vld1q_f64(a + i + 2), vld1q_f64(b + i + 2)));
+  }
+#elif defined(__x86_64__)
+  if (__builtin_cpu_supports("avx")) {
+    bench_stream_add_avx(c, a, b, n);
+    return;
+  }
+#endif
+  for (; i < n; i++)
+    c[i] = a[i] + b[i];
+}
+
+/**
+ * @brief STREAM scale b = q * c.
+ */
+static inline void bench_stream_scale(double *b, const double *c, double q,
+                                      size_t n) {
+  /* b = 0 + q * c: the same loads and stores as a multiplication */
+  size_t i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+  float64x2_t vq = vdupq_n_f64(q);
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f64(b + i, vmulq_f64(vq, vld1q_f64(c + i)));
+    vst1q_f64(b + i + 2, vmulq_f64(vq, vld1q_f64(c + i + 2)));
+  }
+#endif
+  for (; i < n; i++)
+    b[i] = q * c[i];
+}
+
+/**
+ * @brief STREAM copy c = a.
+ */
+static inline void bench_stream_copy(double *c, const double *a, size_t n) {
+  size_t i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f64(c + i, vld1q_f64(a + i));
+    vst1q_f64(c + i + 2, vld1q_f64(a + i + 2));
+  }
+#endif
+  for (; i < n; i++)
+    c[i] = a[i];
+}
+
+/**
+ * @brief Number of independent FMA chains of bench_peak_fma(), enough to
+ * hide the FMA latency on two pipelines.
+ */
+#define BENCH_PEAK_CHAINS 10
+
+/**
+ * @brief Returns the instruction set bench_peak_fma() uses on this machine.
+ */
+static inline const char *bench_peak_isa(void) {
+#if defined(__ARM_NEON) && defined(__aarch64__)
+  return "neon";
+#elif defined(__x86_64__)
+  return __builtin_cpu_supports("fma") ? "fma" : "scalar";
+#else
+  return "scalar";
+#endif
+}
+
+/**
+ * @brief Returns the floating point operations of one call of
+ * bench_peak_fma().
+ */
+static inline double bench_peak_flops(size_t iterations) {
+  /* 2 flops per FMA and lane */
+  double lanes = 1.0;
+  if (strcmp(bench_peak_isa(), "neon") == 0)
+    lanes = 2.0;
+  else if (strcmp(bench_peak_isa(), "fma") == 0)
+    lanes = 4.0;
+  return 2.0 * lanes * BENCH_PEAK_CHAINS * (double)iterations;
+}
+
+/**
+ * @brief Applies a statement to each of the BENCH_PEAK_CHAINS accumulators.
+ */
+#define BENCH_PEAK_EACH(op)                                                    \
+  do {                                                                         \
+    op(x0);                                                                    \
+    op(x1);                                                                    \
+    op(x2);                                                                    \
+    op(x3);                                                                    \
+    op(x4);                                                                    \
+    op(x5);                                                                    \
+    op(x6);                                                                    \
+    op(x7);                                                                    \
+    op(x8);                                                                    \
+    op(x9);                                                                    \
+  } while (0)
+
+#if defined(__x86_64__)
+__attribute__((target("avx2,fma"))) static inline double
+bench_peak_fma_avx(size_t iterations) {
+  __m256d m = _mm256_set1_pd(0.999999), a = _mm256_set1_pd(1e-6);
+  __m256d x0 = a, x1 = a, x2 = a, x3 = a, x4 = a, x5 = a, x6 = a, x7 = a,
+          x8 = a, x9 = a;
+#define BENCH_PEAK_AVX(x) x = _mm256_fmadd_pd(x, m, a)
+  for (size_t i = 0; i < iterations; i++)
+    BENCH_PEAK_EACH(BENCH_PEAK_AVX);
+#undef BENCH_PEAK_AVX
+  __m256d sum = _mm256_add_pd(
+      _mm256_add_pd(_mm256_add_pd(x0, x1), _mm256_add_pd(x2, x3)),
+      _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(x4, x5), _mm256_add_pd(x6, x7)),
+                    _mm256_add_pd(x8, x9)));
+  double lanes[4];
+  _mm256_storeu_pd(lanes, sum);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+#endif
+
+/**
+ * @brief Runs BENCH_PEAK_CHAINS independent double precision FMA chains to
+ * measure the peak compute rate of a core, see bench_peak_flops().
+ *
+ * Uses NEON on aarch64 and AVX2 with FMA on x86-64 CPUs supporting it. The
+ * chains converge to a constant, so no denormals slow them down.
+ *
+ * @return Sum of the chains, pass it to BENCH_DO_NOT_OPTIMIZE
+ */
+static inline double bench_peak_fma(size_t iterations) {
+#if defined(__ARM_NEON) && defined(__aarch64__)
+  float64x2_t m = vdupq_n_f64(0.999999), a = vdupq_n_f64(1e-6);
+  float64x2_t x0 = a, x1 = a, x2 = a, x3 = a, x4 = a, x5 = a, x6 = a, x7 = a,
+              x8 = a, x9 = a;
+#define BENCH_PEAK_NEON(x) x = vfmaq_f64(a, x, m)
+  for (size_t i = 0; i < iterations; i++)
+    BENCH_PEAK_EACH(BENCH_PEAK_NEON);
+#undef BENCH_PEAK_NEON
+  float64x2_t sum = vaddq_f64(
+      vaddq_f64(vaddq_f64(x0, x1), vaddq_f64(x2, x3)),
+      vaddq_f64(vaddq_f64(vaddq_f64(x4, x5), vaddq_f64(x6, x7)),
+                vaddq_f64(x8, x9)));
+  return vgetq_lane_f64(sum, 0) + vgetq_lane_f64(sum, 1);
+#else
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("fma"))
+    return bench_peak_fma_avx(iterations);
+#endif
+  double m = 0.999999, a = 1e-6;
+  double x0 = a, x1 = a, x2 = a, x3 = a, x4 = a, x5 = a, x6 = a, x7 = a,
+         x8 = a, x9 = a;
+#define BENCH_PEAK_SCALAR(x) x = x * m + a
+  for (size_t i = 0; i < iterations; i++)
+    BENCH_PEAK_EACH(BENCH_PEAK_SCALAR);
+#undef BENCH_PEAK_SCALAR
+  return x0 + x1 + x2 + x3 + x4 + x5 + x6 + x7 + x8 + x9;
+#endif
+}
+
+/**
+ * @brief Links the cache lines of a buffer into one random cycle for
+ * bench_chase().
+ *
+ * Each line holds the address of the next one, visited in an order the
+ * hardware prefetchers cannot predict (Sattolo's algorithm).
+ *
+ * @param buffer Buffer of at least bytes bytes
+ * @param bytes Size of the working set
+ * @param stride Distance of the linked lines, usually the cache line size
+ * @param seed Seed of the order
+ * @return Start of the cycle
+ */
+static inline void *bench_chase_build(void *buffer, size_t bytes,
+                                      size_t stride, uint64_t seed) {
+  size_t count = bytes / stride;
+  size_t *order = (size_t *)malloc(count * sizeof(size_t));
+  if (order == NULL || count == 0) {
+    free(order);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < count; i++)
+    order[i] = i;
+  uint64_t x = seed | 1;
+  for (size_t i = count; i-- > 1;) {
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    size_t j = (size_t)((x * 0x2545F4914F6CDD1DULL) % i);
+    size_t tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+
+  char *base = (char *)buffer;
+  for (size_t i = 0; i < count; i++)
+    *(void **)(base + order[i] * stride) =
+        base + order[(i + 1) % count] * stride;
+
+  void *start = base + order[0] * stride;
+  free(order);
+  return start;
+}
+
+/**
+ * @brief Follows a cycle built by bench_chase_build() for a number of
+ * dependent loads.
+ *
+ * @return The address reached, pass it to BENCH_DO_NOT_OPTIMIZE
+ */
+static inline void *bench_chase(void *p, size_t steps) {
+  void **q = (void **)p;
+  for (size_t i = 0; i < steps / 8; i++) {
+    q = (void **)*q;
+    q = (void **)*q;
+    q = (void **)*q;
+    q = (void **)*q;
+    q = (void **)*q;
+    q = (void **)*q;
+    q = (void **)*q;
+    q = (void **)*q;
+  }
+  return q;
+}
+
+/**
+ * @brief Builds the path of the machine characterization.
+ *
+ * --machine overrides the default
+ * $XDG_CACHE_HOME/pibench/machine-<fingerprint>.pibm, which falls back to
+ * ~/.cache.
+ *
+ * @return true on success, false if the path is too long or unknown
+ */
+static inline bool bench_machine_path(char *path, size_t size) {
+  if (bench_options.machine != NULL) {
+    int written = snprintf(path, size, "%s", bench_options.machine);
+    return written >= 0 && (size_t)written < size;
+  }
+
+  char fingerprint[9];
+  bench_machine_fingerprint(fingerprint);
+
+  const char *cache = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  int written = -1;
+  if (cache != NULL && cache[0] != '\0')
+    written =
+        snprintf(path, size, "%s/pibench/machine-%s.pibm", cache, fingerprint);
+  else if (home != NULL)
+    written = snprintf(path, size, "%s/.cache/pibench/machine-%s.pibm", home,
+                       fingerprint);
+  return written >= 0 && (size_t)written < size;
+}
+
+/**
+ * @brief Stores a machine characterization at bench_machine_path().
+ *
+ * Creates the directories of the default path if needed.
+ *
+ * @return true on success
+ */
+static inline bool bench_machine_save(const bench_machine_t *machine) {
+  char path[512];
+  if (!bench_machine_path(path, sizeof(path)))
+    return false;
+
+  /* mkdir -p of the directory of the file */
+  for (char *slash = strchr(path + 1, '/'); slash != NULL;
+       slash = strchr(slash + 1, '/')) {
+    *slash = '\0';
+    bool ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+    *slash = '/';
+    if (!ok) {
+      fprintf(stderr, "Error: Could not create directory of %s\n", path);
+      return false;
+    }
+  }
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Could not open file %s for writing\n", path);
+    return false;
+  }
+  bool ok = write(fd, machine, sizeof(*machine)) == (ssize_t)sizeof(*machine);
+  return close(fd) == 0 && ok;
+}
+
+/**
+ * @brief Loads the machine characterization of the current machine.
+ *
+ * A characterization measured on another machine is ignored.
+ *
+ * @param machine Receives the characterization
+ * @return true if a characterization of this machine was found
+ */
+static inline bool bench_machine_load(bench_machine_t *machine) {
+  char path[512];
+  if (!bench_machine_path(path, sizeof(path)))
+    return false;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  bool ok = read(fd, machine, sizeof(*machine)) == (ssize_t)sizeof(*machine);
+  close(fd);
+
+  char fingerprint[9];
+  bench_machine_fingerprint(fingerprint);
+  return ok &&
+         memcmp(machine->magic, BENCH_MACHINE_MAGIC, sizeof(machine->magic)) ==
+             0 &&
+         machine->version == BENCH_MACHINE_VERSION &&
+         strncmp(machine->fingerprint, fingerprint,
+                 sizeof(machine->fingerprint)) == 0 &&
+         machine->latency_count <= BENCH_MACHINE_MAX_LEVELS &&
+         machine->scaling_count <= BENCH_MACHINE_MAX_THREADS;
+}
+
+#endif // MACHINE_H
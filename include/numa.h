@@ -0,0 +1,244 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "./env.h"
+#include "./topology.h"
+#include <linux/mempolicy.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief Highest number of NUMA nodes memory can be placed on.
+ */
+#define BENCH_MAX_NODES 1024
+
+/**
+ * @brief Placement of the buffers of a benchmark relative to its core.
+ *
+ * BENCH_NUMA_DEFAULT:    Left to the kernel, usually the node of first touch
+ * BENCH_NUMA_LOCAL:      Node of the core the benchmark runs on
+ * BENCH_NUMA_REMOTE:     Nearest other node with memory
+ * BENCH_NUMA_INTERLEAVE: Pages spread round-robin over all nodes
+ * BENCH_NUMA_SWEEP:      Every benchmark runs with LOCAL, REMOTE and
+ *                        INTERLEAVE, only valid as --numa option
+ */
+typedef enum {
+  BENCH_NUMA_DEFAULT,
+  BENCH_NUMA_LOCAL,
+  BENCH_NUMA_REMOTE,
+  BENCH_NUMA_INTERLEAVE,
+  BENCH_NUMA_SWEEP,
+} bench_numa_mode_t;
+
+/**
+ * @brief Set of NUMA nodes in the layout expected by mbind() and
+ * set_mempolicy().
+ */
+typedef struct {
+  unsigned long bits[BENCH_MAX_NODES / (8 * sizeof(unsigned long))];
+} bench_nodemask_t;
+
+/**
+ * @brief Adds a node to a node mask, nodes out of range are ignored.
+ */
+static inline void bench_nodemask_set(bench_nodemask_t *mask, int node) {
+  const int width = 8 * sizeof(unsigned long);
+  if (node >= 0 && node < BENCH_MAX_NODES)
+    mask->bits[node / width] |= 1UL << (node % width);
+}
+
+/**
+ * @brief Checks if a node mask holds no node.
+ */
+static inline bool bench_nodemask_empty(const bench_nodemask_t *mask) {
+  for (size_t i = 0; i < sizeof(mask->bits) / sizeof(mask->bits[0]); i++) {
+    if (mask->bits[i] != 0)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Sets the memory policy of a range and moves its pages with mbind().
+ *
+ * The range is extended to whole pages. Pages already touched are migrated,
+ * unless they are shared with another process.
+ *
+ * @param addr Start of the range
+ * @param length Length of the range in bytes
+ * @param policy MPOL_BIND, MPOL_INTERLEAVE or MPOL_DEFAULT
+ * @param mask Nodes of the policy, NULL for MPOL_DEFAULT
+ * @return true on success
+ */
+static inline bool bench_mbind(void *addr, size_t length, int policy,
+                               const bench_nodemask_t *mask) {
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)addr / page * page;
+  uintptr_t end = ((uintptr_t)addr + length + page - 1) / page * page;
+
+  /* the kernel reads maxnode - 1 bits */
+  return syscall(SYS_mbind, start, end - start, policy,
+                 mask != NULL ? mask->bits : NULL,
+                 mask != NULL ? BENCH_MAX_NODES + 1 : 0,
+                 policy == MPOL_DEFAULT ? 0 : MPOL_MF_MOVE) == 0;
+}
+
+/**
+ * @brief Sets the memory policy of the calling thread with set_mempolicy().
+ *
+ * Applies to the pages the thread touches first from now on.
+ *
+ * @param policy MPOL_BIND, MPOL_INTERLEAVE or MPOL_DEFAULT
+ * @param mask Nodes of the policy, NULL for MPOL_DEFAULT
+ * @return true on success
+ */
+static inline bool bench_set_mempolicy(int policy,
+                                       const bench_nodemask_t *mask) {
+  return syscall(SYS_set_mempolicy, policy, mask != NULL ? mask->bits : NULL,
+                 mask != NULL ? BENCH_MAX_NODES + 1 : 0) == 0;
+}
+
+/**
+ * @brief Reads the distance between two nodes from
+ * /sys/devices/system/node/nodeN/distance.
+ *
+ * @return The distance, 10 for the node itself, -1 if unknown
+ */
+static inline int bench_numa_distance(int from, int to) {
+  char path[64], line[1024];
+  cpu_set_t online;
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/distance",
+           from);
+  if (!bench_sysfs_cpulist("/sys/devices/system/node/online", &online) ||
+      !CPU_ISSET(to, &online) || !bench_read_line(path, line, sizeof(line)))
+    return -1;
+
+  /* one distance per online node, in the order of the node ids */
+  char *p = line;
+  for (int node = 0; node < to; node++) {
+    if (!CPU_ISSET(node, &online))
+      continue;
+    strtol(p, &p, 10);
+  }
+  char *end;
+  long distance = strtol(p, &end, 10);
+  return end == p ? -1 : (int)distance;
+}
+
+/**
+ * @brief Returns the NUMA node of a CPU, 0 if it is unknown.
+ */
+static inline int bench_numa_cpu_node(int cpu) {
+  const bench_topology_t *topology = bench_topology();
+  if (topology->cpus == NULL || cpu < 0 || cpu >= topology->cpu_count)
+    return 0;
+  return topology->cpus[cpu].node;
+}
+
+/**
+ * @brief Returns the nearest other node with memory.
+ *
+ * @param node The local node
+ * @return The remote node, or -1 on machines with a single node
+ */
+static inline int bench_numa_remote_node(int node) {
+  const bench_topology_t *topology = bench_topology();
+  int remote = -1, remote_distance = 0;
+
+  for (size_t i = 0; i < topology->node_count; i++) {
+    const bench_numa_node_t *candidate = &topology->nodes[i];
+    if (candidate->id == node || candidate->mem_total_kb == 0)
+      continue;
+
+    int distance = bench_numa_distance(node, candidate->id);
+    if (distance < 0)
+      distance = INT32_MAX;
+    if (remote < 0 || distance < remote_distance) {
+      remote = candidate->id;
+      remote_distance = distance;
+    }
+  }
+  return remote;
+}
+
+/**
+ * @brief Returns the name of a placement, e.g. "remote".
+ */
+static inline const char *bench_numa_mode_name(bench_numa_mode_t mode) {
+  static const char *names[] = {"default", "local", "remote", "interleave",
+                                "sweep"};
+  return names[mode];
+}
+
+/**
+ * @brief Resolves a placement relative to a CPU into a memory policy.
+ *
+ * @param mode The placement
+ * @param cpu The CPU the benchmark runs on
+ * @param mask Receives the nodes of the policy
+ * @param node Receives the node the memory is bound to, -1 if interleaved
+ * @return MPOL_BIND, MPOL_INTERLEAVE, or MPOL_DEFAULT for BENCH_NUMA_DEFAULT
+ *
+ * @note On machines with a single node, BENCH_NUMA_REMOTE binds to the local
+ * node
+ */
+static inline int bench_numa_policy(bench_numa_mode_t mode, int cpu,
+                                    bench_nodemask_t *mask, int *node) {
+  const bench_topology_t *topology = bench_topology();
+  memset(mask, 0, sizeof(*mask));
+  *node = -1;
+
+  int local = bench_numa_cpu_node(cpu);
+
+  switch (mode) {
+  case BENCH_NUMA_LOCAL:
+  case BENCH_NUMA_REMOTE:
+    *node = mode == BENCH_NUMA_REMOTE ? bench_numa_remote_node(local) : local;
+    if (*node < 0)
+      *node = local;
+    bench_nodemask_set(mask, *node);
+    return MPOL_BIND;
+  case BENCH_NUMA_INTERLEAVE:
+    /* nodes without memory only if the memory of every node is unknown */
+    for (int pass = 0; pass < 2 && bench_nodemask_empty(mask); pass++) {
+      for (size_t i = 0; i < topology->node_count; i++) {
+        if (pass == 1 || topology->nodes[i].mem_total_kb > 0)
+          bench_nodemask_set(mask, topology->nodes[i].id);
+      }
+    }
+    return MPOL_INTERLEAVE;
+  default:
+    return MPOL_DEFAULT;
+  }
+}
+
+/**
+ * @brief Places a buffer relative to a CPU, migrating pages already touched.
+ *
+ *   bench_numa_place(input, size, BENCH_NUMA_REMOTE, 2);
+ *
+ * @param ptr The buffer
+ * @param size Size of the buffer in bytes
+ * @param mode The placement
+ * @param cpu The CPU the buffer is local or remote to
+ * @return true on success
+ */
+static inline bool bench_numa_place(void *ptr, size_t size,
+                                    bench_numa_mode_t mode, int cpu) {
+  bench_nodemask_t mask;
+  int node;
+  int policy = bench_numa_policy(mode, cpu, &mask, &node);
+  return bench_mbind(ptr, size, policy,
+                     policy == MPOL_DEFAULT ? NULL : &mask);
+}
+
+#endif // NUMA_H
@@ -0,0 +1,550 @@
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include "./bench.h"
+#include "./cli.h"
+#include "./registry.h"
+#include "./topology.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief List of values a benchmark parameter takes.
+ *
+ * values:              Heap allocated parameter values
+ * count:               Number of values
+ */
+typedef struct {
+  int64_t *values;
+  size_t count;
+} bench_range_t;
+
+/**
+ * @brief Per-instance setup of a benchmark family, run outside of the timed
+ * region.
+ *
+ * @param args Parameters of the instance
+ * @return Context passed to the benchmark body and the teardown function
+ */
+typedef void *(*bench_instance_setup_fn)(const bench_args_t *args);
+
+/**
+ * @brief Per-instance teardown of a benchmark family, run outside of the
+ * timed region.
+ *
+ * @param ctx Context returned by the setup function
+ * @param args Parameters of the instance
+ */
+typedef void (*bench_instance_teardown_fn)(void *ctx, const bench_args_t *args);
+
+/**
+ * @brief Function running the timed body of a benchmark family instance.
+ */
+typedef void (*bench_family_body_fn)(benchmark_t *benchmark, void *ctx,
+                                     const bench_args_t *args);
+
+/**
+ * @brief Structure describing a parameterized benchmark family.
+ *
+ * name:                Name of the family, instances are named name/v0/v1/...
+ * warmup_iterations:   Number of warmup iterations per instance
+ * timed_iterations:    Number of timed iterations per instance
+ * setup:               Per-instance setup, may be NULL
+ * teardown:            Per-instance teardown, may be NULL
+ * body:                Function running the benchmark
+ * axes:                Values of every parameter
+ * axis_names:          Name of every parameter
+ * axis_count:          Number of parameters
+ * instance_names:      Names of the instances that were generated
+ * instance_count:      Number of generated instance names
+ */
+typedef struct {
+  const char *name;
+  size_t warmup_iterations;
+  size_t timed_iterations;
+  bench_instance_setup_fn setup;
+  bench_instance_teardown_fn teardown;
+  bench_family_body_fn body;
+  bench_range_t axes[BENCH_MAX_PARAMS];
+  const char *axis_names[BENCH_MAX_PARAMS];
+  size_t axis_count;
+  char **instance_names;
+  size_t instance_count;
+} bench_family_t;
+
+/**
+ * @brief Registry of benchmark families.
+ */
+typedef struct {
+  bench_family_t **families;
+  size_t count, capacity;
+} bench_family_registry_t;
+
+PIBENCH_STATE bench_family_registry_t bench_families PIBENCH_INIT(PIBENCH_ZERO);
+
+/**
+ * @brief Creates a range from start to end (inclusive) in linear steps.
+ *
+ * @param start First value
+ * @param end Last value (inclusive)
+ * @param step Distance between two values, must be positive
+ * @return The range, empty on invalid input
+ */
+[[nodiscard]] static inline bench_range_t
+bench_range_linear(int64_t start, int64_t end, int64_t step) {
+  bench_range_t range = {NULL, 0};
+  if (step <= 0 || end < start)
+    return range;
+
+  size_t count = (size_t)((end - start) / step) + 1;
+  range.values = (int64_t *)malloc(count * sizeof(int64_t));
+  if (range.values == NULL)
+    return range;
+
+  for (size_t i = 0; i < count; i++) {
+    range.values[i] = start + (int64_t)i * step;
+  }
+  range.count = count;
+
+  return range;
+}
+
+/**
+ * @brief Creates a range from start to end (inclusive) multiplying by a
+ * constant factor.
+ *
+ * The last value is always end, even if it is not a multiple of the factor,
+ * so the full range is covered.
+ *
+ * @param start First value, must be positive
+ * @param end Last value (inclusive)
+ * @param factor Factor between two values, must be at least 2
+ * @return The range, empty on invalid input
+ */
+[[nodiscard]] static inline bench_range_t
+bench_range_geometric(int64_t start, int64_t end, int64_t factor) {
+  bench_range_t range = {NULL, 0};
+  if (start <= 0 || factor < 2 || end < start)
+    return range;
+
+  /* at most 63 doublings fit into an int64_t, plus the end value */
+  range.values = (int64_t *)malloc(65 * sizeof(int64_t));
+  if (range.values == NULL)
+    return range;
+
+  size_t i = 0;
+  for (int64_t v = start;; v *= factor) {
+    range.values[i++] = v;
+    if (v >= end || v > end / factor)
+      break;
+  }
+  if (range.values[i - 1] != end)
+    range.values[i++] = end;
+  range.count = i;
+
+  return range;
+}
+
+/**
+ * @brief Creates a range of powers of two from start to end (inclusive).
+ *
+ * Typically used for buffer size sweeps, e.g. 1 KB to 64 MB.
+ *
+ * @see bench_range_geometric
+ */
+[[nodiscard]] static inline bench_range_t bench_range_pow2(int64_t start,
+                                                           int64_t end) {
+  return bench_range_geometric(start, end, 2);
+}
+
+/**
+ * @brief Creates a range from an explicit list of values.
+ *
+ * @param values Values to copy into the range
+ * @param count Number of values
+ * @return The range, empty on invalid input
+ */
+[[nodiscard]] static inline bench_range_t
+bench_range_list(const int64_t *values, size_t count) {
+  bench_range_t range = {NULL, 0};
+  if (values == NULL || count == 0)
+    return range;
+
+  range.values = (int64_t *)malloc(count * sizeof(int64_t));
+  if (range.values == NULL)
+    return range;
+
+  memcpy(range.values, values, count * sizeof(int64_t));
+  range.count = count;
+
+  return range;
+}
+
+/**
+ * @brief Creates a range of working set sizes in bytes around the caches of
+ * the CPU the caller runs on.
+ *
+ * Holds half and the full size of every data cache level, so each level is
+ * measured while the data fits and when it spills, and twice and four times
+ * the last level cache for main memory.
+ *
+ * @return The range, in ascending order
+ */
+[[nodiscard]] static inline bench_range_t bench_range_cache_sizes(void) {
+  int64_t values[2 * 4 + 2];
+  size_t count = 0;
+  int cpu = sched_getcpu();
+
+  for (int level = 1; level <= 4; level++) {
+    const bench_cache_t *cache =
+        bench_topology_cache(bench_topology(), cpu < 0 ? 0 : cpu, level);
+    if (cache == NULL)
+      continue;
+    values[count++] = (int64_t)cache->size / 2;
+    values[count++] = (int64_t)cache->size;
+  }
+  if (count == 0) {
+    values[count++] = (int64_t)bench_cache_size(1) / 2;
+    values[count++] = (int64_t)bench_cache_size(1);
+    values[count++] = (int64_t)bench_cache_size(2);
+  }
+  int64_t llc = (int64_t)bench_cache_size(BENCH_CACHE_LLC);
+  values[count++] = 2 * llc;
+  values[count++] = 4 * llc;
+
+  /* sort and drop duplicates, levels may share sizes */
+  for (size_t i = 1; i < count; i++) {
+    int64_t value = values[i];
+    size_t j = i;
+    for (; j > 0 && values[j - 1] > value; j--)
+      values[j] = values[j - 1];
+    values[j] = value;
+  }
+  size_t unique = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (unique == 0 || values[i] != values[unique - 1])
+      values[unique++] = values[i];
+  }
+
+  return bench_range_list(values, unique);
+}
+
+/**
+ * @brief Creates a range from start to end (inclusive) with a custom
+ * generator.
+ *
+ * @param start First value
+ * @param end Last value (inclusive)
+ * @param next Returns the value following its argument, must be increasing
+ * @return The range, empty on invalid input
+ */
+[[nodiscard]] static inline bench_range_t
+bench_range_custom(int64_t start, int64_t end, int64_t (*next)(int64_t)) {
+  bench_range_t range = {NULL, 0};
+  size_t capacity = 0;
+  if (next == NULL || end < start)
+    return range;
+
+  for (int64_t v = start; v <= end;) {
+    if (!bench_registry_grow((void **)&range.values, &capacity, range.count,
+                             sizeof(int64_t)))
+      break;
+    range.values[range.count++] = v;
+
+    int64_t following = next(v);
+    if (following <= v)
+      break;
+    v = following;
+  }
+
+  return range;
+}
+
+/**
+ * @brief Registers a benchmark family with the family registry.
+ *
+ * Usually called from a constructor generated by the
+ * REGISTER_BENCHMARK_FAMILY_* macros.
+ *
+ * @return The registered family, or NULL on allocation failure
+ */
+static inline bench_family_t *
+bench_register_family(const char *name, size_t warmup_iterations,
+                      size_t timed_iterations, bench_instance_setup_fn setup,
+                      bench_instance_teardown_fn teardown,
+                      bench_family_body_fn body) {
+  if (!bench_registry_grow((void **)&bench_families.families,
+                           &bench_families.capacity, bench_families.count,
+                           sizeof(bench_family_t *)))
+    return NULL;
+
+  bench_family_t *family = (bench_family_t *)calloc(1, sizeof(bench_family_t));
+  if (family == NULL)
+    return NULL;
+
+  family->name = name;
+  family->warmup_iterations = warmup_iterations;
+  family->timed_iterations = timed_iterations;
+  family->setup = setup;
+  family->teardown = teardown;
+  family->body = body;
+
+  bench_families.families[bench_families.count++] = family;
+  return family;
+}
+
+/**
+ * @brief Adds a parameter to a benchmark family.
+ *
+ * The family runs one instance for every element of the cartesian product of
+ * all its parameters. The family takes ownership of the range.
+ *
+ * @param family The family to extend
+ * @param name Name of the parameter
+ * @param range Values of the parameter
+ * @return true on success, false if the family has too many parameters or the
+ * range is empty
+ */
+static inline bool bench_family_axis(bench_family_t *family, const char *name,
+                                     bench_range_t range) {
+  if (family->axis_count >= BENCH_MAX_PARAMS || range.count == 0) {
+    fprintf(stderr, "Error: Could not add parameter '%s' to family '%s'\n",
+            name, family->name);
+    free(range.values);
+    return false;
+  }
+
+  family->axes[family->axis_count] = range;
+  family->axis_names[family->axis_count] = name;
+  family->axis_count++;
+  return true;
+}
+
+/**
+ * @brief Builds the name of a family instance, e.g. "memcpy/1024/8".
+ *
+ * @return Heap allocated name, or NULL on allocation failure
+ */
+static inline char *bench_family_instance_name(const bench_family_t *family,
+                                               const bench_args_t *args) {
+  size_t len = strlen(family->name) + 1 + args->count * 21;
+  char *name = (char *)malloc(len);
+  if (name == NULL)
+    return NULL;
+
+  size_t pos = (size_t)snprintf(name, len, "%s", family->name);
+  for (size_t i = 0; i < args->count; i++) {
+    pos += (size_t)snprintf(name + pos, len - pos, "/%ld",
+                            (long)args->values[i]);
+  }
+
+  return name;
+}
+
+/**
+ * @brief Lists or runs every instance of a family selected by the filter.
+ *
+ * Instances are generated from the cartesian product of the parameters, the
+ * last parameter changing fastest. Setup and teardown run outside of the
+ * timed region.
+ *
+ * @param family The family to run
+ */
+static inline void bench_run_family(bench_family_t *family) {
+  size_t total = 1;
+  for (size_t a = 0; a < family->axis_count; a++) {
+    total *= family->axes[a].count;
+  }
+
+  /* a --numa=sweep run generates the instances once per pass */
+  char **names = (char **)realloc(family->instance_names,
+                                  (family->instance_count + total) *
+                                      sizeof(char *));
+  if (names == NULL)
+    return;
+  family->instance_names = names;
+
+  size_t index[BENCH_MAX_PARAMS] = {0};
+  for (size_t n = 0; n < total; n++) {
+    bench_args_t args = PIBENCH_ZERO;
+    args.count = family->axis_count;
+    for (size_t a = 0; a < family->axis_count; a++) {
+      args.values[a] = family->axes[a].values[index[a]];
+      args.names[a] = family->axis_names[a];
+    }
+
+    /* advance the index like an odometer, last parameter fastest */
+    for (size_t a = family->axis_count; a-- > 0;) {
+      if (++index[a] < family->axes[a].count)
+        break;
+      index[a] = 0;
+    }
+
+    char *name = bench_family_instance_name(family, &args);
+    if (name == NULL)
+      continue;
+    family->instance_names[family->instance_count++] = name;
+
+    if (!bench_filter_match(name))
+      continue;
+
+    if (bench_options.list) {
+      printf("%s\n", name);
+      continue;
+    }
+
+    printf("\n=== %s Benchmark ===\n", name);
+
+    void *ctx = family->setup != NULL ? family->setup(&args) : NULL;
+
+    benchmark_t *benchmark =
+        setup_benchmark(name, family->warmup_iterations,
+                        family->timed_iterations, false, false, NULL, 0);
+    benchmark->family = family->name;
+    benchmark->args = args;
+
+    /* settings of the family apply to every instance without its own */
+    bench_inherit_attributes(benchmark, name, family->name);
+    if (benchmark->fixture.ctx == NULL)
+      benchmark->fixture.ctx = ctx;
+
+    family->body(benchmark, ctx, &benchmark->args);
+
+    if (family->teardown != NULL)
+      family->teardown(ctx, &args);
+
+    bench_registry_add_result(benchmark);
+  }
+}
+
+/**
+ * @brief Lists or runs all registered benchmark families.
+ */
+static inline void bench_run_families(void) {
+  for (size_t i = 0; i < bench_families.count; i++) {
+    bench_run_family(bench_families.families[i]);
+  }
+}
+
+/**
+ * @brief Frees all registered families, their ranges and instance names.
+ *
+ * @note Must run after the results referencing the instance names were freed
+ * or exported
+ */
+static inline void bench_families_cleanup(void) {
+  for (size_t i = 0; i < bench_families.count; i++) {
+    bench_family_t *family = bench_families.families[i];
+
+    for (size_t a = 0; a < family->axis_count; a++) {
+      free(family->axes[a].values);
+    }
+    for (size_t n = 0; n < family->instance_count; n++) {
+      free(family->instance_names[n]);
+    }
+    free(family->instance_names);
+    free(family);
+  }
+
+  free(bench_families.families);
+  memset(&bench_families, 0, sizeof(bench_families));
+}
+
+/**
+ * @brief Accesses parameter i of the current instance inside a family body.
+ */
+#define BENCH_ARG(i) (args->values[(i)])
+
+/**
+ * @brief Defines the function configuring the parameters of a family.
+ *
+ * Must follow the family registration, the family is available as `family`:
+ *
+ *   BENCHMARK_FAMILY_ARGS(copy) {
+ *     bench_family_axis(family, "bytes", bench_range_pow2(1 << 10, 64 << 20));
+ *   }
+ */
+#define BENCHMARK_FAMILY_ARGS(id)                                              \
+  static void _bench_family_args_##id(bench_family_t *family)
+
+/**
+ * @brief Defines a registration constructor for a family body.
+ *
+ * Internal helper of the REGISTER_BENCHMARK_FAMILY_* macros.
+ */
+#define _REGISTER_BENCHMARK_FAMILY(id, family_name, setup_fn, teardown_fn)     \
+  BENCHMARK_FAMILY_ARGS(id);                                                   \
+  __attribute__((constructor)) static void _bench_register_family_##id(void) { \
+    bench_family_t *family =                                                   \
+        bench_register_family(family_name, WARMUP_RUNS, TIMED_RUNS, setup_fn,  \
+                              teardown_fn, _bench_family_body_##id);           \
+    if (family != NULL)                                                        \
+      _bench_family_args_##id(family);                                         \
+  }
+
+/**
+ * @brief Registers a pinned, wall-clock timed benchmark family.
+ *
+ * One benchmark is run for every combination of the parameters defined with
+ * BENCHMARK_FAMILY_ARGS(id). The function call can use `ctx` (returned by the
+ * setup function) and `args` / BENCH_ARG(i) (the parameters of the instance).
+ * Setup and teardown may be NULL and run outside of the timed region.
+ */
+#define REGISTER_BENCHMARK_FAMILY_TIME_PINNED(id, name, setup, teardown, core, \
+                                              func)                            \
+  static void _bench_family_body_##id(benchmark_t *benchmark, void *ctx,       \
+                                      const bench_args_t *args) {              \
+    (void)ctx;                                                                 \
+    (void)args;                                                                \
+    BENCHMARK_FUNC_PINNED(func, benchmark, core);                              \
+  }                                                                            \
+  _REGISTER_BENCHMARK_FAMILY(id, name, setup, teardown)
+
+/**
+ * @brief Registers a wall-clock timed benchmark family.
+ *
+ * @see REGISTER_BENCHMARK_FAMILY_TIME_PINNED
+ */
+#define REGISTER_BENCHMARK_FAMILY_TIME(id, name, setup, teardown, func)        \
+  static void _bench_family_body_##id(benchmark_t *benchmark, void *ctx,       \
+                                      const bench_args_t *args) {              \
+    (void)ctx;                                                                 \
+    (void)args;                                                                \
+    BENCHMARK_FUNC(func, benchmark);                                           \
+  }                                                                            \
+  _REGISTER_BENCHMARK_FAMILY(id, name, setup, teardown)
+
+/**
+ * @brief Registers a pinned, cycle timed benchmark family.
+ *
+ * @see REGISTER_BENCHMARK_FAMILY_TIME_PINNED
+ */
+#define REGISTER_BENCHMARK_FAMILY_CYCLES_PINNED(id, name, setup, teardown,     \
+                                                core, func)                    \
+  static void _bench_family_body_##id(benchmark_t *benchmark, void *ctx,       \
+                                      const bench_args_t *args) {              \
+    (void)ctx;                                                                 \
+    (void)args;                                                                \
+    BENCHMARK_FUNC_CYCLES_PINNED(func, benchmark, core);                       \
+  }                                                                            \
+  _REGISTER_BENCHMARK_FAMILY(id, name, setup, teardown)
+
+/**
+ * @brief Registers a cycle timed benchmark family.
+ *
+ * @see REGISTER_BENCHMARK_FAMILY_TIME_PINNED
+ */
+#define REGISTER_BENCHMARK_FAMILY_CYCLES(id, name, setup, teardown, func)      \
+  static void _bench_family_body_##id(benchmark_t *benchmark, void *ctx,       \
+                                      const bench_args_t *args) {              \
+    (void)ctx;                                                                 \
+    (void)args;                                                                \
+    BENCHMARK_FUNC_CYCLES(func, benchmark);                                    \
+  }                                                                            \
+  _REGISTER_BENCHMARK_FAMILY(id, name, setup, teardown)
+
+#endif // PARAMS_H
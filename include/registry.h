@@ -0,0 +1,1058 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "./bench.h"
+#include "./cli.h"
+#include "./data_processing.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Function running the timed body of a registered benchmark.
+ *
+ * Generated by the REGISTER_BENCHMARK_* macros, it runs one of the
+ * BENCHMARK_FUNC* macros on the given benchmark.
+ */
+typedef void (*bench_body_fn)(benchmark_t *benchmark);
+
+/**
+ * @brief Structure describing a benchmark registered at runtime.
+ *
+ * name:                Human-readable name of the benchmark
+ * body:                Function running the benchmark
+ * warmup_iterations:   Number of warmup iterations to run
+ * timed_iterations:    Number of timed iterations to measure
+ * output_buffer:       Buffer written by the benchmark, may be NULL
+ * size:                Size of the output buffer in bytes
+ * is_baseline:         Flag indicating if this is a baseline benchmark
+ * validate:            Flag indicating if the result should be validated
+ */
+typedef struct {
+  const char *name;
+  bench_body_fn body;
+  size_t warmup_iterations;
+  size_t timed_iterations;
+  void *output_buffer;
+  size_t size;
+  bool is_baseline;
+  bool validate;
+} bench_registration_t;
+
+/**
+ * @brief Comparison group with its own baseline and ground truth.
+ *
+ * name:                Name of the group
+ * gt:                  Ground truth of the last baseline of the group that ran
+ */
+typedef struct {
+  const char *name;
+  void *gt;
+} bench_group_t;
+
+/**
+ * @brief Runtime registry of benchmarks and their results.
+ *
+ * entries:             Registered benchmarks in registration order
+ * results:             Benchmarks that were run, in execution order
+ * groups:              Comparison groups that had a benchmark run
+ * gt:                  Ground truth of the last baseline that ran outside of a
+ *                      group, shared by X-macro, registered and C++ benchmarks
+ */
+typedef struct {
+  bench_registration_t *entries;
+  size_t entry_count, entry_capacity;
+  benchmark_t **results;
+  size_t result_count, result_capacity;
+  bench_group_t *groups;
+  size_t group_count, group_capacity;
+  void *gt;
+} bench_registry_t;
+
+PIBENCH_STATE bench_registry_t bench_registry PIBENCH_INIT(PIBENCH_ZERO);
+
+/**
+ * @brief Grows a registry array to hold at least one more element.
+ *
+ * @return true on success, false if the allocation failed
+ */
+static inline bool bench_registry_grow(void **array, size_t *capacity,
+                                       size_t count, size_t element_size) {
+  if (count < *capacity)
+    return true;
+
+  size_t new_capacity = *capacity == 0 ? 16 : *capacity * 2;
+  void *grown = realloc(*array, new_capacity * element_size);
+  if (grown == NULL) {
+    fprintf(stderr, "Error: Could not grow benchmark registry\n");
+    return false;
+  }
+
+  *array = grown;
+  *capacity = new_capacity;
+  return true;
+}
+
+/**
+ * @brief Per-benchmark settings that can be attached by name.
+ *
+ * Lets both X-macro and registered benchmarks be configured without changing
+ * their definition.
+ *
+ * name:                Name of the benchmark (or benchmark family)
+ * fixture:             Hooks run outside of the timed region
+ * has_fixture:         Flag indicating if the fixture was set
+ * validator:           Comparison used to validate the output
+ * has_validator:       Flag indicating if the validator was set
+ * group:               Comparison group, NULL for the default group
+ * work:                Work done by one call
+ * has_work:            Flag indicating if the work was set
+ */
+typedef struct {
+  const char *name;
+  bench_fixture_t fixture;
+  bool has_fixture;
+  bench_validator_t validator;
+  bool has_validator;
+  const char *group;
+  bench_work_t work;
+  bool has_work;
+} bench_attributes_t;
+
+/**
+ * @brief Table of the per-benchmark settings.
+ */
+typedef struct {
+  bench_attributes_t *entries;
+  size_t count, capacity;
+} bench_attribute_table_t;
+
+PIBENCH_STATE bench_attribute_table_t
+    bench_attribute_table PIBENCH_INIT(PIBENCH_ZERO);
+
+/**
+ * @brief Looks up the settings of a benchmark.
+ *
+ * @param name Name of the benchmark
+ * @param create Create an empty entry if none exists
+ * @return The settings, or NULL if none exist and create is false
+ */
+static inline bench_attributes_t *bench_attributes(const char *name,
+                                                   bool create) {
+  for (size_t i = 0; i < bench_attribute_table.count; i++) {
+    if (strcmp(bench_attribute_table.entries[i].name, name) == 0)
+      return &bench_attribute_table.entries[i];
+  }
+
+  if (!create ||
+      !bench_registry_grow((void **)&bench_attribute_table.entries,
+                           &bench_attribute_table.capacity,
+                           bench_attribute_table.count,
+                           sizeof(bench_attributes_t)))
+    return NULL;
+
+  bench_attributes_t *attributes =
+      &bench_attribute_table.entries[bench_attribute_table.count++];
+  memset(attributes, 0, sizeof(bench_attributes_t));
+  attributes->name = name;
+  return attributes;
+}
+
+/**
+ * @brief Attaches setup and teardown hooks to a benchmark.
+ *
+ * Must be called before the benchmark runs. For benchmark families the name
+ * of the family applies to all its instances.
+ *
+ * @param name Name of the benchmark or benchmark family
+ * @param fixture Hooks to run outside of the timed region
+ */
+static inline void bench_set_fixture(const char *name,
+                                     bench_fixture_t fixture) {
+  bench_attributes_t *attributes = bench_attributes(name, true);
+  if (attributes == NULL)
+    return;
+
+  attributes->fixture = fixture;
+  attributes->has_fixture = true;
+}
+
+/**
+ * @brief Sets how the output of a benchmark is compared to the ground truth.
+ *
+ * By default the output has to match the ground truth byte by byte.
+ *
+ * @param name Name of the benchmark or benchmark family
+ * @param validator Typed comparison, e.g. bench_validator_f32_ulp(4)
+ */
+static inline void bench_set_validator(const char *name,
+                                       bench_validator_t validator) {
+  bench_attributes_t *attributes = bench_attributes(name, true);
+  if (attributes == NULL)
+    return;
+
+  attributes->validator = validator;
+  attributes->has_validator = true;
+}
+
+/**
+ * @brief Puts a benchmark into a comparison group.
+ *
+ * Every group has its own baseline and ground truth: benchmarks of a group are
+ * validated against the last baseline of the same group that ran, and results
+ * are compared within their group. Benchmarks without a group form the
+ * default group.
+ *
+ * @param name Name of the benchmark
+ * @param group Name of the group, has to outlive the benchmark
+ */
+static inline void bench_set_group(const char *name, const char *group) {
+  bench_attributes_t *attributes = bench_attributes(name, true);
+  if (attributes == NULL)
+    return;
+
+  attributes->group = group;
+}
+
+/**
+ * @brief Declares the work done by one call of a benchmark.
+ *
+ * Lets the report place the benchmark on a roofline, see
+ * PRINT_RESULTS_ROOFLINE(). For benchmark families, the per_arg terms of the
+ * work scale with the first parameter of every instance:
+ *
+ *   bench_set_work("daxpy", (bench_work_t){.flops_per_arg = 2,
+ *                                          .bytes_per_arg = 24});
+ *
+ * @param name Name of the benchmark or benchmark family
+ * @param work Floating point operations and bytes moved per call
+ */
+static inline void bench_set_work(const char *name, bench_work_t work) {
+  bench_attributes_t *attributes = bench_attributes(name, true);
+  if (attributes == NULL)
+    return;
+
+  attributes->work = work;
+  attributes->has_work = true;
+}
+
+/**
+ * @brief Applies the settings attached to a name to a benchmark.
+ *
+ * @param benchmark The benchmark to configure
+ * @param name Name the settings were attached to
+ * @return true if settings were found
+ */
+static inline bool bench_apply_attributes(benchmark_t *benchmark,
+                                          const char *name) {
+  bench_attributes_t *attributes = bench_attributes(name, false);
+  if (attributes == NULL)
+    return false;
+
+  if (attributes->has_fixture)
+    benchmark->fixture = attributes->fixture;
+  if (attributes->has_validator)
+    benchmark->validator = attributes->validator;
+  if (attributes->group != NULL)
+    benchmark->group = attributes->group;
+  if (attributes->has_work)
+    benchmark->work = attributes->work;
+
+  return true;
+}
+
+/**
+ * @brief Applies the settings attached to a parent, e.g. a benchmark family,
+ * that were not attached to the benchmark itself.
+ *
+ * @param benchmark The benchmark to configure
+ * @param name Name of the benchmark, its settings take precedence
+ * @param parent Name the inherited settings were attached to
+ * @return true if settings of the parent were found
+ */
+static inline bool bench_inherit_attributes(benchmark_t *benchmark,
+                                            const char *name,
+                                            const char *parent) {
+  const bench_attributes_t *own = bench_attributes(name, false);
+  const bench_attributes_t *inherited = bench_attributes(parent, false);
+  if (inherited == NULL)
+    return false;
+
+  if (inherited->has_fixture && (own == NULL || !own->has_fixture))
+    benchmark->fixture = inherited->fixture;
+  if (inherited->has_validator && (own == NULL || !own->has_validator))
+    benchmark->validator = inherited->validator;
+  if (inherited->group != NULL && (own == NULL || own->group == NULL))
+    benchmark->group = inherited->group;
+  if (inherited->has_work && (own == NULL || !own->has_work))
+    benchmark->work = inherited->work;
+
+  return true;
+}
+
+/**
+ * @brief Appends a suffix to the name of a benchmark, e.g. "memcpy@remote".
+ *
+ * @param names Decorated names to add the new name to, freed by the caller
+ * @param count Number of names
+ * @param capacity Capacity of names
+ * @param name Name to decorate
+ * @param suffix Suffix including its separator
+ * @return The decorated name, or name on allocation failure
+ */
+static inline const char *bench_decorate_name(char ***names, size_t *count,
+                                              size_t *capacity,
+                                              const char *name,
+                                              const char *suffix) {
+  size_t len = strlen(name) + strlen(suffix) + 1;
+  char *decorated = (char *)malloc(len);
+  if (decorated == NULL ||
+      !bench_registry_grow((void **)names, capacity, *count, sizeof(char *))) {
+    free(decorated);
+    return name;
+  }
+
+  snprintf(decorated, len, "%s%s", name, suffix);
+  (*names)[(*count)++] = decorated;
+  return decorated;
+}
+
+/**
+ * @brief Number of passes of a --numa=sweep run, one per placement from
+ * BENCH_NUMA_LOCAL to BENCH_NUMA_INTERLEAVE.
+ */
+#define BENCH_NUMA_SWEEP_PASSES 3
+
+/**
+ * @brief Progress of a --numa=sweep run.
+ *
+ * Every pass runs the selected benchmarks with one placement, their results
+ * are named "<name>@<placement>".
+ *
+ * pass:                Index of the current pass
+ * names:               Decorated names of the benchmarks set up so far
+ */
+typedef struct {
+  size_t pass;
+  char **names;
+  size_t name_count, name_capacity;
+} bench_numa_sweep_t;
+
+PIBENCH_STATE bench_numa_sweep_t bench_numa_sweep PIBENCH_INIT(PIBENCH_ZERO);
+
+/**
+ * @brief Returns the placement of the benchmarks set up now.
+ */
+static inline bench_numa_mode_t bench_numa_current(void) {
+  if (bench_options.numa != BENCH_NUMA_SWEEP)
+    return bench_options.numa;
+  return (bench_numa_mode_t)(BENCH_NUMA_LOCAL + bench_numa_sweep.pass);
+}
+
+/**
+ * @brief Decorates the name of a benchmark with the placement of the current
+ * pass, e.g. "memcpy@remote".
+ *
+ * @return The decorated name, owned by the sweep, or name on allocation
+ * failure
+ */
+static inline const char *bench_numa_sweep_name(const char *name) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), "@%s",
+           bench_numa_mode_name(bench_numa_current()));
+  return bench_decorate_name(&bench_numa_sweep.names,
+                             &bench_numa_sweep.name_count,
+                             &bench_numa_sweep.name_capacity, name, suffix);
+}
+
+/**
+ * @brief Starts the first pass of a --numa=sweep run.
+ */
+static inline void bench_numa_sweep_begin(void) {
+  bench_numa_sweep.pass = 0;
+  if (bench_options.numa == BENCH_NUMA_SWEEP && !bench_options.list)
+    printf("\n=== NUMA placement: %s ===\n",
+           bench_numa_mode_name(bench_numa_current()));
+}
+
+/**
+ * @brief Advances to the next pass of a --numa=sweep run.
+ *
+ * @return true if the benchmarks have to be run again
+ */
+static inline bool bench_numa_sweep_next(void) {
+  if (bench_options.numa != BENCH_NUMA_SWEEP || bench_options.list ||
+      bench_numa_sweep.pass + 1 >= BENCH_NUMA_SWEEP_PASSES)
+    return false;
+
+  bench_numa_sweep.pass++;
+  printf("\n=== NUMA placement: %s ===\n",
+         bench_numa_mode_name(bench_numa_current()));
+  return true;
+}
+
+/**
+ * @brief Progress of a run with --repetitions.
+ *
+ * Every repetition runs the selected benchmarks again, from scratch. With more
+ * than one repetition the results are named "<name>#<n>", counting from 1.
+ *
+ * index:               Index of the current repetition
+ * names:               Decorated names of the benchmarks set up so far
+ */
+typedef struct {
+  size_t index;
+  char **names;
+  size_t name_count, name_capacity;
+} bench_repetitions_t;
+
+PIBENCH_STATE bench_repetitions_t bench_repetitions PIBENCH_INIT(PIBENCH_ZERO);
+
+/**
+ * @brief Returns the number of independent runs of every benchmark.
+ */
+static inline size_t bench_repetition_count(void) {
+  return bench_options.repetitions > 1 ? bench_options.repetitions : 1;
+}
+
+/**
+ * @brief Decorates the name of a benchmark with the current repetition, e.g.
+ * "memcpy#2".
+ *
+ * @return The decorated name, owned by the repetitions, or name on allocation
+ * failure
+ */
+static inline const char *bench_repetition_name(const char *name) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), "#%zu", bench_repetitions.index + 1);
+  return bench_decorate_name(&bench_repetitions.names,
+                             &bench_repetitions.name_count,
+                             &bench_repetitions.name_capacity, name, suffix);
+}
+
+/**
+ * @brief Starts the first repetition of the benchmarks.
+ */
+static inline void bench_repetition_begin(void) {
+  bench_repetitions.index = 0;
+  if (bench_repetition_count() > 1 && !bench_options.list)
+    printf("\n=== Repetition 1 of %zu ===\n", bench_repetition_count());
+}
+
+/**
+ * @brief Advances to the next repetition of the benchmarks.
+ *
+ * @return true if the benchmarks have to be run again
+ */
+static inline bool bench_repetition_next(void) {
+  if (bench_options.list ||
+      bench_repetitions.index + 1 >= bench_repetition_count())
+    return false;
+
+  bench_repetitions.index++;
+  printf("\n=== Repetition %zu of %zu ===\n", bench_repetitions.index + 1,
+         bench_repetition_count());
+  return true;
+}
+
+static inline benchmark_t *setup_benchmark(const char *name,
+                                           size_t warmup_iterations,
+                                           size_t timed_iterations,
+                                           bool is_baseline, bool validate,
+                                           void *output_buffer, size_t size) {
+  if (bench_options.samples > 0) {
+    timed_iterations = bench_options.samples;
+  }
+
+  benchmark_t *benchmark = (benchmark_t *)malloc(sizeof(benchmark_t));
+  benchmark->name = name;
+  benchmark->warmup_iterations = warmup_iterations;
+  benchmark->timed_iterations = timed_iterations;
+  benchmark->is_baseline = is_baseline;
+  benchmark->validate = validate;
+  benchmark->is_valid = false;
+  benchmark->family = NULL;
+  benchmark->group = NULL;
+  benchmark->args.count = 0;
+  memset(&benchmark->fixture, 0, sizeof(bench_fixture_t));
+  memset(&benchmark->validator, 0, sizeof(bench_validator_t));
+  memset(&benchmark->validation, 0, sizeof(bench_validation_t));
+  benchmark->block_size = 0;
+  benchmark->sample_count = 0;
+  memset(&benchmark->work, 0, sizeof(bench_work_t));
+  benchmark->numa = bench_numa_current();
+  benchmark->numa_base = name;
+  if (bench_options.numa == BENCH_NUMA_SWEEP)
+    benchmark->name = bench_numa_sweep_name(name);
+  benchmark->repetition = bench_repetitions.index;
+  benchmark->repetition_base = benchmark->name;
+  if (bench_repetition_count() > 1)
+    benchmark->name = bench_repetition_name(benchmark->name);
+
+  benchmark_result_t *results =
+      (benchmark_result_t *)calloc(1, sizeof(benchmark_result_t));
+  results->samples = (uint64_t *)calloc(timed_iterations, sizeof(uint64_t));
+  results->cache_miss_rates =
+      (double *)calloc(timed_iterations, sizeof(double));
+
+  if (is_baseline && bench_options.ground_truth == BENCH_GT_HASH) {
+    results->gt = bench_digest_create(size, bench_options.gt_chunk_size);
+  } else if (is_baseline) {
+    results->gt = calloc(size, 1);
+  } else {
+    results->gt = NULL;
+  }
+
+  if (output_buffer != NULL) {
+    results->output_buffer = output_buffer;
+  } else if (size > 0) {
+    results->output_buffer = bench_alloc(size, bench_options.pages);
+    results->owns_output_buffer = true;
+  } else {
+    results->output_buffer = NULL;
+  }
+
+  results->size = size;
+  results->page_size =
+      results->output_buffer != NULL ? bench_page_size(results->output_buffer)
+                                     : 0;
+  benchmark->results = results;
+
+  bench_apply_attributes(benchmark, name);
+
+  return benchmark;
+}
+
+static inline void cleanup_benchmark(benchmark_t *benchmark,
+                                     bool free_output_buffer) {
+  bool gt_freed = false;
+
+  if (free_output_buffer || benchmark->results->owns_output_buffer) {
+    bench_free(benchmark->results->output_buffer);
+  }
+
+  if (benchmark->is_baseline && !gt_freed) {
+    if (bench_options.ground_truth == BENCH_GT_HASH) {
+      bench_digest_free((bench_digest_t *)benchmark->results->gt);
+    } else {
+      free(benchmark->results->gt);
+    }
+  }
+
+  free(benchmark->results->samples);
+  free(benchmark->results->cache_miss_rates);
+  free(benchmark->results->irq_counts);
+  free(benchmark->results);
+  free(benchmark);
+}
+
+/**
+ * @brief Shares the ground truth between the benchmarks of a group.
+ *
+ * A baseline publishes its ground truth to its group, every other benchmark
+ * picks up the ground truth of its group.
+ *
+ * Benchmarks without a group share the ground truth of the default group,
+ * whether they are X-macro, registered or C++ benchmarks.
+ *
+ * @param benchmark The benchmark about to run
+ */
+static inline void bench_bind_ground_truth(benchmark_t *benchmark) {
+  void **gt = &bench_registry.gt;
+  if (benchmark->group != NULL) {
+    gt = NULL;
+    for (size_t i = 0; i < bench_registry.group_count; i++) {
+      if (strcmp(bench_registry.groups[i].name, benchmark->group) == 0) {
+        gt = &bench_registry.groups[i].gt;
+        break;
+      }
+    }
+
+    if (gt == NULL) {
+      if (!bench_registry_grow((void **)&bench_registry.groups,
+                               &bench_registry.group_capacity,
+                               bench_registry.group_count,
+                               sizeof(bench_group_t)))
+        return;
+
+      bench_group_t *group =
+          &bench_registry.groups[bench_registry.group_count++];
+      group->name = benchmark->group;
+      group->gt = NULL;
+      gt = &group->gt;
+    }
+  }
+
+  if (benchmark->is_baseline) {
+    *gt = benchmark->results->gt;
+  } else {
+    benchmark->results->gt = *gt;
+  }
+}
+
+/**
+ * @brief Registers a benchmark with the runtime registry.
+ *
+ * Usually called from a constructor generated by the REGISTER_BENCHMARK_*
+ * macros, before main() runs.
+ *
+ * @param registration Description of the benchmark
+ */
+static inline void bench_register(bench_registration_t registration) {
+  if (!bench_registry_grow((void **)&bench_registry.entries,
+                           &bench_registry.entry_capacity,
+                           bench_registry.entry_count,
+                           sizeof(bench_registration_t)))
+    return;
+
+  bench_registry.entries[bench_registry.entry_count++] = registration;
+}
+
+/**
+ * @brief Records a benchmark that was run, so it can be reported and exported.
+ *
+ * Warns if the samples look like the body was optimized away.
+ *
+ * @param benchmark The benchmark that finished running
+ */
+static inline void bench_registry_add_result(benchmark_t *benchmark) {
+  if (!bench_registry_grow((void **)&bench_registry.results,
+                           &bench_registry.result_capacity,
+                           bench_registry.result_count, sizeof(benchmark_t *)))
+    return;
+
+  bench_registry.results[bench_registry.result_count++] = benchmark;
+
+  if (bench_samples_elided(benchmark->results->samples,
+                           benchmark->timed_iterations))
+    printf("\033[33mBenchmark %s measured no time in most samples! The body "
+           "may have been optimized away (wrap its result in "
+           "BENCH_DO_NOT_OPTIMIZE()) or be shorter than the timer "
+           "resolution\033[0m\n",
+           benchmark->name);
+
+  if (bench_options.format == BENCH_FORMAT_NDJSON)
+    bench_ndjson_record(benchmark);
+}
+
+/**
+ * @brief Benchmark waiting to run its blocks in an interleaved run.
+ *
+ * benchmark:           The benchmark
+ * registration:        Registration of a registered benchmark, NULL for an
+ *                      X-macro benchmark
+ */
+typedef struct {
+  benchmark_t *benchmark;
+  const bench_registration_t *registration;
+} bench_scheduled_t;
+
+/**
+ * @brief Execution order of the benchmarks.
+ *
+ * Without --interleave every benchmark runs all its samples as soon as it is
+ * reached. With --interleave the benchmarks are first collected, then run in
+ * rounds: every round runs one block of samples of every unfinished benchmark
+ * in a new random order, so drift affects all of them alike.
+ *
+ * entries:             Collected benchmarks, X-macro benchmarks first
+ * order:               Indices of the entries in the order of the round
+ * order_count:         Number of entries in the round
+ * slot:                Position in the order of the round
+ * visit:               Number of X-macro benchmarks reached in this pass
+ * round:               Number of the round
+ * collecting:          Flag indicating if benchmarks are still collected
+ * rng:                 State of the random number generator
+ */
+typedef struct {
+  bench_scheduled_t *entries;
+  size_t count, capacity;
+  size_t *order;
+  size_t order_count;
+  size_t slot;
+  size_t visit;
+  size_t round;
+  bool collecting;
+  uint64_t rng;
+} bench_schedule_t;
+
+PIBENCH_STATE bench_schedule_t bench_schedule_state PIBENCH_INIT(PIBENCH_ZERO);
+
+/**
+ * @brief Starts collecting the benchmarks to run.
+ */
+static inline void bench_schedule_begin(void) {
+  free(bench_schedule_state.entries);
+  free(bench_schedule_state.order);
+  memset(&bench_schedule_state, 0, sizeof(bench_schedule_state));
+  bench_schedule_state.collecting = true;
+}
+
+/**
+ * @brief Adds a benchmark to the interleaved run.
+ */
+static inline void
+bench_schedule_add(benchmark_t *benchmark,
+                   const bench_registration_t *registration) {
+  if (!bench_registry_grow((void **)&bench_schedule_state.entries,
+                           &bench_schedule_state.capacity,
+                           bench_schedule_state.count,
+                           sizeof(bench_scheduled_t))) {
+    cleanup_benchmark(benchmark, false);
+    return;
+  }
+
+  benchmark->block_size = bench_options.interleave;
+  bench_schedule_state.entries[bench_schedule_state.count++] =
+      (bench_scheduled_t){benchmark, registration};
+}
+
+/**
+ * @brief Returns the benchmark that runs next, if it is the given one.
+ *
+ * Called by every X-macro benchmark matching the filter. Without --interleave
+ * the benchmark is set up and returned right away. With --interleave it is set
+ * up and collected on the first pass over the benchmarks, and on later passes
+ * returned only when its block is due.
+ *
+ * @return The benchmark to run one block of, or NULL if it is not due
+ */
+static inline benchmark_t *bench_schedule(const char *name,
+                                          size_t warmup_iterations,
+                                          size_t timed_iterations,
+                                          bool is_baseline, bool validate,
+                                          void *output_buffer, size_t size) {
+  if (bench_options.interleave == 0) {
+    printf("\n=== %s Benchmark ===\n", name);
+
+    benchmark_t *benchmark =
+        setup_benchmark(name, warmup_iterations, timed_iterations, is_baseline,
+                        validate, output_buffer, size);
+    bench_bind_ground_truth(benchmark);
+    return benchmark;
+  }
+
+  if (bench_schedule_state.collecting) {
+    bench_schedule_add(setup_benchmark(name, warmup_iterations,
+                                       timed_iterations, is_baseline, validate,
+                                       output_buffer, size),
+                       NULL);
+    return NULL;
+  }
+
+  size_t index = bench_schedule_state.visit++;
+  if (bench_schedule_state.slot >= bench_schedule_state.order_count ||
+      bench_schedule_state.order[bench_schedule_state.slot] != index)
+    return NULL;
+
+  bench_scheduled_t *entry = &bench_schedule_state.entries[index];
+  if (bench_first_block(entry->benchmark))
+    bench_bind_ground_truth(entry->benchmark);
+  return entry->benchmark;
+}
+
+/**
+ * @brief Records a benchmark once all its samples were measured.
+ *
+ * @param benchmark The benchmark that finished a block
+ */
+static inline void bench_schedule_done(benchmark_t *benchmark) {
+  if (benchmark->sample_count >= benchmark->timed_iterations)
+    bench_registry_add_result(benchmark);
+}
+
+/**
+ * @brief Draws a random number below n (xorshift64*).
+ */
+static inline size_t bench_schedule_random(size_t n) {
+  uint64_t x = bench_schedule_state.rng;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  bench_schedule_state.rng = x;
+  return (size_t)((x * 0x2545F4914F6CDD1DULL) % n);
+}
+
+/**
+ * @brief Orders the unfinished benchmarks for the next round.
+ *
+ * Baselines run first in the first round, so the ground truth exists before
+ * the other benchmarks are validated.
+ *
+ * @return false if all benchmarks are finished
+ */
+static inline bool bench_schedule_round(void) {
+  size_t n = 0, first = 0;
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t i = 0; i < bench_schedule_state.count; i++) {
+      benchmark_t *benchmark = bench_schedule_state.entries[i].benchmark;
+      bool early = bench_schedule_state.round == 0 && benchmark->is_baseline;
+      if (early != (pass == 0) ||
+          benchmark->sample_count >= benchmark->timed_iterations)
+        continue;
+      bench_schedule_state.order[n++] = i;
+    }
+    if (pass == 0)
+      first = n;
+  }
+
+  /* Fisher-Yates shuffle, separately for the baselines of the first round */
+  for (size_t i = n; i-- > 1;) {
+    size_t lo = i < first ? 0 : first;
+    if (i == lo)
+      continue;
+    size_t j = lo + bench_schedule_random(i - lo + 1);
+    size_t tmp = bench_schedule_state.order[i];
+    bench_schedule_state.order[i] = bench_schedule_state.order[j];
+    bench_schedule_state.order[j] = tmp;
+  }
+
+  bench_schedule_state.order_count = n;
+  bench_schedule_state.slot = 0;
+  bench_schedule_state.round++;
+
+  /* the blocks do not report the temperature themselves */
+  if (n > 0 && get_cpu_temperature() >= MAX_TEMP)
+    throttle_warning(MAX_TEMP);
+  return n > 0;
+}
+
+static inline void bench_run_registered(void);
+
+/**
+ * @brief Advances to the next block of an interleaved run.
+ *
+ * Ends the pass that collected the X-macro benchmarks by collecting the
+ * registered benchmarks. Blocks of registered benchmarks are run directly,
+ * for blocks of X-macro benchmarks the caller expands the benchmarks again.
+ *
+ * @return true if the X-macro benchmarks have to be expanded again
+ */
+static inline bool bench_schedule_next(void) {
+  bench_schedule_t *state = &bench_schedule_state;
+
+  if (state->collecting) {
+    /* registered benchmarks are run or collected after the X-macro ones */
+    bench_run_registered();
+    state->collecting = false;
+
+    if (bench_options.interleave == 0 || bench_options.list ||
+        state->count == 0)
+      return false;
+
+    state->order = (size_t *)malloc(state->count * sizeof(size_t));
+    if (state->order == NULL) {
+      fprintf(stderr, "Error: Could not allocate the interleaving order\n");
+      return false;
+    }
+
+    state->rng = bench_options.seed != 0 ? bench_options.seed
+                                         : get_time_ns() ^ (uint64_t)getpid();
+    printf("\n=== Interleaving %zu benchmarks in blocks of %zu samples "
+           "(seed %llu) ===\n",
+           state->count, bench_options.interleave,
+           (unsigned long long)state->rng);
+    if (!bench_schedule_round())
+      return false;
+  } else {
+    state->slot++;
+  }
+
+  for (;;) {
+    if (state->slot >= state->order_count && !bench_schedule_round()) {
+      printf("\n=== Interleaved %zu benchmarks in %zu rounds ===\n",
+             state->count, state->round - 1);
+      return false;
+    }
+
+    bench_scheduled_t *entry = &state->entries[state->order[state->slot]];
+    const bench_registration_t *registration = entry->registration;
+    if (registration == NULL) {
+      state->visit = 0;
+      return true;
+    }
+
+    if (bench_first_block(entry->benchmark))
+      bench_bind_ground_truth(entry->benchmark);
+    registration->body(entry->benchmark);
+    if (registration->output_buffer != NULL)
+      memset(registration->output_buffer, 0, registration->size);
+    bench_schedule_done(entry->benchmark);
+    state->slot++;
+  }
+}
+
+/**
+ * @brief Runs a single registered benchmark and records its result.
+ *
+ * With --interleave the benchmark is only collected, its blocks are run by
+ * bench_schedule_next().
+ *
+ * @param entry The registered benchmark
+ */
+static inline void bench_run_registration(const bench_registration_t *entry) {
+  if (bench_options.interleave > 0) {
+    bench_schedule_add(setup_benchmark(entry->name, entry->warmup_iterations,
+                                       entry->timed_iterations,
+                                       entry->is_baseline, entry->validate,
+                                       entry->output_buffer, entry->size),
+                       entry);
+    return;
+  }
+
+  printf("\n=== %s Benchmark ===\n", entry->name);
+
+  benchmark_t *benchmark = setup_benchmark(
+      entry->name, entry->warmup_iterations, entry->timed_iterations,
+      entry->is_baseline, entry->validate, entry->output_buffer, entry->size);
+
+  bench_bind_ground_truth(benchmark);
+
+  entry->body(benchmark);
+
+  if (entry->output_buffer != NULL) {
+    memset(entry->output_buffer, 0, entry->size);
+  }
+
+  bench_registry_add_result(benchmark);
+}
+
+/**
+ * @brief Lists or runs all registered benchmarks selected by the filter.
+ *
+ * Baselines run first so the ground truth is available for validation,
+ * otherwise benchmarks run in registration order.
+ */
+static inline void bench_run_registered(void) {
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t i = 0; i < bench_registry.entry_count; i++) {
+      const bench_registration_t *entry = &bench_registry.entries[i];
+
+      if (entry->is_baseline != (pass == 0) || !bench_filter_match(entry->name))
+        continue;
+
+      if (bench_options.list) {
+        printf("%s\n", entry->name);
+      } else {
+        bench_run_registration(entry);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Frees all recorded results and the registry itself.
+ */
+static inline void bench_registry_cleanup(void) {
+  /* benchmarks of an interrupted interleaved run were never recorded */
+  for (size_t i = 0; i < bench_schedule_state.count; i++) {
+    benchmark_t *benchmark = bench_schedule_state.entries[i].benchmark;
+    if (benchmark->sample_count < benchmark->timed_iterations)
+      cleanup_benchmark(benchmark, false);
+  }
+
+  for (size_t i = 0; i < bench_registry.result_count; i++) {
+    cleanup_benchmark(bench_registry.results[i], false);
+  }
+
+  free(bench_registry.results);
+  free(bench_registry.entries);
+  free(bench_registry.groups);
+  memset(&bench_registry, 0, sizeof(bench_registry));
+
+  free(bench_attribute_table.entries);
+  memset(&bench_attribute_table, 0, sizeof(bench_attribute_table));
+
+  free(bench_schedule_state.entries);
+  free(bench_schedule_state.order);
+  memset(&bench_schedule_state, 0, sizeof(bench_schedule_state));
+
+  for (size_t i = 0; i < bench_numa_sweep.name_count; i++) {
+    free(bench_numa_sweep.names[i]);
+  }
+  free(bench_numa_sweep.names);
+  memset(&bench_numa_sweep, 0, sizeof(bench_numa_sweep));
+
+  for (size_t i = 0; i < bench_repetitions.name_count; i++) {
+    free(bench_repetitions.names[i]);
+  }
+  free(bench_repetitions.names);
+  memset(&bench_repetitions, 0, sizeof(bench_repetitions));
+}
+
+/**
+ * @brief Defines a registration constructor for a benchmark body.
+ *
+ * Internal helper of the REGISTER_BENCHMARK_* macros.
+ */
+#define _REGISTER_BENCHMARK(id, bench_name, baseline, do_validate, buffer,     \
+                            buffer_size)                                       \
+  __attribute__((constructor)) static void _bench_register_##id(void) {        \
+    bench_register((bench_registration_t){                                     \
+        .name = bench_name,                                                    \
+        .body = _bench_body_##id,                                              \
+        .warmup_iterations = WARMUP_RUNS,                                      \
+        .timed_iterations = TIMED_RUNS,                                        \
+        .output_buffer = buffer,                                               \
+        .size = buffer_size,                                                   \
+        .is_baseline = baseline,                                               \
+        .validate = do_validate,                                               \
+    });                                                                        \
+  }
+
+/**
+ * @brief Registers a pinned, wall-clock timed benchmark at file scope.
+ *
+ * Works like BENCHMARK_TIME_PINNED, but the benchmark registers itself before
+ * main() runs and can be selected at runtime with --filter. The id has to be a
+ * unique identifier, the output buffer and everything used by func must be
+ * visible at file scope.
+ */
+#define REGISTER_BENCHMARK_TIME_PINNED(id, name, is_baseline, validate,        \
+                                       output_buffer, size, core, func)        \
+  static void _bench_body_##id(benchmark_t *benchmark) {                       \
+    BENCHMARK_FUNC_PINNED(func, benchmark, core);                              \
+  }                                                                            \
+  _REGISTER_BENCHMARK(id, name, is_baseline, validate, output_buffer, size)
+
+/**
+ * @brief Registers a wall-clock timed benchmark at file scope.
+ *
+ * @see REGISTER_BENCHMARK_TIME_PINNED
+ */
+#define REGISTER_BENCHMARK_TIME(id, name, is_baseline, validate,               \
+                                output_buffer, size, func)                     \
+  static void _bench_body_##id(benchmark_t *benchmark) {                       \
+    BENCHMARK_FUNC(func, benchmark);                                           \
+  }                                                                            \
+  _REGISTER_BENCHMARK(id, name, is_baseline, validate, output_buffer, size)
+
+/**
+ * @brief Registers a pinned, cycle timed benchmark at file scope.
+ *
+ * @see REGISTER_BENCHMARK_TIME_PINNED
+ */
+#define REGISTER_BENCHMARK_CYCLES_PINNED(id, name, is_baseline, validate,      \
+                                         output_buffer, size, core, func)      \
+  static void _bench_body_##id(benchmark_t *benchmark) {                       \
+    BENCHMARK_FUNC_CYCLES_PINNED(func, benchmark, core);                       \
+  }                                                                            \
+  _REGISTER_BENCHMARK(id, name, is_baseline, validate, output_buffer, size)
+
+/**
+ * @brief Registers a cycle timed benchmark at file scope.
+ *
+ * @see REGISTER_BENCHMARK_TIME_PINNED
+ */
+#define REGISTER_BENCHMARK_CYCLES(id, name, is_baseline, validate,             \
+                                  output_buffer, size, func)                   \
+  static void _bench_body_##id(benchmark_t *benchmark) {                       \
+    BENCHMARK_FUNC_CYCLES(func, benchmark);                                    \
+  }                                                                            \
+  _REGISTER_BENCHMARK(id, name, is_baseline, validate, output_buffer, size)
+
+#endif // REGISTRY_H
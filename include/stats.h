@@ -5,6 +5,7 @@
 #include <math.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 
 /**
  * @brief Calculate the arithmetic mean of an array.
@@ -50,6 +51,88 @@
     (void)0;                                                                   \
   })
 
+/**
+ * @brief qsort() comparator for uint64_t values.
+ */
+static inline int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief qsort() comparator for double values.
+ */
+static inline int compare_f64(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Sort an array of uint64_t or double values with qsort().
+ *
+ * Drop-in replacement for selection_sort with O(n log n) complexity, used for
+ * the samples of a benchmark.
+ *
+ * @param data Pointer to the array to be sorted
+ * @param size Number of elements in the array
+ */
+#ifdef __cplusplus
+static inline auto bench_comparator(const uint64_t *) { return compare_u64; }
+static inline auto bench_comparator(const double *) { return compare_f64; }
+
+#define quick_sort(data, size)                                                 \
+  qsort((data), (size), sizeof((data)[0]), bench_comparator(data))
+#else
+#define quick_sort(data, size)                                                 \
+  qsort((data), (size), sizeof((data)[0]),                                     \
+        _Generic((data)[0], uint64_t: compare_u64, double: compare_f64))
+#endif
+
+/**
+ * @brief Moves an entry of a heap down until both children are smaller,
+ * see sort_pairs().
+ */
+static inline void sort_pairs_sift(uint64_t *keys, uint64_t *values,
+                                   size_t root, size_t size) {
+  for (size_t child = 2 * root + 1; child < size; child = 2 * root + 1) {
+    if (child + 1 < size && keys[child + 1] > keys[child])
+      child++;
+    if (keys[root] >= keys[child])
+      return;
+
+    uint64_t key = keys[root], value = values[root];
+    keys[root] = keys[child];
+    values[root] = values[child];
+    keys[child] = key;
+    values[child] = value;
+    root = child;
+  }
+}
+
+/**
+ * @brief Sort an array of uint64_t keys and move the values along with them.
+ *
+ * Heap sort, so the pairs are sorted in O(n log n) without extra memory. Used
+ * to keep per-sample data next to the samples of a benchmark.
+ *
+ * @param keys Pointer to the array to be sorted
+ * @param values Array reordered like keys
+ * @param size Number of elements in both arrays
+ */
+static inline void sort_pairs(uint64_t *keys, uint64_t *values, size_t size) {
+  for (size_t i = size / 2; i-- > 0;)
+    sort_pairs_sift(keys, values, i, size);
+
+  for (size_t end = size; end-- > 1;) {
+    uint64_t key = keys[0], value = values[0];
+    keys[0] = keys[end];
+    values[0] = values[end];
+    keys[end] = key;
+    values[end] = value;
+    sort_pairs_sift(keys, values, 0, end);
+  }
+}
+
 /**
  * @brief Calculate the median value of an array.
  *
@@ -133,4 +216,163 @@
     _var_result;                                                               \
   })
 
+/**
+ * @brief Calculate a percentile of a sorted array.
+ *
+ * Generic macro that works with any arithmetic type.
+ * Interpolates linearly between the two closest ranks, so the 50th
+ * percentile equals the median.
+ *
+ * @param sorted Pointer to the array of data values, sorted ascending
+ * @param size Number of elements in the array
+ * @param p Percentile between 0 and 100
+ * @return The percentile (as double), or 0.0 if size is 0
+ */
+#define percentile(sorted, size, p)                                            \
+  ({                                                                           \
+    double _pct_result = 0.0;                                                  \
+    if ((size) > 0) {                                                          \
+      const double _pos = (p) / 100.0 * (double)((size) - 1);                  \
+      const size_t _lo = (size_t)_pos;                                         \
+      const size_t _hi = _lo + 1 < (size) ? _lo + 1 : _lo;                     \
+      const double _frac = _pos - (double)_lo;                                 \
+      _pct_result = (double)(sorted)[_lo] +                                    \
+                    ((double)(sorted)[_hi] - (double)(sorted)[_lo]) * _frac;   \
+    }                                                                          \
+    _pct_result;                                                               \
+  })
+
+/**
+ * @brief Calculate the ranks bounding a distribution-free confidence interval
+ * of the median.
+ *
+ * Uses the normal approximation of the binomial distribution of the number of
+ * samples below the median, so no assumption about the distribution of the
+ * samples themselves is made.
+ *
+ * @param size Number of samples
+ * @param z Quantile of the standard normal distribution, e.g. 1.96 for 95%
+ * @param lo Receives the index of the lower bound in the sorted samples
+ * @param hi Receives the index of the upper bound in the sorted samples
+ */
+static inline void median_ci_ranks(size_t size, double z, size_t *lo,
+                                   size_t *hi) {
+  *lo = 0;
+  *hi = size > 0 ? size - 1 : 0;
+  if (size == 0)
+    return;
+
+  double half = z * sqrt((double)size) / 2.0;
+  double lower = floor((double)size / 2.0 - half) - 1.0;
+  double upper = ceil((double)size / 2.0 + half);
+
+  if (lower > 0.0)
+    *lo = (size_t)lower;
+  if (upper < (double)(size - 1))
+    *hi = (size_t)upper;
+}
+
+/**
+ * @brief Continued fraction of the regularized incomplete beta function.
+ *
+ * Evaluated with the modified Lentz method.
+ */
+static inline double incomplete_beta_cf(double a, double b, double x) {
+  const double tiny = 1e-300;
+  double c = 1.0;
+  double d = 1.0 - (a + b) * x / (a + 1.0);
+  if (fabs(d) < tiny)
+    d = tiny;
+  d = 1.0 / d;
+  double h = d;
+
+  for (int m = 1; m <= 300; m++) {
+    double m2 = 2.0 * m;
+    double aa = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2));
+    d = 1.0 + aa * d;
+    c = 1.0 + aa / c;
+    if (fabs(d) < tiny)
+      d = tiny;
+    if (fabs(c) < tiny)
+      c = tiny;
+    d = 1.0 / d;
+    h *= d * c;
+
+    aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0));
+    d = 1.0 + aa * d;
+    c = 1.0 + aa / c;
+    if (fabs(d) < tiny)
+      d = tiny;
+    if (fabs(c) < tiny)
+      c = tiny;
+    d = 1.0 / d;
+    double delta = d * c;
+    h *= delta;
+    if (fabs(delta - 1.0) < 1e-12)
+      break;
+  }
+
+  return h;
+}
+
+/**
+ * @brief Calculate the regularized incomplete beta function I_x(a, b).
+ *
+ * @param a First shape parameter (> 0)
+ * @param b Second shape parameter (> 0)
+ * @param x Upper limit of the integral, between 0 and 1
+ * @return I_x(a, b)
+ */
+static inline double incomplete_beta(double a, double b, double x) {
+  if (x <= 0.0)
+    return 0.0;
+  if (x >= 1.0)
+    return 1.0;
+
+  double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) +
+                     b * log(1.0 - x));
+  if (x < (a + 1.0) / (a + b + 2.0))
+    return front * incomplete_beta_cf(a, b, x) / a;
+  return 1.0 - front * incomplete_beta_cf(b, a, 1.0 - x) / b;
+}
+
+/**
+ * @brief Calculate the two-sided p-value of a Student t statistic.
+ *
+ * @param t The t statistic
+ * @param df Degrees of freedom
+ * @return Probability of a statistic at least as extreme as t
+ */
+static inline double student_t_p_value(double t, double df) {
+  if (df <= 0.0)
+    return 1.0;
+  return incomplete_beta(df / 2.0, 0.5, df / (df + t * t));
+}
+
+/**
+ * @brief Welch's t-test for two samples with unequal variances.
+ *
+ * @param mean1 Mean of the first sample
+ * @param var1 Unbiased variance of the first sample
+ * @param n1 Size of the first sample
+ * @param mean2 Mean of the second sample
+ * @param var2 Unbiased variance of the second sample
+ * @param n2 Size of the second sample
+ * @return Two-sided p-value of the hypothesis that both means are equal
+ */
+static inline double welch_t_test(double mean1, double var1, double n1,
+                                  double mean2, double var2, double n2) {
+  if (n1 < 2.0 || n2 < 2.0)
+    return 1.0;
+
+  double se1 = var1 / n1, se2 = var2 / n2;
+  double se = se1 + se2;
+  if (se <= 0.0)
+    return mean1 == mean2 ? 1.0 : 0.0;
+
+  double t = (mean1 - mean2) / sqrt(se);
+  double df = se * se / (se1 * se1 / (n1 - 1.0) + se2 * se2 / (n2 - 1.0));
+  return student_t_p_value(t, df);
+}
+
 #endif // STATS_H
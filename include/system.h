@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 /**
  * @brief Reads the current value of the ARM64 virtual counter register.
@@ -18,7 +19,8 @@
  * @note Includes memory barriers (ISB) for accurate timing
  * @note Always inlined for minimal overhead
  */
-[[nodiscard]] static __attribute__((always_inline)) uint64_t get_cycles(void) {
+[[nodiscard]] static inline __attribute__((always_inline)) uint64_t
+get_cycles(void) {
   uint64_t val;
   __asm__("isb" ::: "memory");
   __asm__("mrs %0, cntvct_el0" : "=r"(val));
@@ -26,9 +28,23 @@
   return val;
 }
 
+/**
+ * @brief Reads the monotonic clock in nanoseconds.
+ *
+ * @return Current CLOCK_MONOTONIC time in nanoseconds
+ *
+ * @note Used for bookkeeping outside of the timed region
+ */
+[[nodiscard]] static inline uint64_t get_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
 static inline void system_wait() {
-  for (volatile unsigned int i = 0; i < 1 << 15; i++) {
+  for (volatile unsigned int i = 0; i < 1 << 15;) {
     __asm__("nop");
+    i = i + 1;
   }
 }
 
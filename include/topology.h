@@ -0,0 +1,648 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "./barrier.h"
+#include "./env.h"
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief Maximum number of caches recorded per CPU.
+ */
+#define BENCH_TOPOLOGY_MAX_CACHES 8
+
+/**
+ * @brief Level passed to bench_topology_cache() to select the last level
+ * cache.
+ */
+#define BENCH_CACHE_LLC 0
+
+/**
+ * @brief Cache sizes assumed when neither sysfs nor sysconf() know them,
+ * those of a Cortex-A72 (Raspberry Pi 4).
+ */
+#define BENCH_DEFAULT_L1D_SIZE (32 * 1024)
+#define BENCH_DEFAULT_L2_SIZE (1024 * 1024)
+#define BENCH_DEFAULT_LINE_SIZE 64
+
+/**
+ * @brief Kind of data a cache holds.
+ */
+typedef enum {
+  BENCH_CACHE_DATA,
+  BENCH_CACHE_INSTRUCTION,
+  BENCH_CACHE_UNIFIED,
+} bench_cache_type_t;
+
+/**
+ * @brief Structure describing one cache of a CPU.
+ *
+ * level:               Cache level, 1 for L1
+ * type:                Data, instruction or unified
+ * size:                Size in bytes
+ * line_size:           Coherency line size in bytes
+ * ways:                Associativity, 0 if unknown
+ * shared_cpus:         CPUs sharing this cache
+ */
+typedef struct {
+  int level;
+  bench_cache_type_t type;
+  size_t size;
+  size_t line_size;
+  int ways;
+  cpu_set_t shared_cpus;
+} bench_cache_t;
+
+/**
+ * @brief Structure describing the position of one CPU in the topology.
+ *
+ * online:              Flag indicating if the CPU is online
+ * package:             Physical package (socket) id
+ * core:                Core id within the package
+ * cluster:             Cluster id, the package id if the kernel has none
+ * node:                NUMA node of the CPU
+ * capacity:            Relative performance, 1024 for the fastest CPUs
+ * max_freq_khz:        Maximum frequency in kHz, 0 if unknown
+ * siblings:            SMT siblings, including the CPU itself
+ * cluster_cpus:        CPUs of the same cluster
+ * caches:              Caches of the CPU, ordered as reported by sysfs
+ * cache_count:         Number of caches
+ */
+typedef struct {
+  bool online;
+  int package;
+  int core;
+  int cluster;
+  int node;
+  int capacity;
+  uint64_t max_freq_khz;
+  cpu_set_t siblings;
+  cpu_set_t cluster_cpus;
+  bench_cache_t caches[BENCH_TOPOLOGY_MAX_CACHES];
+  size_t cache_count;
+} bench_cpu_t;
+
+/**
+ * @brief Structure describing one NUMA node.
+ *
+ * id:                  Node id
+ * cpus:                CPUs of the node
+ * mem_total_kb:        Memory of the node in kB, 0 if unknown
+ */
+typedef struct {
+  int id;
+  cpu_set_t cpus;
+  uint64_t mem_total_kb;
+} bench_numa_node_t;
+
+/**
+ * @brief Structure describing the CPUs, caches and NUMA nodes of the machine.
+ *
+ * cpus:                Every possible CPU, indexed by CPU number
+ * cpu_count:           Number of entries of cpus
+ * online:              Online CPUs
+ * online_count:        Number of online CPUs
+ * nodes:               NUMA nodes, a single node 0 on UMA machines
+ * node_count:          Number of NUMA nodes
+ * heterogeneous:       Flag indicating if the CPUs differ in capacity
+ *                      (big.LITTLE)
+ */
+typedef struct {
+  bench_cpu_t *cpus;
+  int cpu_count;
+  cpu_set_t online;
+  int online_count;
+  bench_numa_node_t *nodes;
+  size_t node_count;
+  bool heterogeneous;
+} bench_topology_t;
+
+/**
+ * @brief Parses a kernel CPU list such as "0-3,6,8-9".
+ *
+ * Used for sysfs lists as well as for isolcpus= and nohz_full=.
+ *
+ * @param list The CPU list
+ * @param set Receives the CPUs of the list
+ * @return Number of CPUs in the list, -1 if the list is malformed
+ */
+static inline int bench_cpulist_parse(const char *list, cpu_set_t *set) {
+  CPU_ZERO(set);
+
+  const char *p = list;
+  while (*p != '\0' && *p != '\n') {
+    char *end;
+    long first = strtol(p, &end, 10);
+    if (end == p || first < 0)
+      return -1;
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      if (end == p + 1 || last < first)
+        return -1;
+      p = end;
+    }
+    for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+      CPU_SET((int)cpu, set);
+    if (*p == ',')
+      p++;
+    else if (*p != '\0' && *p != '\n')
+      return -1;
+  }
+
+  return CPU_COUNT(set);
+}
+
+/**
+ * @brief Reads an integer from a sysfs file.
+ *
+ * @return The value, or fallback if the file cannot be read
+ */
+static inline long bench_sysfs_long(const char *path, long fallback) {
+  char line[32];
+  if (!bench_read_line(path, line, sizeof(line)))
+    return fallback;
+
+  char *end;
+  long value = strtol(line, &end, 10);
+  return end == line ? fallback : value;
+}
+
+/**
+ * @brief Reads a CPU list from a sysfs file.
+ *
+ * @return true if the file was read and parsed
+ */
+static inline bool bench_sysfs_cpulist(const char *path, cpu_set_t *set) {
+  char line[1024];
+  CPU_ZERO(set);
+  return bench_read_line(path, line, sizeof(line)) &&
+         bench_cpulist_parse(line, set) >= 0;
+}
+
+/**
+ * @brief Parses a cache size such as "48K" or "8M" into bytes.
+ */
+static inline size_t bench_parse_cache_size(const char *text) {
+  char *end;
+  size_t size = strtoull(text, &end, 10);
+  switch (*end) {
+  case 'K':
+    return size << 10;
+  case 'M':
+    return size << 20;
+  case 'G':
+    return size << 30;
+  default:
+    return size;
+  }
+}
+
+/**
+ * @brief Reads the caches of a CPU from /sys/devices/system/cpu/cpuN/cache.
+ */
+static inline void bench_topology_load_caches(int cpu, bench_cpu_t *info) {
+  char path[128], line[32];
+
+  for (int index = 0; info->cache_count < BENCH_TOPOLOGY_MAX_CACHES; index++) {
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cache/index%d/size", cpu, index);
+    if (!bench_read_line(path, line, sizeof(line)))
+      break;
+
+    bench_cache_t *cache = &info->caches[info->cache_count++];
+    cache->size = bench_parse_cache_size(line);
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+    cache->level = (int)bench_sysfs_long(path, 0);
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cache/index%d/type", cpu, index);
+    cache->type = BENCH_CACHE_UNIFIED;
+    if (bench_read_line(path, line, sizeof(line))) {
+      if (strcmp(line, "Data") == 0)
+        cache->type = BENCH_CACHE_DATA;
+      else if (strcmp(line, "Instruction") == 0)
+        cache->type = BENCH_CACHE_INSTRUCTION;
+    }
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cache/index%d/coherency_line_size",
+             cpu, index);
+    cache->line_size = (size_t)bench_sysfs_long(path, BENCH_DEFAULT_LINE_SIZE);
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cache/index%d/"
+             "ways_of_associativity",
+             cpu, index);
+    cache->ways = (int)bench_sysfs_long(path, 0);
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu,
+             index);
+    if (!bench_sysfs_cpulist(path, &cache->shared_cpus))
+      CPU_SET(cpu, &cache->shared_cpus);
+  }
+}
+
+/**
+ * @brief Reads the NUMA nodes from /sys/devices/system/node.
+ *
+ * Machines without NUMA support are described as a single node 0 holding all
+ * CPUs.
+ */
+static inline void bench_topology_load_nodes(bench_topology_t *topology) {
+  cpu_set_t ids;
+  if (!bench_sysfs_cpulist("/sys/devices/system/node/possible", &ids) ||
+      CPU_COUNT(&ids) == 0) {
+    CPU_ZERO(&ids);
+    CPU_SET(0, &ids);
+  }
+
+  topology->nodes = (bench_numa_node_t *)calloc((size_t)CPU_COUNT(&ids),
+                                                sizeof(bench_numa_node_t));
+  if (topology->nodes == NULL)
+    return;
+
+  char path[128], line[256];
+  for (int id = 0; id < CPU_SETSIZE; id++) {
+    if (!CPU_ISSET(id, &ids))
+      continue;
+
+    bench_numa_node_t *node = &topology->nodes[topology->node_count++];
+    node->id = id;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+             id);
+    if (!bench_sysfs_cpulist(path, &node->cpus) && id == 0)
+      node->cpus = topology->online;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/meminfo",
+             id);
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+      continue;
+    while (fgets(line, sizeof(line), f)) {
+      char *total = strstr(line, "MemTotal:");
+      if (total != NULL)
+        node->mem_total_kb = strtoull(total + 9, NULL, 10);
+    }
+    fclose(f);
+  }
+}
+
+/**
+ * @brief Discovers the topology of the machine from sysfs.
+ *
+ * Reads /sys/devices/system/cpu/cpuN/{topology,cache,cpufreq,cpu_capacity}
+ * and /sys/devices/system/node. Missing files fall back to a flat topology:
+ * one core per CPU, one cluster per package, one node.
+ *
+ * @param topology Structure to fill in, release with bench_topology_free()
+ * @return true on success, false if the CPUs could not be enumerated
+ */
+static inline bool bench_topology_load(bench_topology_t *topology) {
+  memset(topology, 0, sizeof(*topology));
+
+  cpu_set_t possible;
+  if (!bench_sysfs_cpulist("/sys/devices/system/cpu/possible", &possible) ||
+      CPU_COUNT(&possible) == 0) {
+    CPU_ZERO(&possible);
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    for (long cpu = 0; cpu < count && cpu < CPU_SETSIZE; cpu++)
+      CPU_SET((int)cpu, &possible);
+  }
+  if (!bench_sysfs_cpulist("/sys/devices/system/cpu/online",
+                           &topology->online))
+    topology->online = possible;
+  topology->online_count = CPU_COUNT(&topology->online);
+
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &possible))
+      topology->cpu_count = cpu + 1;
+  }
+  if (topology->cpu_count == 0)
+    return false;
+
+  topology->cpus =
+      (bench_cpu_t *)calloc((size_t)topology->cpu_count, sizeof(bench_cpu_t));
+  if (topology->cpus == NULL)
+    return false;
+
+  char path[128];
+  uint64_t max_freq = 0;
+  for (int cpu = 0; cpu < topology->cpu_count; cpu++) {
+    bench_cpu_t *info = &topology->cpus[cpu];
+    info->online = CPU_ISSET(cpu, &topology->online);
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    info->package = (int)bench_sysfs_long(path, 0);
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+    info->core = (int)bench_sysfs_long(path, cpu);
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/cluster_id", cpu);
+    info->cluster = (int)bench_sysfs_long(path, -1);
+    if (info->cluster < 0)
+      info->cluster = info->package;
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/core_cpus_list", cpu);
+    if (!bench_sysfs_cpulist(path, &info->siblings)) {
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list",
+               cpu);
+      bench_sysfs_cpulist(path, &info->siblings);
+    }
+    CPU_SET(cpu, &info->siblings);
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/cluster_cpus_list", cpu);
+    if (!bench_sysfs_cpulist(path, &info->cluster_cpus)) {
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/cpu/cpu%d/topology/package_cpus_list", cpu);
+      bench_sysfs_cpulist(path, &info->cluster_cpus);
+    }
+    CPU_SET(cpu, &info->cluster_cpus);
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity",
+             cpu);
+    info->capacity = (int)bench_sysfs_long(path, 0);
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+    info->max_freq_khz = (uint64_t)bench_sysfs_long(path, 0);
+    if (info->max_freq_khz > max_freq)
+      max_freq = info->max_freq_khz;
+
+    bench_topology_load_caches(cpu, info);
+  }
+
+  /* without cpu_capacity, rank the CPUs by their maximum frequency */
+  for (int cpu = 0; cpu < topology->cpu_count; cpu++) {
+    bench_cpu_t *info = &topology->cpus[cpu];
+    if (info->capacity > 0)
+      continue;
+    info->capacity =
+        max_freq > 0 && info->max_freq_khz > 0
+            ? (int)(info->max_freq_khz * 1024 / max_freq)
+            : 1024;
+  }
+  for (int cpu = 1; cpu < topology->cpu_count; cpu++) {
+    if (topology->cpus[cpu].capacity != topology->cpus[0].capacity)
+      topology->heterogeneous = true;
+  }
+
+  bench_topology_load_nodes(topology);
+  for (size_t i = 0; i < topology->node_count; i++) {
+    for (int cpu = 0; cpu < topology->cpu_count; cpu++) {
+      if (CPU_ISSET(cpu, &topology->nodes[i].cpus))
+        topology->cpus[cpu].node = topology->nodes[i].id;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief Frees the memory of a topology loaded with bench_topology_load().
+ */
+static inline void bench_topology_free(bench_topology_t *topology) {
+  free(topology->cpus);
+  free(topology->nodes);
+  memset(topology, 0, sizeof(*topology));
+}
+
+/**
+ * @brief Returns the topology of the machine, loaded on first use.
+ *
+ * @return The topology, never freed; its cpus are NULL if it could not be read
+ */
+static inline const bench_topology_t *bench_topology(void) {
+  static bench_topology_t topology;
+  static bool loaded = false;
+
+  if (!loaded) {
+    bench_topology_load(&topology);
+    loaded = true;
+  }
+  return &topology;
+}
+
+/**
+ * @brief Looks up the data or unified cache of a CPU at a level.
+ *
+ * @param topology The topology
+ * @param cpu CPU number
+ * @param level Cache level, or BENCH_CACHE_LLC for the last level
+ * @return The cache, or NULL if the CPU has no such cache
+ */
+static inline const bench_cache_t *
+bench_topology_cache(const bench_topology_t *topology, int cpu, int level) {
+  if (topology->cpus == NULL || cpu < 0 || cpu >= topology->cpu_count)
+    return NULL;
+
+  const bench_cpu_t *info = &topology->cpus[cpu];
+  const bench_cache_t *found = NULL;
+  for (size_t i = 0; i < info->cache_count; i++) {
+    const bench_cache_t *cache = &info->caches[i];
+    if (cache->type == BENCH_CACHE_INSTRUCTION)
+      continue;
+    if (level == BENCH_CACHE_LLC ? found == NULL || cache->level > found->level
+                                 : cache->level == level)
+      found = cache;
+  }
+  return found;
+}
+
+/**
+ * @brief Returns the size of a data cache of the CPU the caller runs on.
+ *
+ * Falls back to sysconf() and then to the BENCH_DEFAULT_* sizes. A machine
+ * without an L3 reports its L2 as last level cache.
+ *
+ * @param level 1, 2, 3, or BENCH_CACHE_LLC for the last level
+ * @return Size in bytes, 0 if the level does not exist
+ */
+static inline size_t bench_cache_size(int level) {
+  int cpu = sched_getcpu();
+  const bench_cache_t *cache =
+      bench_topology_cache(bench_topology(), cpu < 0 ? 0 : cpu, level);
+  if (cache != NULL)
+    return cache->size;
+
+  long size = 0;
+  switch (level) {
+  case 1:
+    size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    return size > 0 ? (size_t)size : BENCH_DEFAULT_L1D_SIZE;
+  case 2:
+    size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return size > 0 ? (size_t)size : BENCH_DEFAULT_L2_SIZE;
+  case 3:
+    size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    return size > 0 ? (size_t)size : 0;
+  default:
+    size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0)
+      size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return size > 0 ? (size_t)size : BENCH_DEFAULT_L2_SIZE;
+  }
+}
+
+/**
+ * @brief Returns the L1 data cache line size of the CPU the caller runs on.
+ */
+static inline size_t bench_cache_line_size(void) {
+  int cpu = sched_getcpu();
+  const bench_cache_t *cache =
+      bench_topology_cache(bench_topology(), cpu < 0 ? 0 : cpu, 1);
+  if (cache != NULL && cache->line_size > 0)
+    return cache->line_size;
+
+  long size = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+  return size > 0 ? (size_t)size : BENCH_DEFAULT_LINE_SIZE;
+}
+
+/**
+ * @brief Collects the online CPUs of the fastest or the slowest cluster.
+ *
+ * On big.LITTLE SoCs the big cores have the highest capacity. On homogeneous
+ * machines both sets hold all online CPUs.
+ *
+ * @param topology The topology
+ * @param big true for the fastest CPUs, false for the slowest
+ * @param set Receives the CPUs
+ * @return Number of CPUs in the set
+ */
+static inline int bench_topology_cluster_cpus(const bench_topology_t *topology,
+                                              bool big, cpu_set_t *set) {
+  CPU_ZERO(set);
+
+  int wanted = -1;
+  for (int cpu = 0; cpu < topology->cpu_count; cpu++) {
+    const bench_cpu_t *info = &topology->cpus[cpu];
+    if (!info->online)
+      continue;
+    if (wanted < 0 || (big ? info->capacity > wanted : info->capacity < wanted))
+      wanted = info->capacity;
+  }
+
+  for (int cpu = 0; cpu < topology->cpu_count; cpu++) {
+    if (topology->cpus[cpu].online && topology->cpus[cpu].capacity == wanted)
+      CPU_SET(cpu, set);
+  }
+  return CPU_COUNT(set);
+}
+
+/**
+ * @brief Formats a CPU set as a kernel CPU list such as "0-3,6".
+ */
+static inline void bench_cpulist_format(const cpu_set_t *set, char *out,
+                                        size_t size) {
+  size_t len = 0;
+  out[0] = '\0';
+
+  for (int cpu = 0; cpu < CPU_SETSIZE && len < size; cpu++) {
+    if (!CPU_ISSET(cpu, set))
+      continue;
+    int last = cpu;
+    while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set))
+      last++;
+    int written = last > cpu ? snprintf(out + len, size - len, "%s%d-%d",
+                                        len > 0 ? "," : "", cpu, last)
+                             : snprintf(out + len, size - len, "%s%d",
+                                        len > 0 ? "," : "", cpu);
+    if (written < 0)
+      break;
+    len += (size_t)written;
+    cpu = last;
+  }
+}
+
+/**
+ * @brief Prints the CPUs, caches and NUMA nodes of a topology.
+ */
+static inline void bench_topology_print(const bench_topology_t *topology) {
+  char list[256];
+  static const char *types[] = {"d", "i", ""};
+
+  bench_cpulist_format(&topology->online, list, sizeof(list));
+  printf("CPUs: %d online (%s)%s\n", topology->online_count, list,
+         topology->heterogeneous ? ", heterogeneous" : "");
+
+  for (int cpu = 0; cpu < topology->cpu_count; cpu++) {
+    const bench_cpu_t *info = &topology->cpus[cpu];
+    if (!info->online)
+      continue;
+
+    bench_cpulist_format(&info->siblings, list, sizeof(list));
+    printf("  cpu%-3d package %d cluster %d core %d node %d capacity %d "
+           "smt %s |",
+           cpu, info->package, info->cluster, info->core, info->node,
+           info->capacity, list);
+    for (size_t i = 0; i < info->cache_count; i++) {
+      const bench_cache_t *cache = &info->caches[i];
+      printf(" L%d%s %zuK", cache->level, types[cache->type],
+             cache->size >> 10);
+    }
+    printf("\n");
+  }
+
+  for (size_t i = 0; i < topology->node_count; i++) {
+    const bench_numa_node_t *node = &topology->nodes[i];
+    bench_cpulist_format(&node->cpus, list, sizeof(list));
+    printf("Node %d: cpus %s, %lu MB\n", node->id, list,
+           (unsigned long)(node->mem_total_kb >> 10));
+  }
+}
+
+/**
+ * @brief Evicts the data caches by streaming through twice the last level
+ * cache.
+ *
+ * Has the signature of a fixture hook, set it as iteration_setup to measure
+ * every iteration with cold caches:
+ *
+ *   bench_set_fixture("name", (bench_fixture_t){
+ *                                 .iteration_setup = bench_flush_caches});
+ *
+ * @param ctx Unused
+ *
+ * @note The buffer is allocated on first use and kept until the program
+ * exits
+ */
+static inline void bench_flush_caches(void *ctx) {
+  static uint8_t *buffer = NULL;
+  static size_t size = 0;
+  (void)ctx;
+
+  if (buffer == NULL) {
+    size = 2 * bench_cache_size(BENCH_CACHE_LLC);
+    buffer = (uint8_t *)malloc(size);
+    if (buffer == NULL)
+      return;
+  }
+
+  size_t line = bench_cache_line_size();
+  uint64_t sum = 0;
+  for (size_t i = 0; i < size; i += line) {
+    buffer[i] = (uint8_t)i;
+    sum += buffer[i];
+  }
+  BENCH_DO_NOT_OPTIMIZE(sum);
+  BENCH_CLOBBER_MEMORY();
+}
+
+#endif // TOPOLOGY_H
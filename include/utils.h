@@ -3,63 +3,15 @@
 
 #include "./bench.h"
 #include "./data_processing.h"
+#include "./history.h"
+#include "./params.h"
+#include "./registry.h"
 #include <stdint.h>
 #include <stdlib.h>
 
-static inline benchmark_t *setup_benchmark(const char *name,
-                                           size_t warmup_iterations,
-                                           size_t timed_iterations,
-                                           bool is_baseline, bool validate,
-                                           void *output_buffer, size_t size) {
-  benchmark_t *benchmark = (benchmark_t *)malloc(sizeof(benchmark_t));
-  benchmark->name = name;
-  benchmark->warmup_iterations = warmup_iterations;
-  benchmark->timed_iterations = timed_iterations;
-  benchmark->is_baseline = is_baseline;
-  benchmark->validate = validate;
-  benchmark->is_valid = false;
-
-  benchmark_result_t *results =
-      (benchmark_result_t *)malloc(sizeof(benchmark_result_t));
-  results->samples = (uint64_t *)calloc(timed_iterations, sizeof(uint64_t));
-  results->cache_miss_rates =
-      (double *)calloc(timed_iterations, sizeof(double));
-
-  if (is_baseline) {
-    results->gt = calloc(size, 1);
-  } else {
-    results->gt = NULL;
-  }
-
-  if (output_buffer != NULL) {
-    results->output_buffer = output_buffer;
-  } else {
-    results->output_buffer = calloc(size, 1);
-  }
-
-  results->size = size;
-  benchmark->results = results;
-
-  return benchmark;
-}
-
-static inline void cleanup_benchmark(benchmark_t *benchmark,
-                                     bool free_output_buffer) {
-  bool gt_freed = false;
-
-  if (free_output_buffer) {
-    free(benchmark->results->output_buffer);
-  }
-
-  if (benchmark->is_baseline && !gt_freed) {
-    free(benchmark->results->gt);
-  }
-
-  free(benchmark->results->samples);
-  free(benchmark->results->cache_miss_rates);
-  free(benchmark->results);
-  free(benchmark);
-}
+#ifndef BENCHMARKS
+#define BENCHMARKS
+#endif
 
 #define BENCHMARK_TIME_PINNED(name, is_baseline, validate, output_buffer,      \
                               size, core, func)                                \
@@ -78,128 +30,223 @@ enum { BENCHMARK_COUNT = (0 BENCHMARKS) };
 #undef BENCHMARK_CYCLES_PINNED
 #undef BENCHMARK_CYCLES
 
-static benchmark_t *_benchmark_array[BENCHMARK_COUNT];
-static size_t _benchmark_idx = 0;
-
 #define BENCHMARK_TIME_PINNED(name, is_baseline, validate, output_buffer,      \
                               size, core, func)                                \
-  {                                                                            \
-                                                                               \
-    printf("\n=== %s Benchmark ===\n", name);                                  \
-                                                                               \
+  if (bench_options.list) {                                                    \
+    if (bench_filter_match(name))                                              \
+      printf("%s\n", name);                                                    \
+  } else if (bench_filter_match(name)) {                                       \
     benchmark_t *benchmark =                                                   \
-        setup_benchmark(name, WARMUP_RUNS, TIMED_RUNS, is_baseline, validate,  \
-                        output_buffer, size);                                  \
-                                                                               \
-    if (is_baseline) {                                                         \
-      gt = benchmark->results->gt;                                             \
-    } else {                                                                   \
-      benchmark->results->gt = gt;                                             \
+        bench_schedule(name, WARMUP_RUNS, TIMED_RUNS, is_baseline, validate,   \
+                       output_buffer, size);                                   \
+    if (benchmark != NULL) {                                                   \
+      BENCHMARK_FUNC_PINNED(func, benchmark, core);                            \
+      memset(output_buffer, 0, size);                                          \
+      bench_schedule_done(benchmark);                                          \
     }                                                                          \
-                                                                               \
-    BENCHMARK_FUNC_PINNED(func, benchmark, core);                              \
-                                                                               \
-    memset(output_buffer, 0, size);                                            \
-    _benchmark_array[_benchmark_idx++] = benchmark;                            \
   }
 
 #define BENCHMARK_TIME(name, is_baseline, validate, output_buffer, size, func) \
-  {                                                                            \
-                                                                               \
-    printf("\n=== %s Benchmark ===\n", name);                                  \
-                                                                               \
+  if (bench_options.list) {                                                    \
+    if (bench_filter_match(name))                                              \
+      printf("%s\n", name);                                                    \
+  } else if (bench_filter_match(name)) {                                       \
     benchmark_t *benchmark =                                                   \
-        setup_benchmark(name, WARMUP_RUNS, TIMED_RUNS, is_baseline, validate,  \
-                        output_buffer, size);                                  \
-                                                                               \
-    if (is_baseline) {                                                         \
-      gt = benchmark->results->gt;                                             \
-    } else {                                                                   \
-      benchmark->results->gt = gt;                                             \
+        bench_schedule(name, WARMUP_RUNS, TIMED_RUNS, is_baseline, validate,   \
+                       output_buffer, size);                                   \
+    if (benchmark != NULL) {                                                   \
+      BENCHMARK_FUNC(func, benchmark);                                         \
+      memset(output_buffer, 0, size);                                          \
+      bench_schedule_done(benchmark);                                          \
     }                                                                          \
-                                                                               \
-    BENCHMARK_FUNC(func, benchmark);                                           \
-                                                                               \
-    memset(output_buffer, 0, size);                                            \
-    _benchmark_array[_benchmark_idx++] = benchmark;                            \
   }
 
 #define BENCHMARK_CYCLES_PINNED(name, is_baseline, validate, output_buffer,    \
                                 size, core, func)                              \
-  {                                                                            \
-                                                                               \
-    printf("\n=== %s Benchmark ===\n", name);                                  \
-                                                                               \
+  if (bench_options.list) {                                                    \
+    if (bench_filter_match(name))                                              \
+      printf("%s\n", name);                                                    \
+  } else if (bench_filter_match(name)) {                                       \
     benchmark_t *benchmark =                                                   \
-        setup_benchmark(name, WARMUP_RUNS, TIMED_RUNS, is_baseline, validate,  \
-                        output_buffer, size);                                  \
-                                                                               \
-    if (is_baseline) {                                                         \
-      gt = benchmark->results->gt;                                             \
-    } else {                                                                   \
-      benchmark->results->gt = gt;                                             \
+        bench_schedule(name, WARMUP_RUNS, TIMED_RUNS, is_baseline, validate,   \
+                       output_buffer, size);                                   \
+    if (benchmark != NULL) {                                                   \
+      BENCHMARK_FUNC_CYCLES_PINNED(func, benchmark, core);                     \
+      memset(output_buffer, 0, size);                                          \
+      bench_schedule_done(benchmark);                                          \
     }                                                                          \
-                                                                               \
-    BENCHMARK_FUNC_CYCLES_PINNED(func, benchmark, core);                       \
-                                                                               \
-    memset(output_buffer, 0, size);                                            \
-    _benchmark_array[_benchmark_idx++] = benchmark;                            \
   }
 
 #define BENCHMARK_CYCLES(name, is_baseline, validate, output_buffer, size,     \
                          func)                                                 \
-  {                                                                            \
-                                                                               \
-    printf("\n=== %s Benchmark ===\n", name);                                  \
-                                                                               \
+  if (bench_options.list) {                                                    \
+    if (bench_filter_match(name))                                              \
+      printf("%s\n", name);                                                    \
+  } else if (bench_filter_match(name)) {                                       \
     benchmark_t *benchmark =                                                   \
-        setup_benchmark(name, WARMUP_RUNS, TIMED_RUNS, is_baseline, validate,  \
-                        output_buffer, size);                                  \
-                                                                               \
-    if (is_baseline) {                                                         \
-      gt = benchmark->results->gt;                                             \
-    } else {                                                                   \
-      benchmark->results->gt = gt;                                             \
+        bench_schedule(name, WARMUP_RUNS, TIMED_RUNS, is_baseline, validate,   \
+                       output_buffer, size);                                   \
+    if (benchmark != NULL) {                                                   \
+      BENCHMARK_FUNC_CYCLES(func, benchmark);                                  \
+      memset(output_buffer, 0, size);                                          \
+      bench_schedule_done(benchmark);                                          \
     }                                                                          \
-                                                                               \
-    BENCHMARK_FUNC_CYCLES(func, benchmark);                                    \
-                                                                               \
-    memset(output_buffer, 0, size);                                            \
-    _benchmark_array[_benchmark_idx++] = benchmark;                            \
   }
 
-#define RUN_BENCHMARKS() BENCHMARKS
+/**
+ * @brief Parses the command line options of the benchmark binary.
+ *
+ * Exits the program on invalid arguments or after printing the usage.
+ */
+#define PARSE_ARGS(argc, argv)                                                 \
+  do {                                                                         \
+    if (!bench_parse_args(argc, argv, &bench_options))                         \
+      exit(EXIT_FAILURE);                                                      \
+    if (bench_options.help) {                                                  \
+      bench_print_usage(argv[0]);                                              \
+      exit(EXIT_SUCCESS);                                                      \
+    }                                                                          \
+  } while (0)
+
+/**
+ * @brief Runs the X-macro benchmarks, the registered ones and the registered
+ * benchmark families.
+ *
+ * Only benchmarks matching --filter are run. With --list the selected
+ * benchmarks are printed and the program exits. With --interleave the
+ * benchmarks are expanded once per block, see bench_schedule_next(). With
+ * --numa=sweep all of it runs once per placement, and with --repetitions all
+ * of that once per repetition.
+ */
+#define RUN_BENCHMARKS()                                                       \
+  do {                                                                         \
+    bench_repetition_begin();                                                  \
+    do {                                                                       \
+      bench_numa_sweep_begin();                                                \
+      do {                                                                     \
+        bench_schedule_begin();                                                \
+        do {                                                                   \
+          BENCHMARKS                                                           \
+        } while (bench_schedule_next());                                       \
+        bench_run_families();                                                  \
+      } while (bench_numa_sweep_next());                                       \
+    } while (bench_repetition_next());                                         \
+    if (bench_options.list)                                                    \
+      exit(EXIT_SUCCESS);                                                      \
+  } while (0)
 
 #define PRINT_RESULTS_INDIVIDUAL()                                             \
   do {                                                                         \
     printf("\n=== Individual Benchmark Results ===\n");                        \
-    if (BENCHMARK_COUNT > 0) {                                                 \
-      for (size_t i = 0; i < BENCHMARK_COUNT; i++) {                           \
-        benchmark_t *b = _benchmark_array[i];                                  \
-        calculate_stats(b->results, b->timed_iterations);                      \
-        print_result(b);                                                       \
-      }                                                                        \
+    for (size_t i = 0; i < bench_registry.result_count; i++) {                 \
+      benchmark_t *b = bench_registry.results[i];                              \
+      calculate_stats(b->results, b->timed_iterations);                        \
+      print_result(b);                                                         \
     }                                                                          \
   } while (0)
 
+/**
+ * @brief Prints the summary of every comparison group relative to its
+ * baseline, sorted by --sort and --order.
+ *
+ * @param print_invalid Include benchmarks that failed validation
+ */
 #define PRINT_RESULTS_GROUP(print_invalid)                                     \
   do {                                                                         \
     printf("=== Comparative Results ===\n");                                   \
-    print_results(_benchmark_array, BENCHMARK_COUNT, print_invalid);           \
+    print_results(bench_registry.results, bench_registry.result_count,         \
+                  print_invalid);                                              \
+  } while (0)
+
+/**
+ * @brief Prints the pairwise speedup matrix of every comparison group.
+ *
+ * @see bench_set_group
+ */
+#define PRINT_RESULTS_MATRIX()                                                 \
+  do {                                                                         \
+    print_comparison_matrices(bench_registry.results,                          \
+                              bench_registry.result_count);                    \
+  } while (0)
+
+/**
+ * @brief Prints a parameter-versus-time table for every benchmark family.
+ */
+#define PRINT_RESULTS_FAMILIES()                                               \
+  do {                                                                         \
+    print_family_results(bench_registry.results, bench_registry.result_count); \
+  } while (0)
+
+/**
+ * @brief Prints the local/remote penalty of every benchmark of a --numa=sweep
+ * run.
+ */
+#define PRINT_RESULTS_NUMA()                                                   \
+  do {                                                                         \
+    print_numa_results(bench_registry.results, bench_registry.result_count);   \
+  } while (0)
+
+/**
+ * @brief Prints the spread of the medians of every benchmark over the runs of
+ * a --repetitions run.
+ */
+#define PRINT_RESULTS_REPETITIONS()                                            \
+  do {                                                                         \
+    print_repetition_results(bench_registry.results,                           \
+                             bench_registry.result_count);                     \
+  } while (0)
+
+/**
+ * @brief Prints the benchmarks that declared their work on the roofline of the
+ * machine, see bench_set_work().
+ */
+#define PRINT_RESULTS_ROOFLINE()                                               \
+  do {                                                                         \
+    print_roofline(bench_registry.results, bench_registry.result_count);       \
+  } while (0)
+
+/**
+ * @brief Writes the roofline as CSV for plotting, "-" for stdout.
+ */
+#define SAVE_ROOFLINE(path)                                                    \
+  do {                                                                         \
+    to_roofline_csv(bench_registry.results, bench_registry.result_count,       \
+                    path);                                                     \
   } while (0)
 
 #define SAVE(dir)                                                              \
   do {                                                                         \
-    to_csv(_benchmark_array, BENCHMARK_COUNT, dir);                            \
+    to_csv(bench_registry.results, bench_registry.result_count, dir);          \
   } while (0)
 
+/**
+ * @brief Exports the results in the format and location given by --format
+ * and --out.
+ */
+#define EXPORT_RESULTS()                                                       \
+  do {                                                                         \
+    export_results(bench_registry.results, bench_registry.result_count,        \
+                   &bench_options);                                            \
+  } while (0)
+
+/**
+ * @brief Compares the results against the history and records them.
+ *
+ * Does nothing unless --history is given.
+ *
+ * @return Exit status, 1 if a benchmark regressed, 0 otherwise
+ */
+#define COMPARE_HISTORY()                                                      \
+  bench_history_process(bench_registry.results, bench_registry.result_count,   \
+                        &bench_options)
+
 #define CLEANUP()                                                              \
   do {                                                                         \
-    if (BENCHMARK_COUNT > 0) {                                                 \
-      for (size_t i = 0; i < BENCHMARK_COUNT; i++) {                           \
-        cleanup_benchmark(_benchmark_array[i], false);                         \
-      }                                                                        \
-    }                                                                          \
+    bench_registry_cleanup();                                                  \
+    bench_families_cleanup();                                                  \
+    bench_free_options();                                                      \
+    bench_irq_unshield();                                                      \
+    bench_energy_close();                                                      \
   } while (0)
 
 #endif // UTILS_H
@@ -0,0 +1,772 @@
+#ifndef VALIDATE_H
+#define VALIDATE_H
+
+#include "./api.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BENCH_VALIDATE_NEON 1
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define BENCH_VALIDATE_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define BENCH_VALIDATE_SSE2 1
+#endif
+
+/**
+ * @brief Number of bytes compared per block by the vectorized validators.
+ *
+ * Blocks containing a mismatch are rescanned element by element to collect
+ * the mismatch statistics.
+ */
+#define BENCH_VALIDATE_BLOCK 64
+
+/**
+ * @brief Element types and comparison modes of a validator.
+ */
+typedef enum {
+  BENCH_VALIDATE_BYTES,
+  BENCH_VALIDATE_INT,
+  BENCH_VALIDATE_F32,
+  BENCH_VALIDATE_F64,
+  BENCH_VALIDATE_CUSTOM,
+} bench_validate_kind_t;
+
+/**
+ * @brief Structure describing the outcome of a validation.
+ *
+ * valid:               Flag indicating if all elements matched
+ * elements:            Number of compared elements
+ * mismatches:          Number of elements outside of the tolerance
+ * first_mismatch:      Index of the first mismatching element
+ * max_error:           Largest absolute difference of all elements
+ * max_ulp:             Largest ULP distance of the mismatching elements
+ */
+typedef struct {
+  bool valid;
+  size_t elements;
+  size_t mismatches;
+  size_t first_mismatch;
+  double max_error;
+  uint64_t max_ulp;
+} bench_validation_t;
+
+/**
+ * @brief Custom comparator of a validator.
+ *
+ * @param gt Ground truth buffer
+ * @param result Output buffer of the benchmark
+ * @param size Size of both buffers in bytes
+ * @param report Validation report to fill in, valid has to be set
+ * @param ctx User context of the validator
+ */
+typedef void (*bench_compare_fn)(const void *gt, const void *result,
+                                 size_t size, bench_validation_t *report,
+                                 void *ctx);
+
+/**
+ * @brief Structure describing how the output of a benchmark is validated.
+ *
+ * A zero-initialized validator compares the buffers byte by byte.
+ *
+ * kind:                Element type and comparison mode
+ * element_size:        Size of an integer element (1, 2, 4 or 8 bytes)
+ * max_ulp:             Accepted distance in units in the last place (floats)
+ * rel_tol:             Accepted relative difference (floats)
+ * abs_tol:             Accepted absolute difference (floats)
+ * compare:             Comparator used for BENCH_VALIDATE_CUSTOM
+ * ctx:                 User context passed to the comparator
+ *
+ * @note A float element matches if it is equal to the ground truth, within
+ * max_ulp, or within max(abs_tol, rel_tol * max(|gt|, |result|)). Two NaNs
+ * match.
+ */
+typedef struct {
+  bench_validate_kind_t kind;
+  size_t element_size;
+  uint64_t max_ulp;
+  double rel_tol;
+  double abs_tol;
+  bench_compare_fn compare;
+  void *ctx;
+} bench_validator_t;
+
+/**
+ * @brief Creates a validator of the given kind without any tolerance.
+ */
+[[nodiscard]] static inline bench_validator_t
+bench_validator(bench_validate_kind_t kind) {
+  bench_validator_t v = PIBENCH_ZERO;
+  v.kind = kind;
+  return v;
+}
+
+/**
+ * @brief Creates a validator for integer elements compared exactly.
+ */
+[[nodiscard]] static inline bench_validator_t
+bench_validator_int(size_t element_size) {
+  bench_validator_t v = bench_validator(BENCH_VALIDATE_INT);
+  v.element_size = element_size;
+  return v;
+}
+
+/**
+ * @brief Creates a validator for float elements with a ULP tolerance.
+ */
+[[nodiscard]] static inline bench_validator_t
+bench_validator_f32_ulp(uint64_t max_ulp) {
+  bench_validator_t v = bench_validator(BENCH_VALIDATE_F32);
+  v.max_ulp = max_ulp;
+  return v;
+}
+
+/**
+ * @brief Creates a validator for float elements with a relative tolerance.
+ */
+[[nodiscard]] static inline bench_validator_t
+bench_validator_f32_rel(double rel_tol, double abs_tol) {
+  bench_validator_t v = bench_validator(BENCH_VALIDATE_F32);
+  v.rel_tol = rel_tol;
+  v.abs_tol = abs_tol;
+  return v;
+}
+
+/**
+ * @brief Creates a validator for double elements with a ULP tolerance.
+ */
+[[nodiscard]] static inline bench_validator_t
+bench_validator_f64_ulp(uint64_t max_ulp) {
+  bench_validator_t v = bench_validator(BENCH_VALIDATE_F64);
+  v.max_ulp = max_ulp;
+  return v;
+}
+
+/**
+ * @brief Creates a validator for double elements with a relative tolerance.
+ */
+[[nodiscard]] static inline bench_validator_t
+bench_validator_f64_rel(double rel_tol, double abs_tol) {
+  bench_validator_t v = bench_validator(BENCH_VALIDATE_F64);
+  v.rel_tol = rel_tol;
+  v.abs_tol = abs_tol;
+  return v;
+}
+
+/**
+ * @brief Creates a validator using a custom comparator.
+ */
+[[nodiscard]] static inline bench_validator_t
+bench_validator_custom(bench_compare_fn compare, void *ctx) {
+  bench_validator_t v = bench_validator(BENCH_VALIDATE_CUSTOM);
+  v.compare = compare;
+  v.ctx = ctx;
+  return v;
+}
+
+/**
+ * @brief Records a mismatching element in the validation report.
+ */
+static inline void bench_validation_mismatch(bench_validation_t *report,
+                                             size_t index) {
+  if (report->mismatches == 0)
+    report->first_mismatch = index;
+  report->mismatches++;
+}
+
+/**
+ * @brief Compares integer elements one by one.
+ *
+ * @param begin Index of the first element to compare
+ * @param end Index after the last element to compare
+ */
+static inline void bench_validate_int_scalar(const void *gt, const void *result,
+                                             size_t element_size, size_t begin,
+                                             size_t end,
+                                             bench_validation_t *report) {
+  for (size_t i = begin; i < end; i++) {
+    int64_t expected, actual;
+
+    switch (element_size) {
+    case 8:
+      expected = ((const int64_t *)gt)[i];
+      actual = ((const int64_t *)result)[i];
+      break;
+    case 4:
+      expected = ((const int32_t *)gt)[i];
+      actual = ((const int32_t *)result)[i];
+      break;
+    case 2:
+      expected = ((const int16_t *)gt)[i];
+      actual = ((const int16_t *)result)[i];
+      break;
+    default:
+      expected = ((const uint8_t *)gt)[i];
+      actual = ((const uint8_t *)result)[i];
+      break;
+    }
+
+    if (expected != actual) {
+      double error = fabs((double)expected - (double)actual);
+      if (error > report->max_error)
+        report->max_error = error;
+      bench_validation_mismatch(report, i);
+    }
+  }
+}
+
+/**
+ * @brief Compares float elements one by one.
+ *
+ * @param begin Index of the first element to compare
+ * @param end Index after the last element to compare
+ */
+static inline void bench_validate_f32_scalar(const float *gt,
+                                             const float *result, size_t begin,
+                                             size_t end,
+                                             const bench_validator_t *v,
+                                             bench_validation_t *report) {
+  for (size_t i = begin; i < end; i++) {
+    float a = gt[i], b = result[i];
+
+    if (a == b || (isnan(a) && isnan(b)))
+      continue;
+
+    double error = fabs((double)a - (double)b);
+    if (isnan(error))
+      error = INFINITY;
+    if (error > report->max_error)
+      report->max_error = error;
+
+    double magnitude = fmax(fabs((double)a), fabs((double)b));
+    if (error <= fmax(v->abs_tol, v->rel_tol * magnitude))
+      continue;
+
+    int32_t ia, ib;
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+
+    uint64_t ulp = UINT64_MAX;
+    if (!isnan(a) && !isnan(b) && (ia < 0) == (ib < 0))
+      ulp = (uint64_t)llabs((long long)ia - (long long)ib);
+
+    if (ulp <= v->max_ulp)
+      continue;
+
+    if (ulp > report->max_ulp)
+      report->max_ulp = ulp;
+    bench_validation_mismatch(report, i);
+  }
+}
+
+/**
+ * @brief Compares double elements one by one.
+ *
+ * @param begin Index of the first element to compare
+ * @param end Index after the last element to compare
+ */
+static inline void bench_validate_f64_scalar(const double *gt,
+                                             const double *result,
+                                             size_t begin, size_t end,
+                                             const bench_validator_t *v,
+                                             bench_validation_t *report) {
+  for (size_t i = begin; i < end; i++) {
+    double a = gt[i], b = result[i];
+
+    if (a == b || (isnan(a) && isnan(b)))
+      continue;
+
+    double error = fabs(a - b);
+    if (isnan(error))
+      error = INFINITY;
+    if (error > report->max_error)
+      report->max_error = error;
+
+    if (error <= fmax(v->abs_tol, v->rel_tol * fmax(fabs(a), fabs(b))))
+      continue;
+
+    int64_t ia, ib;
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+
+    uint64_t ulp = UINT64_MAX;
+    if (!isnan(a) && !isnan(b) && (ia < 0) == (ib < 0))
+      ulp = ia > ib ? (uint64_t)(ia - ib) : (uint64_t)(ib - ia);
+
+    if (ulp <= v->max_ulp)
+      continue;
+
+    if (ulp > report->max_ulp)
+      report->max_ulp = ulp;
+    bench_validation_mismatch(report, i);
+  }
+}
+
+/**
+ * @brief Finds the blocks that differ between two buffers.
+ *
+ * Compares BENCH_VALIDATE_BLOCK bytes at a time with vector instructions and
+ * rescans differing blocks element by element.
+ *
+ * @return Number of bytes covered by the vectorized loop
+ */
+static inline size_t bench_validate_exact_simd(const uint8_t *gt,
+                                               const uint8_t *result,
+                                               size_t size,
+                                               size_t element_size,
+                                               bench_validation_t *report) {
+  size_t i = 0;
+
+#if defined(BENCH_VALIDATE_NEON)
+  for (; i + BENCH_VALIDATE_BLOCK <= size; i += BENCH_VALIDATE_BLOCK) {
+    uint8x16_t eq = vceqq_u8(vld1q_u8(gt + i), vld1q_u8(result + i));
+    eq = vandq_u8(eq, vceqq_u8(vld1q_u8(gt + i + 16),
+                               vld1q_u8(result + i + 16)));
+    eq = vandq_u8(eq, vceqq_u8(vld1q_u8(gt + i + 32),
+                               vld1q_u8(result + i + 32)));
+    eq = vandq_u8(eq, vceqq_u8(vld1q_u8(gt + i + 48),
+                               vld1q_u8(result + i + 48)));
+    if (vminvq_u8(eq) != 0xff)
+      bench_validate_int_scalar(gt, result, element_size, i / element_size,
+                                (i + BENCH_VALIDATE_BLOCK) / element_size,
+                                report);
+  }
+#elif defined(BENCH_VALIDATE_AVX2)
+  for (; i + BENCH_VALIDATE_BLOCK <= size; i += BENCH_VALIDATE_BLOCK) {
+    __m256i eq0 = _mm256_cmpeq_epi8(
+        _mm256_loadu_si256((const __m256i *)(gt + i)),
+        _mm256_loadu_si256((const __m256i *)(result + i)));
+    __m256i eq1 = _mm256_cmpeq_epi8(
+        _mm256_loadu_si256((const __m256i *)(gt + i + 32)),
+        _mm256_loadu_si256((const __m256i *)(result + i + 32)));
+    if (_mm256_movemask_epi8(_mm256_and_si256(eq0, eq1)) != -1)
+      bench_validate_int_scalar(gt, result, element_size, i / element_size,
+                                (i + BENCH_VALIDATE_BLOCK) / element_size,
+                                report);
+  }
+#elif defined(BENCH_VALIDATE_SSE2)
+  for (; i + BENCH_VALIDATE_BLOCK <= size; i += BENCH_VALIDATE_BLOCK) {
+    __m128i eq = _mm_set1_epi8(-1);
+    for (size_t j = 0; j < BENCH_VALIDATE_BLOCK; j += 16) {
+      __m128i a = _mm_loadu_si128((const __m128i *)(gt + i + j));
+      __m128i b = _mm_loadu_si128((const __m128i *)(result + i + j));
+      eq = _mm_and_si128(eq, _mm_cmpeq_epi8(a, b));
+    }
+    if (_mm_movemask_epi8(eq) != 0xffff)
+      bench_validate_int_scalar(gt, result, element_size, i / element_size,
+                                (i + BENCH_VALIDATE_BLOCK) / element_size,
+                                report);
+  }
+#else
+  (void)gt;
+  (void)result;
+  (void)size;
+  (void)element_size;
+  (void)report;
+#endif
+
+  return i;
+}
+
+/**
+ * @brief Vectorized float comparison.
+ *
+ * Elements that are equal, within the absolute/relative tolerance or within
+ * max_ulp (same sign only) pass in the vector loop. Blocks with any other
+ * element are rescanned by the scalar comparison, which has the final say.
+ *
+ * @return Number of elements covered by the vectorized loop
+ */
+static inline size_t bench_validate_f32_simd(const float *gt,
+                                             const float *result, size_t n,
+                                             const bench_validator_t *v,
+                                             bench_validation_t *report) {
+  const size_t block = BENCH_VALIDATE_BLOCK / sizeof(float);
+  const int32_t ulp_limit =
+      v->max_ulp > INT32_MAX ? INT32_MAX : (int32_t)v->max_ulp;
+  size_t i = 0;
+
+#if defined(BENCH_VALIDATE_NEON)
+  const float32x4_t abs_tol = vdupq_n_f32((float)v->abs_tol);
+  const float32x4_t rel_tol = vdupq_n_f32((float)v->rel_tol);
+  const uint32x4_t limit = vdupq_n_u32((uint32_t)ulp_limit);
+  float32x4_t max_error = vdupq_n_f32(0.0f);
+
+  for (; i + block <= n; i += block) {
+    uint32x4_t ok = vdupq_n_u32(0xffffffff);
+    for (size_t j = 0; j < block; j += 4) {
+      float32x4_t a = vld1q_f32(gt + i + j);
+      float32x4_t b = vld1q_f32(result + i + j);
+      float32x4_t diff = vabdq_f32(a, b);
+      float32x4_t tol = vmaxq_f32(
+          abs_tol, vmulq_f32(rel_tol, vmaxq_f32(vabsq_f32(a), vabsq_f32(b))));
+      int32x4_t ia = vreinterpretq_s32_f32(a);
+      int32x4_t ib = vreinterpretq_s32_f32(b);
+      uint32x4_t same_sign =
+          vcgeq_s32(veorq_s32(ia, ib), vdupq_n_s32(0));
+      uint32x4_t ordered = vandq_u32(vceqq_f32(a, a), vceqq_f32(b, b));
+      uint32x4_t near = vandq_u32(
+          vandq_u32(same_sign, ordered),
+          vcleq_u32(vreinterpretq_u32_s32(vabdq_s32(ia, ib)), limit));
+      uint32x4_t lane_ok =
+          vorrq_u32(vorrq_u32(vceqq_f32(a, b), vcleq_f32(diff, tol)), near);
+      ok = vandq_u32(ok, lane_ok);
+      max_error = vmaxnmq_f32(max_error, diff);
+    }
+    if (vminvq_u32(ok) != 0xffffffff)
+      bench_validate_f32_scalar(gt, result, i, i + block, v, report);
+  }
+
+  double error = vmaxvq_f32(max_error);
+  if (error > report->max_error)
+    report->max_error = error;
+#elif defined(BENCH_VALIDATE_AVX2) || defined(BENCH_VALIDATE_SSE2)
+#if defined(BENCH_VALIDATE_AVX2)
+#define _BV_PS __m256
+#define _BV_SI __m256i
+#define _BV_LANES 8
+#define _BV_LOAD _mm256_loadu_ps
+#define _BV_SET1 _mm256_set1_ps
+#define _BV_SET1_EPI32 _mm256_set1_epi32
+#define _BV_SUB _mm256_sub_ps
+#define _BV_MUL _mm256_mul_ps
+#define _BV_MAX _mm256_max_ps
+#define _BV_AND _mm256_and_ps
+#define _BV_OR _mm256_or_ps
+#define _BV_LE(a, b) _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define _BV_EQ(a, b) _mm256_cmp_ps(a, b, _CMP_EQ_OQ)
+#define _BV_ORD(a, b) _mm256_cmp_ps(a, b, _CMP_ORD_Q)
+#define _BV_CAST_SI _mm256_castps_si256
+#define _BV_CAST_PS _mm256_castsi256_ps
+#define _BV_XOR_SI _mm256_xor_si256
+#define _BV_SUB_EPI32 _mm256_sub_epi32
+#define _BV_SRAI_EPI32 _mm256_srai_epi32
+#define _BV_GT_EPI32 _mm256_cmpgt_epi32
+#define _BV_ANDNOT_SI _mm256_andnot_si256
+#define _BV_MOVEMASK _mm256_movemask_ps
+#define _BV_ALL 0xff
+#else
+#define _BV_PS __m128
+#define _BV_SI __m128i
+#define _BV_LANES 4
+#define _BV_LOAD _mm_loadu_ps
+#define _BV_SET1 _mm_set1_ps
+#define _BV_SET1_EPI32 _mm_set1_epi32
+#define _BV_SUB _mm_sub_ps
+#define _BV_MUL _mm_mul_ps
+#define _BV_MAX _mm_max_ps
+#define _BV_AND _mm_and_ps
+#define _BV_OR _mm_or_ps
+#define _BV_LE(a, b) _mm_cmple_ps(a, b)
+#define _BV_EQ(a, b) _mm_cmpeq_ps(a, b)
+#define _BV_ORD(a, b) _mm_cmpord_ps(a, b)
+#define _BV_CAST_SI _mm_castps_si128
+#define _BV_CAST_PS _mm_castsi128_ps
+#define _BV_XOR_SI _mm_xor_si128
+#define _BV_SUB_EPI32 _mm_sub_epi32
+#define _BV_SRAI_EPI32 _mm_srai_epi32
+#define _BV_GT_EPI32 _mm_cmpgt_epi32
+#define _BV_ANDNOT_SI _mm_andnot_si128
+#define _BV_MOVEMASK _mm_movemask_ps
+#define _BV_ALL 0xf
+#endif
+  const _BV_PS abs_mask = _BV_CAST_PS(_BV_SET1_EPI32(0x7fffffff));
+  const _BV_PS abs_tol = _BV_SET1((float)v->abs_tol);
+  const _BV_PS rel_tol = _BV_SET1((float)v->rel_tol);
+  const _BV_SI limit = _BV_SET1_EPI32(ulp_limit);
+  _BV_PS max_error = _BV_SET1(0.0f);
+
+  for (; i + block <= n; i += block) {
+    int ok = _BV_ALL;
+    for (size_t j = 0; j < block; j += _BV_LANES) {
+      _BV_PS a = _BV_LOAD(gt + i + j);
+      _BV_PS b = _BV_LOAD(result + i + j);
+      _BV_PS diff = _BV_AND(_BV_SUB(a, b), abs_mask);
+      _BV_PS tol =
+          _BV_MAX(abs_tol, _BV_MUL(rel_tol, _BV_MAX(_BV_AND(a, abs_mask),
+                                                    _BV_AND(b, abs_mask))));
+      _BV_SI ia = _BV_CAST_SI(a);
+      _BV_SI ib = _BV_CAST_SI(b);
+      /* |ia - ib| is the ULP distance if both have the same sign */
+      _BV_SI sign = _BV_SRAI_EPI32(_BV_XOR_SI(ia, ib), 31);
+      _BV_SI delta = _BV_SUB_EPI32(ia, ib);
+      _BV_SI negative = _BV_SRAI_EPI32(delta, 31);
+      _BV_SI ulp = _BV_SUB_EPI32(_BV_XOR_SI(delta, negative), negative);
+      _BV_SI near = _BV_ANDNOT_SI(sign, _BV_ANDNOT_SI(_BV_GT_EPI32(ulp, limit),
+                                                      _BV_SET1_EPI32(-1)));
+      _BV_PS lane_ok =
+          _BV_OR(_BV_OR(_BV_EQ(a, b), _BV_LE(diff, tol)),
+                 _BV_AND(_BV_CAST_PS(near), _BV_ORD(a, b)));
+      ok &= _BV_MOVEMASK(lane_ok);
+      /* max returns its second operand if one is NaN, skipping NaN lanes */
+      max_error = _BV_MAX(diff, max_error);
+    }
+    if (ok != _BV_ALL)
+      bench_validate_f32_scalar(gt, result, i, i + block, v, report);
+  }
+
+  float lanes[_BV_LANES];
+  memcpy(lanes, &max_error, sizeof(lanes));
+  for (size_t l = 0; l < _BV_LANES; l++) {
+    if (lanes[l] > report->max_error)
+      report->max_error = lanes[l];
+  }
+#undef _BV_PS
+#undef _BV_SI
+#undef _BV_LANES
+#undef _BV_LOAD
+#undef _BV_SET1
+#undef _BV_SET1_EPI32
+#undef _BV_SUB
+#undef _BV_MUL
+#undef _BV_MAX
+#undef _BV_AND
+#undef _BV_OR
+#undef _BV_LE
+#undef _BV_EQ
+#undef _BV_ORD
+#undef _BV_CAST_SI
+#undef _BV_CAST_PS
+#undef _BV_XOR_SI
+#undef _BV_SUB_EPI32
+#undef _BV_SRAI_EPI32
+#undef _BV_GT_EPI32
+#undef _BV_ANDNOT_SI
+#undef _BV_MOVEMASK
+#undef _BV_ALL
+#else
+  (void)gt;
+  (void)result;
+  (void)n;
+  (void)v;
+  (void)report;
+  (void)block;
+  (void)ulp_limit;
+#endif
+
+  return i;
+}
+
+/**
+ * @brief Vectorized double comparison.
+ *
+ * @see bench_validate_f32_simd
+ *
+ * @return Number of elements covered by the vectorized loop
+ *
+ * @note SSE2 has no 64-bit integer compare, so the ULP check is left to the
+ * scalar rescan there
+ */
+static inline size_t bench_validate_f64_simd(const double *gt,
+                                             const double *result, size_t n,
+                                             const bench_validator_t *v,
+                                             bench_validation_t *report) {
+  const size_t block = BENCH_VALIDATE_BLOCK / sizeof(double);
+  const int64_t ulp_limit =
+      v->max_ulp > INT64_MAX ? INT64_MAX : (int64_t)v->max_ulp;
+  size_t i = 0;
+
+#if defined(BENCH_VALIDATE_NEON)
+  const float64x2_t abs_tol = vdupq_n_f64(v->abs_tol);
+  const float64x2_t rel_tol = vdupq_n_f64(v->rel_tol);
+  const uint64x2_t limit = vdupq_n_u64((uint64_t)ulp_limit);
+  float64x2_t max_error = vdupq_n_f64(0.0);
+
+  for (; i + block <= n; i += block) {
+    uint64x2_t ok = vdupq_n_u64(UINT64_MAX);
+    for (size_t j = 0; j < block; j += 2) {
+      float64x2_t a = vld1q_f64(gt + i + j);
+      float64x2_t b = vld1q_f64(result + i + j);
+      float64x2_t diff = vabdq_f64(a, b);
+      float64x2_t tol = vmaxq_f64(
+          abs_tol, vmulq_f64(rel_tol, vmaxq_f64(vabsq_f64(a), vabsq_f64(b))));
+      int64x2_t ia = vreinterpretq_s64_f64(a);
+      int64x2_t ib = vreinterpretq_s64_f64(b);
+      uint64x2_t same_sign = vcgezq_s64(veorq_s64(ia, ib));
+      uint64x2_t ordered = vandq_u64(vceqq_f64(a, a), vceqq_f64(b, b));
+      uint64x2_t near = vandq_u64(
+          vandq_u64(same_sign, ordered),
+          vcleq_u64(vreinterpretq_u64_s64(vabsq_s64(vsubq_s64(ia, ib))),
+                    limit));
+      uint64x2_t lane_ok =
+          vorrq_u64(vorrq_u64(vceqq_f64(a, b), vcleq_f64(diff, tol)), near);
+      ok = vandq_u64(ok, lane_ok);
+      max_error = vmaxnmq_f64(max_error, diff);
+    }
+    if (vminvq_u32(vreinterpretq_u32_u64(ok)) != 0xffffffff)
+      bench_validate_f64_scalar(gt, result, i, i + block, v, report);
+  }
+
+  double error = vmaxvq_f64(max_error);
+  if (error > report->max_error)
+    report->max_error = error;
+#elif defined(BENCH_VALIDATE_AVX2)
+  const __m256d abs_mask =
+      _mm256_castsi256_pd(_mm256_set1_epi64x(INT64_MAX));
+  const __m256d abs_tol = _mm256_set1_pd(v->abs_tol);
+  const __m256d rel_tol = _mm256_set1_pd(v->rel_tol);
+  const __m256i limit = _mm256_set1_epi64x(ulp_limit);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256d max_error = _mm256_setzero_pd();
+
+  for (; i + block <= n; i += block) {
+    int ok = 0xf;
+    for (size_t j = 0; j < block; j += 4) {
+      __m256d a = _mm256_loadu_pd(gt + i + j);
+      __m256d b = _mm256_loadu_pd(result + i + j);
+      __m256d diff = _mm256_and_pd(_mm256_sub_pd(a, b), abs_mask);
+      __m256d tol = _mm256_max_pd(
+          abs_tol,
+          _mm256_mul_pd(rel_tol, _mm256_max_pd(_mm256_and_pd(a, abs_mask),
+                                               _mm256_and_pd(b, abs_mask))));
+      __m256i ia = _mm256_castpd_si256(a);
+      __m256i ib = _mm256_castpd_si256(b);
+      __m256i opposite = _mm256_cmpgt_epi64(zero, _mm256_xor_si256(ia, ib));
+      __m256i delta = _mm256_sub_epi64(ia, ib);
+      __m256i negative = _mm256_cmpgt_epi64(zero, delta);
+      __m256i ulp =
+          _mm256_sub_epi64(_mm256_xor_si256(delta, negative), negative);
+      __m256i far = _mm256_or_si256(opposite, _mm256_cmpgt_epi64(ulp, limit));
+      __m256d near = _mm256_andnot_pd(_mm256_castsi256_pd(far),
+                                      _mm256_cmp_pd(a, b, _CMP_ORD_Q));
+      __m256d lane_ok = _mm256_or_pd(
+          _mm256_or_pd(_mm256_cmp_pd(a, b, _CMP_EQ_OQ),
+                       _mm256_cmp_pd(diff, tol, _CMP_LE_OQ)),
+          near);
+      ok &= _mm256_movemask_pd(lane_ok);
+      max_error = _mm256_max_pd(diff, max_error);
+    }
+    if (ok != 0xf)
+      bench_validate_f64_scalar(gt, result, i, i + block, v, report);
+  }
+
+  double lanes[4];
+  memcpy(lanes, &max_error, sizeof(lanes));
+  for (size_t l = 0; l < 4; l++) {
+    if (lanes[l] > report->max_error)
+      report->max_error = lanes[l];
+  }
+#elif defined(BENCH_VALIDATE_SSE2)
+  const __m128d abs_mask = _mm_castsi128_pd(_mm_set1_epi64x(INT64_MAX));
+  const __m128d abs_tol = _mm_set1_pd(v->abs_tol);
+  const __m128d rel_tol = _mm_set1_pd(v->rel_tol);
+  __m128d max_error = _mm_setzero_pd();
+  (void)ulp_limit;
+
+  for (; i + block <= n; i += block) {
+    int ok = 0x3;
+    for (size_t j = 0; j < block; j += 2) {
+      __m128d a = _mm_loadu_pd(gt + i + j);
+      __m128d b = _mm_loadu_pd(result + i + j);
+      __m128d diff = _mm_and_pd(_mm_sub_pd(a, b), abs_mask);
+      __m128d tol = _mm_max_pd(
+          abs_tol, _mm_mul_pd(rel_tol, _mm_max_pd(_mm_and_pd(a, abs_mask),
+                                                  _mm_and_pd(b, abs_mask))));
+      ok &= _mm_movemask_pd(
+          _mm_or_pd(_mm_cmpeq_pd(a, b), _mm_cmple_pd(diff, tol)));
+      max_error = _mm_max_pd(diff, max_error);
+    }
+    if (ok != 0x3)
+      bench_validate_f64_scalar(gt, result, i, i + block, v, report);
+  }
+
+  double lanes[2];
+  memcpy(lanes, &max_error, sizeof(lanes));
+  for (size_t l = 0; l < 2; l++) {
+    if (lanes[l] > report->max_error)
+      report->max_error = lanes[l];
+  }
+#else
+  (void)gt;
+  (void)result;
+  (void)n;
+  (void)v;
+  (void)report;
+  (void)block;
+  (void)ulp_limit;
+#endif
+
+  return i;
+}
+
+/**
+ * @brief Validates a result buffer against the ground truth.
+ *
+ * Uses NEON, AVX2 or SSE2 where available and falls back to scalar code for
+ * the remainder of the buffer.
+ *
+ * @param v Validator describing the comparison
+ * @param gt Ground truth buffer
+ * @param result Output buffer of the benchmark
+ * @param size Size of both buffers in bytes
+ * @return The validation report
+ */
+[[nodiscard]] static inline bench_validation_t
+bench_validate(const bench_validator_t *v, const void *gt, const void *result,
+               size_t size) {
+  bench_validation_t report = PIBENCH_ZERO;
+
+  switch (v->kind) {
+  case BENCH_VALIDATE_CUSTOM:
+    report.elements = size;
+    report.valid = false;
+    if (v->compare != NULL)
+      v->compare(gt, result, size, &report, v->ctx);
+    return report;
+
+  case BENCH_VALIDATE_F32: {
+    size_t n = size / sizeof(float);
+    const float *expected = (const float *)gt;
+    const float *actual = (const float *)result;
+    size_t done = bench_validate_f32_simd(expected, actual, n, v, &report);
+    bench_validate_f32_scalar(expected, actual, done, n, v, &report);
+    report.elements = n;
+    break;
+  }
+
+  case BENCH_VALIDATE_F64: {
+    size_t n = size / sizeof(double);
+    const double *expected = (const double *)gt;
+    const double *actual = (const double *)result;
+    size_t done = bench_validate_f64_simd(expected, actual, n, v, &report);
+    bench_validate_f64_scalar(expected, actual, done, n, v, &report);
+    report.elements = n;
+    break;
+  }
+
+  case BENCH_VALIDATE_INT:
+  case BENCH_VALIDATE_BYTES:
+  default: {
+    size_t element_size = v->kind == BENCH_VALIDATE_INT ? v->element_size : 1;
+    if (element_size != 2 && element_size != 4 && element_size != 8)
+      element_size = 1;
+
+    size_t n = size / element_size;
+    size_t done =
+        bench_validate_exact_simd((const uint8_t *)gt, (const uint8_t *)result,
+                                  n * element_size, element_size, &report);
+    bench_validate_int_scalar(gt, result, element_size, done / element_size,
+                              n, &report);
+    report.elements = n;
+
+    /* trailing bytes that do not form a whole element */
+    if (memcmp((const uint8_t *)gt + n * element_size,
+               (const uint8_t *)result + n * element_size,
+               size - n * element_size) != 0)
+      bench_validation_mismatch(&report, n);
+    break;
+  }
+  }
+
+  report.valid = report.mismatches == 0;
+  return report;
+}
+
+#endif // VALIDATE_H
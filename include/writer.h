@@ -0,0 +1,335 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief Size of the buffer of a writer in bytes.
+ */
+#define BENCH_WRITER_BUFFER_SIZE (1 << 20)
+
+/**
+ * @brief Alignment of the buffer and of every flush in direct mode.
+ *
+ * O_DIRECT requires the buffer, the file offset and the length to be
+ * multiples of the logical block size, 4 KiB covers all common devices.
+ */
+#define BENCH_WRITER_ALIGNMENT 4096
+
+/**
+ * @brief Flags of bench_writer_open().
+ *
+ * BENCH_WRITER_DIRECT:      Bypass the page cache with O_DIRECT
+ * BENCH_WRITER_PREALLOCATE: Reserve the expected size with fallocate()
+ */
+enum {
+  BENCH_WRITER_DIRECT = 1 << 0,
+  BENCH_WRITER_PREALLOCATE = 1 << 1,
+};
+
+/**
+ * @brief Structure of a buffered file writer.
+ *
+ * Text is formatted straight into a large aligned buffer, which is written
+ * to the file with write() once it is full, so exporting does not go through
+ * stdio or allocate per record.
+ *
+ * fd:                  File descriptor, -1 if not open
+ * buffer:              Aligned buffer of BENCH_WRITER_BUFFER_SIZE bytes
+ * used:                Number of bytes in the buffer
+ * written:             Number of bytes written to the file
+ * direct:              Flag indicating if the file was opened with O_DIRECT
+ * failed:              Flag indicating if a write failed
+ */
+typedef struct {
+  int fd;
+  char *buffer;
+  size_t used;
+  uint64_t written;
+  bool direct;
+  bool failed;
+} bench_writer_t;
+
+/**
+ * @brief Initializes a writer and allocates its buffer.
+ *
+ * The buffer can be reused for several files with bench_writer_open() and
+ * bench_writer_close().
+ *
+ * @param writer Writer to initialize
+ * @return true on success, false if out of memory
+ */
+static inline bool bench_writer_init(bench_writer_t *writer) {
+  writer->fd = -1;
+  writer->used = 0;
+  writer->written = 0;
+  writer->direct = false;
+  writer->failed = false;
+
+  void *buffer = NULL;
+  if (posix_memalign(&buffer, BENCH_WRITER_ALIGNMENT,
+                     BENCH_WRITER_BUFFER_SIZE) != 0) {
+    writer->buffer = NULL;
+    return false;
+  }
+
+  writer->buffer = (char *)buffer;
+  return true;
+}
+
+/**
+ * @brief Opens a file for writing, truncating it.
+ *
+ * Falls back to buffered I/O if the file system does not support O_DIRECT.
+ * Preallocation is only a hint, failures are ignored.
+ *
+ * @param writer Initialized writer
+ * @param path Path of the file
+ * @param flags Combination of BENCH_WRITER_DIRECT and BENCH_WRITER_PREALLOCATE
+ * @param size_hint Expected size of the file in bytes
+ * @return true on success, false if the file could not be opened
+ */
+static inline bool bench_writer_open(bench_writer_t *writer, const char *path,
+                                     int flags, uint64_t size_hint) {
+  int open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+  writer->fd = -1;
+  writer->direct = false;
+  if (flags & BENCH_WRITER_DIRECT) {
+    writer->fd = open(path, open_flags | O_DIRECT, 0644);
+    writer->direct = writer->fd >= 0;
+  }
+  if (writer->fd < 0)
+    writer->fd = open(path, open_flags, 0644);
+  if (writer->fd < 0)
+    return false;
+
+  if ((flags & BENCH_WRITER_PREALLOCATE) && size_hint > 0)
+    (void)fallocate(writer->fd, 0, 0, (off_t)size_hint);
+
+  writer->used = 0;
+  writer->written = 0;
+  writer->failed = false;
+  return true;
+}
+
+/**
+ * @brief Writes a range of the buffer to the file, retrying partial writes.
+ */
+static inline bool bench_writer_write_all(bench_writer_t *writer,
+                                          const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t ret = write(writer->fd, data, len);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      writer->failed = true;
+      return false;
+    }
+    data += ret;
+    len -= (size_t)ret;
+    writer->written += (uint64_t)ret;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Writes the buffered bytes to the file.
+ *
+ * In direct mode only whole blocks are written, the remainder is moved to the
+ * front of the buffer.
+ *
+ * @param writer Open writer
+ * @return false if a write failed
+ */
+static inline bool bench_writer_flush(bench_writer_t *writer) {
+  size_t len = writer->used;
+  if (writer->direct)
+    len -= len % BENCH_WRITER_ALIGNMENT;
+
+  if (len > 0 && !bench_writer_write_all(writer, writer->buffer, len)) {
+    writer->used = 0;
+    return false;
+  }
+
+  memmove(writer->buffer, writer->buffer + len, writer->used - len);
+  writer->used -= len;
+  return true;
+}
+
+/**
+ * @brief Returns space for at least n bytes at the end of the buffer.
+ *
+ * @param writer Open writer
+ * @param n Number of bytes needed, at most BENCH_WRITER_ALIGNMENT
+ * @return Pointer to the free space
+ */
+static inline char *bench_writer_reserve(bench_writer_t *writer, size_t n) {
+  if (writer->used + n > BENCH_WRITER_BUFFER_SIZE)
+    bench_writer_flush(writer);
+  return writer->buffer + writer->used;
+}
+
+/**
+ * @brief Appends bytes to the writer.
+ */
+static inline void bench_writer_put(bench_writer_t *writer, const char *data,
+                                    size_t len) {
+  while (len > 0) {
+    size_t space = BENCH_WRITER_BUFFER_SIZE - writer->used;
+    if (space == 0) {
+      if (!bench_writer_flush(writer))
+        return;
+      continue;
+    }
+    size_t n = len < space ? len : space;
+    memcpy(writer->buffer + writer->used, data, n);
+    writer->used += n;
+    data += n;
+    len -= n;
+  }
+}
+
+/**
+ * @brief Appends a character to the writer.
+ */
+static inline void bench_writer_char(bench_writer_t *writer, char c) {
+  *bench_writer_reserve(writer, 1) = c;
+  writer->used++;
+}
+
+/**
+ * @brief Formats an unsigned integer in decimal.
+ *
+ * @param out Destination, needs room for 20 characters
+ * @param value Value to format
+ * @return Number of characters written
+ */
+static inline size_t bench_format_u64(char *out, uint64_t value) {
+  char digits[20];
+  size_t n = 0;
+
+  do {
+    digits[n++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+
+  for (size_t i = 0; i < n; i++)
+    out[i] = digits[n - 1 - i];
+  return n;
+}
+
+/**
+ * @brief Appends an unsigned integer in decimal.
+ */
+static inline void bench_writer_u64(bench_writer_t *writer, uint64_t value) {
+  char *out = bench_writer_reserve(writer, 20);
+  writer->used += bench_format_u64(out, value);
+}
+
+/**
+ * @brief Appends a floating point number with a fixed number of decimals.
+ *
+ * Rounds half away from zero. Values that do not fit a 64-bit fixed point
+ * representation are formatted with snprintf().
+ *
+ * @param writer Open writer
+ * @param value Value to format
+ * @param decimals Number of decimals, at most 9
+ */
+static inline void bench_writer_fixed(bench_writer_t *writer, double value,
+                                      unsigned decimals) {
+  static const uint64_t scales[] = {1,      10,      100,      1000,     10000,
+                                    100000, 1000000, 10000000, 100000000,
+                                    1000000000};
+  if (decimals > 9)
+    decimals = 9;
+
+  uint64_t scale = scales[decimals];
+  char *out = bench_writer_reserve(writer, 64);
+  double magnitude = fabs(value);
+
+  if (!isfinite(value) || magnitude * (double)scale >= 1e18) {
+    int n = snprintf(out, 64, "%.*f", (int)decimals, value);
+    if (n > 0)
+      writer->used += (size_t)n < 64 ? (size_t)n : 63;
+    return;
+  }
+
+  uint64_t fixed = (uint64_t)(magnitude * (double)scale + 0.5);
+  size_t n = 0;
+  if (value < 0.0 && fixed > 0)
+    out[n++] = '-';
+
+  n += bench_format_u64(out + n, fixed / scale);
+  if (decimals > 0) {
+    uint64_t fraction = fixed % scale;
+    out[n++] = '.';
+    for (unsigned i = decimals; i > 0; i--) {
+      out[n + i - 1] = (char)('0' + fraction % 10);
+      fraction /= 10;
+    }
+    n += decimals;
+  }
+
+  writer->used += n;
+}
+
+/**
+ * @brief Writes the remaining bytes and closes the file.
+ *
+ * In direct mode the unaligned tail is written after turning O_DIRECT off.
+ * The file is truncated to the written size to drop unused preallocation.
+ *
+ * @param writer Open writer
+ * @return true if all bytes were written
+ */
+static inline bool bench_writer_close(bench_writer_t *writer) {
+  if (writer->fd < 0)
+    return false;
+
+  bench_writer_flush(writer);
+
+  if (writer->used > 0) {
+    if (writer->direct) {
+      int fl = fcntl(writer->fd, F_GETFL);
+      fcntl(writer->fd, F_SETFL, fl & ~O_DIRECT);
+    }
+    bench_writer_write_all(writer, writer->buffer, writer->used);
+    writer->used = 0;
+  }
+
+  if (!writer->failed && ftruncate(writer->fd, (off_t)writer->written) != 0)
+    writer->failed = true;
+  if (close(writer->fd) != 0)
+    writer->failed = true;
+
+  writer->fd = -1;
+  return !writer->failed;
+}
+
+/**
+ * @brief Frees the buffer of a writer.
+ */
+static inline void bench_writer_free(bench_writer_t *writer) {
+  if (writer->fd >= 0)
+    bench_writer_close(writer);
+
+  free(writer->buffer);
+  writer->buffer = NULL;
+}
+
+#endif // WRITER_H
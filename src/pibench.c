@@ -0,0 +1,13 @@
+/**
+ * @file pibench.c
+ * @brief Translation unit of libpibench.
+ *
+ * Compiles the engine declared in data_processing.h and defines the global
+ * state, so benchmarks built with PIBENCH_LINK only expand the timing macros
+ * and share one registry across translation units.
+ */
+
+#define PIBENCH_BUILD
+#include "../include/data_processing.h"
+#include "../include/params.h"
+#include "../include/registry.h"
@@ -0,0 +1,97 @@
+/**
+ * @file cxx-example.cpp
+ * @brief Example of the C++ interface, built by `make check-cxx`.
+ *
+ * Measures a templated kernel with the Runner and registers a benchmark and a
+ * benchmark family with the C macros. `make check-cxx` builds it with
+ * -Werror, so the headers stay warning-free when included from C++.
+ *
+ * Usage: cxx-example [options], see --help
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#define WARMUP_RUNS 10
+#define TIMED_RUNS 100
+
+#include "../include/bench.hpp"
+#include <vector>
+
+/**
+ * @brief Number of elements of the example inputs.
+ */
+#define EXAMPLE_SIZE 4096
+
+static std::vector<float> example_input(EXAMPLE_SIZE, 1.0f);
+static float example_output[EXAMPLE_SIZE];
+
+/**
+ * @brief Sums the elements of an array with a number of independent
+ * accumulators chosen at compile time.
+ */
+template <class T, int Lanes> static T example_sum(const T *data, size_t n) {
+  T acc[Lanes] = {};
+  for (size_t i = 0; i + Lanes <= n; i += Lanes) {
+    for (int l = 0; l < Lanes; l++)
+      acc[l] += data[i + l];
+  }
+  T sum = 0;
+  for (int l = 0; l < Lanes; l++)
+    sum += acc[l];
+  return sum;
+}
+
+static void example_scale(float *out, size_t n, float factor) {
+  for (size_t i = 0; i < n; i++)
+    out[i] = example_input[i] * factor;
+}
+
+REGISTER_BENCHMARK_TIME(scale, "scale", true, false, example_output,
+                        sizeof(example_output),
+                        example_scale(example_output, EXAMPLE_SIZE, 2.0f))
+
+REGISTER_BENCHMARK_FAMILY_TIME(scale_n, "scale n", NULL, NULL,
+                               example_scale(example_output, BENCH_ARG(0),
+                                             2.0f))
+
+BENCHMARK_FAMILY_ARGS(scale_n) {
+  bench_family_axis(family, "n", bench_range_pow2(64, EXAMPLE_SIZE));
+}
+
+int main(int argc, char **argv) {
+  PARSE_ARGS(argc, argv);
+
+  bench_set_validator("scale", bench_validator_f32_ulp(4));
+  bench_set_group("scale", "scale");
+  bench_set_group("scale n", "scale");
+  RUN_BENCHMARKS();
+
+  pibench::Runner<pibench::MonotonicClock, pibench::NoCounters> timed;
+  pibench::Config config;
+  config.name = "sum<float, 1>";
+  config.is_baseline = true;
+  timed.run(
+      [&] {
+        BENCH_DO_NOT_OPTIMIZE(
+            (example_sum<float, 1>(example_input.data(), EXAMPLE_SIZE)));
+      },
+      config);
+
+  pibench::Runner<pibench::MonotonicClock, pibench::L1CacheCounters> counted;
+  config.name = "sum<float, 8>";
+  config.is_baseline = false;
+  counted.run(
+      [&] {
+        BENCH_DO_NOT_OPTIMIZE(
+            (example_sum<float, 8>(example_input.data(), EXAMPLE_SIZE)));
+      },
+      config);
+
+  PRINT_RESULTS_GROUP(false);
+  EXPORT_RESULTS();
+  int status = COMPARE_HISTORY();
+  CLEANUP();
+  return status;
+}
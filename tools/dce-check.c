@@ -0,0 +1,122 @@
+/**
+ * @file dce-check.c
+ * @brief Checks that the optimizer keeps benchmark bodies guarded by
+ * BENCH_DO_NOT_OPTIMIZE() and BENCH_CLOBBER_MEMORY().
+ *
+ * Built with the release flags by `make check-dce`. Every guarded loop has to
+ * take a measurable amount of time, a loop the compiler removed runs in close
+ * to zero time. Exits with 1 if a guarded loop was removed.
+ *
+ * Usage: dce-check
+ */
+
+#include "../include/barrier.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * @brief Number of iterations of every loop.
+ */
+#define DCE_ITERATIONS 10000000ULL
+
+/**
+ * @brief Time per iteration in nanoseconds below which a loop counts as
+ * removed. A single dependent integer operation takes longer on any CPU.
+ */
+#define DCE_MIN_NS_PER_ITERATION 0.05
+
+typedef struct {
+  uint64_t a, b, c;
+} dce_triple_t;
+
+static uint64_t dce_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Prints the time per iteration of a loop and checks it.
+ *
+ * @param name Name of the loop
+ * @param start Start time in nanoseconds
+ * @param guarded Flag indicating if the loop is guarded and has to be kept
+ * @return false if a guarded loop was removed
+ */
+static bool dce_report(const char *name, uint64_t start, bool guarded) {
+  double ns = (double)(dce_now_ns() - start) / (double)DCE_ITERATIONS;
+  bool kept = ns >= DCE_MIN_NS_PER_ITERATION;
+
+  printf("%-24s %8.3f ns/iteration  %s\n", name, ns,
+         kept ? "kept" : (guarded ? "REMOVED" : "removed (expected)"));
+  return kept || !guarded;
+}
+
+int main(void) {
+  bool ok = true;
+  uint64_t start;
+
+  start = dce_now_ns();
+  for (uint64_t i = 0; i < DCE_ITERATIONS; i++)
+    BENCH_DO_NOT_OPTIMIZE(i);
+  ok &= dce_report("empty body", start, true);
+
+  start = dce_now_ns();
+  uint64_t x = 1;
+  for (uint64_t i = 0; i < DCE_ITERATIONS; i++) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    BENCH_DO_NOT_OPTIMIZE(x);
+  }
+  ok &= dce_report("integer", start, true);
+
+  start = dce_now_ns();
+  double d = 1.0;
+  for (uint64_t i = 0; i < DCE_ITERATIONS; i++) {
+    d = d * 0.999999 + 1e-9;
+    BENCH_DO_NOT_OPTIMIZE(d);
+  }
+  ok &= dce_report("double", start, true);
+
+  start = dce_now_ns();
+  for (uint64_t i = 0; i < DCE_ITERATIONS; i++) {
+    dce_triple_t t = {i, i * 3, i * 7};
+    BENCH_DO_NOT_OPTIMIZE(t);
+  }
+  ok &= dce_report("struct", start, true);
+
+  start = dce_now_ns();
+  uint64_t buffer[64];
+  BENCH_ESCAPE(buffer);
+  for (uint64_t i = 0; i < DCE_ITERATIONS; i++) {
+    buffer[i % 64] = i;
+    BENCH_CLOBBER_MEMORY();
+  }
+  ok &= dce_report("clobbered stores", start, true);
+
+  start = dce_now_ns();
+  uint64_t unused = 1;
+  for (uint64_t i = 0; i < DCE_ITERATIONS; i++)
+    unused = unused * 6364136223846793005ULL + 1442695040888963407ULL;
+  (void)unused;
+  dce_report("unguarded", start, false);
+
+  uint64_t empty[100] = {0};
+  uint64_t measured[100];
+  for (size_t i = 0; i < 100; i++)
+    measured[i] = 40 + i % 3;
+  if (!bench_samples_elided(empty, 100) ||
+      bench_samples_elided(measured, 100)) {
+    printf("Elision detection is broken\n");
+    ok = false;
+  }
+
+  if (!ok) {
+    fprintf(stderr, "Error: The compiler removed a guarded benchmark body\n");
+    return 1;
+  }
+
+  printf("All guarded bodies were kept\n");
+  return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file fixture-check.c
+ * @brief Checks that the setup and teardown hooks of a fixture run once per
+ * benchmark, with and without --interleave.
+ *
+ * Built and run by `make check-fixture`. Two registered benchmarks with a
+ * fixture are run once as a whole and once in blocks of FIXTURE_BLOCK
+ * samples, the number of setup and teardown calls is counted. Exits with 1
+ * if a hook ran more or less than once, or if a teardown did not follow its
+ * setup.
+ *
+ * Usage: fixture-check
+ */
+
+#define _GNU_SOURCE
+
+#define WARMUP_RUNS 2
+#define TIMED_RUNS 10
+
+#include "../include/utils.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * @brief Samples per block of the interleaved run, chosen so that the last
+ * block is shorter than the others.
+ */
+#define FIXTURE_BLOCK 3
+
+/**
+ * @brief Calls of the hooks of one benchmark.
+ *
+ * setup:               Calls of the setup hook
+ * teardown:            Calls of the teardown hook
+ * misordered:          Teardowns that did not follow a setup
+ */
+typedef struct {
+  int setup, teardown, misordered;
+} fixture_calls_t;
+
+static fixture_calls_t fixture_calls[2];
+
+static void fixture_setup(void *ctx) {
+  fixture_calls_t *calls = (fixture_calls_t *)ctx;
+  calls->setup++;
+}
+
+static void fixture_teardown(void *ctx) {
+  fixture_calls_t *calls = (fixture_calls_t *)ctx;
+  calls->misordered += calls->teardown >= calls->setup;
+  calls->teardown++;
+}
+
+/**
+ * @brief Body of the benchmarks, long enough to be measured.
+ */
+static void fixture_body(void) {
+  for (uint64_t i = 0; i < 10000; i++)
+    BENCH_DO_NOT_OPTIMIZE(i);
+}
+
+REGISTER_BENCHMARK_TIME(fixture_a, "fixture a", false, false, NULL, 0,
+                        fixture_body())
+REGISTER_BENCHMARK_TIME(fixture_b, "fixture b", false, false, NULL, 0,
+                        fixture_body())
+
+/**
+ * @brief Runs both benchmarks and checks the calls of their hooks.
+ *
+ * @param interleave Samples per block, 0 to run every benchmark at once
+ * @return false if a hook did not run exactly once
+ */
+static bool fixture_run(size_t interleave) {
+  const char *names[2] = {"fixture a", "fixture b"};
+  bool ok = true;
+
+  memset(fixture_calls, 0, sizeof(fixture_calls));
+  for (int i = 0; i < 2; i++) {
+    bench_set_fixture(names[i],
+                      (bench_fixture_t){.setup = fixture_setup,
+                                        .teardown = fixture_teardown,
+                                        .ctx = &fixture_calls[i]});
+  }
+
+  bench_options.interleave = interleave;
+  RUN_BENCHMARKS();
+
+  for (int i = 0; i < 2; i++) {
+    const fixture_calls_t *calls = &fixture_calls[i];
+    bool passed = calls->setup == 1 && calls->teardown == 1 &&
+                  calls->misordered == 0;
+
+    printf("%-10s interleave %-3zu setup %d  teardown %d  %s\n", names[i],
+           interleave, calls->setup, calls->teardown,
+           passed ? "ok" : "FAILED");
+    ok &= passed;
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  PARSE_ARGS(argc, argv);
+
+  bool ok = true;
+  ok &= fixture_run(0);
+  ok &= fixture_run(FIXTURE_BLOCK);
+
+  CLEANUP();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,357 @@
+/**
+ * @file machine-bench.c
+ * @brief Measures the memory bandwidth and latency of the machine.
+ *
+ * Runs independent FMA chains for the peak compute rate and STREAM
+ * copy/scale/add/triad on one pinned core, a pointer-chasing
+ * latency ladder from 4 KB to MACHINE_MAX_BYTES and the triad bandwidth of 1
+ * to N threads, each pinned to its own CPU. The single-threaded measurements
+ * use the pi-bench harness. The characterization is stored at
+ * bench_machine_path() and embedded in every JSON and NDJSON report of the
+ * machine from then on. `make machine-bench` builds and runs it.
+ *
+ * Usage: machine-bench [--machine=<file>] [--core=<n>]
+ */
+
+#include "../include/utils.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @brief Smallest size of each STREAM array, otherwise four times the last
+ * level cache.
+ */
+#define MACHINE_STREAM_MIN_BYTES (16UL << 20)
+
+/**
+ * @brief Number of warmup and timed runs of the STREAM kernels.
+ */
+#define MACHINE_STREAM_WARMUP 2
+#define MACHINE_STREAM_RUNS 20
+
+/**
+ * @brief Loop iterations of one call of the peak compute kernel.
+ */
+#define MACHINE_PEAK_ITERATIONS (1UL << 22)
+
+/**
+ * @brief Largest working set of the latency ladder.
+ */
+#define MACHINE_MAX_BYTES (256UL << 20)
+
+/**
+ * @brief Dependent loads per sample of the latency ladder.
+ */
+#define MACHINE_CHASE_STEPS (1UL << 20)
+
+/**
+ * @brief Number of warmup and timed runs of each latency ladder step.
+ */
+#define MACHINE_CHASE_WARMUP 2
+#define MACHINE_CHASE_RUNS 11
+
+/**
+ * @brief Number of timed runs of each thread count of the scaling test.
+ */
+#define MACHINE_SCALING_RUNS 10
+
+/**
+ * @brief STREAM arrays shared by the kernels and the threads.
+ */
+static double *stream_a, *stream_b, *stream_c;
+static size_t stream_n;
+
+/**
+ * @brief Scalar of the STREAM scale and triad kernels.
+ */
+static const double stream_q = 3.0;
+
+/**
+ * @brief Runs a STREAM kernel in the harness and returns its best bandwidth.
+ *
+ * @param name Name of the benchmark
+ * @param bytes Bytes read and written by one call
+ */
+#define MACHINE_STREAM(name, call, bytes, core, gbs)                           \
+  do {                                                                         \
+    benchmark_t *benchmark =                                                   \
+        setup_benchmark(name, MACHINE_STREAM_WARMUP, MACHINE_STREAM_RUNS,      \
+                        false, false, NULL, 0);                                \
+    BENCH_MEASURE(call, benchmark, TIME, NO_COUNTERS, PINNED, core, 1);        \
+    calculate_stats(benchmark->results, benchmark->timed_iterations);          \
+    uint64_t best_ns = benchmark->results->min_time;                           \
+    gbs = best_ns > 0 ? (double)(bytes) / (double)best_ns : 0.0;               \
+    printf("  %-28s %10.2f GB/s (best of %zu, %lu ns)\n", name, gbs,           \
+           benchmark->timed_iterations, best_ns);                              \
+    cleanup_benchmark(benchmark, false);                                       \
+  } while (0)
+
+/**
+ * @brief Measures STREAM copy, scale, add and triad on one core.
+ */
+static void machine_stream(bench_machine_t *machine, int core) {
+  printf("\nSTREAM (%s kernels, 3 arrays of %zu MB, core %d)\n",
+         machine->kernels, stream_n * sizeof(double) >> 20, core);
+
+  size_t two = 2 * stream_n * sizeof(double);
+  size_t three = 3 * stream_n * sizeof(double);
+  MACHINE_STREAM("copy", bench_stream_copy(stream_c, stream_a, stream_n), two,
+                 core, machine->copy_gbs);
+  MACHINE_STREAM("scale",
+                 bench_stream_scale(stream_b, stream_c, stream_q, stream_n),
+                 two, core, machine->scale_gbs);
+  MACHINE_STREAM("add",
+                 bench_stream_add(stream_c, stream_a, stream_b, stream_n),
+                 three, core, machine->add_gbs);
+  MACHINE_STREAM(
+      "triad",
+      bench_stream_triad(stream_a, stream_b, stream_c, stream_q, stream_n),
+      three, core, machine->triad_gbs);
+  BENCH_CLOBBER_MEMORY();
+}
+
+/**
+ * @brief Measures the peak double precision compute rate of one core.
+ */
+static void machine_peak(bench_machine_t *machine, int core) {
+  printf("\nPeak compute (%s kernel, %d FMA chains, core %d)\n",
+         machine->peak_kernels, BENCH_PEAK_CHAINS, core);
+
+  benchmark_t *benchmark =
+      setup_benchmark("peak", MACHINE_STREAM_WARMUP, MACHINE_STREAM_RUNS,
+                      false, false, NULL, 0);
+  BENCH_MEASURE(
+      BENCH_DO_NOT_OPTIMIZE(bench_peak_fma(MACHINE_PEAK_ITERATIONS)),
+      benchmark, TIME, NO_COUNTERS, PINNED, core, 1);
+  calculate_stats(benchmark->results, benchmark->timed_iterations);
+
+  uint64_t best_ns = benchmark->results->min_time;
+  double flops = bench_peak_flops(MACHINE_PEAK_ITERATIONS);
+  machine->peak_gflops = best_ns > 0 ? flops / (double)best_ns : 0.0;
+  printf("  %-28s %10.2f GFLOP/s (best of %zu, %lu ns)\n", "fma",
+         machine->peak_gflops, benchmark->timed_iterations, best_ns);
+  cleanup_benchmark(benchmark, false);
+}
+
+/**
+ * @brief Measures the latency of dependent loads at growing working sets.
+ *
+ * The buffers are backed by transparent hugepages, so the ladder shows the
+ * caches and memory rather than TLB misses.
+ */
+static void machine_latency(bench_machine_t *machine, int core) {
+  size_t stride = bench_cache_line_size();
+  printf("\nLatency ladder (%zu byte stride, %lu loads per sample, core %d)\n",
+         stride, MACHINE_CHASE_STEPS, core);
+
+  for (size_t bytes = 4096;
+       bytes <= MACHINE_MAX_BYTES &&
+       machine->latency_count < BENCH_MACHINE_MAX_LEVELS;
+       bytes *= 2) {
+    void *buffer = bench_alloc(bytes, BENCH_ALLOC_THP);
+    void *head = buffer != NULL
+                     ? bench_chase_build(buffer, bytes, stride, bytes)
+                     : NULL;
+    if (head == NULL) {
+      bench_free(buffer);
+      printf("  %-28zu could not allocate\n", bytes);
+      break;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "chase/%zu", bytes);
+    benchmark_t *benchmark =
+        setup_benchmark(name, MACHINE_CHASE_WARMUP, MACHINE_CHASE_RUNS, false,
+                        false, NULL, 0);
+    /* the names of BENCH_MEASURE's locals are taken */
+    BENCH_MEASURE(BENCH_DO_NOT_OPTIMIZE(bench_chase(head, MACHINE_CHASE_STEPS)),
+                  benchmark, TIME, NO_COUNTERS, PINNED, core, 1);
+    calculate_stats(benchmark->results, benchmark->timed_iterations);
+
+    bench_latency_point_t *point = &machine->latency[machine->latency_count++];
+    point->bytes = bytes;
+    point->ns =
+        (double)benchmark->results->median_time / (double)MACHINE_CHASE_STEPS;
+    printf("  %10zu KB %16.2f ns\n", bytes >> 10, point->ns);
+
+    cleanup_benchmark(benchmark, false);
+    bench_free(buffer);
+  }
+}
+
+/**
+ * @brief Work of one thread of the scaling test.
+ *
+ * cpu:                 CPU the thread is pinned to
+ * begin, end:          Slice of the STREAM arrays of the thread
+ * start, stop:         Barriers around every timed run
+ */
+typedef struct {
+  int cpu;
+  size_t begin, end;
+  pthread_barrier_t *start, *stop;
+} machine_worker_t;
+
+static void *machine_worker(void *arg) {
+  machine_worker_t *worker = (machine_worker_t *)arg;
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(worker->cpu, &cpuset);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+
+  size_t n = worker->end - worker->begin;
+  for (int run = 0; run <= MACHINE_SCALING_RUNS; run++) {
+    pthread_barrier_wait(worker->start);
+    bench_stream_triad(stream_a + worker->begin, stream_b + worker->begin,
+                       stream_c + worker->begin, stream_q, n);
+    BENCH_CLOBBER_MEMORY();
+    pthread_barrier_wait(worker->stop);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Orders the online CPUs with one CPU per physical core first, so SMT
+ * siblings are only used once every core has a thread.
+ *
+ * @return Number of CPUs
+ */
+static int machine_cpu_order(int *cpus, int max) {
+  const bench_topology_t *topology = bench_topology();
+  int count = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    for (int cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++) {
+      if (!CPU_ISSET(cpu, &topology->online))
+        continue;
+      bool first = true;
+      if (topology->cpus != NULL && cpu < topology->cpu_count) {
+        for (int sibling = 0; sibling < cpu; sibling++)
+          first &= !CPU_ISSET(sibling, &topology->cpus[cpu].siblings);
+      }
+      if (first == (pass == 0))
+        cpus[count++] = cpu;
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief Measures the combined triad bandwidth of 1 to N threads.
+ *
+ * Like STREAM with OpenMP, the threads split the arrays between them.
+ */
+static void machine_scaling(bench_machine_t *machine) {
+  int cpus[BENCH_MACHINE_MAX_THREADS];
+  int count = machine_cpu_order(cpus, BENCH_MACHINE_MAX_THREADS);
+  size_t three = 3 * stream_n * sizeof(double);
+  printf("\nTriad scaling (best of %d runs)\n", MACHINE_SCALING_RUNS);
+
+  for (int threads = 1; threads <= count; threads++) {
+    pthread_barrier_t start, stop;
+    pthread_barrier_init(&start, NULL, (unsigned)threads + 1);
+    pthread_barrier_init(&stop, NULL, (unsigned)threads + 1);
+
+    pthread_t ids[BENCH_MACHINE_MAX_THREADS];
+    machine_worker_t workers[BENCH_MACHINE_MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+      workers[t] = (machine_worker_t){
+          .cpu = cpus[t],
+          .begin = stream_n * (size_t)t / (size_t)threads,
+          .end = stream_n * (size_t)(t + 1) / (size_t)threads,
+          .start = &start,
+          .stop = &stop,
+      };
+      pthread_create(&ids[t], NULL, machine_worker, &workers[t]);
+    }
+
+    /* the first run is a warmup */
+    uint64_t best = UINT64_MAX;
+    for (int run = 0; run <= MACHINE_SCALING_RUNS; run++) {
+      pthread_barrier_wait(&start);
+      uint64_t begin = get_time_ns();
+      pthread_barrier_wait(&stop);
+      uint64_t elapsed = get_time_ns() - begin;
+      if (run > 0 && elapsed < best)
+        best = elapsed;
+    }
+
+    for (int t = 0; t < threads; t++)
+      pthread_join(ids[t], NULL);
+    pthread_barrier_destroy(&start);
+    pthread_barrier_destroy(&stop);
+
+    bench_scaling_point_t *point = &machine->scaling[machine->scaling_count++];
+    point->threads = (uint32_t)threads;
+    point->gbs = (double)three / (double)best;
+    printf("  %3d threads %16.2f GB/s\n", threads, point->gbs);
+  }
+}
+
+int main(int argc, char **argv) {
+  PARSE_ARGS(argc, argv);
+
+  bench_env_t env;
+  bench_env_collect(&env);
+  int core = env.cpu_count > 1 ? env.cpu_count - 1 : 0;
+
+  bench_machine_t machine;
+  memset(&machine, 0, sizeof(machine));
+  memcpy(machine.magic, BENCH_MACHINE_MAGIC, sizeof(machine.magic));
+  machine.version = BENCH_MACHINE_VERSION;
+  bench_machine_fingerprint(machine.fingerprint);
+  snprintf(machine.kernels, sizeof(machine.kernels), "%s", bench_stream_isa());
+  snprintf(machine.peak_kernels, sizeof(machine.peak_kernels), "%s",
+           bench_peak_isa());
+  machine.timestamp = (uint64_t)time(NULL);
+  machine.core = bench_resolve_core(core);
+
+  /* four times the last level cache, but no more than 1/16 of the memory */
+  size_t memory = (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+  size_t bytes = 4 * bench_cache_size(BENCH_CACHE_LLC);
+  if (bytes > memory / 16)
+    bytes = memory / 16;
+  if (bytes < MACHINE_STREAM_MIN_BYTES)
+    bytes = MACHINE_STREAM_MIN_BYTES;
+  stream_n = bytes / sizeof(double);
+  machine.stream_bytes = stream_n * sizeof(double);
+
+  stream_a = (double *)bench_alloc(bytes, BENCH_ALLOC_THP);
+  stream_b = (double *)bench_alloc(bytes, BENCH_ALLOC_THP);
+  stream_c = (double *)bench_alloc(bytes, BENCH_ALLOC_THP);
+  if (stream_a == NULL || stream_b == NULL || stream_c == NULL) {
+    fprintf(stderr, "Error: Could not allocate the STREAM arrays\n");
+    return EXIT_FAILURE;
+  }
+  for (size_t i = 0; i < stream_n; i++) {
+    stream_a[i] = 1.0;
+    stream_b[i] = 2.0;
+  }
+
+  printf("pi-bench machine characterization\n");
+  printf("  cpu:         %s (%d cores)\n", env.cpu_model, env.cpu_count);
+  printf("  fingerprint: %s\n", machine.fingerprint);
+
+  machine_peak(&machine, machine.core);
+  machine_stream(&machine, machine.core);
+  machine_scaling(&machine);
+  bench_free(stream_a);
+  bench_free(stream_b);
+  bench_free(stream_c);
+
+  machine_latency(&machine, machine.core);
+
+  char path[512];
+  if (!bench_machine_save(&machine) ||
+      !bench_machine_path(path, sizeof(path))) {
+    fprintf(stderr, "Error: Could not store the machine characterization\n");
+    CLEANUP();
+    return EXIT_FAILURE;
+  }
+  printf("\nSaved to %s\n", path);
+
+  CLEANUP();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file pibench-convert.c
+ * @brief Converts binary result files to CSV or JSON.
+ *
+ * The JSON and NDJSON reports carry the environment and machine
+ * characterization stored in the file, not those of the converting machine.
+ * Files without them only report the hostname and time of the export.
+ *
+ * Usage: pibench-convert <results.pibr> [--format=csv|json|ndjson]
+ *                        [--out=<path>]
+ */
+
+#include "../include/binary.h"
+#include "../include/data_processing.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argv[1][0] == '-') {
+    fprintf(stderr,
+            "Usage: %s <results.pibr> [--format=csv|json|ndjson] "
+            "[--out=<path>]\n",
+            argv[0]);
+    return 1;
+  }
+
+  /* the input file takes the place of the program name */
+  if (!bench_parse_args(argc - 1, argv + 1, &bench_options) ||
+      bench_options.format == BENCH_FORMAT_BINARY) {
+    fprintf(stderr, "Error: Output format has to be csv, json or ndjson\n");
+    return 1;
+  }
+
+  bench_bin_reader_t reader;
+  if (!bench_bin_open(&reader, argv[1]))
+    return 1;
+
+  /* report the run, not the machine converting it */
+  bench_bin_env_t strings;
+  bench_run_metadata.recorded = true;
+  if (bench_bin_env(&reader, &bench_run_metadata.env, &strings)) {
+    bench_run_metadata.has_machine =
+        bench_bin_machine(&reader, &bench_run_metadata.machine);
+  } else {
+    bench_env_t *env = &bench_run_metadata.env;
+    memset(env, 0, sizeof(*env));
+    bench_bin_copy_string(env->hostname, sizeof(env->hostname),
+                          reader.header->hostname,
+                          sizeof(reader.header->hostname));
+    env->temperature = -1.0f;
+    env->cycle_counter = env->compiler = env->cflags = env->git_sha =
+        "unknown";
+    env->timestamp = reader.header->timestamp;
+  }
+
+  size_t count = bench_bin_count(&reader);
+  benchmark_t *benchmarks =
+      (benchmark_t *)calloc(count + 1, sizeof(*benchmarks));
+  benchmark_result_t *results =
+      (benchmark_result_t *)calloc(count + 1, sizeof(*results));
+  benchmark_t **pointers = (benchmark_t **)calloc(count + 1, sizeof(*pointers));
+  bool success = benchmarks != NULL && results != NULL && pointers != NULL;
+
+  for (size_t i = 0; i < count && success; i++) {
+    const bench_bin_descriptor_t *d = bench_bin_descriptor(&reader, i);
+    const bench_bin_column_t *irqs = bench_bin_irq_column(&reader, d);
+    size_t n = (size_t)d->timed_iterations;
+
+    results[i].samples = (uint64_t *)malloc((n + 1) * sizeof(uint64_t));
+    results[i].cache_miss_rates = (double *)malloc((n + 1) * sizeof(double));
+    results[i].is_cycles = (d->flags & BENCH_BIN_CYCLES) != 0;
+
+    success = results[i].samples != NULL &&
+              results[i].cache_miss_rates != NULL &&
+              bench_bin_read(&reader, &d->samples, n, results[i].samples) &&
+              bench_bin_read(&reader, &d->cache_miss_rates, n,
+                             results[i].cache_miss_rates);
+    if (success && irqs != NULL) {
+      results[i].irq_counts = (uint64_t *)malloc((n + 1) * sizeof(uint64_t));
+      success = results[i].irq_counts != NULL &&
+                bench_bin_read(&reader, irqs, n, results[i].irq_counts);
+    }
+    if (!success) {
+      fprintf(stderr, "Error: Could not decode benchmark '%s'\n", d->name);
+      break;
+    }
+    /* samples of older files are microseconds */
+    if ((d->flags & (BENCH_BIN_CYCLES | BENCH_BIN_NANOSECONDS)) == 0) {
+      for (size_t j = 0; j < n; j++)
+        results[i].samples[j] *= 1000;
+    }
+
+    benchmarks[i].name = d->name;
+    benchmarks[i].warmup_iterations = (size_t)d->warmup_iterations;
+    benchmarks[i].timed_iterations = n;
+    benchmarks[i].results = &results[i];
+    benchmarks[i].is_baseline = (d->flags & BENCH_BIN_BASELINE) != 0;
+    benchmarks[i].validate = (d->flags & BENCH_BIN_VALIDATED) != 0;
+    benchmarks[i].is_valid = (d->flags & BENCH_BIN_VALID) != 0;
+    pointers[i] = &benchmarks[i];
+  }
+
+  if (success)
+    success = export_results(pointers, count, &bench_options);
+
+  for (size_t i = 0; results != NULL && i < count; i++) {
+    free(results[i].samples);
+    free(results[i].cache_miss_rates);
+    free(results[i].irq_counts);
+  }
+  free(pointers);
+  free(results);
+  free(benchmarks);
+  bench_bin_close(&reader);
+  bench_free_options();
+
+  return success ? 0 : 1;
+}
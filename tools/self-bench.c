@@ -0,0 +1,375 @@
+/**
+ * @file self-bench.c
+ * @brief Measures the overhead and noise floor of pi-bench itself.
+ *
+ * Reports the cost of an empty benchmark body for every BENCHMARK_FUNC
+ * variant, the cost and resolution of the timers and cache counters, the
+ * jitter of back-to-back cycle counter reads on a pinned and an unpinned
+ * core, and the cost of the statistics and export routines at 1e3 to 1e7
+ * samples. `make self-bench` saves the report next to the binary, named
+ * after the git revision, so it can be compared across versions.
+ *
+ * Usage: self-bench [max_samples]
+ */
+
+#include "../include/utils.h"
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Number of warmup calls of the empty benchmarks.
+ */
+#define SELF_WARMUP 1000
+
+/**
+ * @brief Number of samples of the empty benchmarks and the jitter series.
+ */
+#define SELF_SAMPLES 100000
+
+/**
+ * @brief Number of calls of a timer whose cost is measured.
+ */
+#define SELF_TIMER_CALLS 1000000
+
+/**
+ * @brief Number of start/stop pairs of the cache counters.
+ */
+#define SELF_COUNTER_CALLS 1000
+
+/**
+ * @brief Largest number of samples the statistics and export routines are
+ * measured at.
+ */
+#define SELF_MAX_SAMPLES 10000000
+
+/**
+ * @brief Percentiles of a series of measurements.
+ *
+ * p50/p90/p99/p999:    50th, 90th, 99th and 99.9th percentile
+ * min/max:             Smallest and largest value
+ */
+typedef struct {
+  double p50, p90, p99, p999;
+  uint64_t min, max;
+} self_dist_t;
+
+/**
+ * @brief Sorts a series and returns its percentiles.
+ */
+static self_dist_t self_distribution(uint64_t *values, size_t n) {
+  quick_sort(values, n);
+  self_dist_t dist = {.p50 = percentile(values, n, 50.0),
+                      .p90 = percentile(values, n, 90.0),
+                      .p99 = percentile(values, n, 99.0),
+                      .p999 = percentile(values, n, 99.9),
+                      .min = values[0],
+                      .max = values[n - 1]};
+  return dist;
+}
+
+static void self_print_dist(const char *name, const self_dist_t *dist,
+                            const char *unit) {
+  printf("  %-28s p50 %8.1f  p90 %8.1f  p99 %8.1f  p99.9 %8.1f  max %10lu %s\n",
+         name, dist->p50, dist->p90, dist->p99, dist->p999, dist->max, unit);
+}
+
+/**
+ * @brief Creates a benchmark that measures all its samples in one quiet block.
+ */
+static benchmark_t *self_benchmark(const char *name, size_t warmup,
+                                   size_t samples) {
+  benchmark_t *benchmark =
+      setup_benchmark(name, warmup, samples, false, false, NULL, 0);
+  benchmark->block_size = benchmark->timed_iterations;
+  return benchmark;
+}
+
+/**
+ * @brief Reports the empty body measurement of one BENCHMARK_FUNC variant.
+ *
+ * @param benchmark The finished benchmark
+ * @param elapsed_ns Duration of the whole macro in nanoseconds
+ */
+static void self_report_empty(benchmark_t *benchmark, uint64_t elapsed_ns) {
+  benchmark_result_t *results = benchmark->results;
+  size_t n = benchmark->timed_iterations;
+  size_t empty = 0;
+  for (size_t i = 0; i < n; i++) {
+    /* the overhead compensation of the cycle counter wraps below zero */
+    if (results->samples[i] > UINT64_MAX / 2)
+      results->samples[i] = 0;
+    empty += results->samples[i] == 0;
+  }
+
+  self_dist_t dist = self_distribution(results->samples, n);
+  self_print_dist(benchmark->name, &dist, results->is_cycles ? "cycles" : "ns");
+  printf("  %-28s %.1f ns per call of the harness, %.1f%% empty samples\n", "",
+         (double)elapsed_ns / (double)(benchmark->warmup_iterations + n),
+         100.0 * (double)empty / (double)n);
+
+  cleanup_benchmark(benchmark, false);
+}
+
+/**
+ * @brief Measures an empty body with every BENCHMARK_FUNC variant.
+ */
+static void self_bench_harness(int core) {
+  printf("\nEmpty body (%d samples, pinned to core %d)\n", SELF_SAMPLES, core);
+
+  benchmark_t *benchmark = self_benchmark("BENCHMARK_FUNC_PINNED",
+                                          SELF_WARMUP, SELF_SAMPLES);
+  uint64_t start = get_time_ns();
+  BENCHMARK_FUNC_PINNED(BENCH_DO_NOT_OPTIMIZE(0), benchmark, core);
+  self_report_empty(benchmark, get_time_ns() - start);
+
+  benchmark = self_benchmark("BENCHMARK_FUNC", SELF_WARMUP, SELF_SAMPLES);
+  start = get_time_ns();
+  BENCHMARK_FUNC(BENCH_DO_NOT_OPTIMIZE(0), benchmark);
+  self_report_empty(benchmark, get_time_ns() - start);
+
+  benchmark = self_benchmark("BENCHMARK_FUNC_CYCLES_PINNED", SELF_WARMUP,
+                             SELF_SAMPLES);
+  start = get_time_ns();
+  BENCHMARK_FUNC_CYCLES_PINNED(BENCH_DO_NOT_OPTIMIZE(0), benchmark, core);
+  self_report_empty(benchmark, get_time_ns() - start);
+
+  benchmark =
+      self_benchmark("BENCHMARK_FUNC_CYCLES", SELF_WARMUP, SELF_SAMPLES);
+  start = get_time_ns();
+  BENCHMARK_FUNC_CYCLES(BENCH_DO_NOT_OPTIMIZE(0), benchmark);
+  self_report_empty(benchmark, get_time_ns() - start);
+}
+
+/**
+ * @brief Measures the cost and resolution of get_cycles() and clock_gettime().
+ */
+static void self_bench_timers(void) {
+  printf("\nTimers (%d calls)\n", SELF_TIMER_CALLS);
+
+  uint64_t start = get_time_ns();
+  uint64_t first_cycles = get_cycles();
+  for (size_t i = 0; i < SELF_TIMER_CALLS; i++)
+    BENCH_DO_NOT_OPTIMIZE(get_cycles());
+  uint64_t cycles = get_cycles() - first_cycles;
+  uint64_t elapsed = get_time_ns() - start;
+  double ticks_per_ns = (double)cycles / (double)elapsed;
+
+  uint64_t resolution = UINT64_MAX;
+  uint64_t previous = get_cycles();
+  for (size_t i = 0; i < SELF_TIMER_CALLS; i++) {
+    uint64_t now = get_cycles();
+    if (now != previous && now - previous < resolution)
+      resolution = now - previous;
+    previous = now;
+  }
+
+  printf("  %-28s %8.2f ns per call, %.3f ticks per ns\n", "get_cycles()",
+         (double)elapsed / SELF_TIMER_CALLS, ticks_per_ns);
+  printf("  %-28s %8lu ticks (%.2f ns)\n", "get_cycles() resolution",
+         resolution, (double)resolution / ticks_per_ns);
+  printf("  %-28s %8lu ticks\n", "get_cycle_count_overhead()",
+         get_cycle_count_overhead());
+
+  struct timespec ts;
+  start = get_time_ns();
+  for (size_t i = 0; i < SELF_TIMER_CALLS; i++) {
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    BENCH_DO_NOT_OPTIMIZE(ts.tv_nsec);
+  }
+  elapsed = get_time_ns() - start;
+
+  resolution = UINT64_MAX;
+  previous = get_time_ns();
+  for (size_t i = 0; i < SELF_TIMER_CALLS; i++) {
+    uint64_t now = get_time_ns();
+    if (now != previous && now - previous < resolution)
+      resolution = now - previous;
+    previous = now;
+  }
+
+  struct timespec res = {0, 0};
+  clock_getres(CLOCK_MONOTONIC, &res);
+  printf("  %-28s %8.2f ns per call\n", "clock_gettime()",
+         (double)elapsed / SELF_TIMER_CALLS);
+  printf("  %-28s %8lu ns (clock_getres %ld ns)\n",
+         "clock_gettime() resolution", resolution, res.tv_nsec);
+}
+
+/**
+ * @brief Measures the cost of starting and stopping the cache counters.
+ */
+static void self_bench_counters(void) {
+  printf("\nCache counters (%d start/stop pairs)\n", SELF_COUNTER_CALLS);
+
+  cache_counter_t counter = start_l1_cache_miss_counter();
+  bool available = counter.refs_fd != -1;
+  stop_l1_cache_miss_counter(&counter);
+  if (!available) {
+    printf("  %-28s unavailable\n", "perf_event_open()");
+    return;
+  }
+
+  uint64_t start = get_time_ns();
+  for (size_t i = 0; i < SELF_COUNTER_CALLS; i++) {
+    counter = start_l1_cache_miss_counter();
+    BENCH_DO_NOT_OPTIMIZE(stop_l1_cache_miss_counter(&counter));
+  }
+  printf("  %-28s %8.0f ns per pair\n", "start/stop",
+         (double)(get_time_ns() - start) / SELF_COUNTER_CALLS);
+}
+
+/**
+ * @brief Measures the distribution of back-to-back cycle counter reads.
+ */
+static void self_bench_jitter(int core) {
+  printf("\nJitter of back-to-back get_cycles() (%d samples)\n", SELF_SAMPLES);
+
+  uint64_t *deltas = (uint64_t *)malloc(SELF_SAMPLES * sizeof(uint64_t));
+  if (deltas == NULL)
+    return;
+
+  cpu_set_t old_set;
+  CPU_ZERO(&old_set);
+  sched_getaffinity(0, sizeof(cpu_set_t), &old_set);
+
+  for (int pinned = 0; pinned < 2; pinned++) {
+    if (pinned) {
+      cpu_set_t cpuset;
+      CPU_ZERO(&cpuset);
+      CPU_SET(core, &cpuset);
+      if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0)
+        perror("Failed to set affinity!");
+    }
+
+    system_wait();
+    for (size_t i = 0; i < SELF_SAMPLES; i++) {
+      uint64_t start = get_cycles();
+      uint64_t end = get_cycles();
+      deltas[i] = end - start;
+    }
+
+    self_dist_t dist = self_distribution(deltas, SELF_SAMPLES);
+    self_print_dist(pinned ? "pinned" : "unpinned", &dist, "ticks");
+  }
+
+  sched_setaffinity(0, sizeof(cpu_set_t), &old_set);
+  free(deltas);
+}
+
+/**
+ * @brief Removes the files written by the export routines.
+ */
+static void self_remove_dir(const char *dir) {
+  DIR *d = opendir(dir);
+  if (d != NULL) {
+    struct dirent *entry;
+    char path[512];
+    while ((entry = readdir(d)) != NULL) {
+      if (entry->d_name[0] == '.')
+        continue;
+      snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+      unlink(path);
+    }
+    closedir(d);
+  }
+  rmdir(dir);
+}
+
+/**
+ * @brief Fills the samples with the same pseudo-random sequence for a seed.
+ */
+static void self_fill(benchmark_result_t *results, size_t n, uint64_t seed) {
+  uint64_t rng = seed;
+  for (size_t i = 0; i < n; i++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    results->samples[i] = 1000 + rng % 256;
+    results->cache_miss_rates[i] = (double)(rng >> 40) / (double)(1 << 24);
+  }
+}
+
+/**
+ * @brief Measures the statistics and export routines at growing sample counts.
+ *
+ * calculate_stats() sorts the samples in place, so they are refilled before
+ * every export to keep the exports from running on sorted data.
+ */
+static void self_bench_processing(size_t max_samples) {
+  char dir[] = "/tmp/pibench-self-XXXXXX";
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    return;
+  }
+
+  char json[sizeof(dir) + 16], binary[sizeof(dir) + 16];
+  snprintf(json, sizeof(json), "%s/self.json", dir);
+  snprintf(binary, sizeof(binary), "%s/self.pibr", dir);
+
+  printf("\nStatistics and export (ms)\n");
+  printf("  %-10s %10s %10s %10s %10s\n", "samples", "stats", "csv", "json",
+         "binary");
+
+  const uint64_t seed = 0x9E3779B97F4A7C15ULL;
+  for (size_t n = 1000; n <= max_samples; n *= 10) {
+    benchmark_t *benchmark = self_benchmark("self", 0, n);
+    benchmark_result_t *results = benchmark->results;
+    self_fill(results, n, seed);
+
+    uint64_t start = get_time_ns();
+    calculate_stats(results, n);
+    double stats_ms = (double)(get_time_ns() - start) / 1e6;
+
+    self_fill(results, n, seed);
+    start = get_time_ns();
+    to_csv(&benchmark, 1, dir);
+    double csv_ms = (double)(get_time_ns() - start) / 1e6;
+
+    self_fill(results, n, seed);
+    start = get_time_ns();
+    to_json(&benchmark, 1, json);
+    double json_ms = (double)(get_time_ns() - start) / 1e6;
+
+    self_fill(results, n, seed);
+    start = get_time_ns();
+    to_binary(&benchmark, 1, binary, BENCH_BIN_DELTA);
+    double binary_ms = (double)(get_time_ns() - start) / 1e6;
+
+    printf("  %-10zu %10.2f %10.2f %10.2f %10.2f\n", n, stats_ms, csv_ms,
+           json_ms, binary_ms);
+
+    cleanup_benchmark(benchmark, false);
+  }
+
+  self_remove_dir(dir);
+}
+
+int main(int argc, char **argv) {
+  size_t max_samples = SELF_MAX_SAMPLES;
+  if (argc > 1)
+    max_samples = strtoull(argv[1], NULL, 10);
+
+  bench_env_t env;
+  bench_env_collect(&env);
+  int core = env.cpu_count > 1 ? env.cpu_count - 1 : 0;
+
+  printf("pi-bench self-benchmark\n");
+  printf("  revision: %s\n", env.git_sha);
+  printf("  compiler: %s\n", env.compiler);
+  printf("  cflags:   %s\n", env.cflags);
+  printf("  cpu:      %s (%d cores)\n", env.cpu_model, env.cpu_count);
+  printf("  kernel:   %s\n", env.kernel);
+
+  self_bench_harness(core);
+  self_bench_timers();
+  self_bench_counters();
+  self_bench_jitter(core);
+  self_bench_processing(max_samples);
+
+  bench_registry_cleanup();
+  return 0;
+}